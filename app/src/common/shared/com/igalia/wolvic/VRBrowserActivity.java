@@ -14,6 +14,7 @@ import android.content.Intent;
 import android.content.IntentFilter;
 import android.content.SharedPreferences;
 import android.content.res.Configuration;
+import android.graphics.Bitmap;
 import android.graphics.Canvas;
 import android.graphics.Color;
 import android.graphics.Paint;
@@ -95,12 +96,15 @@ import com.igalia.wolvic.utils.SystemUtils;
 import org.json.JSONObject;
 
 import java.io.File;
+import java.nio.ByteBuffer;
+import java.nio.ByteOrder;
 import java.util.ArrayList;
 import java.util.Arrays;
 import java.util.HashSet;
 import java.util.LinkedList;
 import java.util.Set;
 import java.util.concurrent.ConcurrentHashMap;
+import java.util.concurrent.atomic.AtomicBoolean;
 import java.util.function.Consumer;
 
 public class VRBrowserActivity extends PlatformActivity implements WidgetManagerDelegate,
@@ -160,6 +164,22 @@ public class VRBrowserActivity extends PlatformActivity implements WidgetManager
     static final int SwipeDelay = 1000; // milliseconds
     static final long RESET_CRASH_COUNT_DELAY = 5000;
 
+    // Native event records, see JNIEventChannel.h. Each record is an int type
+    // followed by seven int or float values.
+    static final int NATIVE_EVENT_SIZE = 32;
+    static final int NATIVE_EVENT_MOTION = 1;
+    static final int NATIVE_EVENT_SCROLL = 2;
+    static final int NATIVE_EVENT_AUDIO_POSE = 3;
+    static final int NATIVE_EVENT_GESTURE = 4;
+    static final int NATIVE_EVENT_RESIZE = 5;
+    static final int NATIVE_EVENT_MOVE_END = 6;
+    static final int NATIVE_EVENT_BATTERY_LEVELS = 7;
+    static final int NATIVE_EVENT_WIDGET_ON_SCREEN = 8;
+    static final int NATIVE_EVENT_FOCUSED = 1;
+    static final int NATIVE_EVENT_PRESSED = 1 << 1;
+    // Width of the images shown in place of the widgets whose surface was released.
+    static final int WIDGET_SNAPSHOT_WIDTH = 256;
+
     static final String LOGTAG = SystemUtils.createLogtag(VRBrowserActivity.class);
     ConcurrentHashMap<Integer, Widget> mWidgets;
     private int mWidgetHandleIndex = 1;
@@ -199,6 +219,13 @@ public class VRBrowserActivity extends PlatformActivity implements WidgetManager
     private float mCurrentCylinderDensity = 0;
     private boolean mHideWebXRIntersitial = false;
     private FragmentController mFragmentController;
+    // Only touched on the UI thread.
+    private ByteBuffer mNativeEvents;
+    private int mNativeEventsMask;
+    private int mNativeEventsRead;
+    private volatile int mNativeEventsEnd;
+    private final AtomicBoolean mNativeEventsDrainPending = new AtomicBoolean(false);
+    private final Runnable mDrainNativeEventsRunnable = this::drainNativeEvents;
 
     private boolean callOnAudioManager(Consumer<AudioManager> fn) {
         if (mAudioManager == null) {
@@ -307,6 +334,8 @@ public class VRBrowserActivity extends PlatformActivity implements WidgetManager
         });
         final String tempPath = getCacheDir().getAbsolutePath();
         queueRunnable(() -> setTemporaryFilePath(tempPath));
+        final long surfaceMemoryBudget = mSettings.getSurfaceMemoryBudget() * 1024L * 1024L;
+        queueRunnable(() -> setSurfaceMemoryBudgetNative(surfaceMemoryBudget));
 
         initializeWidgets();
 
@@ -1006,7 +1035,15 @@ public class VRBrowserActivity extends PlatformActivity implements WidgetManager
                 }
             };
 
-            widget.setSurface(aSurface, aWidth, aHeight, aFirstDrawCallback);
+            if (aSurface == null && aNativeCallback != 0) {
+                // The surface was released to save memory. Native code shows a snapshot of the
+                // widget until the surface is created again, and frees it once we are done with it.
+                sendWidgetSnapshot(widget);
+                widget.setSurface(null, aWidth, aHeight, null);
+                aFirstDrawCallback.run();
+            } else {
+                widget.setSurface(aSurface, aWidth, aHeight, aFirstDrawCallback);
+            }
 
             UIWidget view = (UIWidget) widget;
             // Add widget to a virtual display for invalidation
@@ -1020,77 +1057,163 @@ public class VRBrowserActivity extends PlatformActivity implements WidgetManager
         });
     }
 
-    @Keep
-    @SuppressWarnings("unused")
-    void handleMotionEvent(final int aHandle, final int aDevice, final boolean aFocused, final boolean aPressed, final float aX, final float aY) {
-        runOnUiThread(() -> {
-            Widget widget = mWidgets.get(aHandle);
-            if (!isWidgetInputEnabled(widget)) {
-                widget = null; // Fallback to mRootWidget in order to allow world clicks to dismiss UI.
+    private void sendWidgetSnapshot(final Widget aWidget) {
+        final int handle = aWidget.getHandle();
+        aWidget.captureSnapshot(WIDGET_SNAPSHOT_WIDTH).thenAccept(bitmap -> {
+            if (bitmap == null || bitmap.getWidth() <= 0 || bitmap.getHeight() <= 0) {
+                return;
             }
-
-            float scale = widget != null ? widget.getPlacement().textureScale : 1.0f;
-            final float x = aX / scale;
-            final float y = aY / scale;
-
-            if (widget == null) {
-                MotionEventGenerator.dispatch(mRootWidget, aDevice, aFocused, aPressed, x, y);
-
-            } else if (widget.getBorderWidth() > 0) {
-                final int border = widget.getBorderWidth();
-                MotionEventGenerator.dispatch(widget, aDevice, aFocused, aPressed, x - border, y - border);
-
-            } else {
-                MotionEventGenerator.dispatch(widget, aDevice, aFocused, aPressed, x, y);
+            Bitmap snapshot = bitmap;
+            if (snapshot.getWidth() > WIDGET_SNAPSHOT_WIDTH) {
+                int height = Math.max(1, snapshot.getHeight() * WIDGET_SNAPSHOT_WIDTH / snapshot.getWidth());
+                snapshot = Bitmap.createScaledBitmap(snapshot, WIDGET_SNAPSHOT_WIDTH, height, true);
             }
+            if (snapshot.getConfig() != Bitmap.Config.ARGB_8888) {
+                snapshot = snapshot.copy(Bitmap.Config.ARGB_8888, false);
+            }
+            final ByteBuffer pixels = ByteBuffer.allocate(snapshot.getByteCount());
+            snapshot.copyPixelsToBuffer(pixels);
+            final int width = snapshot.getWidth();
+            final int height = snapshot.getHeight();
+            queueRunnable(() -> setWidgetSnapshotNative(handle, pixels.array(), width, height));
         });
     }
 
     @Keep
     @SuppressWarnings("unused")
-    void handleScrollEvent(final int aHandle, final int aDevice, final float aX, final float aY) {
+    void setNativeEventBuffer(final ByteBuffer aBuffer, final int aCapacity) {
         runOnUiThread(() -> {
-            Widget widget = mWidgets.get(aHandle);
-            if (!isWidgetInputEnabled(widget)) {
-                return;
-            }
-            if (widget != null) {
-                float scrollDirection = mSettings.getScrollDirection() == 0 ? 1.0f : -1.0f;
-                MotionEventGenerator.dispatchScroll(widget, aDevice, true,aX * scrollDirection, aY * scrollDirection);
-            } else {
-                Log.e(LOGTAG, "Failed to find widget for scroll event: " + aHandle);
-            }
+            mNativeEvents = aBuffer.order(ByteOrder.nativeOrder());
+            mNativeEventsMask = aCapacity - 1;
+            mNativeEventsRead = 0;
         });
     }
 
+    // Called by the render thread once per frame with the end of the queued native events.
     @Keep
     @SuppressWarnings("unused")
-    void handleGesture(final int aType) {
-        runOnUiThread(() -> {
-            boolean consumed = false;
-            if ((aType == GestureSwipeLeft) && (mLastGesture == GestureSwipeLeft)) {
-                Log.d(LOGTAG, "Go back!");
-                SessionStore.get().getActiveSession().goBack();
-
-                consumed = true;
-            } else if ((aType == GestureSwipeRight) && (mLastGesture == GestureSwipeRight)) {
-                Log.d(LOGTAG, "Go forward!");
-                SessionStore.get().getActiveSession().goForward();
-                consumed = true;
-            }
-            if (mLastRunnable != null) {
-                mLastRunnable.mCanceled = true;
-                mLastRunnable = null;
-            }
-            if (consumed) {
-                mLastGesture = NoGesture;
+    void drainNativeEvents(final int aEnd) {
+        mNativeEventsEnd = aEnd;
+        if (mNativeEventsDrainPending.compareAndSet(false, true)) {
+            runOnUiThread(mDrainNativeEventsRunnable);
+        }
+    }
 
-            } else {
-                mLastGesture = aType;
-                mLastRunnable = new SwipeRunnable();
-                mHandler.postDelayed(mLastRunnable, SwipeDelay);
+    private void drainNativeEvents() {
+        mNativeEventsDrainPending.set(false);
+        final ByteBuffer events = mNativeEvents;
+        if (events == null) {
+            return;
+        }
+        final int end = mNativeEventsEnd;
+        while (mNativeEventsRead != end) {
+            final int offset = (mNativeEventsRead & mNativeEventsMask) * NATIVE_EVENT_SIZE;
+            handleNativeEvent(events, offset);
+            mNativeEventsRead++;
+        }
+        releaseNativeEventsNative(end);
+    }
+
+    private void handleNativeEvent(final ByteBuffer aEvents, final int aOffset) {
+        final int type = aEvents.getInt(aOffset);
+        final int values = aOffset + 4;
+        switch (type) {
+            case NATIVE_EVENT_MOTION: {
+                final int flags = aEvents.getInt(values + 8);
+                handleMotionEvent(aEvents.getInt(values), aEvents.getInt(values + 4),
+                        (flags & NATIVE_EVENT_FOCUSED) != 0, (flags & NATIVE_EVENT_PRESSED) != 0,
+                        aEvents.getFloat(values + 12), aEvents.getFloat(values + 16));
+                break;
             }
-        });
+            case NATIVE_EVENT_SCROLL:
+                handleScrollEvent(aEvents.getInt(values), aEvents.getInt(values + 4),
+                        aEvents.getFloat(values + 8), aEvents.getFloat(values + 12));
+                break;
+            case NATIVE_EVENT_AUDIO_POSE:
+                handleAudioPose(aEvents.getFloat(values), aEvents.getFloat(values + 4),
+                        aEvents.getFloat(values + 8), aEvents.getFloat(values + 12),
+                        aEvents.getFloat(values + 16), aEvents.getFloat(values + 20), aEvents.getFloat(values + 24));
+                break;
+            case NATIVE_EVENT_GESTURE:
+                handleGesture(aEvents.getInt(values));
+                break;
+            case NATIVE_EVENT_RESIZE:
+                handleResize(aEvents.getInt(values), aEvents.getFloat(values + 4), aEvents.getFloat(values + 8));
+                break;
+            case NATIVE_EVENT_MOVE_END:
+                handleMoveEnd(aEvents.getInt(values), aEvents.getFloat(values + 4), aEvents.getFloat(values + 8),
+                        aEvents.getFloat(values + 12), aEvents.getFloat(values + 16));
+                break;
+            case NATIVE_EVENT_BATTERY_LEVELS:
+                updateBatterLevels(aEvents.getInt(values), aEvents.getInt(values + 4));
+                break;
+            case NATIVE_EVENT_WIDGET_ON_SCREEN:
+                handleWidgetOnScreen(aEvents.getInt(values), aEvents.getInt(values + 4) != 0);
+                break;
+            default:
+                Log.e(LOGTAG, "Unknown native event: " + type);
+        }
+    }
+
+    private void handleMotionEvent(final int aHandle, final int aDevice, final boolean aFocused, final boolean aPressed, final float aX, final float aY) {
+        Widget widget = mWidgets.get(aHandle);
+        if (!isWidgetInputEnabled(widget)) {
+            widget = null; // Fallback to mRootWidget in order to allow world clicks to dismiss UI.
+        }
+
+        float scale = widget != null ? widget.getPlacement().textureScale : 1.0f;
+        final float x = aX / scale;
+        final float y = aY / scale;
+
+        if (widget == null) {
+            MotionEventGenerator.dispatch(mRootWidget, aDevice, aFocused, aPressed, x, y);
+
+        } else if (widget.getBorderWidth() > 0) {
+            final int border = widget.getBorderWidth();
+            MotionEventGenerator.dispatch(widget, aDevice, aFocused, aPressed, x - border, y - border);
+
+        } else {
+            MotionEventGenerator.dispatch(widget, aDevice, aFocused, aPressed, x, y);
+        }
+    }
+
+    private void handleScrollEvent(final int aHandle, final int aDevice, final float aX, final float aY) {
+        Widget widget = mWidgets.get(aHandle);
+        if (!isWidgetInputEnabled(widget)) {
+            return;
+        }
+        if (widget != null) {
+            float scrollDirection = mSettings.getScrollDirection() == 0 ? 1.0f : -1.0f;
+            MotionEventGenerator.dispatchScroll(widget, aDevice, true,aX * scrollDirection, aY * scrollDirection);
+        } else {
+            Log.e(LOGTAG, "Failed to find widget for scroll event: " + aHandle);
+        }
+    }
+
+    private void handleGesture(final int aType) {
+        boolean consumed = false;
+        if ((aType == GestureSwipeLeft) && (mLastGesture == GestureSwipeLeft)) {
+            Log.d(LOGTAG, "Go back!");
+            SessionStore.get().getActiveSession().goBack();
+
+            consumed = true;
+        } else if ((aType == GestureSwipeRight) && (mLastGesture == GestureSwipeRight)) {
+            Log.d(LOGTAG, "Go forward!");
+            SessionStore.get().getActiveSession().goForward();
+            consumed = true;
+        }
+        if (mLastRunnable != null) {
+            mLastRunnable.mCanceled = true;
+            mLastRunnable = null;
+        }
+        if (consumed) {
+            mLastGesture = NoGesture;
+
+        } else {
+            mLastGesture = aType;
+            mLastRunnable = new SwipeRunnable();
+            mHandler.postDelayed(mLastRunnable, SwipeDelay);
+        }
     }
 
     @SuppressWarnings({"UnusedDeclaration"})
@@ -1107,31 +1230,30 @@ public class VRBrowserActivity extends PlatformActivity implements WidgetManager
         });
     }
 
-    @Keep
-    @SuppressWarnings({"UnusedDeclaration"})
-    void handleAudioPose(float qx, float qy, float qz, float qw, float px, float py, float pz) {
+    private void handleAudioPose(float qx, float qy, float qz, float qw, float px, float py, float pz) {
         mAudioEngine.setPose(qx, qy, qz, qw, px, py, pz);
 
         // https://developers.google.com/vr/reference/android/com/google/vr/sdk/audio/GvrAudioEngine.html#resume()
         // The initialize method must be called from the main thread at a regular rate.
-        runOnUiThread(mAudioUpdateRunnable);
+        mAudioUpdateRunnable.run();
     }
 
-    @Keep
-    @SuppressWarnings("unused")
-    void handleResize(final int aHandle, final float aWorldWidth, final float aWorldHeight) {
-        runOnUiThread(() -> mWindows.getFocusedWindow().handleResizeEvent(aWorldWidth, aWorldHeight));
+    private void handleResize(final int aHandle, final float aWorldWidth, final float aWorldHeight) {
+        mWindows.getFocusedWindow().handleResizeEvent(aWorldWidth, aWorldHeight);
     }
 
-    @Keep
-    @SuppressWarnings("unused")
-    void handleMoveEnd(final int aHandle, final float aDeltaX, final float aDeltaY, final float aDeltaZ, final float aRotation) {
-        runOnUiThread(() -> {
-            Widget widget = mWidgets.get(aHandle);
-            if (widget != null) {
-                widget.handleMoveEvent(aDeltaX, aDeltaY, aDeltaZ, aRotation);
-            }
-        });
+    private void handleMoveEnd(final int aHandle, final float aDeltaX, final float aDeltaY, final float aDeltaZ, final float aRotation) {
+        Widget widget = mWidgets.get(aHandle);
+        if (widget != null) {
+            widget.handleMoveEvent(aDeltaX, aDeltaY, aDeltaZ, aRotation);
+        }
+    }
+
+    private void handleWidgetOnScreen(final int aHandle, final boolean aOnScreen) {
+        Widget widget = mWidgets.get(aHandle);
+        if (widget != null) {
+            widget.setOnScreen(aOnScreen);
+        }
     }
 
     @Keep
@@ -1276,6 +1398,12 @@ public class VRBrowserActivity extends PlatformActivity implements WidgetManager
         return path.getAbsolutePath();
     }
 
+    @Keep
+    @SuppressWarnings("unused")
+    String getCacheAbsolutePath() {
+        return getCacheDir().getAbsolutePath();
+    }
+
     @Keep
     @SuppressWarnings("unused")
     public boolean isOverrideEnvPathEnabled() {
@@ -1385,12 +1513,6 @@ public class VRBrowserActivity extends PlatformActivity implements WidgetManager
         runOnUiThread(() -> EngineProvider.INSTANCE.getOrCreateRuntime(VRBrowserActivity.this).appendAppNotesToCrashReport(aNotes));
     }
 
-    @Keep
-    @SuppressWarnings("unused")
-    private void updateControllerBatteryLevels(final int leftLevel, final int rightLevel) {
-        runOnUiThread(() -> updateBatterLevels(leftLevel, rightLevel));
-    }
-
     private void updateBatterLevels(final int leftLevel, final int rightLevel) {
         BatteryManager bm = (BatteryManager)getSystemService(BATTERY_SERVICE);
         int battery = bm == null ? 100 : bm.getIntProperty(BatteryManager.BATTERY_PROPERTY_CAPACITY);
@@ -1472,8 +1594,11 @@ public class VRBrowserActivity extends PlatformActivity implements WidgetManager
         mWidgets.put(aWidget.getHandle(), aWidget);
         ((View)aWidget).setVisibility(aWidget.getPlacement().visible ? View.VISIBLE : View.GONE);
         final int handle = aWidget.getHandle();
-        final WidgetPlacement clone = aWidget.getPlacement().clone();
-        queueRunnable(() -> addWidgetNative(handle, clone));
+        final int[] placement = aWidget.getPlacement().pack();
+        // A new widget always takes the name, even if it was packed before.
+        placement[1] |= WidgetPlacement.PACKED_HAS_NAME;
+        final String name = aWidget.getPlacement().name;
+        queueRunnable(() -> addWidgetNative(handle, placement, name));
         updateActiveDialog(aWidget);
     }
 
@@ -1483,8 +1608,9 @@ public class VRBrowserActivity extends PlatformActivity implements WidgetManager
             return;
         }
         final int handle = aWidget.getHandle();
-        final WidgetPlacement clone = aWidget.getPlacement().clone();
-        queueRunnable(() -> updateWidgetNative(handle, clone));
+        final int[] placement = aWidget.getPlacement().pack();
+        final String name = aWidget.getPlacement().packedName();
+        queueRunnable(() -> updateWidgetNative(handle, placement, name));
 
         final int textureWidth = aWidget.getPlacement().textureWidth();
         final int textureHeight = aWidget.getPlacement().textureHeight();
@@ -1853,11 +1979,13 @@ public class VRBrowserActivity extends PlatformActivity implements WidgetManager
         return (AppServicesProvider)getApplication();
     }
 
-    private native void addWidgetNative(int aHandle, WidgetPlacement aPlacement);
-    private native void updateWidgetNative(int aHandle, WidgetPlacement aPlacement);
+    private native void addWidgetNative(int aHandle, int[] aPlacement, String aName);
+    private native void updateWidgetNative(int aHandle, int[] aPlacement, String aName);
     private native void updateVisibleWidgetsNative();
     private native void removeWidgetNative(int aHandle);
     private native void recreateWidgetSurfaceNative(int aHandle);
+    private native void setSurfaceMemoryBudgetNative(long aBytes);
+    private native void setWidgetSnapshotNative(int aHandle, byte[] aPixels, int aWidth, int aHeight);
     private native void startWidgetResizeNative(int aHandle, float maxWidth, float maxHeight, float minWidth, float minHeight);
     private native void finishWidgetResizeNative(int aHandle);
     private native void startWidgetMoveNative(int aHandle, int aMoveBehaviour);
@@ -1873,6 +2001,7 @@ public class VRBrowserActivity extends PlatformActivity implements WidgetManager
     private native void recenterUIYawNative(@YawTarget int aTarget);
     private native void setControllersVisibleNative(boolean aVisible);
     private native void runCallbackNative(long aCallback);
+    private native void releaseNativeEventsNative(int aIndex);
     private native void setCylinderDensityNative(float aDensity);
     private native void setCPULevelNative(@CPULevelFlags int aCPULevel);
     private native void setWebXRIntersitialStateNative(@WebXRInterstitialState int aState);
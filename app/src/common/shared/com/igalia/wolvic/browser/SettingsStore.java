@@ -96,6 +96,8 @@ public class SettingsStore {
     public final static int MSAA_DEFAULT_LEVEL = 1;
     public final static boolean AUDIO_ENABLED = false;
     public final static float CYLINDER_DENSITY_ENABLED_DEFAULT = 4680.0f;
+    // In megabytes, 0 keeps the surfaces of every widget.
+    public final static int SURFACE_MEMORY_BUDGET_DEFAULT = 256;
     private final static long CRASH_RESTART_DELTA = 2000;
     public final static boolean AUTOPLAY_ENABLED = false;
     public final static boolean DEBUG_LOGGING_DEFAULT = BuildConfig.DEBUG;
@@ -555,6 +557,11 @@ public class SettingsStore {
         return getCylinderDensity() > 0;
     }
 
+    public int getSurfaceMemoryBudget() {
+        return mPrefs.getInt(
+                mContext.getString(R.string.settings_key_surface_memory_budget), SURFACE_MEMORY_BUDGET_DEFAULT);
+    }
+
     public void setSelectedKeyboard(Locale aLocale) {
         SharedPreferences.Editor editor = mPrefs.edit();
         editor.putString(mContext.getString(R.string.settings_key_keyboard_locale), aLocale.toLanguageTag());
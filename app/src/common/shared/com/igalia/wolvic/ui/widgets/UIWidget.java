@@ -7,6 +7,7 @@ package com.igalia.wolvic.ui.widgets;
 
 import android.content.Context;
 import android.content.res.Configuration;
+import android.graphics.Bitmap;
 import android.graphics.Canvas;
 import android.graphics.Rect;
 import android.graphics.SurfaceTexture;
@@ -27,6 +28,7 @@ import com.igalia.wolvic.utils.SystemUtils;
 
 import java.lang.reflect.Constructor;
 import java.util.HashMap;
+import java.util.concurrent.CompletableFuture;
 
 public abstract class UIWidget extends FrameLayout implements Widget {
 
@@ -261,6 +263,20 @@ public abstract class UIWidget extends FrameLayout implements Widget {
         }
     }
 
+    @Override
+    public CompletableFuture<Bitmap> captureSnapshot(int aMaxWidth) {
+        if (getWidth() <= 0 || getHeight() <= 0) {
+            return CompletableFuture.completedFuture(null);
+        }
+        float scale = Math.min(1.0f, aMaxWidth / (float)getWidth());
+        Bitmap bitmap = Bitmap.createBitmap(Math.max(1, Math.round(getWidth() * scale)),
+                Math.max(1, Math.round(getHeight() * scale)), Bitmap.Config.ARGB_8888);
+        Canvas canvas = new Canvas(bitmap);
+        canvas.scale(scale, scale);
+        super.draw(canvas);
+        return CompletableFuture.completedFuture(bitmap);
+    }
+
     private void draw(Canvas aCanvas, UISurfaceTextureRenderer aRenderer) {
         if (mResizing) {
             return;
@@ -6,12 +6,15 @@
 package com.igalia.wolvic.ui.widgets;
 
 import android.content.res.Configuration;
+import android.graphics.Bitmap;
 import android.graphics.SurfaceTexture;
 import android.view.MotionEvent;
 import android.view.Surface;
 
 import androidx.annotation.NonNull;
 
+import java.util.concurrent.CompletableFuture;
+
 public interface Widget {
 
     int NO_WINDOW_ID = -1;
@@ -35,6 +38,12 @@ public interface Widget {
     boolean isDialog();
     void setVisible(boolean aVisible);
     void resizeByMultiplier(float aspect, float multiplier);
+    // Called when the widget has been out of view for a while, and again when it is back in view.
+    default void setOnScreen(boolean aOnScreen) {}
+    // Image of the widget at most aMaxWidth pixels wide, shown while its surface is released.
+    default CompletableFuture<Bitmap> captureSnapshot(int aMaxWidth) {
+        return CompletableFuture.completedFuture(null);
+    }
     default void detachFromWindow() {}
     default void attachToWindow(@NonNull WindowWidget window) {}
     int getBorderWidth();
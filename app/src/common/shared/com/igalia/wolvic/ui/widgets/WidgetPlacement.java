@@ -18,6 +18,8 @@ import com.igalia.wolvic.R;
 import com.igalia.wolvic.browser.SettingsStore;
 import com.igalia.wolvic.utils.DeviceType;
 
+import java.util.Objects;
+
 public class WidgetPlacement {
     static final float WORLD_DPI_RATIO = 2.0f/720.0f;
 
@@ -27,6 +29,14 @@ public class WidgetPlacement {
     public static final int SCENE_ROOT_OPAQUE = 1;
     public static final int SCENE_WEBXR_INTERSTITIAL = 2;
 
+    // Number of ints written by pack(), see WidgetPlacement::FromPacked.
+    public static final int PACKED_SIZE = 33;
+    // Bits of the packed header flags.
+    public static final int PACKED_HAS_NAME = 1;
+    // Shared by every placement so that a widget never gets the stamp of a
+    // previous placement object. 0 is reserved for native placements.
+    private static int sPackedVersion = 0;
+
     private WidgetPlacement() {}
     public WidgetPlacement(Context aContext) {
         density = aContext.getResources().getDisplayMetrics().density;
@@ -75,6 +85,22 @@ public class WidgetPlacement {
      * See Widget::UpdateCylinderMatrix for more info.
      */
     public float cylinderMapRadius;
+    /*
+     * The native side may lower the resolution of the layer surface while the widget is small
+     * in view; the new size is sent through setSurface(). Widgets whose content layout depends
+     * on the surface size must disable it.
+     */
+    public boolean textureLOD = true;
+    /*
+     * The widget content covers all of it, so the native side may skip drawing the widgets
+     * entirely behind it.
+     */
+    public boolean opaque;
+
+    // State of the last pack() call, not copied by clone() or copyFrom().
+    private int[] mLastPacked;
+    private String mLastPackedName;
+    private boolean mPackedNameChanged = true;
 
     public WidgetPlacement clone() {
         WidgetPlacement w = new WidgetPlacement();
@@ -113,6 +139,77 @@ public class WidgetPlacement {
         this.name = w.name;
         this.clearColor = w.clearColor;
         this.cylinderMapRadius = w.cylinderMapRadius;
+        this.textureLOD = w.textureLOD;
+        this.opaque = w.opaque;
+    }
+
+    /**
+     * Packs the placement in the fixed layout decoded by WidgetPlacement::FromPacked. The version
+     * stamp in the first slot only changes when the packed content or the name changed since the
+     * previous call, so the native side can skip placements it already applied. The flags in the
+     * second slot tell whether packedName() is sent, so that a name can also be cleared. Must be
+     * called on the UI thread; the returned array is owned by the caller.
+     */
+    public int[] pack() {
+        int[] result = new int[PACKED_SIZE];
+        result[2] = width;
+        result[3] = height;
+        result[4] = Float.floatToRawIntBits(anchorX);
+        result[5] = Float.floatToRawIntBits(anchorY);
+        result[6] = Float.floatToRawIntBits(translationX);
+        result[7] = Float.floatToRawIntBits(translationY);
+        result[8] = Float.floatToRawIntBits(translationZ);
+        result[9] = Float.floatToRawIntBits(rotationAxisX);
+        result[10] = Float.floatToRawIntBits(rotationAxisY);
+        result[11] = Float.floatToRawIntBits(rotationAxisZ);
+        result[12] = Float.floatToRawIntBits(rotation);
+        result[13] = parentHandle;
+        result[14] = Float.floatToRawIntBits(parentAnchorX);
+        result[15] = Float.floatToRawIntBits(parentAnchorY);
+        result[16] = Float.floatToRawIntBits(density);
+        result[17] = Float.floatToRawIntBits(worldWidth);
+        result[18] = visible ? 1 : 0;
+        result[19] = scene;
+        result[20] = showPointer ? 1 : 0;
+        result[21] = composited ? 1 : 0;
+        result[22] = layer ? 1 : 0;
+        result[23] = layerPriority;
+        result[24] = proxifyLayer ? 1 : 0;
+        result[25] = Float.floatToRawIntBits(textureScale);
+        result[26] = cylinder ? 1 : 0;
+        result[27] = Float.floatToRawIntBits(cylinderMapRadius);
+        result[28] = tintColor;
+        result[29] = borderColor;
+        result[30] = clearColor;
+        result[31] = textureLOD ? 1 : 0;
+        result[32] = opaque ? 1 : 0;
+
+        mPackedNameChanged = mLastPacked == null || !Objects.equals(name, mLastPackedName);
+        result[1] = mPackedNameChanged ? PACKED_HAS_NAME : 0;
+        boolean changed = mPackedNameChanged;
+        for (int i = 2; i < PACKED_SIZE && !changed; i++) {
+            changed = result[i] != mLastPacked[i];
+        }
+        if (!changed) {
+            result[0] = mLastPacked[0];
+        } else {
+            sPackedVersion++;
+            if (sPackedVersion == 0) {
+                sPackedVersion++;
+            }
+            result[0] = sPackedVersion;
+        }
+        mLastPacked = result;
+        mLastPackedName = name;
+        return result;
+    }
+
+    /**
+     * The name to send along the last packed placement, which may be null. Only read by the native
+     * side when it changed, see pack().
+     */
+    public String packedName() {
+        return mPackedNameChanged ? name : null;
     }
 
     public int textureWidth() {
@@ -11,6 +11,7 @@ import android.content.Intent;
 import android.content.SharedPreferences;
 import android.content.pm.PackageManager;
 import android.content.res.Configuration;
+import android.graphics.Bitmap;
 import android.graphics.Canvas;
 import android.graphics.Matrix;
 import android.graphics.Rect;
@@ -65,6 +66,7 @@ import com.igalia.wolvic.ui.widgets.dialogs.PromptDialogWidget;
 import com.igalia.wolvic.ui.widgets.dialogs.SelectionActionWidget;
 import com.igalia.wolvic.ui.widgets.menus.ContextMenuWidget;
 import com.igalia.wolvic.ui.widgets.prompts.PromptData;
+import com.igalia.wolvic.utils.BitmapCache;
 import com.igalia.wolvic.utils.InternalPages;
 import com.igalia.wolvic.utils.StringUtils;
 import com.igalia.wolvic.utils.UrlUtils;
@@ -78,6 +80,7 @@ import java.net.URLConnection;
 import java.util.Arrays;
 import java.util.Collections;
 import java.util.List;
+import java.util.concurrent.CompletableFuture;
 import java.util.concurrent.CopyOnWriteArrayList;
 import java.util.concurrent.Executor;
 import java.util.stream.Collectors;
@@ -122,6 +125,7 @@ public class WindowWidget extends UIWidget implements SessionChangeListener,
     private int mBorderWidth;
     private Runnable mFirstDrawCallback;
     private boolean mIsInVRVideoMode;
+    private boolean mIsOffScreen;
     private View mView;
     private Session mSession;
     private int mWindowId;
@@ -265,6 +269,9 @@ public class WindowWidget extends UIWidget implements SessionChangeListener,
         aPlacement.visible = true;
         aPlacement.cylinder = true;
         aPlacement.textureScale = 1.0f;
+        // The surface size is the size of the web content viewport.
+        aPlacement.textureLOD = false;
+        aPlacement.opaque = true;
         aPlacement.name = "Window";
         // Check Windows.placeWindow method for remaining placement set-up
     }
@@ -358,7 +365,8 @@ public class WindowWidget extends UIWidget implements SessionChangeListener,
     @Override
     public void onResume() {
         super.onResume();
-        if (isVisible() || mIsInVRVideoMode) {
+        // Off-screen windows stay inactive until setOnScreen() brings them back.
+        if ((isVisible() && !mIsOffScreen) || mIsInVRVideoMode) {
             mSession.setActive(true);
             if (!SettingsStore.getInstance(getContext()).getLayersEnabled() && !mSession.hasDisplay()) {
                 // Ensure the Display is correctly recreated.
@@ -1166,6 +1174,26 @@ public class WindowWidget extends UIWidget implements SessionChangeListener,
         mViewModel.setIsWindowVisible(aVisible);
     }
 
+    @Override
+    public void setOnScreen(boolean aOnScreen) {
+        if (mIsOffScreen == !aOnScreen) {
+            return;
+        }
+        mIsOffScreen = !aOnScreen;
+        if (!isVisible() || mIsInVRVideoMode) {
+            return;
+        }
+        // An inactive session stops painting. Playing media is left alone.
+        if (mIsOffScreen) {
+            Media media = mSession.getActiveVideo();
+            if (media == null || !media.isPlaying()) {
+                mSession.setActive(false);
+            }
+        } else if (!mSession.isActive()) {
+            mSession.setActive(true);
+        }
+    }
+
     @Override
     public void draw(Canvas aCanvas) {
         if (mView != null) {
@@ -1173,6 +1201,18 @@ public class WindowWidget extends UIWidget implements SessionChangeListener,
         }
     }
 
+    @Override
+    public CompletableFuture<Bitmap> captureSnapshot(int aMaxWidth) {
+        if (mView != null) {
+            return super.captureSnapshot(aMaxWidth);
+        }
+        if (mSession == null) {
+            return CompletableFuture.completedFuture(null);
+        }
+        // The web content is not drawn by the view, use the thumbnail of the session.
+        return BitmapCache.getInstance(getContext()).getBitmap(mSession.getId()).exceptionally(throwable -> null);
+    }
+
     public void setSession(@NonNull Session aSession, @SetSessionActiveState int previousSessionState) {
         setSession(aSession, SESSION_RELEASE_DISPLAY, previousSessionState);
     }
@@ -0,0 +1,126 @@
+/* -*- Mode: C++; tab-width: 20; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+// Measures ExternalVR::PushFramePoses on the render thread while a simulated
+// Gecko thread reads the system state from the shared memory, the same way
+// VRServiceHost does. On this layout the reader copies the state with the
+// generation counters; the reported wait is the time spent until it got a
+// consistent copy.
+//
+//   external-vr-benchmark [--frames N] [--controllers N]
+
+#include "Controller.h"
+#include "ExternalVR.h"
+#include "ExternalVRShmem.h"
+#include "ExternalVRTransport.h"
+#include "HeadlessUtils.h"
+#include "vrb/Logger.h"
+#include "vrb/Matrix.h"
+#include "vrb/Vector.h"
+
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+using namespace crow;
+
+namespace {
+
+typedef std::chrono::steady_clock Clock;
+
+struct Options {
+  int32_t frames = 5000;
+  int32_t controllers = 2;
+};
+
+Options
+ParseOptions(int argc, char** argv) {
+  Options result;
+  HeadlessOptionParser()
+      .Int("--frames", result.frames, 1)
+      .Int("--controllers", result.controllers, 0, mozilla::gfx::kVRControllerMaxCount)
+      .Parse(argc, argv);
+  return result;
+}
+
+double
+Microseconds(const Clock::time_point& aStart, const Clock::time_point& aEnd) {
+  return std::chrono::duration<double, std::micro>(aEnd - aStart).count();
+}
+
+} // namespace
+
+int
+main(int argc, char** argv) {
+  const Options options = ParseOptions(argc, argv);
+
+  ExternalVRPtr externalVR = ExternalVR::Create();
+  externalVR->SetEyeOffset(device::Eye::Left, -0.032f, 0.0f, 0.0f);
+  externalVR->SetEyeOffset(device::Eye::Right, 0.032f, 0.0f, 0.0f);
+  externalVR->SetCapabilityFlags(device::Position | device::Orientation | device::Present);
+  ExternalVRShmem* shmem = externalVR->GetSharedData();
+
+  std::vector<Controller> controllers((size_t)options.controllers);
+  for (int32_t i = 0; i < options.controllers; ++i) {
+    Controller& controller = controllers[i];
+    controller.index = i;
+    controller.enabled = true;
+    controller.leftHanded = (i % 2) == 0;
+    controller.immersiveName = "Oculus Touch (Right)";
+    controller.numButtons = kControllerMaxButtonCount;
+    controller.numAxes = kControllerMaxAxes;
+    controller.type = device::OculusQuest2;
+    controller.deviceCapabilities = device::Position | device::Orientation | device::GripSpacePosition;
+  }
+
+  std::atomic<bool> running(true);
+  std::vector<double> waits;
+  waits.reserve((size_t)options.frames * 4);
+  std::thread reader([&] {
+    mozilla::gfx::VRSystemState state;
+    while (running) {
+      const Clock::time_point start = Clock::now();
+      while (true) {
+        const int64_t generation = ExternalVRTransport::BeginRead(&shmem->generationB);
+        memcpy(&state, &shmem->state, sizeof(state));
+        if (ExternalVRTransport::EndRead(&shmem->generationA, generation)) {
+          break;
+        }
+      }
+      waits.push_back(Microseconds(start, Clock::now()));
+      std::this_thread::yield();
+    }
+  });
+
+  std::vector<double> pushes;
+  pushes.reserve((size_t)options.frames);
+  for (int32_t frame = 0; frame < options.frames; ++frame) {
+    const float angle = (float)frame * 0.01f;
+    const vrb::Matrix head = vrb::Matrix::Translation(vrb::Vector(0.0f, 1.6f, 0.0f))
+        .PostMultiply(vrb::Matrix::Rotation(vrb::Vector(0.0f, 1.0f, 0.0f), angle));
+    for (Controller& controller: controllers) {
+      controller.transformMatrix = vrb::Matrix::Translation(vrb::Vector(controller.leftHanded ? -0.2f : 0.2f, 1.2f, -0.3f))
+          .PostMultiply(vrb::Matrix::Rotation(vrb::Vector(1.0f, 0.0f, 0.0f), angle));
+      controller.immersivePressedState = (uint64_t)((frame / 30) % 2);
+      controller.immersiveTriggerValues[0] = (float)(frame % 100) / 100.0f;
+      controller.immersiveAxes[0] = sinf(angle);
+    }
+    const Clock::time_point start = Clock::now();
+    externalVR->PushFramePoses(head, controllers, frame / 72.0);
+    pushes.push_back(Microseconds(start, Clock::now()));
+    std::this_thread::sleep_for(std::chrono::microseconds(500));
+  }
+  running = false;
+  reader.join();
+
+  printf("frames=%d controllers=%d push p50=%.2fus p99=%.2fus reader-wait p50=%.2fus p99=%.2fus max=%.2fus\n",
+         options.frames, options.controllers, Percentile(pushes, 0.50), Percentile(pushes, 0.99),
+         Percentile(waits, 0.50), Percentile(waits, 0.99), waits.empty() ? 0.0 : waits.back());
+  return 0;
+}
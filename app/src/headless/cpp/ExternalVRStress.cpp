@@ -0,0 +1,253 @@
+/* -*- Mode: C++; tab-width: 20; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+// Stress test for the ExternalVRTransport synchronization modes. A producer
+// thread plays the browser: it publishes a frame state every frame interval
+// and optionally stalls while holding the mutex, like a busy Gecko thread. A
+// consumer thread plays the render thread and waits for every new frame.
+//
+//   external-vr-stress [--frames N] [--interval-us N] [--stall-us N] [--stall-every N]
+//
+// For both the mutex/condition mode and the seqlock/futex mode it prints the
+// consumer wait latency histogram (time from publication to the consumer
+// holding a consistent copy) and the number of torn reads, which must be zero.
+
+#include "ExternalVRTransport.h"
+#include "HeadlessUtils.h"
+#include "vrb/Logger.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <pthread.h>
+#include <thread>
+#include <vector>
+
+using namespace crow;
+
+namespace {
+
+const double kWaitTimeout = 0.1;
+// Large enough that a copy takes a while, like VRBrowserState.
+const int kPayloadWords = 1024;
+
+struct Options {
+  int32_t frames = 2000;
+  int32_t intervalUs = 1000;
+  int32_t stallUs = 2000;
+  int32_t stallEvery = 10;
+};
+
+Options
+ParseOptions(int argc, char** argv) {
+  Options result;
+  HeadlessOptionParser()
+      .Int("--frames", result.frames, 1)
+      .Int("--interval-us", result.intervalUs, 0)
+      .Int("--stall-us", result.stallUs, 0)
+      .Int("--stall-every", result.stallEvery, 0)
+      .Parse(argc, argv);
+  return result;
+}
+
+// Mirrors the parts of VRExternalShmem used by each mode.
+struct Shared {
+  pthread_mutex_t mutex;
+  pthread_cond_t cond;
+  volatile int64_t generationA;
+  volatile int64_t generationB;
+  int64_t frameId;
+  int64_t publishTime;
+  int64_t payload[kPayloadWords];
+};
+
+struct Snapshot {
+  int64_t frameId;
+  int64_t publishTime;
+  int64_t payload[kPayloadWords];
+};
+
+void
+WriteFrame(Shared& aShared, const int64_t aFrameId) {
+  aShared.frameId = aFrameId;
+  for (int i = 0; i < kPayloadWords; ++i) {
+    aShared.payload[i] = aFrameId;
+  }
+  aShared.publishTime = ExternalVRTransport::NowNanoseconds();
+}
+
+bool
+IsTorn(const Snapshot& aSnapshot) {
+  for (int i = 0; i < kPayloadWords; ++i) {
+    if (aSnapshot.payload[i] != aSnapshot.frameId) {
+      return true;
+    }
+  }
+  return false;
+}
+
+void
+Stall(const Options& aOptions, const int64_t aFrameId) {
+  if (aOptions.stallEvery > 0 && aOptions.stallUs > 0 && (aFrameId % aOptions.stallEvery) == 0) {
+    std::this_thread::sleep_for(std::chrono::microseconds(aOptions.stallUs));
+  }
+}
+
+// Power of two microsecond buckets: [0,1) [1,2) [2,4) ... and an overflow bucket.
+class Histogram {
+public:
+  static const int kBuckets = 18;
+
+  void Add(const int64_t aNanoseconds) {
+    const int64_t us = aNanoseconds / 1000;
+    int bucket = 0;
+    while (bucket < kBuckets - 1 && us >= (1LL << bucket)) {
+      bucket++;
+    }
+    mCounts[bucket]++;
+    mValues.push_back(aNanoseconds);
+  }
+
+  void Print(const char* aName, const int32_t aTorn, const int32_t aMissed) {
+    std::sort(mValues.begin(), mValues.end());
+    printf("%s: samples=%zu p50=%.1fus p99=%.1fus max=%.1fus torn=%d timeouts=%d\n", aName, mValues.size(),
+           Percentile(0.50), Percentile(0.99), mValues.empty() ? 0.0 : mValues.back() / 1000.0, aTorn, aMissed);
+    for (int i = 0; i < kBuckets; ++i) {
+      if (mCounts[i] == 0) {
+        continue;
+      }
+      const long low = i == 0 ? 0 : (1L << (i - 1));
+      if (i == kBuckets - 1) {
+        printf("  >=%7ldus %7d\n", low, mCounts[i]);
+      } else {
+        printf("  <%8ldus %7d\n", 1L << i, mCounts[i]);
+      }
+    }
+  }
+
+private:
+  double Percentile(const double aPercentile) {
+    return crow::Percentile(mValues, aPercentile) / 1000.0;
+  }
+
+  int32_t mCounts[kBuckets] = {};
+  std::vector<int64_t> mValues;
+};
+
+void
+RunMutex(const Options& aOptions, Shared& aShared, Histogram& aHistogram, int32_t& aTorn, int32_t& aMissed) {
+  std::atomic<bool> running(true);
+  std::thread producer([&] {
+    for (int64_t frame = 1; frame <= aOptions.frames; ++frame) {
+      pthread_mutex_lock(&aShared.mutex);
+      WriteFrame(aShared, frame);
+      Stall(aOptions, frame);
+      pthread_cond_signal(&aShared.cond);
+      pthread_mutex_unlock(&aShared.mutex);
+      std::this_thread::sleep_for(std::chrono::microseconds(aOptions.intervalUs));
+    }
+    running = false;
+  });
+
+  Snapshot snapshot = {};
+  int64_t lastFrame = 0;
+  while (lastFrame < aOptions.frames) {
+    pthread_mutex_lock(&aShared.mutex);
+    bool timedOut = false;
+    while (aShared.frameId == lastFrame && !timedOut) {
+      timedOut = !ExternalVRTransport::TimedWait(&aShared.cond, &aShared.mutex, ExternalVRTransport::Deadline(kWaitTimeout));
+    }
+    memcpy(&snapshot, &aShared.frameId, sizeof(snapshot));
+    pthread_mutex_unlock(&aShared.mutex);
+    if (timedOut) {
+      aMissed++;
+      if (!running) {
+        break;
+      }
+      continue;
+    }
+    aHistogram.Add(ExternalVRTransport::NowNanoseconds() - snapshot.publishTime);
+    aTorn += IsTorn(snapshot) ? 1 : 0;
+    lastFrame = snapshot.frameId;
+  }
+  producer.join();
+}
+
+void
+RunSeqlock(const Options& aOptions, Shared& aShared, Histogram& aHistogram, int32_t& aTorn, int32_t& aMissed) {
+  std::atomic<bool> running(true);
+  std::thread producer([&] {
+    for (int64_t frame = 1; frame <= aOptions.frames; ++frame) {
+      ExternalVRTransport::BeginWrite(&aShared.generationA);
+      WriteFrame(aShared, frame);
+      ExternalVRTransport::EndWrite(&aShared.generationB);
+      // A stalled producer does not hold anything the consumer needs.
+      Stall(aOptions, frame);
+      std::this_thread::sleep_for(std::chrono::microseconds(aOptions.intervalUs));
+    }
+    running = false;
+  });
+
+  Snapshot snapshot = {};
+  int64_t lastFrame = 0;
+  int64_t generation = 0;
+  while (lastFrame < aOptions.frames) {
+    if (!ExternalVRTransport::WaitForGeneration(&aShared.generationB, generation, ExternalVRTransport::Deadline(kWaitTimeout))) {
+      aMissed++;
+      if (!running) {
+        break;
+      }
+      continue;
+    }
+    while (true) {
+      generation = ExternalVRTransport::BeginRead(&aShared.generationB);
+      memcpy(&snapshot, &aShared.frameId, sizeof(snapshot));
+      if (ExternalVRTransport::EndRead(&aShared.generationA, generation)) {
+        break;
+      }
+    }
+    if (snapshot.frameId == lastFrame) {
+      continue;
+    }
+    aHistogram.Add(ExternalVRTransport::NowNanoseconds() - snapshot.publishTime);
+    aTorn += IsTorn(snapshot) ? 1 : 0;
+    lastFrame = snapshot.frameId;
+  }
+  producer.join();
+}
+
+} // namespace
+
+int
+main(int argc, char** argv) {
+  const Options options = ParseOptions(argc, argv);
+  printf("frames=%d interval=%dus stall=%dus every %d frames\n", options.frames, options.intervalUs,
+         options.stallUs, options.stallEvery);
+
+  std::unique_ptr<Shared> shared(new Shared());
+  memset(shared.get(), 0, sizeof(Shared));
+  pthread_mutex_init(&shared->mutex, nullptr);
+  pthread_cond_init(&shared->cond, nullptr);
+
+  int32_t torn = 0;
+  int32_t missed = 0;
+  Histogram mutexHistogram;
+  RunMutex(options, *shared, mutexHistogram, torn, missed);
+  mutexHistogram.Print("mutex+condition", torn, missed);
+  const int32_t mutexTorn = torn;
+
+  torn = 0;
+  missed = 0;
+  Histogram seqlockHistogram;
+  RunSeqlock(options, *shared, seqlockHistogram, torn, missed);
+  seqlockHistogram.Print("seqlock+futex", torn, missed);
+
+  pthread_cond_destroy(&shared->cond);
+  pthread_mutex_destroy(&shared->mutex);
+  return (mutexTorn + torn) > 0 ? 1 : 0;
+}
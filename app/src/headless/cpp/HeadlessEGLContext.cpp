@@ -0,0 +1,104 @@
+/* -*- Mode: C++; tab-width: 20; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include "HeadlessEGLContext.h"
+#include "vrb/Logger.h"
+#include <EGL/eglext.h>
+
+namespace crow {
+
+HeadlessEGLContext::HeadlessEGLContext()
+  : mMajorVersion(0), mMinorVersion(0), mDisplay(EGL_NO_DISPLAY), mConfig(0), mSurface(EGL_NO_SURFACE),
+    mContext(EGL_NO_CONTEXT) {
+}
+
+HeadlessEGLContextPtr
+HeadlessEGLContext::Create() {
+  return std::make_shared<HeadlessEGLContext>();
+}
+
+bool
+HeadlessEGLContext::Initialize(const int32_t aWidth, const int32_t aHeight) {
+  mDisplay = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+  if (eglInitialize(mDisplay, &mMajorVersion, &mMinorVersion) == EGL_FALSE) {
+    VRB_ERROR("eglInitialize() failed: 0x%x", eglGetError());
+    return false;
+  }
+
+  const EGLint configAttribs[] = {
+      EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+      EGL_RENDERABLE_TYPE, EGL_OPENGL_ES3_BIT_KHR,
+      EGL_RED_SIZE, 8,
+      EGL_GREEN_SIZE, 8,
+      EGL_BLUE_SIZE, 8,
+      EGL_ALPHA_SIZE, 8,
+      EGL_DEPTH_SIZE, 24,
+      EGL_NONE
+  };
+  EGLint numConfigs = 0;
+  if (eglChooseConfig(mDisplay, configAttribs, &mConfig, 1, &numConfigs) == EGL_FALSE || numConfigs == 0) {
+    VRB_ERROR("eglChooseConfig() failed: 0x%x", eglGetError());
+    return false;
+  }
+
+  if (eglBindAPI(EGL_OPENGL_ES_API) == EGL_FALSE) {
+    VRB_ERROR("eglBindAPI() failed: 0x%x", eglGetError());
+    return false;
+  }
+
+  const EGLint contextAttribs[] = {
+      EGL_CONTEXT_CLIENT_VERSION, 3,
+      EGL_NONE
+  };
+  mContext = eglCreateContext(mDisplay, mConfig, EGL_NO_CONTEXT, contextAttribs);
+  if (mContext == EGL_NO_CONTEXT) {
+    VRB_ERROR("eglCreateContext() failed: 0x%x", eglGetError());
+    return false;
+  }
+
+  const EGLint surfaceAttribs[] = {
+      EGL_WIDTH, aWidth,
+      EGL_HEIGHT, aHeight,
+      EGL_NONE
+  };
+  mSurface = eglCreatePbufferSurface(mDisplay, mConfig, surfaceAttribs);
+  if (mSurface == EGL_NO_SURFACE) {
+    VRB_ERROR("eglCreatePbufferSurface() failed: 0x%x", eglGetError());
+    eglDestroyContext(mDisplay, mContext);
+    mContext = EGL_NO_CONTEXT;
+    return false;
+  }
+
+  return MakeCurrent();
+}
+
+void
+HeadlessEGLContext::Destroy() {
+  if (mDisplay == EGL_NO_DISPLAY) {
+    return;
+  }
+  eglMakeCurrent(mDisplay, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+  if (mContext != EGL_NO_CONTEXT) {
+    eglDestroyContext(mDisplay, mContext);
+    mContext = EGL_NO_CONTEXT;
+  }
+  if (mSurface != EGL_NO_SURFACE) {
+    eglDestroySurface(mDisplay, mSurface);
+    mSurface = EGL_NO_SURFACE;
+  }
+  eglTerminate(mDisplay);
+  mDisplay = EGL_NO_DISPLAY;
+}
+
+bool
+HeadlessEGLContext::MakeCurrent() {
+  if (eglMakeCurrent(mDisplay, mSurface, mSurface, mContext) == EGL_FALSE) {
+    VRB_ERROR("eglMakeCurrent() failed: 0x%x", eglGetError());
+    return false;
+  }
+  return true;
+}
+
+} // namespace crow
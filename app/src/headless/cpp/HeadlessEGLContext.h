@@ -0,0 +1,38 @@
+/* -*- Mode: C++; tab-width: 20; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#pragma once
+
+#include <EGL/egl.h>
+#include <memory>
+
+namespace crow {
+
+class HeadlessEGLContext;
+
+typedef std::shared_ptr<HeadlessEGLContext> HeadlessEGLContextPtr;
+
+// Off-screen GLES3 context used by the host (Linux) build. Run with
+// EGL_PLATFORM=surfaceless and LIBGL_ALWAYS_SOFTWARE=1 to use Mesa/llvmpipe
+// without a display server.
+class HeadlessEGLContext {
+public:
+  static HeadlessEGLContextPtr Create();
+
+  bool Initialize(const int32_t aWidth, const int32_t aHeight);
+  void Destroy();
+  bool MakeCurrent();
+
+  HeadlessEGLContext();
+private:
+  EGLint mMajorVersion;
+  EGLint mMinorVersion;
+  EGLDisplay mDisplay;
+  EGLConfig mConfig;
+  EGLSurface mSurface;
+  EGLContext mContext;
+};
+
+} // namespace crow
@@ -0,0 +1,139 @@
+/* -*- Mode: C++; tab-width: 20; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+// Host driver for the native render core. It runs BrowserWorld on top of the
+// NoAPI device delegate with no Java peer: every VRBrowser callback becomes a
+// no-op because InitializeJava is never called. Frame CPU time is reported as
+// percentiles so CI can catch regressions without a headset.
+//
+//   headless-runner [--frames N] [--widgets N] [--width W] [--height H]
+//                   [--depth N] [--cylinder] [--budget-ms MS]
+//
+// --depth chains widgets into parent/child groups of N to exercise the widget
+// hierarchy (e.g. windows with trays and tooltips). Running with an increasing
+// --widgets count shows how frame cost scales with the number of widgets.
+// The exit code is non zero when the p95 frame time exceeds --budget-ms.
+
+#include "BrowserWorld.h"
+#include "DeviceDelegateNoAPI.h"
+#include "HeadlessEGLContext.h"
+#include "HeadlessUtils.h"
+#include "WidgetPlacement.h"
+#include "vrb/Logger.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <vector>
+
+using namespace crow;
+
+namespace {
+
+struct Options {
+  int32_t frames = 600;
+  int32_t widgets = 8;
+  int32_t width = 1920;
+  int32_t height = 1080;
+  int32_t depth = 1;
+  bool cylinder = false;
+  double budgetMs = 0.0;
+};
+
+Options
+ParseOptions(int argc, char** argv) {
+  Options result;
+  HeadlessOptionParser()
+      .Int("--frames", result.frames)
+      .Int("--widgets", result.widgets)
+      .Int("--width", result.width)
+      .Int("--height", result.height)
+      .Int("--depth", result.depth, 1)
+      .Double("--budget-ms", result.budgetMs)
+      .Flag("--cylinder", result.cylinder)
+      .Parse(argc, argv);
+  return result;
+}
+
+// Lay windows out on a grid in front of the home position, the same way the
+// Java side places them: translation is expressed in widget pixels.
+void
+AddWidgets(const Options& aOptions) {
+  for (int32_t i = 0; i < aOptions.widgets; ++i) {
+    WidgetPlacementPtr placement = CreateHeadlessPlacement(kHeadlessWindowWidth, kHeadlessWindowHeight,
+                                                           aOptions.cylinder);
+    if (i % aOptions.depth != 0) {
+      // Children sit slightly in front of their parent.
+      placement->parentHandle = i;
+      placement->translation = vrb::Vector(0.0f, 0.0f, 10.0f);
+    } else {
+      placement->translation = HeadlessGridTranslation(i / aOptions.depth);
+    }
+    BrowserWorld::Instance().AddWidget(i + 1, placement);
+  }
+}
+
+} // namespace
+
+int
+main(int argc, char** argv) {
+  const Options options = ParseOptions(argc, argv);
+
+  HeadlessEGLContextPtr egl = HeadlessEGLContext::Create();
+  if (!egl->Initialize(options.width, options.height)) {
+    VRB_ERROR("Unable to create headless EGL context");
+    return 2;
+  }
+
+  BrowserWorld& world = BrowserWorld::Instance();
+  DeviceDelegateNoAPIPtr device = DeviceDelegateNoAPI::Create(world.GetRenderContext());
+  device->Resume();
+  world.RegisterDeviceDelegate(device);
+  world.InitializeGL();
+  world.Resume();
+  device->SetViewport(options.width, options.height);
+  world.SetCylinderDensity(options.cylinder ? 4680.0f : 0.0f);
+  AddWidgets(options);
+
+  std::vector<double> frameTimes;
+  frameTimes.reserve((size_t)options.frames);
+  for (int32_t frame = 0; frame < options.frames; ++frame) {
+    // Sweep the virtual controller across the viewport so hit testing and
+    // pointer updates run every frame.
+    const float x = (float)(frame % options.width);
+    const float y = options.height * 0.5f;
+    device->TouchEvent((frame / 60) % 2 == 1, x, y);
+
+    const auto start = std::chrono::steady_clock::now();
+    world.Draw();
+    const auto end = std::chrono::steady_clock::now();
+    frameTimes.push_back(std::chrono::duration<double, std::milli>(end - start).count());
+  }
+
+  std::vector<double> sorted = frameTimes;
+  std::sort(sorted.begin(), sorted.end());
+  double total = 0.0;
+  for (double time: frameTimes) {
+    total += time;
+  }
+  const double mean = frameTimes.empty() ? 0.0 : total / frameTimes.size();
+  const double p95 = Percentile(sorted, 0.95);
+  printf("frames=%d widgets=%d depth=%d mean=%.3fms p50=%.3fms p95=%.3fms p99=%.3fms max=%.3fms\n",
+         options.frames, options.widgets, options.depth, mean, Percentile(sorted, 0.50), p95,
+         Percentile(sorted, 0.99), sorted.empty() ? 0.0 : sorted.back());
+
+  world.Pause();
+  world.ShutdownGL();
+  world.RegisterDeviceDelegate(nullptr);
+  BrowserWorld::Destroy();
+  device = nullptr;
+  egl->Destroy();
+
+  if (options.budgetMs > 0.0 && p95 > options.budgetMs) {
+    VRB_ERROR("p95 frame time %.3fms exceeds budget %.3fms", p95, options.budgetMs);
+    return 1;
+  }
+  return 0;
+}
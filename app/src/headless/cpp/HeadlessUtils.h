@@ -0,0 +1,119 @@
+/* -*- Mode: C++; tab-width: 20; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#pragma once
+
+#include "WidgetPlacement.h"
+#include "vrb/Logger.h"
+#include "vrb/Vector.h"
+
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <stdint.h>
+#include <vector>
+
+namespace crow {
+
+// Command line options of the headless tools:
+//
+//   HeadlessOptionParser()
+//       .Int("--frames", options.frames, 1)
+//       .Flag("--cylinder", options.cylinder)
+//       .Parse(argc, argv);
+//
+// Integer values are clamped to the given range. Unknown arguments are logged
+// and skipped.
+class HeadlessOptionParser {
+public:
+  HeadlessOptionParser& Int(const char* aName, int32_t& aValue, const int32_t aMin = INT32_MIN,
+                            const int32_t aMax = INT32_MAX) {
+    int32_t* value = &aValue;
+    mOptions.push_back({aName, true, [value, aMin, aMax](const char* aText) {
+      *value = std::max(aMin, std::min(atoi(aText), aMax));
+    }});
+    return *this;
+  }
+
+  HeadlessOptionParser& Double(const char* aName, double& aValue) {
+    double* value = &aValue;
+    mOptions.push_back({aName, true, [value](const char* aText) { *value = atof(aText); }});
+    return *this;
+  }
+
+  HeadlessOptionParser& Flag(const char* aName, bool& aValue) {
+    bool* value = &aValue;
+    mOptions.push_back({aName, false, [value](const char*) { *value = true; }});
+    return *this;
+  }
+
+  void Parse(int argc, char** argv) const {
+    for (int i = 1; i < argc; ++i) {
+      const bool hasValue = (i + 1) < argc;
+      auto option = std::find_if(mOptions.begin(), mOptions.end(), [&](const Option& aOption) {
+        return !strcmp(argv[i], aOption.name) && (hasValue || !aOption.hasValue);
+      });
+      if (option == mOptions.end()) {
+        VRB_ERROR("Unknown argument: %s", argv[i]);
+      } else if (option->hasValue) {
+        option->set(argv[++i]);
+      } else {
+        option->set(nullptr);
+      }
+    }
+  }
+
+private:
+  struct Option {
+    const char* name;
+    bool hasValue;
+    std::function<void(const char*)> set;
+  };
+  std::vector<Option> mOptions;
+};
+
+// Nearest rank percentile, aPercentile in [0, 1]. Sorts aValues.
+template <typename T>
+T
+Percentile(std::vector<T>& aValues, const double aPercentile) {
+  if (aValues.empty()) {
+    return T();
+  }
+  std::sort(aValues.begin(), aValues.end());
+  const size_t rank = (size_t)std::max(1.0, std::ceil(aPercentile * aValues.size()));
+  return aValues[std::min(aValues.size(), rank) - 1];
+}
+
+const int32_t kHeadlessWindowWidth = 800;
+const int32_t kHeadlessWindowHeight = 450;
+
+// Placement of the windows the headless tools create: composited, with the
+// border the Java side gives browser windows.
+inline WidgetPlacementPtr
+CreateHeadlessPlacement(const int32_t aWidth = kHeadlessWindowWidth,
+                        const int32_t aHeight = kHeadlessWindowHeight, const bool aCylinder = false) {
+  WidgetPlacementPtr placement = WidgetPlacement::Create(aWidth, aHeight);
+  placement->cylinder = aCylinder;
+  placement->composited = true;
+  placement->borderColor = 0x80808080;
+  return placement;
+}
+
+// Translation of the window in grid cell aCell, four columns wide, in front of
+// the home position. Like the Java side, it is expressed in widget pixels.
+inline vrb::Vector
+HeadlessGridTranslation(const int32_t aCell) {
+  const int32_t kColumns = 4;
+  const float kDistance = -4.0f / WidgetPlacement::kWorldDPIRatio;
+  const int32_t column = aCell % kColumns;
+  const int32_t row = aCell / kColumns;
+  return vrb::Vector((column - kColumns / 2) * (kHeadlessWindowWidth + 50.0f),
+                     row * (kHeadlessWindowHeight + 50.0f), kDistance);
+}
+
+} // namespace crow
@@ -0,0 +1,177 @@
+/* -*- Mode: C++; tab-width: 20; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+// Compares per widget Widget::TestControllerIntersection calls with the
+// batched WidgetHitTester for two controllers sweeping over N widgets.
+//
+//   hit-test-benchmark [--widgets N] [--iterations N] [--cylinder]
+//
+// The exit code is non zero when both paths disagree on the hit widget.
+
+#include "Cylinder.h"
+#include "HeadlessEGLContext.h"
+#include "HeadlessUtils.h"
+#include "Quad.h"
+#include "Widget.h"
+#include "WidgetHitTester.h"
+#include "WidgetPlacement.h"
+#include "WidgetRegistry.h"
+#include "vrb/CreationContext.h"
+#include "vrb/Logger.h"
+#include "vrb/Matrix.h"
+#include "vrb/RenderContext.h"
+#include "vrb/Vector.h"
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <vector>
+
+using namespace crow;
+
+namespace {
+
+const int kControllers = 2;
+
+struct Options {
+  int32_t widgets = 32;
+  int32_t iterations = 2000;
+  bool cylinder = false;
+};
+
+Options
+ParseOptions(int argc, char** argv) {
+  Options result;
+  HeadlessOptionParser()
+      .Int("--widgets", result.widgets, 1)
+      .Int("--iterations", result.iterations, 1)
+      .Flag("--cylinder", result.cylinder)
+      .Parse(argc, argv);
+  return result;
+}
+
+// Widgets are laid out on a grid four meters in front of the origin.
+WidgetPtr
+CreateWidget(vrb::RenderContextPtr& aContext, const Options& aOptions, const int32_t aIndex) {
+  const int32_t kTextureWidth = kHeadlessWindowWidth;
+  const int32_t kTextureHeight = kHeadlessWindowHeight;
+  const int32_t kColumns = 8;
+  const float worldWidth = kTextureWidth * WidgetPlacement::kWorldDPIRatio;
+  const float worldHeight = kTextureHeight * WidgetPlacement::kWorldDPIRatio;
+
+  WidgetPlacementPtr placement = CreateHeadlessPlacement(kTextureWidth, kTextureHeight, aOptions.cylinder);
+  vrb::CreationContextPtr create = aContext->GetRenderThreadCreationContext();
+  WidgetPtr widget;
+  if (aOptions.cylinder) {
+    CylinderPtr cylinder = Cylinder::Create(create);
+    widget = Widget::Create(aContext, aIndex + 1, placement, worldWidth, worldHeight, kTextureWidth, kTextureHeight, cylinder);
+    widget->SetCylinderDensity(4680.0f);
+  } else {
+    QuadPtr quad = Quad::Create(create, worldWidth, worldHeight, nullptr);
+    widget = Widget::Create(aContext, aIndex + 1, placement, kTextureWidth, kTextureHeight, quad);
+  }
+  const float x = ((aIndex % kColumns) - kColumns / 2) * (worldWidth + 0.1f);
+  const float y = (aIndex / kColumns) * (worldHeight + 0.1f);
+  widget->SetTransform(vrb::Matrix::Translation(vrb::Vector(x, y, -4.0f - aIndex * 0.01f)));
+  widget->ToggleWidget(true);
+  return widget;
+}
+
+void
+GetRay(const Options& aOptions, const int32_t aIteration, const int aController, vrb::Vector& aStart, vrb::Vector& aDirection) {
+  const float angle = (float)(aIteration % 360) * (float)M_PI / 180.0f;
+  aStart = vrb::Vector(aController == 0 ? -0.2f : 0.2f, 1.0f, 0.0f);
+  aDirection = vrb::Vector(sinf(angle + aController) * 0.8f, cosf(angle * 0.5f) * 0.3f, -1.0f).Normalize();
+}
+
+} // namespace
+
+int
+main(int argc, char** argv) {
+  const Options options = ParseOptions(argc, argv);
+
+  HeadlessEGLContextPtr egl = HeadlessEGLContext::Create();
+  if (!egl->Initialize(64, 64)) {
+    VRB_ERROR("Unable to create headless EGL context");
+    return 2;
+  }
+  vrb::RenderContextPtr context = vrb::RenderContext::Create();
+  context->InitializeGL();
+
+  WidgetRegistry widgets;
+  for (int32_t i = 0; i < options.widgets; ++i) {
+    widgets.Add(CreateWidget(context, options, i));
+  }
+  WidgetHitTesterPtr hitTester = WidgetHitTester::Create();
+
+  int mismatches = 0;
+  std::vector<const Widget*> expected((size_t)options.iterations * kControllers);
+
+  // Every widget is tested for every controller.
+  auto start = std::chrono::steady_clock::now();
+  for (int32_t iteration = 0; iteration < options.iterations; ++iteration) {
+    for (int controller = 0; controller < kControllers; ++controller) {
+      vrb::Vector rayStart, rayDirection;
+      GetRay(options, iteration, controller, rayStart, rayDirection);
+      const Widget* hitWidget = nullptr;
+      float hitDistance = 300.0f;
+      for (const WidgetPtr& widget: widgets) {
+        vrb::Vector result, normal;
+        float distance = 0.0f;
+        bool isInWidget = false;
+        if (widget->TestControllerIntersection(rayStart, rayDirection, result, normal, true, isInWidget, distance) &&
+            isInWidget && distance < hitDistance) {
+          hitWidget = widget.get();
+          hitDistance = distance;
+        }
+      }
+      expected[iteration * kControllers + controller] = hitWidget;
+    }
+  }
+  const double linear = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+
+  // Both controllers are culled in one batch, then only the candidates are tested.
+  start = std::chrono::steady_clock::now();
+  for (int32_t iteration = 0; iteration < options.iterations; ++iteration) {
+    hitTester->Update(widgets, 0, vrb::Matrix::Identity());
+    hitTester->ClearRays();
+    vrb::Vector rayStarts[kControllers], rayDirections[kControllers];
+    for (int controller = 0; controller < kControllers; ++controller) {
+      GetRay(options, iteration, controller, rayStarts[controller], rayDirections[controller]);
+      hitTester->AddRay(rayStarts[controller], rayDirections[controller]);
+    }
+    hitTester->Cull();
+    for (int controller = 0; controller < kControllers; ++controller) {
+      const Widget* hitWidget = nullptr;
+      float hitDistance = 300.0f;
+      for (size_t index = 0; index < hitTester->GetWidgetCount(); ++index) {
+        if (!hitTester->IsCandidate(index, controller)) {
+          continue;
+        }
+        vrb::Vector result, normal;
+        float distance = 0.0f;
+        bool isInWidget = false;
+        if (hitTester->TestIntersection(index, rayStarts[controller], rayDirections[controller], result, normal, true, isInWidget, distance) &&
+            isInWidget && distance < hitDistance) {
+          hitWidget = hitTester->GetWidget(index).get();
+          hitDistance = distance;
+        }
+      }
+      if (expected[iteration * kControllers + controller] != hitWidget) {
+        mismatches++;
+      }
+    }
+  }
+  const double batched = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+
+  printf("controllers=%d widgets=%d cylinder=%d linear=%.3fus batched=%.3fus speedup=%.2fx mismatches=%d\n",
+         kControllers, options.widgets, options.cylinder ? 1 : 0, linear / options.iterations,
+         batched / options.iterations, batched > 0.0 ? linear / batched : 0.0, mismatches);
+
+  hitTester = nullptr;
+  context->ShutdownGL();
+  egl->Destroy();
+  return mismatches > 0 ? 1 : 0;
+}
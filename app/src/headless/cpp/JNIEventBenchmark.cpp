@@ -0,0 +1,200 @@
+/* -*- Mode: C++; tab-width: 20; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+// Measures the render thread side of the native to Java event channel: the
+// cost of queuing the per frame controller and audio events in the
+// JNIEventChannel while a simulated UI thread drains it, and the cost of
+// registering and running one shot callbacks in the CallbackRegistry compared
+// with a heap allocated std::function per callback.
+//
+//   jni-event-benchmark [--frames N] [--controllers N] [--capacity N] [--callbacks N] [--frame-us N]
+//
+// Frames are --frame-us apart (outside of the timed region) so the drain
+// keeps up the way it does at display rate. A small --capacity makes records
+// wait in the backlog; the exit code is non zero when a press or release
+// change of a controller does not reach the drain.
+
+#include "CallbackRegistry.h"
+#include "HeadlessUtils.h"
+#include "JNIEventChannel.h"
+#include "vrb/Logger.h"
+
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <functional>
+#include <thread>
+#include <vector>
+
+using namespace crow;
+
+namespace {
+
+typedef std::chrono::steady_clock Clock;
+
+struct Options {
+  int32_t frames = 20000;
+  int32_t controllers = 2;
+  int32_t capacity = 1024;
+  int32_t callbacks = 1000000;
+  int32_t frameMicroseconds = 100;
+};
+
+Options
+ParseOptions(int argc, char** argv) {
+  Options result;
+  HeadlessOptionParser()
+      .Int("--frames", result.frames, 1)
+      .Int("--controllers", result.controllers, 0)
+      .Int("--capacity", result.capacity, 1)
+      .Int("--callbacks", result.callbacks, 1)
+      .Int("--frame-us", result.frameMicroseconds, 0)
+      .Parse(argc, argv);
+  return result;
+}
+
+double
+Nanoseconds(const Clock::time_point& aStart, const Clock::time_point& aEnd) {
+  return std::chrono::duration<double, std::nano>(aEnd - aStart).count();
+}
+
+// The events BrowserWorld queues in a frame: a motion and a scroll event per
+// controller, the audio pose and, once a second, the battery levels.
+int32_t
+PushFrameEvents(JNIEventChannel& aChannel, const int32_t aFrame, const int32_t aControllers) {
+  int32_t count = 0;
+  for (int32_t i = 0; i < aControllers; ++i) {
+    JNIEventChannel::Record* motion = aChannel.Push(JNIEventChannel::EventType::MotionEvent);
+    if (motion) {
+      motion->values[0].i = 1;
+      motion->values[1].i = i;
+      motion->values[2].i = JNIEventChannel::kFocused | ((aFrame / 30) % 2 ? JNIEventChannel::kPressed : 0);
+      motion->values[3].f = (float)(aFrame % 800);
+      motion->values[4].f = (float)(aFrame % 450);
+    }
+    JNIEventChannel::Record* scroll = aChannel.Push(JNIEventChannel::EventType::ScrollEvent);
+    if (scroll) {
+      scroll->values[0].i = 1;
+      scroll->values[1].i = i;
+      scroll->values[2].f = 0.0f;
+      scroll->values[3].f = 0.1f;
+    }
+    count += 2;
+  }
+  JNIEventChannel::Record* pose = aChannel.Push(JNIEventChannel::EventType::AudioPose);
+  if (pose) {
+    const float angle = (float)aFrame * 0.01f;
+    pose->values[0].f = 0.0f;
+    pose->values[1].f = sinf(angle * 0.5f);
+    pose->values[2].f = 0.0f;
+    pose->values[3].f = cosf(angle * 0.5f);
+    pose->values[4].f = 0.0f;
+    pose->values[5].f = 1.6f;
+    pose->values[6].f = 0.0f;
+  }
+  count++;
+  if (aFrame % 72 == 0) {
+    JNIEventChannel::Record* battery = aChannel.Push(JNIEventChannel::EventType::ControllerBatteryLevels);
+    if (battery) {
+      battery->values[0].i = 80;
+      battery->values[1].i = 75;
+    }
+    count++;
+  }
+  return count;
+}
+
+} // namespace
+
+int
+main(int argc, char** argv) {
+  const Options options = ParseOptions(argc, argv);
+
+  JNIEventChannelPtr channel = JNIEventChannel::Create((uint32_t)options.capacity);
+  std::atomic<bool> running(true);
+  std::atomic<uint64_t> consumed(0);
+  int64_t transitions = 0;
+  // Plays VRBrowserActivity.drainNativeEvents: reads every published record and releases the slots.
+  std::thread consumer([&] {
+    uint32_t read = 0;
+    float checksum = 0.0f;
+    std::vector<int32_t> flags((size_t)options.controllers, -1);
+    while (running || read != channel->GetPublished()) {
+      const uint32_t end = channel->GetPublished();
+      if (end == read) {
+        std::this_thread::yield();
+        continue;
+      }
+      for (; read != end; ++read) {
+        const JNIEventChannel::Record& record = channel->GetRecord(read);
+        checksum += (float)record.type + record.values[3].f;
+        if (record.type == (int32_t)JNIEventChannel::EventType::MotionEvent &&
+            record.values[2].i != flags[record.values[1].i]) {
+          flags[record.values[1].i] = record.values[2].i;
+          transitions++;
+        }
+      }
+      channel->Release(end);
+      consumed.fetch_add(1, std::memory_order_relaxed);
+    }
+    if (checksum < 0.0f) {
+      printf("checksum=%f\n", checksum);
+    }
+  });
+
+  std::vector<double> frames;
+  frames.reserve((size_t)options.frames);
+  int64_t events = 0;
+  int64_t expectedTransitions = 0;
+  for (int32_t frame = 0; frame < options.frames; ++frame) {
+    if (frame == 0 || (frame / 30) % 2 != ((frame - 1) / 30) % 2) {
+      expectedTransitions += options.controllers;
+    }
+    const Clock::time_point start = Clock::now();
+    events += PushFrameEvents(*channel, frame, options.controllers);
+    channel->Publish();
+    frames.push_back(Nanoseconds(start, Clock::now()));
+    std::this_thread::sleep_for(std::chrono::microseconds(options.frameMicroseconds));
+  }
+  // Records left in the backlog once the ring frees up.
+  while (channel->GetBacklogSize() > 0) {
+    channel->Publish();
+    std::this_thread::yield();
+  }
+  running = false;
+  consumer.join();
+
+  double total = 0.0;
+  for (double time: frames) {
+    total += time;
+  }
+  printf("frames=%d events=%lld capacity=%u drains=%llu coalesced=%u transitions=%lld/%lld\n", options.frames,
+         (long long)events, channel->GetCapacity(), (unsigned long long)consumed.load(), channel->GetCoalescedCount(),
+         (long long)transitions, (long long)expectedTransitions);
+  printf("queue: %.1fns/event frame p50=%.0fns p99=%.0fns\n", events > 0 ? total / events : 0.0,
+         Percentile(frames, 0.50), Percentile(frames, 0.99));
+
+  // Callbacks are registered and run one at a time, as with the first composite callbacks.
+  int64_t runs = 0;
+  CallbackRegistryPtr registry = CallbackRegistry::Create();
+  Clock::time_point start = Clock::now();
+  for (int32_t i = 0; i < options.callbacks; ++i) {
+    const uint64_t handle = registry->Register([&runs] { runs++; });
+    registry->Run(handle);
+  }
+  const double pooled = Nanoseconds(start, Clock::now()) / options.callbacks;
+
+  start = Clock::now();
+  for (int32_t i = 0; i < options.callbacks; ++i) {
+    const std::function<void()> callback = [&runs] { runs++; };
+    std::function<void()>* heap = new std::function<void()>(callback);
+    (*heap)();
+    delete heap;
+  }
+  const double allocated = Nanoseconds(start, Clock::now()) / options.callbacks;
+  printf("callbacks=%lld pooled=%.1fns allocated=%.1fns\n", (long long)runs, pooled, allocated);
+  return transitions == expectedTransitions ? 0 : 1;
+}
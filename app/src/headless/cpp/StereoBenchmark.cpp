@@ -0,0 +1,131 @@
+/* -*- Mode: C++; tab-width: 20; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+// Compares the CPU submit time of BrowserWorld frames drawn per eye (each eye
+// binds its target and culls every root again) with the single pass stereo
+// path (every root is culled once and drawn in the viewport of each eye).
+//
+//   stereo-benchmark [--frames N] [--widgets N] [--width W] [--height H] [--cylinder]
+//
+// The GPU is drained with glFinish() outside of the timed region so that only
+// the CPU cost of culling and issuing the draw calls is measured.
+
+#include "BrowserWorld.h"
+#include "DeviceDelegateNoAPI.h"
+#include "HeadlessEGLContext.h"
+#include "HeadlessUtils.h"
+#include "WidgetPlacement.h"
+#include "vrb/Logger.h"
+#include "vrb/gl.h"
+
+#include <chrono>
+#include <cstdio>
+#include <vector>
+
+using namespace crow;
+
+namespace {
+
+const int32_t kWarmupFrames = 30;
+
+struct Options {
+  int32_t frames = 300;
+  int32_t widgets = 16;
+  int32_t width = 1920;
+  int32_t height = 1080;
+  bool cylinder = false;
+};
+
+Options
+ParseOptions(int argc, char** argv) {
+  Options result;
+  HeadlessOptionParser()
+      .Int("--frames", result.frames, 1)
+      .Int("--widgets", result.widgets, 0)
+      .Int("--width", result.width)
+      .Int("--height", result.height)
+      .Flag("--cylinder", result.cylinder)
+      .Parse(argc, argv);
+  return result;
+}
+
+void
+AddWidgets(const Options& aOptions) {
+  for (int32_t i = 0; i < aOptions.widgets; ++i) {
+    WidgetPlacementPtr placement = CreateHeadlessPlacement(kHeadlessWindowWidth, kHeadlessWindowHeight,
+                                                           aOptions.cylinder);
+    placement->translation = HeadlessGridTranslation(i);
+    BrowserWorld::Instance().AddWidget(i + 1, placement);
+  }
+}
+
+struct Result {
+  double mean = 0.0;
+  double p50 = 0.0;
+  double p95 = 0.0;
+};
+
+Result
+Measure(const Options& aOptions, DeviceDelegateNoAPI& aDevice, const bool aSinglePass) {
+  BrowserWorld& world = BrowserWorld::Instance();
+  aDevice.SetSinglePassStereo(aSinglePass);
+  std::vector<double> times;
+  times.reserve((size_t)aOptions.frames);
+  for (int32_t frame = -kWarmupFrames; frame < aOptions.frames; ++frame) {
+    const auto start = std::chrono::steady_clock::now();
+    world.Draw();
+    const auto end = std::chrono::steady_clock::now();
+    glFinish();
+    if (frame >= 0) {
+      times.push_back(std::chrono::duration<double, std::milli>(end - start).count());
+    }
+  }
+  Result result;
+  for (double time: times) {
+    result.mean += time;
+  }
+  result.mean /= times.size();
+  result.p50 = Percentile(times, 0.50);
+  result.p95 = Percentile(times, 0.95);
+  return result;
+}
+
+} // namespace
+
+int
+main(int argc, char** argv) {
+  const Options options = ParseOptions(argc, argv);
+
+  HeadlessEGLContextPtr egl = HeadlessEGLContext::Create();
+  if (!egl->Initialize(options.width, options.height)) {
+    VRB_ERROR("Unable to create headless EGL context");
+    return 2;
+  }
+
+  BrowserWorld& world = BrowserWorld::Instance();
+  DeviceDelegateNoAPIPtr device = DeviceDelegateNoAPI::Create(world.GetRenderContext());
+  device->Resume();
+  world.RegisterDeviceDelegate(device);
+  world.InitializeGL();
+  world.Resume();
+  device->SetViewport(options.width, options.height);
+  world.SetCylinderDensity(options.cylinder ? 4680.0f : 0.0f);
+  AddWidgets(options);
+
+  const Result perEye = Measure(options, *device, false);
+  const Result singlePass = Measure(options, *device, true);
+  printf("frames=%d widgets=%d\n", options.frames, options.widgets);
+  printf("per eye:     mean=%.3fms p50=%.3fms p95=%.3fms\n", perEye.mean, perEye.p50, perEye.p95);
+  printf("single pass: mean=%.3fms p50=%.3fms p95=%.3fms\n", singlePass.mean, singlePass.p50, singlePass.p95);
+  printf("speedup: %.2fx\n", singlePass.mean > 0.0 ? perEye.mean / singlePass.mean : 0.0);
+
+  world.Pause();
+  world.ShutdownGL();
+  world.RegisterDeviceDelegate(nullptr);
+  BrowserWorld::Destroy();
+  device = nullptr;
+  egl->Destroy();
+  return 0;
+}
@@ -0,0 +1,126 @@
+/* -*- Mode: C++; tab-width: 20; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+// Checks the rootTransparent order of two unrelated widget trees of
+// different depth: children go ahead of their own ancestors, while layer
+// priority and depth order widgets of different trees.
+//
+//   transparent-sort-test
+//
+// The exit code is non zero when any case is out of order.
+
+#include "HeadlessEGLContext.h"
+#include "HeadlessUtils.h"
+#include "Quad.h"
+#include "TransparentSort.h"
+#include "Widget.h"
+#include "WidgetPlacement.h"
+#include "WidgetRegistry.h"
+#include "vrb/CreationContext.h"
+#include "vrb/Logger.h"
+#include "vrb/Node.h"
+#include "vrb/RenderContext.h"
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+using namespace crow;
+
+namespace {
+
+// Tree A is a window with a child and a grandchild, tree B a window with a
+// single child.
+enum { A = 0, A1, A2, B, B1, kWidgetCount };
+const char* kNames[kWidgetCount] = {"A", "A1", "A2", "B", "B1"};
+const int32_t kParents[kWidgetCount] = {-1, A, A1, -1, B};
+
+struct Case {
+  const char* name;
+  int32_t priorities[kWidgetCount];
+  float z[kWidgetCount];
+  int32_t expected[kWidgetCount];
+};
+
+const Case kCases[] = {
+  // The deeper tree is behind: B and its child stay ahead of A2.
+  {"unrelated depth", {0, 0, 0, 0, 0}, {0.5f, 0.4f, 0.3f, 0.1f, 0.05f}, {B1, B, A2, A1, A}},
+  // B has a higher priority, so it goes ahead of the nearer, deeper tree.
+  {"unrelated priority", {0, 0, 0, 1, 1}, {0.2f, 0.15f, 0.1f, 0.9f, 0.95f}, {B1, B, A2, A1, A}},
+  // Children farther than their parents still go ahead of them.
+  {"child behind parent", {0, 0, 0, 0, 0}, {0.1f, 0.2f, 0.3f, 0.6f, 0.7f}, {A2, A1, A, B1, B}},
+};
+
+WidgetPtr
+CreateWidget(vrb::RenderContextPtr& aContext, const int32_t aIndex) {
+  const int32_t kTextureWidth = 400;
+  const int32_t kTextureHeight = 300;
+  WidgetPlacementPtr placement = CreateHeadlessPlacement(kTextureWidth, kTextureHeight);
+  placement->parentHandle = kParents[aIndex] >= 0 ? kParents[aIndex] + 1 : -1;
+  vrb::CreationContextPtr create = aContext->GetRenderThreadCreationContext();
+  QuadPtr quad = Quad::Create(create, kTextureWidth * WidgetPlacement::kWorldDPIRatio,
+                              kTextureHeight * WidgetPlacement::kWorldDPIRatio, nullptr);
+  WidgetPtr widget = Widget::Create(aContext, aIndex + 1, placement, kTextureWidth, kTextureHeight, quad);
+  widget->ToggleWidget(true);
+  return widget;
+}
+
+std::string
+OrderString(const WidgetRegistry& aWidgets, const std::vector<TransparentSortEntry>& aEntries) {
+  std::string result;
+  for (const TransparentSortEntry& entry: aEntries) {
+    const Widget* widget = aWidgets.FindByRoot(entry.node);
+    result += result.empty() ? "" : " ";
+    result += widget ? kNames[widget->GetHandle() - 1] : "?";
+  }
+  return result;
+}
+
+} // namespace
+
+int
+main() {
+  HeadlessEGLContextPtr egl = HeadlessEGLContext::Create();
+  if (!egl->Initialize(64, 64)) {
+    VRB_ERROR("Unable to create headless EGL context");
+    return 2;
+  }
+  vrb::RenderContextPtr context = vrb::RenderContext::Create();
+  context->InitializeGL();
+
+  WidgetRegistry widgets;
+  for (int32_t i = 0; i < kWidgetCount; ++i) {
+    widgets.Add(CreateWidget(context, i));
+  }
+  auto isParent = [&widgets](const Widget& aChild, const Widget& aParent) {
+    return widgets.IsParent(aChild, aParent);
+  };
+
+  int failures = 0;
+  for (const Case& testCase: kCases) {
+    // Start from the registry order, as the nodes would be before the first sort.
+    std::vector<TransparentSortEntry> entries;
+    for (const WidgetPtr& widget: widgets) {
+      const int32_t index = (int32_t)widget->GetHandle() - 1;
+      entries.push_back({PackTransparentSortKey(testCase.priorities[index], testCase.z[index]),
+                         widget->GetRoot().get(), widget.get(), widgets.ParentCount(*widget)});
+    }
+    SortTransparentEntries(entries, isParent);
+
+    std::vector<TransparentSortEntry> expected;
+    for (const int32_t index: testCase.expected) {
+      const WidgetPtr widget = widgets.Get(index + 1);
+      expected.push_back({0, widget->GetRoot().get(), widget.get(), 0});
+    }
+    const std::string order = OrderString(widgets, entries);
+    const bool passed = order == OrderString(widgets, expected);
+    printf("%s: %s: %s\n", passed ? "PASS" : "FAIL", testCase.name, order.c_str());
+    failures += passed ? 0 : 1;
+  }
+
+  context->ShutdownGL();
+  egl->Destroy();
+  return failures > 0 ? 1 : 0;
+}
@@ -7,18 +7,29 @@
 #include "Controller.h"
 #include "ControllerContainer.h"
 #include "FadeAnimation.h"
+#include "FrameProfiler.h"
 #include "Device.h"
 #include "DeviceDelegate.h"
 #include "ExternalBlitter.h"
 #include "ExternalVR.h"
+#include "ExternalVRTransport.h"
 #include "GeckoSurfaceTexture.h"
+#include "ModelCache.h"
 #include "Skybox.h"
 #include "SplashAnimation.h"
+#include "StartupGraph.h"
+#include "TransparentSort.h"
 #include "Pointer.h"
+#include "ProgramCache.h"
 #include "Widget.h"
 #include "WidgetMover.h"
 #include "WidgetResizer.h"
 #include "WidgetPlacement.h"
+#include "WidgetHitTester.h"
+#include "WidgetRegistry.h"
+#include "WidgetSurfaceBudget.h"
+#include "WidgetSurfaceLOD.h"
+#include "WidgetVisibility.h"
 #include "Cylinder.h"
 #include "Quad.h"
 #include "VRBrowser.h"
@@ -49,16 +60,20 @@
 #include "vrb/TextureCache.h"
 #include "vrb/TextureSurface.h"
 #include "vrb/TextureCubeMap.h"
+#include "vrb/TextureGL.h"
 #include "vrb/ThreadUtils.h"
 #include "vrb/Toggle.h"
 #include "vrb/Transform.h"
 #include "vrb/VertexArray.h"
 #include "vrb/Vector.h"
 
+#include <algorithm>
 #include <array>
+#include <cmath>
 #include <functional>
-#include <fstream>
+#include <limits>
 #include <unordered_map>
+#include <unordered_set>
 
 #if defined(OCULUSVR) && STORE_BUILD == 1
 #include "OVR_Platform.h"
@@ -82,6 +97,128 @@ const int GestureSwipeRight = 1;
 
 const float kScrollFactor = 20.0f; // Just picked what fell right.
 const double kHoverRate = 1.0 / 10.0;
+// Transparent nodes are only re-sorted when the head moved more than this.
+const float kSortPositionThreshold = 0.001f; // In meters.
+const float kSortDirectionThreshold = 0.99999f; // Cosine of ~0.25 degrees.
+
+// Time kept between giving up on a WebXR frame and the submit deadline, as a
+// multiple of the measured blit and submit time, but at least kMinSubmitMargin.
+const double kSubmitMarginScale = 1.5;
+const double kMinSubmitMargin = 0.001;
+
+// Widget surface resolution, see BrowserWorld::State::UpdateSurfaceLOD().
+const float kSurfaceOversample = 1.2f; // Texels per display pixel.
+const float kMinSurfaceDistance = 0.25f; // In meters.
+const float kHiddenSurfaceScale = 0.5f; // Widgets entirely behind the head.
+
+// Widget layout dirty flags, see BrowserWorld::LayoutDirtyWidgets.
+const uint32_t kLayoutPlacement = 1 << 0; // Visibility, layer priority, border and proxy layer.
+const uint32_t kLayoutSize = 1 << 1; // Texture size and world width.
+const uint32_t kLayoutTransform = 1 << 2; // Transform relative to the parent.
+const uint32_t kLayoutCylinder = 1 << 3; // Quad or cylinder geometry.
+const uint32_t kLayoutResized = 1 << 4; // Width or height in widget pixels changed.
+const uint32_t kLayoutAll = kLayoutPlacement | kLayoutSize | kLayoutTransform | kLayoutCylinder;
+// Changes to a parent that require its children to be laid out again.
+const uint32_t kLayoutParentMask = kLayoutSize | kLayoutTransform | kLayoutCylinder;
+
+bool
+SameVector(const vrb::Vector& aA, const vrb::Vector& aB) {
+  return aA.x() == aB.x() && aA.y() == aB.y() && aA.z() == aB.z();
+}
+
+uint32_t
+ComputeLayoutChanges(const WidgetPlacementPtr& aOld, const WidgetPlacementPtr& aNew) {
+  if (!aOld || aOld == aNew) {
+    // The placement may have been modified in place.
+    return kLayoutAll;
+  }
+  uint32_t result = 0;
+  if (aOld->visible != aNew->visible || aOld->layerPriority != aNew->layerPriority ||
+      aOld->borderColor != aNew->borderColor || aOld->proxifyLayer != aNew->proxifyLayer) {
+    result |= kLayoutPlacement;
+  }
+  if (aOld->width != aNew->width || aOld->height != aNew->height) {
+    result |= kLayoutSize | kLayoutResized;
+  }
+  if (aOld->density != aNew->density || aOld->textureScale != aNew->textureScale ||
+      aOld->worldWidth != aNew->worldWidth) {
+    result |= kLayoutSize;
+  }
+  if (!SameVector(aOld->anchor, aNew->anchor) || !SameVector(aOld->translation, aNew->translation) ||
+      !SameVector(aOld->rotationAxis, aNew->rotationAxis) || aOld->rotation != aNew->rotation ||
+      aOld->parentHandle != aNew->parentHandle || !SameVector(aOld->parentAnchor, aNew->parentAnchor)) {
+    result |= kLayoutTransform;
+  }
+  if (aOld->cylinder != aNew->cylinder || aOld->cylinderMapRadius != aNew->cylinderMapRadius) {
+    result |= kLayoutCylinder;
+  }
+  return result;
+}
+
+// True when culling aNode adds anything to a draw list that renders into the
+// eye buffer. Compositor layer nodes only request their layer, disabled
+// toggle children are not culled, and any other leaf is assumed to draw.
+bool
+DrawsInEyeBuffer(vrb::Node& aNode) {
+  if (dynamic_cast<VRLayerNode*>(&aNode)) {
+    return false;
+  }
+  vrb::Group* group = dynamic_cast<vrb::Group*>(&aNode);
+  if (!group) {
+    return true;
+  }
+  vrb::Toggle* toggle = dynamic_cast<vrb::Toggle*>(group);
+  const int count = group->GetNodeCount();
+  for (int i = 0; i < count; ++i) {
+    vrb::Node* child = group->GetNode(i).get();
+    if (toggle && !toggle->IsEnabled(*child)) {
+      continue;
+    }
+    if (DrawsInEyeBuffer(*child)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// Surface resolution, relative to the texture size, at which a texel of aWidget
+// covers about one display pixel where the widget is nearest to the head.
+float
+RequiredSurfaceScale(const Widget& aWidget, const vrb::Vector& aHeadPosition, const vrb::Vector& aHeadDirection,
+                     const float aPixelsPerRadian) {
+  int32_t textureWidth = 0, textureHeight = 0;
+  aWidget.GetSurfaceTextureSize(textureWidth, textureHeight);
+  if (textureWidth <= 0 || textureHeight <= 0) {
+    return 1.0f;
+  }
+  float worldWidth = 0.0f, worldHeight = 0.0f;
+  aWidget.GetWorldSize(worldWidth, worldHeight);
+  vrb::Vector min, max;
+  aWidget.GetWidgetMinAndMax(min, max);
+  const vrb::Matrix transform = aWidget.GetTransformNode()->GetWorldTransform();
+  const vrb::Vector head = transform.AfineInverse().MultiplyPosition(aHeadPosition);
+  const vrb::Vector nearest(std::max(min.x(), std::min(head.x(), max.x())), std::max(min.y(), std::min(head.y(), max.y())), 0.0f);
+  const float distance = std::max(kMinSurfaceDistance, (transform.MultiplyPosition(nearest) - aHeadPosition).Magnitude());
+  const float texelSize = std::max(worldWidth / (float)textureWidth, worldHeight / (float)textureHeight);
+  float result = texelSize * aPixelsPerRadian / distance;
+
+  bool behind = true;
+  for (const vrb::Vector& corner: {min, max, vrb::Vector(min.x(), max.y(), 0.0f), vrb::Vector(max.x(), min.y(), 0.0f)}) {
+    if ((transform.MultiplyPosition(corner) - aHeadPosition).Dot(aHeadDirection) > 0.0f) {
+      behind = false;
+      break;
+    }
+  }
+  if (behind) {
+    result = std::min(result, kHiddenSurfaceScale);
+  }
+  return result * kSurfaceOversample;
+}
+
+struct TransparentSortPosition {
+  uint64_t position;
+  vrb::Node* node;
+};
 
 class SurfaceObserver;
 typedef std::shared_ptr<SurfaceObserver> SurfaceObserverPtr;
@@ -150,7 +287,15 @@ PerformanceObserver::PerformanceRestored(const double& aTargetFrameRate, const d
 namespace crow {
 struct BrowserWorld::State {
   BrowserWorldWeakPtr self;
-  std::vector<WidgetPtr> widgets;
+  WidgetRegistry widgets;
+  WidgetSurfaceLOD surfaceLOD;
+  WidgetSurfaceBudget surfaceBudget;
+  // Widgets whose layer surface was released to stay within surfaceBudget.
+  std::unordered_set<int32_t> releasedSurfaces;
+  WidgetVisibility visibility;
+  // Set by TickWorld() for EndFrame() to cull the widget layers of the frame.
+  bool cullWidgetLayers = false;
+  WidgetHitTesterPtr widgetHitTester;
   SurfaceObserverPtr surfaceObserver;
   DeviceDelegatePtr device;
   bool paused;
@@ -159,6 +304,8 @@ struct BrowserWorld::State {
   RenderContextPtr context;
   CreationContextPtr create;
   ModelLoaderAndroidPtr loader;
+  ModelCachePtr modelCache;
+  ProgramCachePtr programCache;
   GroupPtr rootOpaqueParent;
   TransformPtr rootOpaque;
   TransformPtr rootTransparent;
@@ -170,6 +317,14 @@ struct BrowserWorld::State {
   ControllerContainerPtr controllers;
   CullVisitorPtr cullVisitor;
   DrawableListPtr drawList;
+  // The world roots are culled once per frame in TickWorld() into these lists,
+  // which are then drawn for both eyes. They live as long as the world so their
+  // storage is reused from frame to frame.
+  DrawableListPtr opaqueList;
+  DrawableListPtr environmentList;
+  DrawableListPtr videoLists[2];
+  DrawableListPtr controllerList;
+  DrawableListPtr transparentList;
   CameraPtr leftCamera;
   CameraPtr rightCamera;
   float cylinderDensity;
@@ -183,7 +338,11 @@ struct BrowserWorld::State {
   bool windowsInitialized;
   SkyboxPtr skybox;
   FadeAnimationPtr fadeAnimation;
-  uint32_t loaderDelay;
+  StartupGraphPtr startup;
+  uint32_t startupGL;
+  uint32_t startupCachePath;
+  uint32_t startupSkybox;
+  uint32_t startupWidgets;
   bool exitImmersiveRequested;
   WidgetPtr resizingWidget;
   SplashAnimationPtr splashAnimation;
@@ -191,7 +350,15 @@ struct BrowserWorld::State {
   PerformanceMonitorPtr monitor;
   WidgetMoverPtr movingWidget;
   WidgetResizerPtr widgetResizer;
-  std::unordered_map<vrb::Node*, std::pair<Widget*, float>> depthSorting;
+  std::vector<TransparentSortEntry> sortEntries;
+  std::vector<TransparentSortPosition> sortPositions;
+  std::vector<Widget*> sortPointerTargets;
+  uint32_t layoutGeneration = 0;
+  uint32_t sortedLayoutGeneration = 0;
+  vrb::Matrix sortedHead = vrb::Matrix::Identity();
+  bool sortValid = false;
+  // Moving average of the CPU time, in seconds, from a WebXR frame arriving to its submission.
+  double immersiveSubmitCost = 0.0;
   std::function<void(device::Eye)> drawHandler;
   std::function<void()> frameEndHandler;
   bool wasInGazeMode = false;
@@ -206,10 +373,12 @@ struct BrowserWorld::State {
 #endif
 
   State() : paused(true), glInitialized(false), modelsLoaded(false), env(nullptr), cylinderDensity(0.0f), nearClip(0.1f),
-            farClip(300.0f), activity(nullptr), windowsInitialized(false), exitImmersiveRequested(false), loaderDelay(0) {
+            farClip(300.0f), activity(nullptr), windowsInitialized(false), exitImmersiveRequested(false) {
     context = RenderContext::Create();
     create = context->GetRenderThreadCreationContext();
     loader = ModelLoaderAndroid::Create(context);
+    modelCache = ModelCache::Create();
+    programCache = ProgramCache::Create();
     context->GetProgramFactory()->SetLoaderThread(loader);
     rootOpaque = Transform::Create(create);
     rootTransparent = Transform::Create(create);
@@ -222,11 +391,31 @@ struct BrowserWorld::State {
     //rootTransparent->AddLight(light);
     cullVisitor = CullVisitor::Create(create);
     drawList = DrawableList::Create(create);
+    opaqueList = DrawableList::Create(create);
+    environmentList = DrawableList::Create(create);
+    videoLists[0] = DrawableList::Create(create);
+    videoLists[1] = DrawableList::Create(create);
+    controllerList = DrawableList::Create(create);
+    transparentList = DrawableList::Create(create);
     controllers = ControllerContainer::Create(create, rootTransparent, loader);
+    widgetHitTester = WidgetHitTester::Create();
     externalVR = ExternalVR::Create();
-    blitter = ExternalBlitter::Create(create);
+    blitter = ExternalBlitter::Create(create, programCache);
     fadeAnimation = FadeAnimation::Create(create);
     splashAnimation = SplashAnimation::Create(create);
+    startup = StartupGraph::Create();
+    startupGL = startup->AddTask("GL", {}, true);
+    startupCachePath = startup->AddTask("Cache path", {}, false);
+    const uint32_t startupLoader = startup->AddTask("Loader GL", {startupGL}, true);
+    startup->RunOnRenderThread(startupLoader, [this]() {
+      loader->InitializeGL();
+    });
+    const uint32_t startupPrograms = startup->AddTask("Program prewarm", {startupLoader}, false);
+    startup->RunOnRenderThread(startupPrograms, [this]() {
+      programCache->Prewarm(create);
+    });
+    startupSkybox = startup->AddTask("Skybox", {startupLoader}, true);
+    startupWidgets = startup->AddTask("First widget", {}, true);
     monitor = PerformanceMonitor::Create(create);
     monitor->AddPerformanceMonitorObserver(std::make_shared<PerformanceObserver>());
     wasInGazeMode = false;
@@ -245,12 +434,23 @@ struct BrowserWorld::State {
   void UpdateControllers(bool& aRelayoutWidgets);
   void SimulateBack();
   void ClearWebXRControllerData();
+  double GetFrameWaitDeadline(const bool aStartFramePending) const;
+  void UpdateImmersiveSubmitCost(const int64_t aWaitEnd, const int64_t aStartFrameDuration);
+  void CullWorld();
+  DeviceDelegate::EyeContent ClassifyEyeContent() const;
+  void ClearWorldLists();
+  void DrawStereo(DrawableList& aList);
   WidgetPtr GetWidget(int32_t aHandle) const;
   WidgetPtr FindWidget(const std::function<bool(const WidgetPtr&)>& aCondition) const;
   bool IsParent(const Widget& aChild, const Widget& aParent) const;
-  int ParentCount(const WidgetPtr& aWidget) const;
-  float ComputeNormalizedZ(const Widget& aWidget) const;
+  int ParentCount(const Widget& aWidget) const;
+  float ComputeNormalizedZ(const Widget& aWidget, const vrb::Vector& aHeadPosition,
+                           const vrb::Vector& aHeadDirection, const vrb::Matrix& aViewProjection) const;
+  bool NeedsWidgetSort();
   void SortWidgets();
+  void UpdateSurfaceLOD();
+  void UpdateSurfaceBudget();
+  void CullWidgetLayers();
   void UpdateWidgetCylinder(const WidgetPtr& aWidget, const float aDensity);
 };
 
@@ -396,10 +596,23 @@ BrowserWorld::State::UpdateControllers(bool& aRelayoutWidgets) {
   EnsureControllerFocused();
   int leftBatteryLevel = -1;
   int rightBatteryLevel = -1;
+
+  // Cull the widgets against all the controller rays at once.
+  widgetHitTester->Update(widgets, layoutGeneration, rootTransparent->GetTransform());
+  widgetHitTester->ClearRays();
+  for (Controller& controller: controllers->GetControllers()) {
+    if (controller.enabled && (controller.index >= 0)) {
+      widgetHitTester->AddRay(controller.StartPoint(), controller.Direction());
+    }
+  }
+  widgetHitTester->Cull();
+
+  int ray = -1;
   for (Controller& controller: controllers->GetControllers()) {
     if (!controller.enabled || (controller.index < 0)) {
       continue;
     }
+    ray++;
     if (controller.index != device->GazeModeIndex()) {
       if (controller.leftHanded) {
         leftBatteryLevel = controller.batteryLevel;
@@ -456,7 +669,11 @@ BrowserWorld::State::UpdateControllers(bool& aRelayoutWidgets) {
         hitNormal = normal;
       }
     } else if (controllers->IsVisible()){
-      for (const WidgetPtr& widget: widgets) {
+      for (size_t index = 0; index < widgetHitTester->GetWidgetCount(); ++index) {
+        if (!widgetHitTester->IsCandidate(index, ray)) {
+          continue;
+        }
+        const WidgetPtr& widget = widgetHitTester->GetWidget(index);
         if (controller.focused) {
           if (isResizing && resizingWidget != widget) {
             // Don't interact with other widgets when resizing gesture is active.
@@ -472,7 +689,7 @@ BrowserWorld::State::UpdateControllers(bool& aRelayoutWidgets) {
         float distance = 0.0f;
         bool isInWidget = false;
         const bool clamp = !widget->IsResizing() && !movingWidget;
-        if (widget->TestControllerIntersection(start, direction, result, normal, clamp, isInWidget, distance)) {
+        if (widgetHitTester->TestIntersection(index, start, direction, result, normal, clamp, isInWidget, distance)) {
           if (isInWidget && (distance < hitDistance)) {
             hitWidget = widget;
             hitDistance = distance;
@@ -506,7 +723,13 @@ BrowserWorld::State::UpdateControllers(bool& aRelayoutWidgets) {
       } else {
         WidgetPlacementPtr updatedPlacement = movingWidget->HandleMove(start, direction);
         if (updatedPlacement) {
-          movingWidget->GetWidget()->SetPlacement(updatedPlacement);
+          WidgetPtr widget = movingWidget->GetWidget();
+          // The mover updates the translation and rotation of its own placement copy.
+          const uint32_t changes = widget->GetPlacement() == updatedPlacement ? kLayoutTransform
+              : ComputeLayoutChanges(widget->GetPlacement(), updatedPlacement);
+          widget->SetPlacement(updatedPlacement);
+          widgets.UpdateParent(*widget);
+          widgets.MarkDirty((int32_t)widget->GetHandle(), changes);
           aRelayoutWidgets = true;
         }
       }
@@ -516,12 +739,8 @@ BrowserWorld::State::UpdateControllers(bool& aRelayoutWidgets) {
 
       resizingWidget = hitWidget;
       if (aResized) {
+        widgets.MarkDirty((int32_t)hitWidget->GetHandle(), kLayoutTransform);
         aRelayoutWidgets = true;
-
-        std::shared_ptr<BrowserWorld> world = self.lock();
-        if (world) {
-          world->LayoutWidget(hitWidget->GetHandle());
-        }
       }
 
       if (aResizeEnded) {
@@ -637,11 +856,106 @@ BrowserWorld::State::ClearWebXRControllerData() {
     }
 }
 
+// Returns the time until which it is worth waiting for the next WebXR frame: after
+// it there is no time left to blit and submit it before the display latches it.
+double
+BrowserWorld::State::GetFrameWaitDeadline(const bool aStartFramePending) const {
+  double submitDeadline = 0.0;
+  double displayPeriod = 0.0;
+  if (!device->GetFrameTiming(submitDeadline, displayPeriod)) {
+    return 0.0;
+  }
+  if (aStartFramePending) {
+    // The frame that will be submitted is started after the wait.
+    submitDeadline += displayPeriod;
+  }
+  const double margin = std::max(kMinSubmitMargin, std::min(immersiveSubmitCost * kSubmitMarginScale, displayPeriod * 0.5));
+  return submitDeadline - margin;
+}
+
+void
+BrowserWorld::State::UpdateImmersiveSubmitCost(const int64_t aWaitEnd, const int64_t aStartFrameDuration) {
+  const double cost = (double)(ExternalVRTransport::NowNanoseconds() - aWaitEnd - aStartFrameDuration) * 1e-9;
+  immersiveSubmitCost = immersiveSubmitCost > 0.0 ? immersiveSubmitCost * 0.9 + cost * 0.1 : cost;
+}
+
+// The scene graph does not change between the eyes, only the VR video shows a
+// different node to each eye.
+void
+BrowserWorld::State::CullWorld() {
+  CROW_PROFILE_SCOPE(Cull);
+  opaqueList->Reset();
+  rootOpaqueParent->Cull(*cullVisitor, *opaqueList);
+  environmentList->Reset();
+  if (rootEnvironment) {
+    rootEnvironment->Cull(*cullVisitor, *environmentList);
+  }
+  for (const device::Eye eye: {device::Eye::Left, device::Eye::Right}) {
+    DrawableList& list = *videoLists[device::EyeIndex(eye)];
+    list.Reset();
+    if (vrVideo) {
+      vrVideo->SelectEye(eye);
+      vrVideo->GetRoot()->Cull(*cullVisitor, list);
+    }
+  }
+  controllerList->Reset();
+  rootController->Cull(*cullVisitor, *controllerList);
+  transparentList->Reset();
+  rootTransparent->Cull(*cullVisitor, *transparentList);
+}
+
+// Walks the roots CullWorld() culled for the content that is not a compositor
+// layer. The pointers are transparent nodes but count as controller content.
+DeviceDelegate::EyeContent
+BrowserWorld::State::ClassifyEyeContent() const {
+  if (rootEnvironment || DrawsInEyeBuffer(*rootOpaqueParent) || (vrVideo && DrawsInEyeBuffer(*vrVideo->GetRoot()))) {
+    return DeviceDelegate::EyeContent::Full;
+  }
+  bool controllersVisible = DrawsInEyeBuffer(*rootController);
+  const int count = rootTransparent->GetNodeCount();
+  for (int i = 0; i < count; ++i) {
+    vrb::Node* node = rootTransparent->GetNode(i).get();
+    if (!DrawsInEyeBuffer(*node)) {
+      continue;
+    }
+    bool isPointer = false;
+    for (const Controller& controller: controllers->GetControllers()) {
+      if (controller.pointer && controller.pointer->GetRoot().get() == node) {
+        isPointer = true;
+        break;
+      }
+    }
+    if (!isPointer) {
+      return DeviceDelegate::EyeContent::Full;
+    }
+    controllersVisible = true;
+  }
+  return controllersVisible ? DeviceDelegate::EyeContent::ControllersOnly : DeviceDelegate::EyeContent::None;
+}
+
+// The lists hold on to the drawables, release them while the world is not drawn.
+void
+BrowserWorld::State::ClearWorldLists() {
+  opaqueList->Reset();
+  environmentList->Reset();
+  videoLists[0]->Reset();
+  videoLists[1]->Reset();
+  controllerList->Reset();
+  transparentList->Reset();
+}
+
+// Draws aList in the viewport of each eye.
+void
+BrowserWorld::State::DrawStereo(DrawableList& aList) {
+  device->SetEyeViewport(device::Eye::Left);
+  aList.Draw(*leftCamera);
+  device->SetEyeViewport(device::Eye::Right);
+  aList.Draw(*rightCamera);
+}
+
 WidgetPtr
 BrowserWorld::State::GetWidget(int32_t aHandle) const {
-  return FindWidget([=](const WidgetPtr& aWidget){
-    return aWidget->GetHandle() == aHandle;
-  });
+  return widgets.Get(aHandle);
 }
 
 WidgetPtr
@@ -656,75 +970,95 @@ BrowserWorld::State::FindWidget(const std::function<bool(const WidgetPtr&)>& aCo
 
 bool
 BrowserWorld::State::IsParent(const Widget& aChild, const Widget& aParent) const {
-  if (aChild.GetPlacement()->parentHandle == aParent.GetHandle()) {
-    return true;
-  }
-
-  if (aChild.GetPlacement()->parentHandle > 0) {
-    WidgetPtr next = GetWidget(aChild.GetPlacement()->parentHandle);
-    if (next) {
-      return IsParent(*next, aParent);
-    }
-  }
-
-  return false;
+  return widgets.IsParent(aChild, aParent);
 }
 
 int
-BrowserWorld::State::ParentCount(const WidgetPtr& aWidget) const {
-  int result = 0;
-  WidgetPtr current = aWidget;
-  while (current && current->GetPlacement()->parentHandle > 0) {
-    current = GetWidget(current->GetPlacement()->parentHandle);
-    if (current) {
-      result++;
-    }
-  }
-  return result;
+BrowserWorld::State::ParentCount(const Widget& aWidget) const {
+  return widgets.ParentCount(aWidget);
 }
 
 float
-BrowserWorld::State::ComputeNormalizedZ(const Widget& aWidget) const {
-  const vrb::Vector headPosition = device->GetHeadTransform().GetTranslation();
-  const vrb::Vector headDirection = device->GetHeadTransform().MultiplyDirection(vrb::Vector(0.0f, 0.0f, -1.0f));
-
+BrowserWorld::State::ComputeNormalizedZ(const Widget& aWidget, const vrb::Vector& aHeadPosition,
+                                        const vrb::Vector& aHeadDirection, const vrb::Matrix& aViewProjection) const {
   vrb::Vector hitPoint;
   vrb::Vector normal;
   bool inside = false;
   float distance;
   if (aWidget.GetQuad()) {
-    aWidget.GetQuad()->TestIntersection(headPosition, headDirection, hitPoint, normal, true, inside, distance);
+    aWidget.GetQuad()->TestIntersection(aHeadPosition, aHeadDirection, hitPoint, normal, true, inside, distance);
   } else if (aWidget.GetCylinder()) {
-    aWidget.GetCylinder()->TestIntersection(headPosition, headDirection, hitPoint, normal, true, inside, distance);
+    aWidget.GetCylinder()->TestIntersection(aHeadPosition, aHeadDirection, hitPoint, normal, true, inside, distance);
   }
 
-  const vrb::Matrix& projection = device->GetCamera(device::Eye::Left)->GetPerspective();
-  const vrb::Matrix& view = device->GetCamera(device::Eye::Left)->GetView();
-  vrb::Matrix viewProjection = projection.PostMultiply(view);
-
-  vrb::Vector ndc = viewProjection.MultiplyPosition(hitPoint);
+  vrb::Vector ndc = aViewProjection.MultiplyPosition(hitPoint);
 
   return ndc.z();
 }
 
+bool
+BrowserWorld::State::NeedsWidgetSort() {
+  // Compare the head in widget space so that recentering also triggers a sort.
+  const vrb::Matrix head = rootTransparent->GetTransform().AfineInverse().PostMultiply(device->GetHeadTransform());
+  // Widgets being resized or moved change every frame.
+  bool result = !sortValid || layoutGeneration != sortedLayoutGeneration || widgetResizer || movingWidget ||
+      sortEntries.size() != (size_t)rootTransparent->GetNodeCount();
+
+  if (!result) {
+    const vrb::Vector forward(0.0f, 0.0f, -1.0f);
+    const vrb::Vector delta = head.GetTranslation() - sortedHead.GetTranslation();
+    const float direction = head.MultiplyDirection(forward).Dot(sortedHead.MultiplyDirection(forward));
+    result = delta.Magnitude() > kSortPositionThreshold || direction < kSortDirectionThreshold;
+  }
+
+  // Pointer nodes are sorted against the widget they hit.
+  size_t pointerIndex = 0;
+  for (Controller& controller: controllers->GetControllers()) {
+    if (!controller.pointer) {
+      continue;
+    }
+    Widget* target = controller.pointer->GetHitWidget().get();
+    if (pointerIndex >= sortPointerTargets.size()) {
+      sortPointerTargets.push_back(target);
+      result = true;
+    } else if (sortPointerTargets[pointerIndex] != target) {
+      sortPointerTargets[pointerIndex] = target;
+      result = true;
+    }
+    pointerIndex++;
+  }
+
+  if (result) {
+    sortValid = true;
+    sortedLayoutGeneration = layoutGeneration;
+    sortedHead = head;
+  }
+  return result;
+}
+
 void
 BrowserWorld::State::SortWidgets() {
-  depthSorting.clear();
+  if (!NeedsWidgetSort()) {
+    return;
+  }
+
+  const vrb::Matrix& head = device->GetHeadTransform();
+  const vrb::Vector headPosition = head.GetTranslation();
+  const vrb::Vector headDirection = head.MultiplyDirection(vrb::Vector(0.0f, 0.0f, -1.0f));
+  const CameraPtr camera = device->GetCamera(device::Eye::Left);
+  const vrb::Matrix viewProjection = camera->GetPerspective().PostMultiply(camera->GetView());
 
-  // Compute normalized z for each widget
-  for (int i = 0; i < rootTransparent->GetNodeCount(); ++i) {
-    vrb::NodePtr node = rootTransparent->GetNode(i);
-    Widget * target = nullptr;
+  // Compute the sort key of each node. Nodes are still in last frame's order,
+  // so sorting them is close to linear.
+  const int nodeCount = rootTransparent->GetNodeCount();
+  sortEntries.clear();
+  for (int i = 0; i < nodeCount; ++i) {
+    vrb::Node* node = rootTransparent->GetNode(i).get();
+    Widget * target = widgets.FindByRoot(node);
     float zDelta = 0.0f;
-    for (const auto & widget: widgets) {
-      if (widget->GetRoot() == node) {
-        target = widget.get();
-        break;
-      }
-    }
     if (!target) {
       for (Controller& controller: controllers->GetControllers()) {
-        if (controller.pointer && controller.pointer->GetRoot() == node) {
+        if (controller.pointer && controller.pointer->GetRoot().get() == node) {
           target = controller.pointer->GetHitWidget().get();
           zDelta = 0.02f;
           break;
@@ -732,41 +1066,169 @@ BrowserWorld::State::SortWidgets() {
       }
     }
 
-    if (!target && widgetResizer && widgetResizer->GetRoot() == node) {
+    if (!target && widgetResizer && widgetResizer->GetRoot().get() == node) {
       target = widgetResizer->GetWidget();
       zDelta = 0.01f;
     }
 
-    if (!target || !target->IsVisible()) {
-      depthSorting.emplace(node.get(), std::make_pair(target, 1.0f));
-      continue;
+    TransparentSortEntry entry = {std::numeric_limits<uint64_t>::max(), node, nullptr, 0};
+    if (target && target->IsVisible()) {
+      const float z = ComputeNormalizedZ(*target, headPosition, headDirection, viewProjection) - zDelta;
+      entry.key = PackTransparentSortKey(target->GetPlacement()->layerPriority, z);
+      entry.widget = target;
+      entry.depth = ParentCount(*target);
     }
+    sortEntries.push_back(entry);
+  }
 
-    const float z = ComputeNormalizedZ(*target) - zDelta;
+  const bool changed = SortTransparentEntries(sortEntries, [this](const Widget& aChild, const Widget& aParent) {
+    return IsParent(aChild, aParent);
+  });
+  if (!changed) {
+    return;
+  }
 
-    depthSorting.emplace(node.get(), std::make_pair(target, z));
+  // Apply the new order. Each node is mapped to its position through a
+  // pointer-sorted table so the comparator is a binary search.
+  sortPositions.clear();
+  for (size_t i = 0; i < sortEntries.size(); ++i) {
+    sortPositions.push_back({(uint64_t)i, sortEntries[i].node});
   }
+  std::sort(sortPositions.begin(), sortPositions.end(), [](const TransparentSortPosition& a, const TransparentSortPosition& b) {
+    return a.node < b.node;
+  });
+  auto position = [this](const vrb::Node* aNode) -> uint64_t {
+    auto it = std::lower_bound(sortPositions.begin(), sortPositions.end(), aNode, [](const TransparentSortPosition& a, const vrb::Node* b) {
+      return a.node < b;
+    });
+    return it != sortPositions.end() && it->node == aNode ? it->position : std::numeric_limits<uint64_t>::max();
+  };
+  rootTransparent->SortNodes([&position](const NodePtr& a, const NodePtr& b) {
+    return position(a.get()) < position(b.get());
+  });
+}
 
-  // Sort nodes based on cached depth values
-  rootTransparent->SortNodes([=](const NodePtr& a, const NodePtr& b) {
-    auto da = depthSorting.find(a.get());
-    auto db = depthSorting.find(b.get());
-    Widget* wa = da->second.first;
-    Widget* wb = db->second.first;
+// Sizes the layer surfaces of the widgets to the resolution they need at the
+// current distance, see WidgetPlacement::textureLOD. A resize recreates the
+// layer surface and has Java paint the widget again at the new size, so at
+// most one surface is resized per frame.
+void
+BrowserWorld::State::UpdateSurfaceLOD() {
+  const float pixelsPerDegree = device->GetPixelsPerDegree();
+  if (pixelsPerDegree <= 0.0f) {
+    return;
+  }
+  const float pixelsPerRadian = pixelsPerDegree * 180.0f / (float)M_PI;
+  const vrb::Matrix& head = device->GetHeadTransform();
+  const vrb::Vector headPosition = head.GetTranslation();
+  const vrb::Vector headDirection = head.MultiplyDirection(vrb::Vector(0.0f, 0.0f, -1.0f));
+  const double now = context->GetTimestamp();
+  for (const WidgetPtr& widget: widgets) {
+    if (!widget->GetLayer() || !widget->IsVisible() || widget->IsResizing() ||
+        (movingWidget && movingWidget->GetWidget() == widget)) {
+      continue;
+    }
+    const float required = widget->GetPlacement()->textureLOD ?
+        RequiredSurfaceScale(*widget, headPosition, headDirection, pixelsPerRadian) : 1.0f;
+    const float current = widget->GetSurfaceScale();
+    const float scale = surfaceLOD.Update((int32_t)widget->GetHandle(), current, required, now);
+    if (scale != current) {
+      VRB_DEBUG("Widget %u surface scale %.2f -> %.2f", widget->GetHandle(), current, scale);
+      widget->SetSurfaceScale(scale);
+      break;
+    }
+  }
+}
 
-    // Parenting or layer priority sort
-    if (wa && wb && wa->IsVisible() && wb->IsVisible()) {
-      if (IsParent(*wa, *wb)) {
-        return true;
-      } else if (IsParent(*wb, *wa)) {
-        return false;
-      } else if (wa->GetPlacement()->layerPriority != wb->GetPlacement()->layerPriority) {
-        return wa->GetPlacement()->layerPriority > wb->GetPlacement()->layerPriority;
+// Releases the layer surfaces of the widgets hidden the longest while the
+// surfaces take more memory than the budget, one per frame, and creates them
+// again when the widgets are shown. The snapshot Java sends for a released
+// widget is drawn until its new surface is painted.
+void
+BrowserWorld::State::UpdateSurfaceBudget() {
+  if (surfaceBudget.GetBudget() <= 0 && releasedSurfaces.empty()) {
+    return;
+  }
+  const double now = context->GetTimestamp();
+  for (const WidgetPtr& widget: widgets) {
+    VRLayerSurfacePtr layer = widget->GetLayer();
+    if (!layer) {
+      continue;
+    }
+    const int32_t handle = (int32_t)widget->GetHandle();
+    const bool shown = widget->IsVisible();
+    auto released = releasedSurfaces.find(handle);
+    if (released != releasedSurfaces.end() && (shown || layer->GetSurface() || surfaceBudget.GetBudget() <= 0)) {
+      // The surface may also have been created again by a layer move.
+      releasedSurfaces.erase(released);
+      if (!layer->GetSurface()) {
+        VRB_DEBUG("Widget %d surface restored", handle);
+        widget->RecreateSurface();
       }
+      released = releasedSurfaces.end();
     }
+    const bool holdsSurface = released == releasedSurfaces.end();
+    surfaceBudget.Update(handle, holdsSurface ? layer->GetWidth() : 0, holdsSurface ? layer->GetHeight() : 0, shown, now);
+  }
 
-    // Depth sort
-    return da->second.second < db->second.second;
+  const int32_t handle = surfaceBudget.PickEviction(now);
+  WidgetPtr widget = handle >= 0 ? GetWidget(handle) : nullptr;
+  if (!widget) {
+    return;
+  }
+  if (widget->IsResizing() || (movingWidget && movingWidget->GetWidget() == widget) ||
+      !device->ReleaseLayerSurface(widget->GetLayer())) {
+    surfaceBudget.Defer(handle, now);
+    return;
+  }
+  VRB_DEBUG("Widget %d surface released, %lld bytes in use", handle, (long long)surfaceBudget.GetUsedBytes());
+  releasedSurfaces.insert(handle);
+  surfaceBudget.Update(handle, 0, 0, false, now);
+}
+
+// Skips the layers of the widgets that neither eye sees in this frame, and tells
+// Java which widgets stay out of view so that it can throttle them. Drawing the
+// frame requests the widget layers, so this runs between drawing and EndFrame.
+void
+BrowserWorld::State::CullWidgetLayers() {
+  // The VR video projection may be fed by a window layer.
+  if (vrVideo || !leftCamera || !rightCamera) {
+    return;
+  }
+  visibility.Begin(*leftCamera, *rightCamera);
+  for (const WidgetPtr& widget: widgets) {
+    if (!widget->IsVisible()) {
+      continue;
+    }
+    vrb::Vector min, max;
+    widget->GetWidgetMinAndMax(min, max);
+    visibility.Add((int32_t)widget->GetHandle(), widget->GetTransformNode()->GetWorldTransform(), min, max,
+                   widget->GetQuad() != nullptr, widget->GetPlacement()->opaque);
+  }
+  visibility.End(context->GetTimestamp());
+
+  int32_t outsideFrustum = 0;
+  int32_t occluded = 0;
+  for (const WidgetPtr& widget: widgets) {
+    VRLayerSurfacePtr layer = widget->GetLayer();
+    if (!layer || !layer->IsDrawRequested()) {
+      continue;
+    }
+    const WidgetVisibility::Result result = visibility.GetResult((int32_t)widget->GetHandle());
+    if (result == WidgetVisibility::Result::OutsideFrustum) {
+      layer->ClearRequestDraw();
+      outsideFrustum++;
+    } else if (result == WidgetVisibility::Result::Occluded) {
+      layer->ClearRequestDraw();
+      occluded++;
+    }
+  }
+  CROW_PROFILE_COUNTER(OutsideFrustumLayers, outsideFrustum);
+  CROW_PROFILE_COUNTER(OccludedLayers, occluded);
+
+  visibility.ReportChanges([](const int32_t aHandle, const bool aOnScreen) {
+    VRB_DEBUG("Widget %d is %s", aHandle, aOnScreen ? "on screen" : "off screen");
+    return VRBrowser::HandleWidgetOnScreen(aHandle, (jboolean)aOnScreen);
   });
 }
 
@@ -847,6 +1309,7 @@ BrowserWorld::Pause() {
   m.paused = true;
   m.externalVR->OnPause();
   m.monitor->Pause();
+  CROW_PROFILE_DUMP();
 }
 
 void
@@ -886,12 +1349,36 @@ BrowserWorld::InitializeJava(JNIEnv* aEnv, jobject& aActivity, jobject& aAssetMa
   VRBrowser::InitializeJava(m.env, m.activity);
   GeckoSurfaceTexture::InitializeJava(m.env, m.activity);
   m.loader->InitializeJava(aEnv, aActivity, aAssetManager);
+  m.modelCache->InitializeJava(aEnv, aAssetManager);
+  // The programs linked in InitializeGL() and the first meshes would miss the
+  // caches if they waited for setTemporaryFilePath().
+  const std::string cachePath = VRBrowser::GetCacheAbsolutePath();
+  if (!cachePath.empty()) {
+    m.modelCache->SetCachePath(cachePath);
+    m.programCache->SetCachePath(cachePath);
+  }
   VRBrowser::RegisterExternalContext((jlong)m.externalVR->GetSharedData());
   VRBrowser::SetDeviceType(m.device->GetDeviceType());
 
   if (!m.modelsLoaded) {
     m.device->OnControllersReady([this](){
       const int32_t modelCount = m.device->GetControllerModelCount();
+      std::vector<std::string> fileNames;
+      for (int32_t index = 0; index < modelCount; index++) {
+        if (!m.device->GetControllerModelTask(index)) {
+          fileNames.push_back(m.device->GetControllerModelName(index));
+        }
+      }
+      // Parsed on a worker while the loader thread is busy with the skybox.
+      const uint32_t meshes = m.startup->AddTask("Controller meshes", {m.startupCachePath}, false);
+      ModelCachePtr modelCache = m.modelCache;
+      m.startup->RunOnWorker(meshes, [modelCache, fileNames]() {
+        for (const std::string& fileName: fileNames) {
+          if (!fileName.empty()) {
+            modelCache->Prepare(fileName);
+          }
+        }
+      });
       for (int32_t index = 0; index < modelCount; index++) {
         vrb::LoadTask task = m.device->GetControllerModelTask(index);
         if (task) {
@@ -903,7 +1390,7 @@ BrowserWorld::InitializeJava(JNIEnv* aEnv, jobject& aActivity, jobject& aAssetMa
         } else {
           const std::string fileName = m.device->GetControllerModelName(index);
           if (!fileName.empty()) {
-            m.controllers->LoadControllerModel(index, m.loader, fileName);
+            m.controllers->LoadControllerModel(index, m.loader, m.modelCache, fileName);
           }
         }
       }
@@ -944,10 +1431,9 @@ BrowserWorld::InitializeGL() {
       if (m.splashAnimation) {
         m.splashAnimation->Load(m.context, m.device);
       }
-      // delay the m.loader->InitializeGL() call to fix some issues with Daydream activities
-      m.loaderDelay = 3;
+      m.startup->Finish(m.startupGL);
       SurfaceTextureFactoryPtr factory = m.context->GetSurfaceTextureFactory();
-      for (WidgetPtr& widget: m.widgets) {
+      for (const WidgetPtr& widget: m.widgets) {
         const std::string name = widget->GetSurfaceTextureName();
         jobject surface = factory->LookupSurfaceTexture(name);
         if (surface) {
@@ -1042,19 +1528,21 @@ BrowserWorld::StartFrame() {
       return;
     }
   }
-  if (m.loaderDelay > 0) {
-    m.loaderDelay--;
-    if (m.loaderDelay == 0) {
-      m.loader->InitializeGL();
-    }
-  }
+  m.startup->Update();
 
+  CROW_PROFILE_BEGIN_FRAME();
 #if defined(OCULUSVR) && STORE_BUILD == 1
   ProcessOVRPlatformEvents();
 #endif
-  m.device->ProcessEvents();
+  {
+    CROW_PROFILE_SCOPE(ProcessEvents);
+    m.device->ProcessEvents();
+  }
   m.context->Update();
-  m.externalVR->PullBrowserState();
+  {
+    CROW_PROFILE_SCOPE(PullBrowserState);
+    m.externalVR->PullBrowserState();
+  }
   m.externalVR->SetHapticState(m.controllers);
 
   const uint64_t frameId = m.externalVR->GetFrameId();
@@ -1069,12 +1557,16 @@ BrowserWorld::StartFrame() {
   } else {
     bool relayoutWidgets = false;
     m.UpdateGazeModeState();
-    m.UpdateControllers(relayoutWidgets);
-    if (relayoutWidgets) {
-      UpdateVisibleWidgets();
+    {
+      CROW_PROFILE_SCOPE(UpdateControllers);
+      m.UpdateControllers(relayoutWidgets);
+      if (relayoutWidgets) {
+        LayoutDirtyWidgets();
+      }
     }
     TickWorld();
     m.externalVR->PushSystemState();
+    m.startup->FirstInteractiveFrame();
   }
 }
 
@@ -1082,11 +1574,19 @@ void
 BrowserWorld::EndFrame() {
   ASSERT_ON_RENDER_THREAD();
 
-  if (m.frameEndHandler) {
-    m.frameEndHandler();
-    m.frameEndHandler = nullptr;
-  } else {
-    m.device->EndFrame();
+  if (m.cullWidgetLayers) {
+    m.cullWidgetLayers = false;
+    m.CullWidgetLayers();
+  }
+
+  {
+    CROW_PROFILE_SCOPE(DeviceEndFrame);
+    if (m.frameEndHandler) {
+      m.frameEndHandler();
+      m.frameEndHandler = nullptr;
+    } else {
+      m.device->EndFrame();
+    }
   }
   m.drawHandler = nullptr;
 
@@ -1095,6 +1595,8 @@ BrowserWorld::EndFrame() {
   const vrb::Vector p = head.GetTranslation();
   const vrb::Quaternion q(head);
   VRBrowser::HandleAudioPose(q.x(), q.y(), q.z(), q.w(), p.x(), p.y(), p.z());
+  VRBrowser::FlushEvents();
+  CROW_PROFILE_END_FRAME();
 }
 
 void
@@ -1110,31 +1612,23 @@ BrowserWorld::SetTemporaryFilePath(const std::string& aPath) {
   ASSERT_ON_RENDER_THREAD();
   VRB_LOG("Got temp path: %s", aPath.c_str());
   m.context->GetDataCache()->SetCachePath(aPath);
+  m.modelCache->SetCachePath(aPath);
+  m.programCache->SetCachePath(aPath);
+  m.startup->Finish(m.startupCachePath);
+  CROW_PROFILE_SET_TRACE_PATH(aPath + "/frame_trace.json");
 }
 
 void
 BrowserWorld::UpdateEnvironment() {
   ASSERT_ON_RENDER_THREAD();
   std::string skyboxPath = VRBrowser::GetActiveEnvironment();
-  std::string extension = Skybox::ValidateCustomSkyboxAndFindFileExtension(skyboxPath);
+  std::string overridePath;
   if (VRBrowser::isOverrideEnvPathEnabled()) {
-    std::string storagePath = VRBrowser::GetStorageAbsolutePath(INJECT_SKYBOX_PATH);
-    if (std::ifstream(storagePath)) {
-      skyboxPath = storagePath;
-      extension = Skybox::ValidateCustomSkyboxAndFindFileExtension(storagePath);
-      if (!extension.empty()) {
-        skyboxPath = storagePath;
-        VRB_DEBUG("Found custom skybox file extension: %s", extension.c_str());
-      } else {
-        VRB_ERROR("Failed to find custom skybox files.");
-      }
-    } else {
-      VRB_ERROR("Failed to find override skybox storage path %s", storagePath.c_str());
-    }
+    overridePath = VRBrowser::GetStorageAbsolutePath(INJECT_SKYBOX_PATH);
   }
 
   VRB_LOG("Setting environment: %s", skyboxPath.c_str());
-  CreateSkyBox(skyboxPath, extension);
+  CreateSkyBox(skyboxPath, overridePath);
 }
 
 void
@@ -1210,7 +1704,7 @@ BrowserWorld::AddWidget(int32_t aHandle, const WidgetPlacementPtr& aPlacement) {
         break;
   }
 
-  m.widgets.push_back(widget);
+  m.widgets.Add(widget);
   UpdateWidget(widget->GetHandle(), aPlacement);
 }
 
@@ -1222,44 +1716,27 @@ BrowserWorld::UpdateWidget(int32_t aHandle, const WidgetPlacementPtr& aPlacement
       VRB_ERROR("Can't find Widget with handle: %d", aHandle);
       return;
   }
-
-  int32_t oldWidth = 0;
-  int32_t oldHeight = 0;
-  if (widget->GetPlacement()) {
-      oldWidth = widget->GetPlacement()->width;
-      oldHeight = widget->GetPlacement()->height;
-  }
-
-  widget->SetPlacement(aPlacement);
-  m.UpdateWidgetCylinder(widget, m.cylinderDensity);
-  widget->ToggleWidget(aPlacement->visible);
-  widget->SetSurfaceTextureSize(aPlacement->GetTextureWidth(), aPlacement->GetTextureHeight());
-
-  float worldWidth = 0.0f, worldHeight = 0.0f;
-  widget->GetWorldSize(worldWidth, worldHeight);
-
-  float newWorldWidth = aPlacement->worldWidth;
-  if (newWorldWidth <= 0.0f) {
-    newWorldWidth = aPlacement->width * WidgetPlacement::kWorldDPIRatio;
+  const WidgetPlacementPtr& current = widget->GetPlacement();
+  if (current && aPlacement->version && current->version == aPlacement->version) {
+    // Java sent a placement that is already applied.
+    return;
   }
-
-  if (newWorldWidth != worldWidth || oldWidth != aPlacement->width || oldHeight != aPlacement->height) {
-    widget->SetWorldWidth(newWorldWidth);
+  if (current && !aPlacement->hasName) {
+    // The name is only sent when it changes.
+    aPlacement->name = current->name;
   }
 
-  widget->SetBorderColor(vrb::Color(aPlacement->borderColor));
-  widget->SetProxifyLayer(aPlacement->proxifyLayer);
-  LayoutWidget(aHandle);
+  const uint32_t changes = ComputeLayoutChanges(current, aPlacement);
+  widget->SetPlacement(aPlacement);
+  m.widgets.UpdateParent(*widget);
+  m.widgets.MarkDirty(aHandle, changes);
+  LayoutDirtyWidgets();
 }
 
 void
 BrowserWorld::UpdateWidgetRecursive(int32_t aHandle, const WidgetPlacementPtr& aPlacement) {
+  // Children of the updated widget are laid out again by LayoutDirtyWidgets.
   UpdateWidget(aHandle, aPlacement);
-  for (WidgetPtr& widget: m.widgets) {
-    if (widget->GetPlacement() && widget->GetPlacement()->parentHandle == aHandle) {
-      UpdateWidgetRecursive(widget->GetHandle(), widget->GetPlacement());
-    }
-  }
 }
 
 void
@@ -1269,10 +1746,12 @@ BrowserWorld::RemoveWidget(int32_t aHandle) {
   if (widget) {
     widget->ResetFirstDraw();
     widget->GetRoot()->RemoveFromParents();
-    auto it = std::find(m.widgets.begin(), m.widgets.end(), widget);
-    if (it != m.widgets.end()) {
-      m.widgets.erase(it);
-    }
+    m.widgets.Remove(aHandle);
+    m.surfaceLOD.Remove(aHandle);
+    m.surfaceBudget.Remove(aHandle);
+    m.releasedSurfaces.erase(aHandle);
+    m.visibility.Remove(aHandle);
+    m.layoutGeneration++;
     if (widget->GetLayer()) {
       m.device->DeleteLayer(widget->GetLayer());
     }
@@ -1288,6 +1767,26 @@ BrowserWorld::RecreateWidgetSurface(int32_t aHandle) {
   }
 }
 
+void
+BrowserWorld::SetSurfaceMemoryBudget(const int64_t aBytes) {
+  ASSERT_ON_RENDER_THREAD();
+  m.surfaceBudget.SetBudget(aBytes);
+}
+
+void
+BrowserWorld::SetWidgetSnapshot(int32_t aHandle, std::unique_ptr<uint8_t[]>& aPixels, const size_t aSize,
+                                const int32_t aWidth, const int32_t aHeight) {
+  ASSERT_ON_RENDER_THREAD();
+  WidgetPtr widget = m.GetWidget(aHandle);
+  // The surface may already be back.
+  if (!widget || !m.releasedSurfaces.count(aHandle)) {
+    return;
+  }
+  vrb::TextureGLPtr texture = vrb::TextureGL::Create(m.create);
+  texture->SetImageData(aPixels, aSize, aWidth, aHeight, GL_RGBA);
+  widget->SetSnapshot(texture, aWidth, aHeight);
+}
+
 void
 BrowserWorld::StartWidgetResize(int32_t aHandle, const vrb::Vector& aMaxSize, const vrb::Vector& aMinSize) {
   ASSERT_ON_RENDER_THREAD();
@@ -1366,23 +1865,12 @@ BrowserWorld::FinishWidgetMove() {
 void
 BrowserWorld::UpdateVisibleWidgets() {
   ASSERT_ON_RENDER_THREAD();
-
-  std::vector<WidgetPtr> widgets = m.widgets;
-  // Sort by parent before updating.
-  std::sort(widgets.begin(), widgets.end(), [=](const WidgetPtr& a, const WidgetPtr& b) {
-    int parentsA = m.ParentCount(a);
-    int parentsB = m.ParentCount(b);
-    if (parentsA != parentsB) {
-      return parentsA < parentsB;
-    }
-    return m.IsParent(*b, *a);
-  });
-
-  for (const WidgetPtr& widget: widgets) {
+  for (const WidgetPtr& widget: m.widgets) {
     if (widget->IsVisible() && !widget->IsResizing()) {
-      UpdateWidget(widget->GetHandle(), widget->GetPlacement());
+      m.widgets.MarkDirty((int32_t)widget->GetHandle(), kLayoutAll);
     }
   }
+  LayoutDirtyWidgets();
 }
 
 void
@@ -1435,6 +1923,7 @@ BrowserWorld::LayoutWidget(int32_t aHandle) {
     translation = transform.GetTranslation();
   }
   widget->SetTransform(parent ? parent->GetTransform().PostMultiply(transform) : transform);
+  m.layoutGeneration++;
 
   if (!widget->GetCylinder()) {
     widget->LayoutQuadWithCylinderParent(parent);
@@ -1513,9 +2002,10 @@ BrowserWorld::RecenterUIYaw(const YawTarget aTarget) {
 void
 BrowserWorld::SetCylinderDensity(const float aDensity) {
   m.cylinderDensity = aDensity;
-  for (WidgetPtr& widget: m.widgets) {
+  for (const WidgetPtr& widget: m.widgets) {
     m.UpdateWidgetCylinder(widget, aDensity);
   }
+  m.layoutGeneration++;
 }
 
 void
@@ -1566,7 +2056,12 @@ BrowserWorld::TickWorld() {
     m.skybox->SetTransform(vrb::Matrix::Translation(headPosition));
   }
 
-  m.SortWidgets();
+  {
+    CROW_PROFILE_SCOPE(SortWidgets);
+    m.SortWidgets();
+  }
+  m.UpdateSurfaceLOD();
+  m.UpdateSurfaceBudget();
   m.device->StartFrame();
   m.rootOpaque->SetTransform(m.device->GetReorientTransform());
   m.rootTransparent->SetTransform(m.device->GetReorientTransform().PostMultiply(m.widgetsYaw));
@@ -1577,20 +2072,97 @@ BrowserWorld::TickWorld() {
     m.vrVideo->SetReorientTransform(m.device->GetReorientTransform());
   }
 
-  m.drawHandler = [=](device::Eye aEye) {
-    DrawWorld(aEye);
-  };
+  m.CullWorld();
+  DeviceDelegate::EyeContent eyeContent = DeviceDelegate::EyeContent::Full;
+  if (m.device->SupportsEyeContent()) {
+    eyeContent = m.ClassifyEyeContent();
+    m.device->SetEyeContent(eyeContent);
+  }
+  m.cullWidgetLayers = true;
+
+  if (eyeContent == DeviceDelegate::EyeContent::None) {
+    // The device skips the eye buffers, so there is no render target to draw into.
+    m.drawHandler = nullptr;
+  } else if (m.device->SupportsSinglePassStereo() && !m.layerEnvironment) {
+    // The environment projection layer has a render target per eye.
+    m.drawHandler = [=](device::Eye aEye) {
+      if (aEye == device::Eye::Left) {
+        DrawWorldStereo();
+      }
+    };
+  } else {
+    m.drawHandler = [=](device::Eye aEye) {
+      DrawWorld(aEye);
+    };
+  }
+}
+
+// Applies the pending layout dirty flags. Widgets are visited parents first so
+// that a change in a parent's transform, size or geometry is propagated as a
+// transform change to its whole subtree, and only to it.
+void
+BrowserWorld::LayoutDirtyWidgets() {
+  if (!m.widgets.HasDirty()) {
+    return;
+  }
+  // Applying a layout does not change the hierarchy, so the order stays valid.
+  for (const WidgetPtr& widget: m.widgets.GetParentFirstOrder()) {
+    const int32_t handle = (int32_t)widget->GetHandle();
+    uint32_t changes = m.widgets.GetDirty(handle);
+    if (m.widgets.GetDirty(widget->GetPlacement()->parentHandle) & kLayoutParentMask) {
+      changes |= kLayoutTransform;
+      m.widgets.MarkDirty(handle, kLayoutTransform);
+    }
+    if (changes) {
+      ApplyWidgetLayout(widget, changes);
+    }
+  }
+  m.widgets.ClearDirty();
+}
+
+void
+BrowserWorld::ApplyWidgetLayout(const WidgetPtr& aWidget, const uint32_t aFlags) {
+  const WidgetPlacementPtr& placement = aWidget->GetPlacement();
+  if (aFlags & (kLayoutCylinder | kLayoutSize)) {
+    m.UpdateWidgetCylinder(aWidget, m.cylinderDensity);
+  }
+  if (aFlags & kLayoutPlacement) {
+    aWidget->ToggleWidget(placement->visible);
+  }
+  if (aFlags & kLayoutSize) {
+    aWidget->SetSurfaceTextureSize(placement->GetTextureWidth(), placement->GetTextureHeight());
+
+    float worldWidth = 0.0f, worldHeight = 0.0f;
+    aWidget->GetWorldSize(worldWidth, worldHeight);
+
+    float newWorldWidth = placement->worldWidth;
+    if (newWorldWidth <= 0.0f) {
+      newWorldWidth = placement->width * WidgetPlacement::kWorldDPIRatio;
+    }
+
+    if (newWorldWidth != worldWidth || (aFlags & kLayoutResized)) {
+      aWidget->SetWorldWidth(newWorldWidth);
+    }
+  }
+  if (aFlags & kLayoutPlacement) {
+    aWidget->SetBorderColor(vrb::Color(placement->borderColor));
+    aWidget->SetProxifyLayer(placement->proxifyLayer);
+    // Visibility and layer priority are part of the transparent sort.
+    m.layoutGeneration++;
+  }
+  if (aFlags & (kLayoutSize | kLayoutTransform | kLayoutCylinder)) {
+    LayoutWidget((int32_t)aWidget->GetHandle());
+  }
 }
 
 void
 BrowserWorld::DrawWorld(device::Eye aEye) {
+  CROW_PROFILE_SCOPE(CullDraw);
   const CameraPtr camera = aEye == device::Eye::Left ? m.leftCamera : m.rightCamera;
   m.device->BindEye(aEye);
 
   // Draw skybox
-  m.drawList->Reset();
-  m.rootOpaqueParent->Cull(*m.cullVisitor, *m.drawList);
-  m.drawList->Draw(*camera);
+  m.opaqueList->Draw(*camera);
 
   // Draw environment if available
   if (m.layerEnvironment) {
@@ -1601,9 +2173,7 @@ BrowserWorld::DrawWorld(device::Eye aEye) {
 
   }
   if (m.rootEnvironment) {
-    m.drawList->Reset();
-    m.rootEnvironment->Cull(*m.cullVisitor, *m.drawList);
-    m.drawList->Draw(*camera);
+    m.environmentList->Draw(*camera);
   }
   if (m.layerEnvironment) {
     m.layerEnvironment->Unbind();
@@ -1612,24 +2182,49 @@ BrowserWorld::DrawWorld(device::Eye aEye) {
   // Draw equirect video
   if (m.vrVideo) {
     m.vrVideo->SelectEye(aEye);
-    m.drawList->Reset();
-    m.vrVideo->GetRoot()->Cull(*m.cullVisitor, *m.drawList);
-    m.drawList->Draw(*camera);
+    m.videoLists[device::EyeIndex(aEye)]->Draw(*camera);
   }
 
   // Draw controllers
-  m.drawList->Reset();
-  m.rootController->Cull(*m.cullVisitor, *m.drawList);
-  m.drawList->Draw(*camera);
+  m.controllerList->Draw(*camera);
   VRB_GL_CHECK(glDepthMask(GL_FALSE));
-  m.drawList->Reset();
-  m.rootTransparent->Cull(*m.cullVisitor, *m.drawList);
-  m.drawList->Draw(*camera);
+  m.transparentList->Draw(*camera);
+  VRB_GL_CHECK(glDepthMask(GL_TRUE));
+}
+
+// Same passes as DrawWorld() for both eyes at once, without switching render targets.
+void
+BrowserWorld::DrawWorldStereo() {
+  CROW_PROFILE_SCOPE(CullDraw);
+  m.device->BindStereoTarget();
+
+  // Draw skybox
+  m.DrawStereo(*m.opaqueList);
+
+  // Draw environment if available
+  if (m.rootEnvironment) {
+    m.DrawStereo(*m.environmentList);
+  }
+
+  // Draw equirect video, each eye shows its own half of the video.
+  if (m.vrVideo) {
+    for (const device::Eye eye: {device::Eye::Left, device::Eye::Right}) {
+      m.vrVideo->SelectEye(eye);
+      m.device->SetEyeViewport(eye);
+      m.videoLists[device::EyeIndex(eye)]->Draw(eye == device::Eye::Left ? *m.leftCamera : *m.rightCamera);
+    }
+  }
+
+  // Draw controllers
+  m.DrawStereo(*m.controllerList);
+  VRB_GL_CHECK(glDepthMask(GL_FALSE));
+  m.DrawStereo(*m.transparentList);
   VRB_GL_CHECK(glDepthMask(GL_TRUE));
 }
 
 void
 BrowserWorld::TickImmersive() {
+  m.ClearWorldLists();
   m.externalVR->SetCompositorEnabled(false);
   m.device->SetRenderMode(device::RenderMode::Immersive);
 
@@ -1648,7 +2243,14 @@ BrowserWorld::TickImmersive() {
   }
   int32_t surfaceHandle, textureWidth, textureHeight = 0;
   device::EyeRect leftEye, rightEye;
-  bool aDiscardFrame = !m.externalVR->WaitFrameResult();
+  ExternalVR::FrameResult frameResult;
+  {
+    CROW_PROFILE_SCOPE(WaitFrameResult);
+    const bool startFramePending = framePrediction == DeviceDelegate::FramePrediction::ONE_FRAME_AHEAD;
+    frameResult = m.externalVR->WaitFrameResult(m.GetFrameWaitDeadline(startFramePending));
+  }
+  const int64_t waitEnd = ExternalVRTransport::NowNanoseconds();
+  int64_t startFrameDuration = 0;
   m.externalVR->GetFrameResult(surfaceHandle, textureWidth, textureHeight, leftEye, rightEye);
   ExternalVR::VRState state = m.externalVR->GetVRState();
   if (supportsFrameAhead) {
@@ -1660,17 +2262,31 @@ BrowserWorld::TickImmersive() {
       } else {
           // Predict poses for one frame ahead and push the data to shmem so Gecko
           // can start the next XR RAF ASAP.
+          const int64_t startFrameBegin = ExternalVRTransport::NowNanoseconds();
           m.device->StartFrame(framePrediction);
+          startFrameDuration = ExternalVRTransport::NowNanoseconds() - startFrameBegin;
       }
       m.externalVR->PushFramePoses(m.device->GetHeadTransform(), m.controllers->GetControllers(),
               m.context->GetTimestamp());
   }
   if (state == ExternalVR::VRState::Rendering) {
-    if (!aDiscardFrame) {
+    const bool missedFrame = frameResult == ExternalVR::FrameResult::Missed;
+    bool repeatFrame = false;
+    if (missedFrame) {
+      // Draw the last frame again instead of leaving the eye buffers empty, the
+      // compositor reprojects it to the current head pose.
+      repeatFrame = m.webXRInterstialState == WebXRInterstialState::HIDDEN && m.blitter->StartRepeatFrame();
+      m.externalVR->CountMissedFrame(repeatFrame);
+      if (repeatFrame) {
+        m.drawHandler = [=](device::Eye aEye) {
+            DrawImmersive(aEye);
+        };
+      }
+    } else {
       if (textureWidth > 0 && textureHeight > 0) {
         m.device->SetImmersiveSize((uint32_t) textureWidth/2, (uint32_t) textureHeight);
       }
-      m.blitter->StartFrame(surfaceHandle, leftEye, rightEye);
+      m.blitter->StartFrame(surfaceHandle, textureWidth, textureHeight, leftEye, rightEye);
       if (m.webXRInterstialState != WebXRInterstialState::HIDDEN) {
         TickWebXRInterstitial();
       } else {
@@ -1684,9 +2300,18 @@ BrowserWorld::TickImmersive() {
         };
       }
     }
+    DeviceDelegate::FrameEndMode endMode = DeviceDelegate::FrameEndMode::APPLY;
+    if (repeatFrame) {
+      endMode = DeviceDelegate::FrameEndMode::REPEAT;
+    } else if (missedFrame) {
+      endMode = DeviceDelegate::FrameEndMode::DISCARD;
+    }
     m.frameEndHandler = [=]() {
-      m.device->EndFrame(aDiscardFrame ? DeviceDelegate::FrameEndMode::DISCARD : DeviceDelegate::FrameEndMode::APPLY);
+      m.device->EndFrame(endMode);
       m.blitter->EndFrame();
+      if (!missedFrame) {
+        m.UpdateImmersiveSubmitCost(waitEnd, startFrameDuration);
+      }
     };
   } else {
     if (surfaceHandle != 0) {
@@ -1727,6 +2352,17 @@ BrowserWorld::TickSplashAnimation() {
     return;
   }
   m.device->StartFrame();
+  if (!m.startup->IsFinished(m.startupWidgets)) {
+    WidgetPtr drawn = m.FindWidget([](const WidgetPtr& aWidget) {
+      return aWidget->IsVisible() && aWidget->GetPlacement()->composited;
+    });
+    if (drawn) {
+      m.startup->Finish(m.startupWidgets);
+    }
+  }
+  if (m.startup->IsCriticalPathDone()) {
+    m.splashAnimation->SetReady();
+  }
   const bool animationFinished = m.splashAnimation->Update(m.device->GetHeadTransform());
   m.drawHandler = [=](device::Eye aEye) {
     DrawSplashAnimation(aEye);
@@ -1755,46 +2391,25 @@ BrowserWorld::DrawSplashAnimation(device::Eye aEye) {
 }
 
 void
-BrowserWorld::CreateSkyBox(const std::string& aBasePath, const std::string& aExtension) {
+BrowserWorld::CreateSkyBox(const std::string& aBasePath, const std::string& aOverridePath) {
   ASSERT_ON_RENDER_THREAD();
-  vrb::PausePerformanceMonitor pauseMonitor(*m.monitor);
-  const bool empty = aBasePath == "cubemap/void";
+  const bool empty = aBasePath == "cubemap/void" && aOverridePath.empty();
   if (empty) {
     if (m.skybox) {
-      VRLayerCubePtr layer = m.skybox->GetLayer();
-      if (layer) {
-        m.device->DeleteLayer(layer);
-      }
-      m.skybox->GetRoot()->RemoveFromParents();
-      m.skybox = nullptr;
+      m.skybox->Unload();
     }
+    m.startup->Finish(m.startupSkybox);
     return;
   }
-  const std::string extension = aExtension.empty() ? ".ktx" : aExtension;
-  GLenum glFormat = GL_RGBA8;
-  if (extension == ".ktx") {
-#if defined(OPENXR) && defined(OCULUSVR)
-    glFormat =  GL_COMPRESSED_SRGB8_ETC2;
-#else
-    glFormat =  GL_COMPRESSED_RGB8_ETC2;
-#endif
-  }
-  const int32_t size = 1024;
-  if (m.skybox) {
-    m.skybox->SetVisible(true);
-    if (m.skybox->GetLayer() && (m.skybox->GetLayer()->GetWidth() != size || m.skybox->GetLayer()->GetFormat() != glFormat)) {
-      VRLayerCubePtr oldLayer = m.skybox->GetLayer();
-      VRLayerCubePtr newLayer = m.device->CreateLayerCube(size, size, glFormat);
-      m.skybox->SetLayer(newLayer);
-      m.device->DeleteLayer(oldLayer);
-    }
-    m.skybox->Load(m.loader, aBasePath, extension);
-  } else {
-    VRLayerCubePtr layer = m.device->CreateLayerCube(size, size, glFormat);
-    m.skybox = Skybox::Create(m.create, layer);
+  if (!m.skybox) {
+    m.skybox = Skybox::Create(m.create, m.device);
+    m.skybox->SetLoadedCallback([this]() {
+      m.startup->Finish(m.startupSkybox);
+    });
     m.rootOpaqueParent->AddNode(m.skybox->GetRoot());
-    m.skybox->Load(m.loader, aBasePath, extension);
   }
+  m.skybox->SetVisible(true);
+  m.skybox->Load(m.loader, aBasePath, aOverridePath);
 }
 
 void BrowserWorld::CreateEnvironment() {
@@ -1803,7 +2418,7 @@ void BrowserWorld::CreateEnvironment() {
   m.rootEnvironment->AddLight(Light::Create(m.create));
 
   vrb::TransformPtr model = Transform::Create(m.create);
-  m.loader->LoadModel("FirefoxPlatform2_low.obj", model);
+  m.modelCache->LoadModel(m.loader, "FirefoxPlatform2_low.obj", model);
   m.rootEnvironment->AddNode(model);
   vrb::Matrix transform = vrb::Matrix::Identity();
   model->SetTransform(transform);
@@ -1824,16 +2439,16 @@ void BrowserWorld::CreateEnvironment() {
 extern "C" {
 
 JNI_METHOD(void, addWidgetNative)
-(JNIEnv* aEnv, jobject, jint aHandle, jobject aPlacement) {
-  crow::WidgetPlacementPtr placement = crow::WidgetPlacement::FromJava(aEnv, aPlacement);
+(JNIEnv* aEnv, jobject, jint aHandle, jintArray aPlacement, jstring aName) {
+  crow::WidgetPlacementPtr placement = crow::WidgetPlacement::FromJava(aEnv, aPlacement, aName);
   if (placement) {
     crow::BrowserWorld::Instance().AddWidget(aHandle, placement);
   }
 }
 
 JNI_METHOD(void, updateWidgetNative)
-(JNIEnv* aEnv, jobject, jint aHandle, jobject aPlacement) {
-  crow::WidgetPlacementPtr placement = crow::WidgetPlacement::FromJava(aEnv, aPlacement);
+(JNIEnv* aEnv, jobject, jint aHandle, jintArray aPlacement, jstring aName) {
+  crow::WidgetPlacementPtr placement = crow::WidgetPlacement::FromJava(aEnv, aPlacement, aName);
   if (placement) {
     crow::BrowserWorld::Instance().UpdateWidgetRecursive(aHandle, placement);
   }
@@ -1856,6 +2471,23 @@ JNI_METHOD(void, recreateWidgetSurfaceNative)
   crow::BrowserWorld::Instance().RecreateWidgetSurface(aHandle);
 }
 
+JNI_METHOD(void, setSurfaceMemoryBudgetNative)
+(JNIEnv*, jobject, jlong aBytes) {
+  crow::BrowserWorld::Instance().SetSurfaceMemoryBudget(aBytes);
+}
+
+JNI_METHOD(void, setWidgetSnapshotNative)
+(JNIEnv* aEnv, jobject, jint aHandle, jbyteArray aPixels, jint aWidth, jint aHeight) {
+  const jsize size = aEnv->GetArrayLength(aPixels);
+  if (aWidth <= 0 || aHeight <= 0 || size < aWidth * aHeight * 4) {
+    VRB_ERROR("Invalid snapshot of widget %d", aHandle);
+    return;
+  }
+  std::unique_ptr<uint8_t[]> pixels = std::make_unique<uint8_t[]>((size_t)size);
+  aEnv->GetByteArrayRegion(aPixels, 0, size, reinterpret_cast<jbyte*>(pixels.get()));
+  crow::BrowserWorld::Instance().SetWidgetSnapshot(aHandle, pixels, (size_t)size, aWidth, aHeight);
+}
+
 JNI_METHOD(void, startWidgetResizeNative)
 (JNIEnv*, jobject, jint aHandle, jfloat aMaxWidth, jfloat aMaxHeight, jfloat aMinWidth, jfloat aMinHeight) {
   crow::BrowserWorld::Instance().StartWidgetResize(aHandle,
@@ -1951,12 +2583,15 @@ JNI_METHOD(void, setCylinderDensityNative)
 JNI_METHOD(void, runCallbackNative)
 (JNIEnv*, jobject, jlong aCallback) {
   if (aCallback) {
-    auto func = reinterpret_cast<std::function<void()> *>((uintptr_t)aCallback);
-    (*func)();
-    delete func;
+    crow::VRBrowser::RunCallback(aCallback);
   }
 }
 
+JNI_METHOD(void, releaseNativeEventsNative)
+(JNIEnv*, jobject, jint aIndex) {
+  crow::VRBrowser::ReleaseEvents(aIndex);
+}
+
 JNI_METHOD(void, setCPULevelNative)
 (JNIEnv*, jobject, jint aCPULevel) {
   crow::BrowserWorld::Instance().SetCPULevel(static_cast<crow::device::CPULevel>(aCPULevel));
@@ -55,6 +55,9 @@ public:
   void UpdateWidgetRecursive(int32_t aHandle, const WidgetPlacementPtr& aPlacement);
   void RemoveWidget(int32_t aHandle);
   void RecreateWidgetSurface(int32_t aHandle);
+  void SetSurfaceMemoryBudget(const int64_t aBytes);
+  void SetWidgetSnapshot(int32_t aHandle, std::unique_ptr<uint8_t[]>& aPixels, const size_t aSize,
+                         const int32_t aWidth, const int32_t aHeight);
   void StartWidgetResize(int32_t aHandle, const vrb::Vector& aMaxSize, const vrb::Vector& aMinSize);
   void FinishWidgetResize(int32_t aHandle);
   void StartWidgetMove(int32_t aHandle, const int32_t aMoveBehavour);
@@ -86,11 +89,14 @@ protected:
   void TickImmersive();
   void TickSplashAnimation();
   void TickWebXRInterstitial();
+  void LayoutDirtyWidgets();
+  void ApplyWidgetLayout(const WidgetPtr& aWidget, const uint32_t aFlags);
   void DrawWorld(device::Eye aEye);
+  void DrawWorldStereo();
   void DrawImmersive(device::Eye aEye);
   void DrawWebXRInterstitial(device::Eye aEye);
   void DrawSplashAnimation(device::Eye aEye);
-  void CreateSkyBox(const std::string& aBasePath, const std::string& aExtension);
+  void CreateSkyBox(const std::string& aBasePath, const std::string& aOverridePath);
   void CreateEnvironment();
 private:
 #if defined(OCULUSVR) && STORE_BUILD == 1
@@ -0,0 +1,104 @@
+/* -*- Mode: C++; tab-width: 20; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include "CallbackRegistry.h"
+#include "vrb/ConcreteClass.h"
+
+#include <vector>
+
+namespace {
+
+const size_t kInitialSlots = 16;
+
+} // namespace
+
+namespace crow {
+
+struct CallbackRegistry::State {
+  struct Slot {
+    std::function<void()> callback;
+    uint32_t generation = 0;
+  };
+  std::vector<Slot> slots;
+  std::vector<uint32_t> freeSlots;
+  size_t pending = 0;
+
+  State() {
+    slots.reserve(kInitialSlots);
+    freeSlots.reserve(kInitialSlots);
+  }
+
+  // Handles are (generation << 32) | (slot + 1), so 0 is never a valid handle.
+  static uint64_t MakeHandle(const uint32_t aSlot, const uint32_t aGeneration) {
+    return ((uint64_t)aGeneration << 32) | (uint64_t)(aSlot + 1);
+  }
+};
+
+CallbackRegistryPtr
+CallbackRegistry::Create() {
+  return std::make_shared<vrb::ConcreteClass<CallbackRegistry, CallbackRegistry::State> >();
+}
+
+uint64_t
+CallbackRegistry::Register(const std::function<void()>& aCallback) {
+  if (!aCallback) {
+    return 0;
+  }
+  uint32_t index;
+  if (m.freeSlots.empty()) {
+    index = (uint32_t)m.slots.size();
+    m.slots.emplace_back();
+  } else {
+    index = m.freeSlots.back();
+    m.freeSlots.pop_back();
+  }
+  State::Slot& slot = m.slots[index];
+  slot.callback = aCallback;
+  m.pending++;
+  return State::MakeHandle(index, slot.generation);
+}
+
+bool
+CallbackRegistry::Run(const uint64_t aHandle) {
+  const uint32_t index = (uint32_t)(aHandle & 0xFFFFFFFF) - 1;
+  const uint32_t generation = (uint32_t)(aHandle >> 32);
+  if (aHandle == 0 || index >= m.slots.size()) {
+    return false;
+  }
+  State::Slot& slot = m.slots[index];
+  if (slot.generation != generation || !slot.callback) {
+    return false;
+  }
+  // The callback may register new callbacks, which can move the slots.
+  std::function<void()> callback = std::move(slot.callback);
+  slot.callback = nullptr;
+  slot.generation++;
+  m.freeSlots.push_back(index);
+  m.pending--;
+  callback();
+  return true;
+}
+
+size_t
+CallbackRegistry::GetPendingCount() const {
+  return m.pending;
+}
+
+void
+CallbackRegistry::Clear() {
+  for (uint32_t i = 0; i < m.slots.size(); ++i) {
+    State::Slot& slot = m.slots[i];
+    if (slot.callback) {
+      slot.callback = nullptr;
+      slot.generation++;
+      m.freeSlots.push_back(i);
+    }
+  }
+  m.pending = 0;
+}
+
+CallbackRegistry::CallbackRegistry(State& aState) : m(aState) {}
+
+} // namespace crow
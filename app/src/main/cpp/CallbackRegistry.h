@@ -0,0 +1,46 @@
+/* -*- Mode: C++; tab-width: 20; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#ifndef VRBROWSER_CALLBACK_REGISTRY_DOT_H
+#define VRBROWSER_CALLBACK_REGISTRY_DOT_H
+
+#include "vrb/MacroUtils.h"
+
+#include <functional>
+#include <memory>
+#include <stddef.h>
+#include <stdint.h>
+
+namespace crow {
+
+class CallbackRegistry;
+typedef std::shared_ptr<CallbackRegistry> CallbackRegistryPtr;
+
+// One shot callbacks handed to Java as opaque handles. Callbacks are stored in
+// pooled slots that are reused once run, instead of a heap allocated
+// std::function per callback. A handle carries the slot generation so a stale
+// or repeated handle is ignored. Render thread only.
+class CallbackRegistry {
+public:
+  static CallbackRegistryPtr Create();
+  // Returns 0 when aCallback is empty.
+  uint64_t Register(const std::function<void()>& aCallback);
+  // Runs and unregisters the callback. Returns false for unknown handles.
+  bool Run(const uint64_t aHandle);
+  size_t GetPendingCount() const;
+  void Clear();
+protected:
+  struct State;
+  CallbackRegistry(State& aState);
+  ~CallbackRegistry() = default;
+private:
+  State& m;
+  CallbackRegistry() = delete;
+  VRB_NO_DEFAULTS(CallbackRegistry)
+};
+
+} // namespace crow
+
+#endif // VRBROWSER_CALLBACK_REGISTRY_DOT_H
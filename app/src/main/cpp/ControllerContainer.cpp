@@ -101,9 +101,10 @@ ControllerContainer::GetRoot() const {
 }
 
 void
-ControllerContainer::LoadControllerModel(const int32_t aModelIndex, const ModelLoaderAndroidPtr& aLoader, const std::string& aFileName) {
+ControllerContainer::LoadControllerModel(const int32_t aModelIndex, const ModelLoaderAndroidPtr& aLoader,
+                                         const ModelCachePtr& aCache, const std::string& aFileName) {
   m.SetUpModelsGroup(aModelIndex);
-  aLoader->LoadModel(aFileName, m.models[aModelIndex]);
+  aCache->LoadModel(aLoader, aFileName, m.models[aModelIndex]);
 }
 
 void
@@ -8,6 +8,7 @@
 
 #include "ControllerDelegate.h"
 #include "Controller.h"
+#include "ModelCache.h"
 
 #include "vrb/Forward.h"
 #include "vrb/MacroUtils.h"
@@ -27,7 +28,8 @@ public:
   enum class HandEnum { Left, Right };
   static ControllerContainerPtr Create(vrb::CreationContextPtr& aContext, const vrb::GroupPtr& aPointerContainer, const vrb::ModelLoaderAndroidPtr& aLoader);
   vrb::TogglePtr GetRoot() const;
-  void LoadControllerModel(const int32_t aModelIndex, const vrb::ModelLoaderAndroidPtr& aLoader, const std::string& aFileName);
+  void LoadControllerModel(const int32_t aModelIndex, const vrb::ModelLoaderAndroidPtr& aLoader, const ModelCachePtr& aCache,
+                           const std::string& aFileName);
   void LoadControllerModel(const int32_t aModelIndex);
   void SetControllerModelTask(const int32_t aModelIndex, const vrb::LoadTask& aTask);
   void InitializeBeam();
@@ -0,0 +1,209 @@
+/* -*- Mode: C++; tab-width: 20; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include "CubemapKTX2.h"
+#include "vrb/GLError.h"
+#include "vrb/Logger.h"
+
+#include <fstream>
+#include <string.h>
+
+namespace {
+
+const uint8_t kIdentifier[12] = {0xAB, 'K', 'T', 'X', ' ', '2', '0', 0xBB, '\r', '\n', 0x1A, '\n'};
+
+struct Header {
+  uint8_t identifier[12];
+  uint32_t vkFormat;
+  uint32_t typeSize;
+  uint32_t pixelWidth;
+  uint32_t pixelHeight;
+  uint32_t pixelDepth;
+  uint32_t layerCount;
+  uint32_t faceCount;
+  uint32_t levelCount;
+  uint32_t supercompressionScheme;
+  uint32_t dfdByteOffset;
+  uint32_t dfdByteLength;
+  uint32_t kvdByteOffset;
+  uint32_t kvdByteLength;
+  uint64_t sgdByteOffset;
+  uint64_t sgdByteLength;
+};
+static_assert(sizeof(Header) == 80, "KTX2 header has to be 80 bytes");
+
+struct LevelIndex {
+  uint64_t byteOffset;
+  uint64_t byteLength;
+  uint64_t uncompressedByteLength;
+};
+
+// VkFormat values of the formats that can be uploaded without transcoding.
+const uint32_t VK_FORMAT_R8G8B8A8_UNORM = 37;
+const uint32_t VK_FORMAT_R8G8B8A8_SRGB = 43;
+const uint32_t VK_FORMAT_ETC2_R8G8B8_UNORM_BLOCK = 147;
+const uint32_t VK_FORMAT_ETC2_R8G8B8_SRGB_BLOCK = 148;
+const uint32_t VK_FORMAT_ETC2_R8G8B8A8_UNORM_BLOCK = 151;
+const uint32_t VK_FORMAT_ETC2_R8G8B8A8_SRGB_BLOCK = 152;
+
+bool
+GetGLFormat(const uint32_t aVkFormat, GLenum& aFormat, bool& aCompressed) {
+  aCompressed = true;
+  switch (aVkFormat) {
+    case VK_FORMAT_R8G8B8A8_UNORM: aFormat = GL_RGBA8; aCompressed = false; return true;
+    case VK_FORMAT_R8G8B8A8_SRGB: aFormat = GL_SRGB8_ALPHA8; aCompressed = false; return true;
+    case VK_FORMAT_ETC2_R8G8B8_UNORM_BLOCK: aFormat = GL_COMPRESSED_RGB8_ETC2; return true;
+    case VK_FORMAT_ETC2_R8G8B8_SRGB_BLOCK: aFormat = GL_COMPRESSED_SRGB8_ETC2; return true;
+    case VK_FORMAT_ETC2_R8G8B8A8_UNORM_BLOCK: aFormat = GL_COMPRESSED_RGBA8_ETC2_EAC; return true;
+    case VK_FORMAT_ETC2_R8G8B8A8_SRGB_BLOCK: aFormat = GL_COMPRESSED_SRGB8_ALPHA8_ETC2_EAC; return true;
+    default: return false;
+  }
+}
+
+} // namespace
+
+namespace crow {
+
+CubemapKTX2::CubemapKTX2() : mInternalFormat(GL_NONE), mCompressed(false), mSize(0) {}
+
+bool
+CubemapKTX2::Open(const std::string& aPath) {
+  mPath.clear();
+  mLevels.clear();
+  std::ifstream input(aPath, std::ios::binary);
+  if (!input) {
+    return false;
+  }
+  input.seekg(0, std::ios::end);
+  const uint64_t fileSize = (uint64_t)input.tellg();
+  input.seekg(0, std::ios::beg);
+
+  Header header;
+  if (!input.read((char*)&header, sizeof(header)) || memcmp(header.identifier, kIdentifier, sizeof(kIdentifier)) != 0) {
+    VRB_ERROR("Not a KTX2 file: %s", aPath.c_str());
+    return false;
+  }
+  if (!GetGLFormat(header.vkFormat, mInternalFormat, mCompressed)) {
+    VRB_ERROR("Unsupported KTX2 format %u: %s", header.vkFormat, aPath.c_str());
+    return false;
+  }
+  if (header.supercompressionScheme != 0) {
+    VRB_ERROR("Supercompressed KTX2 files are not supported: %s", aPath.c_str());
+    return false;
+  }
+  if (header.faceCount != 6 || header.layerCount != 0 || header.pixelDepth != 0 ||
+      header.pixelWidth == 0 || header.pixelWidth > INT32_MAX || header.pixelWidth != header.pixelHeight) {
+    VRB_ERROR("KTX2 file is not a square cubemap: %s", aPath.c_str());
+    return false;
+  }
+
+  mSize = (int32_t)header.pixelWidth;
+  uint32_t maxLevelCount = 1;
+  while ((header.pixelWidth >> maxLevelCount) > 0) {
+    maxLevelCount++;
+  }
+  const uint32_t levelCount = header.levelCount > 0 ? header.levelCount : 1;
+  if (levelCount > maxLevelCount) {
+    VRB_ERROR("KTX2 file has %u levels, at most %u expected: %s", levelCount, maxLevelCount, aPath.c_str());
+    return false;
+  }
+  for (uint32_t i = 0; i < levelCount; ++i) {
+    LevelIndex index;
+    if (!input.read((char*)&index, sizeof(index))) {
+      VRB_ERROR("Truncated KTX2 level index: %s", aPath.c_str());
+      mLevels.clear();
+      return false;
+    }
+    const uint64_t expected = (uint64_t)GetFaceBytes((int32_t)i) * 6;
+    if (index.byteLength != expected || index.byteLength > fileSize || index.byteOffset > fileSize - index.byteLength) {
+      VRB_ERROR("Invalid KTX2 level %u: %s", i, aPath.c_str());
+      mLevels.clear();
+      return false;
+    }
+    mLevels.push_back(Level{index.byteOffset, index.byteLength});
+  }
+  mPath = aPath;
+  return true;
+}
+
+bool
+CubemapKTX2::IsValid() const {
+  return !mLevels.empty();
+}
+
+const std::string&
+CubemapKTX2::GetPath() const {
+  return mPath;
+}
+
+GLenum
+CubemapKTX2::GetInternalFormat() const {
+  return mInternalFormat;
+}
+
+bool
+CubemapKTX2::IsSRGB() const {
+  return mInternalFormat == GL_SRGB8_ALPHA8 || mInternalFormat == GL_COMPRESSED_SRGB8_ETC2 ||
+         mInternalFormat == GL_COMPRESSED_SRGB8_ALPHA8_ETC2_EAC;
+}
+
+int32_t
+CubemapKTX2::GetLevelCount() const {
+  return (int32_t)mLevels.size();
+}
+
+int32_t
+CubemapKTX2::GetLevelSize(const int32_t aLevel) const {
+  if (aLevel < 0 || aLevel >= 31) {
+    return 1;
+  }
+  const int32_t size = mSize >> aLevel;
+  return size > 0 ? size : 1;
+}
+
+int64_t
+CubemapKTX2::GetFaceBytes(const int32_t aLevel) const {
+  const int64_t size = GetLevelSize(aLevel);
+  if (!mCompressed) {
+    return size * size * 4;
+  }
+  const int64_t blocks = (size + 3) / 4;
+  const int64_t blockBytes = mInternalFormat == GL_COMPRESSED_RGB8_ETC2 ||
+                             mInternalFormat == GL_COMPRESSED_SRGB8_ETC2 ? 8 : 16;
+  return blocks * blocks * blockBytes;
+}
+
+bool
+CubemapKTX2::Upload(const int32_t aLevel, const GLint aTargetLevel, const bool aHasStorage) const {
+  if (aLevel < 0 || aLevel >= GetLevelCount()) {
+    return false;
+  }
+  const Level& level = mLevels[aLevel];
+  std::vector<uint8_t> data((size_t)level.length);
+  std::ifstream input(mPath, std::ios::binary);
+  if (!input.seekg((std::streamoff)level.offset) || !input.read((char*)data.data(), (std::streamsize)data.size())) {
+    VRB_ERROR("Failed to read KTX2 level %d: %s", aLevel, mPath.c_str());
+    return false;
+  }
+
+  const GLsizei size = GetLevelSize(aLevel);
+  const GLsizei faceBytes = (GLsizei)GetFaceBytes(aLevel);
+  for (int face = 0; face < 6; ++face) {
+    const GLenum target = (GLenum)(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face);
+    const uint8_t* pixels = data.data() + face * faceBytes;
+    if (mCompressed && aHasStorage) {
+      VRB_GL_CHECK(glCompressedTexSubImage2D(target, aTargetLevel, 0, 0, size, size, mInternalFormat, faceBytes, pixels));
+    } else if (mCompressed) {
+      VRB_GL_CHECK(glCompressedTexImage2D(target, aTargetLevel, mInternalFormat, size, size, 0, faceBytes, pixels));
+    } else if (aHasStorage) {
+      VRB_GL_CHECK(glTexSubImage2D(target, aTargetLevel, 0, 0, size, size, GL_RGBA, GL_UNSIGNED_BYTE, pixels));
+    } else {
+      VRB_GL_CHECK(glTexImage2D(target, aTargetLevel, mInternalFormat, size, size, 0, GL_RGBA, GL_UNSIGNED_BYTE, pixels));
+    }
+  }
+  return true;
+}
+
+} // namespace crow
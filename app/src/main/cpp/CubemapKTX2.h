@@ -0,0 +1,52 @@
+/* -*- Mode: C++; tab-width: 20; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#ifndef VRBROWSER_CUBEMAP_KTX2_H
+#define VRBROWSER_CUBEMAP_KTX2_H
+
+#include "vrb/gl.h"
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+namespace crow {
+
+// Single file KTX2 cubemap with precomputed mips. Only the formats that GLES 3
+// uploads as is are supported: RGBA8 and ETC2, without supercompression.
+// Open() only reads the header, the levels are read when they are uploaded so
+// the object can be copied to the thread that does it.
+class CubemapKTX2 {
+public:
+  CubemapKTX2();
+  // False if the file does not exist or is not a supported cubemap.
+  bool Open(const std::string& aPath);
+  bool IsValid() const;
+  const std::string& GetPath() const;
+  GLenum GetInternalFormat() const;
+  bool IsSRGB() const;
+  // Level 0 is the largest one.
+  int32_t GetLevelCount() const;
+  int32_t GetLevelSize(const int32_t aLevel) const;
+  // Uploads the six faces of aLevel to the mip aTargetLevel of the cubemap
+  // bound to GL_TEXTURE_CUBE_MAP. The storage of the mip is allocated unless
+  // aHasStorage is true, as for the compositor swapchain images.
+  bool Upload(const int32_t aLevel, const GLint aTargetLevel, const bool aHasStorage) const;
+private:
+  struct Level {
+    uint64_t offset;
+    uint64_t length;
+  };
+  int64_t GetFaceBytes(const int32_t aLevel) const;
+  std::string mPath;
+  GLenum mInternalFormat;
+  bool mCompressed;
+  int32_t mSize;
+  std::vector<Level> mLevels;
+};
+
+} // namespace crow
+
+#endif // VRBROWSER_CUBEMAP_KTX2_H
@@ -4,6 +4,7 @@
  * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
 
 #include "Cylinder.h"
+#include "MeshCache.h"
 #include "Quad.h"
 #include "VRLayer.h"
 #include "VRLayerNode.h"
@@ -23,6 +24,8 @@
 #include "vrb/Vector.h"
 #include "vrb/VertexArray.h"
 
+#include <algorithm>
+
 namespace crow {
 
 // Ratio between world size and cylinder surface size.
@@ -38,6 +41,7 @@ struct Cylinder::State {
   int32_t textureHeight;
   vrb::TogglePtr root;
   vrb::TransformPtr transform;
+  vrb::TransformPtr meshTransform;
   vrb::GeometryPtr geometry;
   float radius;
   float height;
@@ -47,6 +51,7 @@ struct Cylinder::State {
   float border;
   vrb::Color borderColor;
   vrb::Color solidColor;
+  float surfaceScale;
 
   State()
       : textureWidth(0)
@@ -57,6 +62,7 @@ struct Cylinder::State {
       , textureScaleX(1.0f)
       , textureScaleY(1.0f)
       , border(0.0f)
+      , surfaceScale(1.0f)
   {}
 
   void Initialize() {
@@ -69,105 +75,30 @@ struct Cylinder::State {
       layerNode = VRLayerNode::Create(create, layer);
       transform->AddNode(layerNode);
     } else {
-      geometry = CreateCylinderGeometry(radius, height, (float) M_PI);
-      transform->AddNode(geometry);
+      geometry = CreateCylinderGeometry();
+      meshTransform = vrb::Transform::Create(create);
+      vrb::Matrix scale = vrb::Matrix::Identity();
+      scale.ScaleInPlace(vrb::Vector(radius, height, radius));
+      meshTransform->SetTransform(scale);
+      meshTransform->AddNode(geometry);
+      transform->AddNode(meshTransform);
     }
     root = vrb::Toggle::Create(create);
     root->AddNode(transform);
   }
 
   const int kRadialSegments = 200;
-  const int kHeightSegments = 1;
-
-  vrb::GeometryPtr CreateCylinderGeometry(const float aRadius, const float aHeight, const float aArcLength) {
-    const float pi = (float) M_PI;
 
-    const float startAngle = pi * 0.5f + aArcLength * 0.5f;
+  int32_t GetSurfaceSize(const int32_t aTextureSize) const {
+    return std::max(1, (int32_t)ceilf(aTextureSize * surfaceScale));
+  }
 
+  // The mesh is shared with the other cylinders of the same shape and scaled by meshTransform.
+  vrb::GeometryPtr CreateCylinderGeometry() {
     vrb::CreationContextPtr create = context.lock();
-    vrb::GeometryPtr geometry = vrb::Geometry::Create(create);
-    vrb::VertexArrayPtr array = vrb::VertexArray::Create(create);
-
-    const int ySegments = kHeightSegments + (border > 0.0f ? 2 : 0);
-
-    for (int y = 0; y <= ySegments; ++y) {
-      float offset = 0.0f;
-      float v = (float) y / (float) kHeightSegments;
-      vrb::Color vertexColor = solidColor;
-
-      if (border > 0) {
-        if (y == 0) {
-          v = 0.0f;
-          offset = border;
-          vertexColor = borderColor;
-        } else if (y == ySegments) {
-          v = 1.0f;
-          offset = -border;
-          vertexColor = borderColor;
-        } else {
-          v = (float) (y - 1) / (float) kHeightSegments;
-        }
-      }
-
-
-      for (int x = 0; x <= kRadialSegments; ++x) {
-        const float u = (float) x / (float) kRadialSegments;
-
-        const float theta = startAngle - aArcLength * u;
-
-        const float sinTheta = sinf(theta);
-        const float cosTheta = cosf(theta);
-        vrb::Vector vertex;
-        vrb::Vector uv;
-        vrb::Vector normal;
-
-        vertex.x() = aRadius * cosTheta;
-        vertex.y() = -v * aHeight + aHeight * 0.5f + offset;
-        vertex.z() = -aRadius * sinTheta;
-
-        uv.x() = u;
-        uv.y() = v;
-        uv.z() = 0.0f;
-
-        normal.x() = -cosTheta;
-        normal.y() = 0.0f;
-        normal.z() = sinTheta;
-
-        array->AppendVertex(vertex);
-        array->AppendUV(uv);
-        array->AppendNormal(vertex.Normalize());
-        if (border > 0.0f) {
-          array->AppendColor(vertexColor);
-        }
-      }
-    }
-    geometry->SetVertexArray(array);
-
-    std::vector<int> indices;
-
-    for (int x = 0; x < kRadialSegments; ++x) {
-      for (int y = 0; y < ySegments; ++y) {
-        const int a = 1 + y * (kRadialSegments + 1) + x;
-        const int b = 1 + (y + 1) * (kRadialSegments + 1) + x;
-        const int c = 1 + (y + 1) * (kRadialSegments + 1) + x + 1;
-        const int d = 1 + y * (kRadialSegments + 1) + x + 1;
-
-        indices.clear();
-        indices.push_back(b);
-        indices.push_back(c);
-        indices.push_back(d);
-        indices.push_back(a);
-
-        // update group counter
-        geometry->AddFace(indices, indices, indices);
-      }
-    }
-
-    vrb::RenderStatePtr state = vrb::RenderState::Create(create);
-    state->SetLightsEnabled(false);
-    geometry->SetRenderState(state);
-
-    return geometry;
+    const float relativeBorder = height > 0.0f ? border / height : 0.0f;
+    return MeshCache::Get(create)->CreateCylinderGeometry(kRadialSegments, (float) M_PI, relativeBorder,
+                                                          solidColor, borderColor);
   }
 
   void updateTextureLayout() {
@@ -272,11 +203,12 @@ Cylinder::GetTextureSize(int32_t& aWidth, int32_t& aHeight) const {
 }
 
 void
-Cylinder::SetTextureSize(int32_t aWidth, int32_t aHeight) {
+Cylinder::SetTextureSize(int32_t aWidth, int32_t aHeight, const float aSurfaceScale) {
   m.textureWidth = aWidth;
   m.textureHeight = aHeight;
+  m.surfaceScale = aSurfaceScale;
   if (m.layer) {
-    m.layer->Resize(aWidth, aHeight);
+    m.layer->Resize(m.GetSurfaceSize(aWidth), m.GetSurfaceSize(aHeight));
   }
   m.updateTextureLayout();
 }
@@ -284,7 +216,7 @@ void
 Cylinder::RecreateSurface() {
   if (m.layer) {
     bool force = true;
-    m.layer->Resize(m.textureWidth , m.textureHeight, force);
+    m.layer->Resize(m.GetSurfaceSize(m.textureWidth), m.GetSurfaceSize(m.textureHeight), force);
   }
 }
 
@@ -387,7 +319,19 @@ Cylinder::TestIntersection(const vrb::Vector& aStartPoint, const vrb::Vector& aD
   }
 
   vrb::Matrix worldTransform = m.transform->GetWorldTransform();
-  vrb::Matrix modelView = worldTransform.AfineInverse();
+  return TestIntersection(worldTransform, worldTransform.AfineInverse(), aStartPoint, aDirection, aResult, aNormal, aClamp, aIsInside, aDistance);
+}
+
+bool
+Cylinder::TestIntersection(const vrb::Matrix& aTransform, const vrb::Matrix& aInverse, const vrb::Vector& aStartPoint, const vrb::Vector& aDirection,
+                           vrb::Vector& aResult, vrb::Vector& aNormal, bool aClamp, bool& aIsInside, float& aDistance) const {
+  aDistance = -1.0f;
+  if (!m.root->IsEnabled(*m.transform)) {
+    return false;
+  }
+
+  const vrb::Matrix& worldTransform = aTransform;
+  const vrb::Matrix& modelView = aInverse;
   vrb::Vector start = modelView.MultiplyPosition(aStartPoint);
   vrb::Vector direction = modelView.MultiplyDirection(aDirection);
   if (vrb::Vector(start.x(), 0.0f, start.z()).Magnitude() <= m.radius) {
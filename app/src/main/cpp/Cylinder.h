@@ -33,7 +33,9 @@ public:
   static float kWorldDensityRatio;
   void UpdateProgram(const std::string& aCustomFragmentShader);
   void GetTextureSize(int32_t& aWidth, int32_t& aHeight) const;
-  void SetTextureSize(int32_t aWidth, int32_t aHeight);
+  // aSurfaceScale is the resolution of the layer surface relative to the texture size. Widget
+  // coordinates stay in texture pixels.
+  void SetTextureSize(int32_t aWidth, int32_t aHeight, const float aSurfaceScale = 1.0f);
   void RecreateSurface();
   void SetTexture(const vrb::TexturePtr& aTexture, int32_t aWidth, int32_t aHeight);
   void SetTextureScale(const float aScaleX, const float aScaleY);
@@ -50,6 +52,9 @@ public:
   vrb::TransformPtr GetTransformNode() const;
   void SetTransform(const vrb::Matrix& aTransform);
   bool TestIntersection(const vrb::Vector& aStartPoint, const vrb::Vector& aDirection, vrb::Vector& aResult, vrb::Vector& aNormal, bool aClamp, bool& aIsInside, float& aDistance) const;
+  // Same as above with the world transform of the geometry and its inverse supplied by the caller.
+  bool TestIntersection(const vrb::Matrix& aTransform, const vrb::Matrix& aInverse, const vrb::Vector& aStartPoint, const vrb::Vector& aDirection,
+                        vrb::Vector& aResult, vrb::Vector& aNormal, bool aClamp, bool& aIsInside, float& aDistance) const;
   void ConvertToQuadCoordinates(const vrb::Vector& point, float& aX, float& aY, bool aClamp) const;
   void ConvertFromQuadCoordinates(const float aX, const float aY, vrb::Vector& aWorldPoint, vrb::Vector& aNormal);
   float DistanceToBackPlane(const vrb::Vector& aStartPoint, const vrb::Vector& aDirection) const;
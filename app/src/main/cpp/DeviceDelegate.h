@@ -55,7 +55,16 @@ public:
   };
   enum class FrameEndMode {
       APPLY,
-      DISCARD
+      DISCARD,
+      // The eye buffers hold the content of the last applied frame again.
+      REPEAT
+  };
+  // What the draw lists of the next frame render into the eye buffers, besides compositor layers.
+  enum class EyeContent {
+      Full,
+      // Only the controller models, beams and pointers.
+      ControllersOnly,
+      None
   };
   virtual device::DeviceType GetDeviceType() { return device::UnknownType; }
   virtual void SetRenderMode(const device::RenderMode aMode) = 0;
@@ -80,7 +89,23 @@ public:
     return aPrediction == FramePrediction::NO_FRAME_AHEAD;
   }
   virtual void StartFrame(const FramePrediction aPrediction = FramePrediction::NO_FRAME_AHEAD) = 0;
+  // CLOCK_MONOTONIC time, in seconds, by which the frame started by the last StartFrame() call has to be
+  // submitted to reach its predicted display time, and the display refresh period. False when unknown.
+  virtual bool GetFrameTiming(double& aSubmitDeadline, double& aDisplayPeriod) const { return false; }
+  // Eye buffer pixels per degree at the center of the view. 0 when unknown.
+  virtual float GetPixelsPerDegree() const { return 0.0f; }
   virtual void BindEye(const device::Eye aWhich) = 0;
+  // Single pass stereo: both eyes share one render target, side by side. BindStereoTarget() binds and
+  // clears it and SetEyeViewport() then only selects the viewport of an eye, so a scene root can be
+  // culled once and drawn for both eyes without switching render targets.
+  virtual bool SupportsSinglePassStereo() const { return false; }
+  virtual void BindStereoTarget() {}
+  virtual void SetEyeViewport(const device::Eye aWhich) {}
+  // Hint set between StartFrame() and the first BindEye() call, reset to Full by EndFrame(). A device
+  // may render ControllersOnly frames at a lower resolution and skip the eye buffers of None frames,
+  // for which BrowserWorld does not draw.
+  virtual bool SupportsEyeContent() const { return false; }
+  virtual void SetEyeContent(const EyeContent aContent) {}
   virtual void EndFrame(const FrameEndMode aMode = FrameEndMode::APPLY) = 0;
   virtual bool IsInGazeMode() const { return false; };
   virtual int32_t GazeModeIndex() const { return -1; };
@@ -94,6 +119,9 @@ public:
   virtual VRLayerCubePtr CreateLayerCube(int32_t aWidth, int32_t aHeight, GLint aInternalFormat) { return nullptr; }
   virtual VRLayerEquirectPtr CreateLayerEquirect(const VRLayerPtr &aSource) { return nullptr; }
   virtual void DeleteLayer(const VRLayerPtr& aLayer) {};
+  // Frees the surface of a layer, which is not drawn until VRLayerSurface::Resize() creates a new one.
+  // Returns false if the layer keeps its surface.
+  virtual bool ReleaseLayerSurface(const VRLayerSurfacePtr& aLayer) { return false; }
   virtual bool IsControllerLightEnabled() const { return true; }
   virtual vrb::LoadTask GetControllerModelTask(int32_t index) { return nullptr; } ;
   virtual void OnControllersReady(const std::function<void()>& callback) {
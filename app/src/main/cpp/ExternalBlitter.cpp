@@ -5,6 +5,7 @@
 
 #include "ExternalBlitter.h"
 #include "GeckoSurfaceTexture.h"
+#include "ProgramCache.h"
 #include "vrb/ConcreteClass.h"
 #include "vrb/private/ResourceGLState.h"
 #include "vrb/gl.h"
@@ -25,6 +26,18 @@ void main(void) {
 }
 )SHADER";
 
+const char* sFragmentShader2D = R"SHADER(
+precision mediump float;
+
+uniform sampler2D u_texture0;
+
+varying vec2 v_uv;
+
+void main() {
+  gl_FragColor = texture2D(u_texture0, v_uv);
+}
+)SHADER";
+
 const char* sFragmentShader = R"SHADER(
 #extension GL_OES_EGL_image_external : require
 precision mediump float;
@@ -45,42 +58,155 @@ const GLfloat sVerticies[] = {
     1.0f, -1.0f, 0.0f
 };
 
+// Flipped vertically so that the copy is sampled with the same UVs as the surface.
+const GLfloat sCopyUV[] = {
+    0.0f, 1.0f,
+    0.0f, 0.0f,
+    1.0f, 1.0f,
+    1.0f, 0.0f
+};
+
+// Frames are copied for the repeat fallback during this many frames after a miss.
+const int32_t kRetainFrameCount = 300;
+
 }
 
 namespace crow {
 
 struct ExternalBlitter::State : public vrb::ResourceGL::State {
-  GLuint vertexShader;
-  GLuint fragmentShader;
+  ProgramCachePtr programCache;
   GLuint program;
   GLint aPosition;
   GLint aUV;
   GLint uTexture0;
+  // Draws the copy of the last frame.
+  GLuint program2D;
+  GLint aPosition2D;
+  GLint aUV2D;
+  GLint uTexture02D;
+  GLuint retainedFBO;
+  GLuint retainedTexture;
+  int32_t retainedWidth;
+  int32_t retainedHeight;
+  bool hasRetainedFrame;
+  bool repeating;
+  int32_t retainFrames;
   device::EyeRect eyes[device::EyeCount];
   GeckoSurfaceTexturePtr surface;
   GLfloat leftUV[8];
   GLfloat rightUV[8];
   std::map<const int32_t, GeckoSurfaceTexturePtr> surfaceMap;
   State()
-      : vertexShader(0)
-      , fragmentShader(0)
-      , program(0)
+      : program(0)
       , aPosition(0)
       , aUV(0)
       , uTexture0(0)
+      , program2D(0)
+      , aPosition2D(0)
+      , aUV2D(0)
+      , uTexture02D(0)
+      , retainedFBO(0)
+      , retainedTexture(0)
+      , retainedWidth(0)
+      , retainedHeight(0)
+      , hasRetainedFrame(false)
+      , repeating(false)
+      , retainFrames(0)
       , leftUV{0.0f, 0.0f, 0.0f, 1.0f, 0.5f, 0.0f, 0.5f, 1.0f}
       , rightUV{0.5f, 0.0f, 0.5f, 1.0f, 1.0f, 0.0f, 1.0f, 1.0f}
   {}
+
+  bool ResizeRetainedFrame(const int32_t aWidth, const int32_t aHeight) {
+    if (retainedTexture && retainedWidth == aWidth && retainedHeight == aHeight) {
+      return true;
+    }
+    DeleteRetainedFrame();
+    VRB_GL_CHECK(glGenTextures(1, &retainedTexture));
+    VRB_GL_CHECK(glBindTexture(GL_TEXTURE_2D, retainedTexture));
+    VRB_GL_CHECK(glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, aWidth, aHeight, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr));
+    VRB_GL_CHECK(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR));
+    VRB_GL_CHECK(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR));
+    VRB_GL_CHECK(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE));
+    VRB_GL_CHECK(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE));
+    VRB_GL_CHECK(glBindTexture(GL_TEXTURE_2D, 0));
+    VRB_GL_CHECK(glGenFramebuffers(1, &retainedFBO));
+    VRB_GL_CHECK(glBindFramebuffer(GL_FRAMEBUFFER, retainedFBO));
+    VRB_GL_CHECK(glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, retainedTexture, 0));
+    const GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+    if (status != GL_FRAMEBUFFER_COMPLETE) {
+      VRB_ERROR("ExternalBlitter: incomplete frame copy framebuffer: 0x%X", status);
+      DeleteRetainedFrame();
+      return false;
+    }
+    retainedWidth = aWidth;
+    retainedHeight = aHeight;
+    return true;
+  }
+
+  void DeleteRetainedFrame() {
+    if (retainedFBO) {
+      VRB_GL_CHECK(glDeleteFramebuffers(1, &retainedFBO));
+      retainedFBO = 0;
+    }
+    if (retainedTexture) {
+      VRB_GL_CHECK(glDeleteTextures(1, &retainedTexture));
+      retainedTexture = 0;
+    }
+    retainedWidth = 0;
+    retainedHeight = 0;
+    hasRetainedFrame = false;
+  }
+
+  // Copies the current surface image so it can be drawn again after it is released.
+  void RetainFrame(const int32_t aWidth, const int32_t aHeight) {
+    if (!program || aWidth <= 0 || aHeight <= 0 || !ResizeRetainedFrame(aWidth, aHeight)) {
+      hasRetainedFrame = false;
+      return;
+    }
+    GLint previousFBO = 0;
+    GLint previousViewport[4] = {};
+    VRB_GL_CHECK(glGetIntegerv(GL_FRAMEBUFFER_BINDING, &previousFBO));
+    VRB_GL_CHECK(glGetIntegerv(GL_VIEWPORT, previousViewport));
+    VRB_GL_CHECK(glBindFramebuffer(GL_FRAMEBUFFER, retainedFBO));
+    VRB_GL_CHECK(glViewport(0, 0, aWidth, aHeight));
+    DrawQuad(program, aPosition, aUV, uTexture0, GL_TEXTURE_EXTERNAL_OES, surface->GetTextureName(), sCopyUV);
+    VRB_GL_CHECK(glBindFramebuffer(GL_FRAMEBUFFER, (GLuint)previousFBO));
+    VRB_GL_CHECK(glViewport(previousViewport[0], previousViewport[1], previousViewport[2], previousViewport[3]));
+    hasRetainedFrame = true;
+  }
+
+  void DrawQuad(const GLuint aProgram, const GLint aPositionAttribute, const GLint aUVAttribute, const GLint aTextureUniform,
+                const GLenum aTarget, const GLuint aTextureName, const GLfloat* aUVData) {
+    const GLboolean enabled = glIsEnabled(GL_DEPTH_TEST);
+    if (enabled) {
+      VRB_GL_CHECK(glDisable(GL_DEPTH_TEST));
+    }
+    VRB_GL_CHECK(glUseProgram(aProgram));
+    VRB_GL_CHECK(glActiveTexture(GL_TEXTURE0));
+    VRB_GL_CHECK(glBindTexture(aTarget, aTextureName));
+    VRB_GL_CHECK(glUniform1i(aTextureUniform, 0));
+    VRB_GL_CHECK(glVertexAttribPointer((GLuint)aPositionAttribute, 3, GL_FLOAT, GL_FALSE, 0, sVerticies));
+    VRB_GL_CHECK(glEnableVertexAttribArray((GLuint)aPositionAttribute));
+    VRB_GL_CHECK(glVertexAttribPointer((GLuint)aUVAttribute, 2, GL_FLOAT, GL_FALSE, 0, aUVData));
+    VRB_GL_CHECK(glEnableVertexAttribArray((GLuint)aUVAttribute));
+    VRB_GL_CHECK(glDrawArrays(GL_TRIANGLE_STRIP, 0, 4));
+    if (enabled) {
+      VRB_GL_CHECK(glEnable(GL_DEPTH_TEST));
+    }
+  }
 };
 
 ExternalBlitterPtr
-ExternalBlitter::Create(vrb::CreationContextPtr& aContext) {
-  return std::make_shared<vrb::ConcreteClass<ExternalBlitter, ExternalBlitter::State> >(aContext);
+ExternalBlitter::Create(vrb::CreationContextPtr& aContext, const ProgramCachePtr& aProgramCache) {
+  ExternalBlitterPtr result = std::make_shared<vrb::ConcreteClass<ExternalBlitter, ExternalBlitter::State> >(aContext);
+  result->m.programCache = aProgramCache;
+  return result;
 }
 
 void
-ExternalBlitter::StartFrame(const int32_t aSurfaceHandle, const device::EyeRect& aLeftEye,
-                            const device::EyeRect& aRightEye) {
+ExternalBlitter::StartFrame(const int32_t aSurfaceHandle, const int32_t aTextureWidth, const int32_t aTextureHeight,
+                            const device::EyeRect& aLeftEye, const device::EyeRect& aRightEye) {
+  m.repeating = false;
   std::map<const int32_t, GeckoSurfaceTexturePtr>::iterator iter = m.surfaceMap.find(aSurfaceHandle);
 
   if (iter == m.surfaceMap.end()) {
@@ -105,36 +231,40 @@ ExternalBlitter::StartFrame(const int32_t aSurfaceHandle, const device::EyeRect&
   m.surface->UpdateTexImage();
   m.eyes[device::EyeIndex(device::Eye::Left)] = aLeftEye;
   m.eyes[device::EyeIndex(device::Eye::Right)] = aRightEye;
+
+  if (m.retainFrames > 0) {
+    m.retainFrames--;
+    m.RetainFrame(aTextureWidth, aTextureHeight);
+  } else if (m.retainedTexture) {
+    // No miss for a while, stop paying for the copy.
+    m.DeleteRetainedFrame();
+  }
+}
+
+bool
+ExternalBlitter::StartRepeatFrame() {
+  m.retainFrames = kRetainFrameCount;
+  m.repeating = m.hasRetainedFrame && m.program2D;
+  return m.repeating;
 }
 
 void
 ExternalBlitter::Draw(const device::Eye aEye) {
+  const GLfloat* data = (aEye == device::Eye::Left ? &m.leftUV[0] : &m.rightUV[0]);
+  if (m.repeating) {
+    m.DrawQuad(m.program2D, m.aPosition2D, m.aUV2D, m.uTexture02D, GL_TEXTURE_2D, m.retainedTexture, data);
+    return;
+  }
   if (!m.program || !m.surface) {
     VRB_ERROR("ExternalBlitter::Draw FAILED!");
     return;
   }
-  const GLboolean enabled = glIsEnabled(GL_DEPTH_TEST);
-  if (enabled) {
-    VRB_GL_CHECK(glDisable(GL_DEPTH_TEST));
-  }
-  VRB_GL_CHECK(glUseProgram(m.program));
-  VRB_GL_CHECK(glActiveTexture(GL_TEXTURE0));
-  VRB_GL_CHECK(glBindTexture(GL_TEXTURE_EXTERNAL_OES, m.surface->GetTextureName()));
-  //m.defaultT->Bind();
-  VRB_GL_CHECK(glUniform1i(m.uTexture0, 0));
-  VRB_GL_CHECK(glVertexAttribPointer((GLuint)m.aPosition, 3, GL_FLOAT, GL_FALSE, 0, sVerticies));
-  VRB_GL_CHECK(glEnableVertexAttribArray((GLuint)m.aPosition));
-  GLfloat* data = (aEye == device::Eye::Left ? &m.leftUV[0] : &m.rightUV[0]);
-  VRB_GL_CHECK(glVertexAttribPointer((GLuint)m.aUV, 2, GL_FLOAT, GL_FALSE, 0, data));
-  VRB_GL_CHECK(glEnableVertexAttribArray((GLuint)m.aUV));
-  VRB_GL_CHECK(glDrawArrays(GL_TRIANGLE_STRIP, 0, 4));
-  if (enabled) {
-    VRB_GL_CHECK(glEnable(GL_DEPTH_TEST));
-  }
+  m.DrawQuad(m.program, m.aPosition, m.aUV, m.uTexture0, GL_TEXTURE_EXTERNAL_OES, m.surface->GetTextureName(), data);
 }
 
 void
 ExternalBlitter::EndFrame() {
+  m.repeating = false;
   if (m.surface) {
     // We need to detach the SurfaceTexture to prevent the Gecko WebGL compositor from getting blocked.
     m.surface->ReleaseTexImage();
@@ -150,6 +280,9 @@ ExternalBlitter::StopPresenting() {
     m.surface = nullptr;
   }
   m.surfaceMap.clear();
+  m.DeleteRetainedFrame();
+  m.retainFrames = 0;
+  m.repeating = false;
 }
 
 void
@@ -180,31 +313,30 @@ ExternalBlitter::ExternalBlitter(State& aState, vrb::CreationContextPtr& aContex
 
 void
 ExternalBlitter::InitializeGL() {
-  m.vertexShader = vrb::LoadShader(GL_VERTEX_SHADER, sVertexShader);
-  m.fragmentShader = vrb::LoadShader(GL_FRAGMENT_SHADER, sFragmentShader);
-  if (m.vertexShader && m.fragmentShader) {
-    m.program = vrb::CreateProgram(m.vertexShader, m.fragmentShader);
-  }
+  m.program = m.programCache->CreateProgram(sVertexShader, sFragmentShader);
   if (m.program) {
     m.aPosition = vrb::GetAttributeLocation(m.program, "a_position");
     m.aUV = vrb::GetAttributeLocation(m.program, "a_uv");
     m.uTexture0 = vrb::GetUniformLocation(m.program, "u_texture0");
   }
+  m.program2D = m.programCache->CreateProgram(sVertexShader, sFragmentShader2D);
+  if (m.program2D) {
+    m.aPosition2D = vrb::GetAttributeLocation(m.program2D, "a_position");
+    m.aUV2D = vrb::GetAttributeLocation(m.program2D, "a_uv");
+    m.uTexture02D = vrb::GetUniformLocation(m.program2D, "u_texture0");
+  }
 }
 
 void
 ExternalBlitter::ShutdownGL() {
+  m.DeleteRetainedFrame();
   if (m.program) {
     VRB_GL_CHECK(glDeleteProgram(m.program));
     m.program = 0;
   }
-  if (m.vertexShader) {
-    VRB_GL_CHECK(glDeleteShader(m.vertexShader));
-    m.vertexShader = 0;
-  }
-  if (m.vertexShader) {
-    VRB_GL_CHECK(glDeleteShader(m.fragmentShader));
-    m.fragmentShader = 0;
+  if (m.program2D) {
+    VRB_GL_CHECK(glDeleteProgram(m.program2D));
+    m.program2D = 0;
   }
 }
 
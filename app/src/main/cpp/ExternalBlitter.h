@@ -11,6 +11,7 @@
 #include "vrb/ResourceGL.h"
 #include "Device.h"
 #include "ExternalVR.h"
+#include "ProgramCache.h"
 #include <memory>
 
 namespace crow {
@@ -20,8 +21,14 @@ typedef std::shared_ptr<ExternalBlitter> ExternalBlitterPtr;
 
 class ExternalBlitter : protected vrb::ResourceGL {
 public:
-  static ExternalBlitterPtr Create(vrb::CreationContextPtr& aContext);
-  void StartFrame(const int32_t aSurfaceHandle, const device::EyeRect& aLeftEye, const device::EyeRect& aRightEye);
+  static ExternalBlitterPtr Create(vrb::CreationContextPtr& aContext, const ProgramCachePtr& aProgramCache);
+  void StartFrame(const int32_t aSurfaceHandle, const int32_t aTextureWidth, const int32_t aTextureHeight,
+                  const device::EyeRect& aLeftEye, const device::EyeRect& aRightEye);
+  // Starts a frame that draws the last frame again when the browser missed the
+  // deadline. Returns false when no copy of it was kept; copies are kept for a
+  // while after each miss. The device has to submit it with the pose it was
+  // rendered for so the compositor reprojects it.
+  bool StartRepeatFrame();
   void Draw(const device::Eye aEye);
   void EndFrame();
   void StopPresenting();
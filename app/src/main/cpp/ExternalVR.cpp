@@ -4,21 +4,20 @@
  * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
 
 #include "ExternalVR.h"
+#include "ExternalVRTransport.h"
 #include "VRBrowser.h"
 
 #include "vrb/Matrix.h"
 #include "vrb/Quaternion.h"
 #include "vrb/Vector.h"
-#include "moz_external_vr.h"
+#include "ExternalVRShmem.h"
+#include <algorithm>
 #include <pthread.h>
 #include <unistd.h>
 
 namespace {
 
-const float SecondsToNanoseconds = 1e9f;
-const int SecondsToNanosecondsI32 = int(1e9);
-const int MicrosecondsToNanoseconds = 1000;
-
+#if !defined(EXTERNALVR_SEQLOCK)
 class Lock {
   pthread_mutex_t* mMutex;
   bool mLocked;
@@ -63,25 +62,10 @@ public:
     }
   }
 
-  bool DoWait(const float aWait) {
+  bool DoWait(const timespec& aDeadline) {
     if (mLocked || pthread_mutex_lock(mMutex) == 0) {
       mLocked = true;
-      if (aWait == 0.0f) {
-        return pthread_cond_wait(mCond, mMutex) == 0;
-      } else {
-        float sec = 0;
-        float nsec = modff(aWait, &sec);
-        struct timeval tv = {};
-        struct timespec ts = {};
-        gettimeofday(&tv, nullptr);
-        ts.tv_sec = tv.tv_sec + int(sec);
-        ts.tv_nsec = (tv.tv_usec * MicrosecondsToNanoseconds) + int(SecondsToNanoseconds * nsec);
-        if (ts.tv_nsec >= SecondsToNanosecondsI32) {
-          ts.tv_nsec -= SecondsToNanosecondsI32;
-          ts.tv_sec++;
-        }
-        return pthread_cond_timedwait(mCond, mMutex, &ts) == 0;
-      }
+      return crow::ExternalVRTransport::TimedWait(mCond, mMutex, aDeadline);
     }
     return false;
   }
@@ -110,6 +94,7 @@ private:
   VRB_NO_DEFAULTS(Wait)
   VRB_NO_NEW_DELETE
 };
+#endif // !defined(EXTERNALVR_SEQLOCK)
 
 } // namespace
 
@@ -117,43 +102,76 @@ namespace crow {
 
 struct ExternalVR::State {
   static ExternalVR::State* sState;
+#if !defined(EXTERNALVR_SEQLOCK)
   pthread_mutex_t* browserMutex = nullptr;
   pthread_cond_t* browserCond = nullptr;
+#else
+  volatile int64_t* browserGenerationA = nullptr;
+  volatile int64_t* browserGenerationB = nullptr;
+  mozilla::gfx::VRBrowserState pendingBrowser = {};
+#endif
   mozilla::gfx::VRBrowserState* sourceBrowserState = nullptr;
-  mozilla::gfx::VRExternalShmem data = {};
+  ExternalVRShmem data = {};
   mozilla::gfx::VRSystemState system = {};
   mozilla::gfx::VRBrowserState browser = {};
   // device::CapabilityFlags deviceCapabilities = 0;
   vrb::Matrix eyeTransforms[device::EyeCount];
+  vrb::Matrix eyeInverses[device::EyeCount];
+  // Controller slots filled by the last PushFramePoses call.
+  uint32_t activeControllers = 0;
+  // Controller slots modified since the last PushSystemState call.
+  uint32_t dirtyControllers = 0;
   uint64_t lastFrameId = 0;
+  // Consecutive WaitFrameResult calls that returned FrameResult::Missed.
+  uint32_t missedFrames = 0;
+  ExternalVR::FrameCounters counters;
   bool firstPresentingFrame = false;
   bool compositorEnabled = true;
   bool waitingForExit = false;
 
   State() {
+    InitializeSync();
+    for (int i = 0; i < device::EyeCount; ++i) {
+      eyeInverses[i] = eyeTransforms[i].AfineInverse();
+    }
+  }
+
+  ~State() {
+    DestroySync();
+  }
+
+  void InitializeSync() {
+#if !defined(EXTERNALVR_SEQLOCK)
     pthread_mutex_init(&data.systemMutex, nullptr);
     pthread_mutex_init(&data.geckoMutex, nullptr);
     pthread_mutex_init(&data.servoMutex, nullptr);
+    // The browser engine also waits on these, with CLOCK_REALTIME deadlines,
+    // so they keep the default clock.
     pthread_cond_init(&data.systemCond, nullptr);
     pthread_cond_init(&data.geckoCond, nullptr);
     pthread_cond_init(&data.servoCond, nullptr);
+#endif
   }
 
-  ~State() {
+  void DestroySync() {
+#if !defined(EXTERNALVR_SEQLOCK)
     pthread_mutex_destroy(&(data.systemMutex));
     pthread_mutex_destroy(&(data.geckoMutex));
     pthread_mutex_destroy(&(data.servoMutex));
     pthread_cond_destroy(&(data.systemCond));
     pthread_cond_destroy(&(data.geckoCond));
     pthread_cond_destroy(&(data.servoCond));
+#endif
   }
 
   void Reset() {
-    memset(&data, 0, sizeof(mozilla::gfx::VRExternalShmem));
+    DestroySync();
+    memset(&data, 0, sizeof(ExternalVRShmem));
+    InitializeSync();
     memset(&system, 0, sizeof(mozilla::gfx::VRSystemState));
     memset(&browser, 0, sizeof(mozilla::gfx::VRBrowserState));
     data.version = mozilla::gfx::kVRExternalVersion;
-    data.size = sizeof(mozilla::gfx::VRExternalShmem);
+    data.size = sizeof(ExternalVRShmem);
     system.displayState.isConnected = true;
     system.displayState.isMounted = true;
     system.displayState.nativeFramebufferScaleFactor = 1.0f;
@@ -161,7 +179,11 @@ struct ExternalVR::State {
     memcpy(&(system.sensorState.leftViewMatrix), identity.Data(), sizeof(system.sensorState.leftViewMatrix));
     memcpy(&(system.sensorState.rightViewMatrix), identity.Data(), sizeof(system.sensorState.rightViewMatrix));
     system.sensorState.pose.orientation[3] = 1.0f;
+    activeControllers = 0;
+    dirtyControllers = 0;
     lastFrameId = 0;
+    missedFrames = 0;
+    counters = ExternalVR::FrameCounters();
     firstPresentingFrame = false;
     waitingForExit = false;
     SetSourceBrowser(VRBrowserType::Gecko);
@@ -175,9 +197,43 @@ struct ExternalVR::State {
     return *sState;
   }
 
+  void PushSystemStateWhileLocked() {
+    // Controller slots are most of the state, only copy the ones that changed.
+    data.state.enumerationCompleted = system.enumerationCompleted;
+    memcpy(&(data.state.displayState), &(system.displayState), sizeof(mozilla::gfx::VRDisplayState));
+    memcpy(&(data.state.sensorState), &(system.sensorState), sizeof(mozilla::gfx::VRHMDSensorState));
+    for (int i = 0; dirtyControllers != 0 && i < mozilla::gfx::kVRControllerMaxCount; ++i) {
+      if (dirtyControllers & (1u << i)) {
+        memcpy(&(data.state.controllerState[i]), &(system.controllerState[i]), sizeof(mozilla::gfx::VRControllerState));
+        dirtyControllers &= ~(1u << i);
+      }
+    }
+  }
+
+#if !defined(EXTERNALVR_SEQLOCK)
   void PullBrowserStateWhileLocked() {
+    ApplyBrowserState(*sourceBrowserState);
+  }
+#else
+  // Copies the browser state without blocking the writer. When the copy keeps
+  // overlapping with writes the previous state is kept until the next call.
+  bool PullBrowserStateLockFree() {
+    const int kMaxAttempts = 4;
+    for (int attempt = 0; attempt < kMaxAttempts; ++attempt) {
+      const int64_t generation = ExternalVRTransport::BeginRead(browserGenerationB);
+      memcpy(&pendingBrowser, sourceBrowserState, sizeof(mozilla::gfx::VRBrowserState));
+      if (ExternalVRTransport::EndRead(browserGenerationA, generation)) {
+        ApplyBrowserState(pendingBrowser);
+        return true;
+      }
+    }
+    return false;
+  }
+#endif
+
+  void ApplyBrowserState(const mozilla::gfx::VRBrowserState& aState) {
     const bool wasPresenting = IsPresenting();
-    memcpy(&browser, sourceBrowserState, sizeof(mozilla::gfx::VRBrowserState));
+    memcpy(&browser, &aState, sizeof(mozilla::gfx::VRBrowserState));
 
 
     if ((!wasPresenting && IsPresenting()) || browser.navigationTransitionActive) {
@@ -189,18 +245,57 @@ struct ExternalVR::State {
     }
   }
 
+  // Returns true when a new frame was submitted or the browser stopped presenting.
+  bool CheckFrameSubmitted() {
+    if (!IsPresenting() || browser.layerState[0].layer_stereo_immersive.frameId != lastFrameId) {
+      firstPresentingFrame = false;
+      system.displayState.lastSubmittedFrameSuccessful = true;
+      system.displayState.lastSubmittedFrameId = browser.layerState[0].layer_stereo_immersive.frameId;
+      // VRB_LOG("RequestFrame BREAK %llu",  browser.layerState[0].layer_stereo_immersive.frameId);
+      return true;
+    }
+    return false;
+  }
+
+  ExternalVR::FrameResult OnNewFrame() {
+    lastFrameId = browser.layerState[0].layer_stereo_immersive.frameId;
+    const bool late = missedFrames > 0;
+    missedFrames = 0;
+    if (late) {
+      counters.late++;
+      return ExternalVR::FrameResult::Late;
+    }
+    counters.onTime++;
+    return ExternalVR::FrameResult::OnTime;
+  }
+
+  ExternalVR::FrameResult OnMissedFrame() {
+    missedFrames++;
+    return ExternalVR::FrameResult::Missed;
+  }
+
   bool IsPresenting() const {
     return browser.presentationActive || browser.navigationTransitionActive || browser.layerState[0].type == mozilla::gfx::VRLayerType::LayerType_Stereo_Immersive;
   }
 
   void SetSourceBrowser(VRBrowserType aBrowser) {
     if (aBrowser == VRBrowserType::Gecko) {
+#if !defined(EXTERNALVR_SEQLOCK)
       browserCond = &data.geckoCond;
       browserMutex = &data.geckoMutex;
+#else
+      browserGenerationA = &data.geckoGenerationA;
+      browserGenerationB = &data.geckoGenerationB;
+#endif
       sourceBrowserState = &data.geckoState;
     } else {
+#if !defined(EXTERNALVR_SEQLOCK)
       browserCond = &data.servoCond;
       browserMutex = &data.servoMutex;
+#else
+      browserGenerationA = &data.servoGenerationA;
+      browserGenerationB = &data.servoGenerationB;
+#endif
       sourceBrowserState = &data.servoState;
     }
   }
@@ -256,7 +351,7 @@ ExternalVR::Create() {
   return std::make_shared<ExternalVR>();
 }
 
-mozilla::gfx::VRExternalShmem*
+ExternalVRShmem*
 ExternalVR::GetSharedData() {
   return &(m.data);
 }
@@ -338,6 +433,7 @@ ExternalVR::SetEyeTransform(const device::Eye aEye, const vrb::Matrix& aTransfor
                                              : mozilla::gfx::VRDisplayState::Eye_Left);
   //memcpy(&(m.system.displayState.eyeTransform[which]), aTransform.Data(), sizeof(m.system.displayState.eyeTransform[which]));
   m.eyeTransforms[device::EyeIndex(aEye)] = aTransform;
+  m.eyeInverses[device::EyeIndex(aEye)] = aTransform.AfineInverse();
 }
 
 void
@@ -364,19 +460,29 @@ ExternalVR::SetSittingToStandingTransform(const vrb::Matrix& aTransform) {
 
 void
 ExternalVR::PushSystemState() {
+#if !defined(EXTERNALVR_SEQLOCK)
   Lock lock(&(m.data.systemMutex));
   if (lock.IsLocked()) {
-    memcpy(&(m.data.state), &(m.system), sizeof(mozilla::gfx::VRSystemState));
+    m.PushSystemStateWhileLocked();
     pthread_cond_signal(&m.data.systemCond);
   }
+#else
+  ExternalVRTransport::BeginWrite(&m.data.generationA);
+  m.PushSystemStateWhileLocked();
+  ExternalVRTransport::EndWrite(&m.data.generationB);
+#endif
 }
 
 void
 ExternalVR::PullBrowserState() {
+#if !defined(EXTERNALVR_SEQLOCK)
   Lock lock(m.browserMutex);
   if (lock.IsLocked()) {
    m.PullBrowserStateWhileLocked();
   }
+#else
+  m.PullBrowserStateLockFree();
+#endif
 }
 
 void
@@ -462,7 +568,7 @@ ExternalVR::GetVRState() const {
 
 void
 ExternalVR::PushFramePoses(const vrb::Matrix& aHeadTransform, const std::vector<Controller>& aControllers, const double aTimestamp) {
-  const vrb::Matrix inverseHeadTransform = aHeadTransform.Inverse();
+  const vrb::Matrix inverseHeadTransform = aHeadTransform.AfineInverse();
   vrb::Quaternion quaternion(inverseHeadTransform);
   vrb::Vector translation = aHeadTransform.GetTranslation();
   memcpy(&(m.system.sensorState.pose.orientation), quaternion.Data(),
@@ -472,22 +578,30 @@ ExternalVR::PushFramePoses(const vrb::Matrix& aHeadTransform, const std::vector<
   m.system.sensorState.inputFrameID++;
   m.system.displayState.lastSubmittedFrameId = m.lastFrameId;
 
-  vrb::Matrix leftView = m.eyeTransforms[device::EyeIndex(device::Eye::Left)].Inverse().PostMultiply(inverseHeadTransform);
-  vrb::Matrix rightView = m.eyeTransforms[device::EyeIndex(device::Eye::Right)].Inverse().PostMultiply(inverseHeadTransform);
+  vrb::Matrix leftView = m.eyeInverses[device::EyeIndex(device::Eye::Left)].PostMultiply(inverseHeadTransform);
+  vrb::Matrix rightView = m.eyeInverses[device::EyeIndex(device::Eye::Right)].PostMultiply(inverseHeadTransform);
   memcpy(&(m.system.sensorState.leftViewMatrix), leftView.Data(),
          sizeof(m.system.sensorState.leftViewMatrix));
   memcpy(&(m.system.sensorState.rightViewMatrix), rightView.Data(),
          sizeof(m.system.sensorState.rightViewMatrix));
 
-
-  memset(m.system.controllerState, 0, sizeof(m.system.controllerState));
-  for (int i = 0; i < aControllers.size(); ++i) {
+  uint32_t active = 0;
+  const size_t count = std::min(aControllers.size(), (size_t)mozilla::gfx::kVRControllerMaxCount);
+  for (size_t i = 0; i < count; ++i) {
     const Controller& controller = aControllers[i];
     if (controller.immersiveName.empty() || !controller.enabled) {
       continue;
     }
+    const uint32_t slot = 1u << i;
+    active |= slot;
+    const uint16_t flags = GetControllerCapabilityFlags(controller.deviceCapabilities);
     mozilla::gfx::VRControllerState& immersiveController = m.system.controllerState[i];
-    memcpy(immersiveController.controllerName, controller.immersiveName.c_str(), controller.immersiveName.size() + 1);
+    if (!(m.activeControllers & slot) || static_cast<uint16_t>(immersiveController.flags) != flags ||
+        strncmp(immersiveController.controllerName, controller.immersiveName.c_str(), mozilla::gfx::kVRControllerNameMaxLen) != 0) {
+      // A different controller uses this slot, clear the values it does not write.
+      memset(&immersiveController, 0, sizeof(immersiveController));
+      strncpy(immersiveController.controllerName, controller.immersiveName.c_str(), mozilla::gfx::kVRControllerNameMaxLen - 1);
+    }
     immersiveController.numButtons = controller.numButtons;
     immersiveController.buttonPressed = controller.immersivePressedState;
     immersiveController.buttonTouched = controller.immersiveTouchedState;
@@ -501,8 +615,6 @@ ExternalVR::PushFramePoses(const vrb::Matrix& aHeadTransform, const std::vector<
     immersiveController.numHaptics = controller.numHaptics;
     immersiveController.hand = controller.leftHanded ? mozilla::gfx::ControllerHand::Left : mozilla::gfx::ControllerHand::Right;
     immersiveController.type = GetVRControllerTypeByDevice(controller.type);
-
-    const uint16_t flags = GetControllerCapabilityFlags(controller.deviceCapabilities);
     immersiveController.flags = static_cast<mozilla::gfx::ControllerCapabilityFlags>(flags);
 
     if (flags & static_cast<uint16_t>(mozilla::gfx::ControllerCapabilityFlags::Cap_Orientation)) {
@@ -519,9 +631,9 @@ ExternalVR::PushFramePoses(const vrb::Matrix& aHeadTransform, const std::vector<
 
     if (flags & static_cast<uint16_t>(mozilla::gfx::ControllerCapabilityFlags::Cap_GripSpacePosition)) {
 #ifdef OPENXR
-      auto immersiveBeamTransform = controller.immersiveBeamTransform;
+      const vrb::Matrix& immersiveBeamTransform = controller.immersiveBeamTransform;
 #else
-      auto immersiveBeamTransform = controller.transformMatrix.PostMultiply(controller.immersiveBeamTransform);
+      const vrb::Matrix immersiveBeamTransform = controller.transformMatrix.PostMultiply(controller.immersiveBeamTransform);
 #endif
       vrb::Vector position(immersiveBeamTransform.GetTranslation());
       vrb::Quaternion rotate(immersiveBeamTransform.AfineInverse());
@@ -539,42 +651,76 @@ ExternalVR::PushFramePoses(const vrb::Matrix& aHeadTransform, const std::vector<
     immersiveController.squeezeActionStopFrameId = controller.squeezeActionStopFrameId;
   }
 
+  // Clear the slots of the controllers that are gone.
+  const uint32_t removed = m.activeControllers & ~active;
+  for (int i = 0; removed != 0 && i < mozilla::gfx::kVRControllerMaxCount; ++i) {
+    if (removed & (1u << i)) {
+      memset(&(m.system.controllerState[i]), 0, sizeof(mozilla::gfx::VRControllerState));
+    }
+  }
+  m.dirtyControllers |= active | removed;
+  m.activeControllers = active;
+
   m.system.sensorState.timestamp = aTimestamp;
 
   PushSystemState();
 }
 
-bool
-ExternalVR::WaitFrameResult() {
+ExternalVR::FrameResult
+ExternalVR::WaitFrameResult(const double aDeadline) {
+  const double kConditionTimeout = 0.1;
+  const double maxDeadline = ExternalVRTransport::NowSeconds() + kConditionTimeout;
+  const timespec deadline = ExternalVRTransport::DeadlineAt(aDeadline > 0.0 ? std::min(aDeadline, maxDeadline) : maxDeadline);
+#if !defined(EXTERNALVR_SEQLOCK)
   Wait wait(m.browserMutex, m.browserCond);
   wait.Lock();
   // browserMutex is locked in wait.lock().
   m.PullBrowserStateWhileLocked();
-  while (true) {
-    if (!IsPresenting() || m.browser.layerState[0].layer_stereo_immersive.frameId != m.lastFrameId) {
-      m.firstPresentingFrame = false;
-      m.system.displayState.lastSubmittedFrameSuccessful = true;
-      m.system.displayState.lastSubmittedFrameId = m.browser.layerState[0].layer_stereo_immersive.frameId;
-      // VRB_LOG("RequestFrame BREAK %llu",  m.browser.layerState[0].layer_stereo_immersive.frameId);
-      break;
-    }
+  while (!m.CheckFrameSubmitted()) {
     if (m.firstPresentingFrame || m.waitingForExit) {
-      return true; // Do not block to show loading screen until the first frame arrives.
+      return FrameResult::OnTime; // Do not block to show loading screen until the first frame arrives.
     }
     // VRB_LOG("RequestFrame ABOUT TO WAIT FOR FRAME %llu %llu",m.browser.layerState[0].layer_stereo_immersive.frameId, m.lastFrameId);
-    const float kConditionTimeout = 0.1f;
     // Wait causes the current thread to block until the condition variable is notified or the timeout happens.
     // Waiting for the condition variable releases the mutex atomically. So GV can modify the browser data.
-    if (!wait.DoWait(kConditionTimeout)) {
-      return false;
+    if (!wait.DoWait(deadline)) {
+      return m.OnMissedFrame();
     }
     // VRB_LOG("RequestFrame DONE TO WAIT FOR FRAME");
 
     // browserMutex lock is reacquired again after the condition variable wait exits.
     m.PullBrowserStateWhileLocked();
   }
-  m.lastFrameId = m.browser.layerState[0].layer_stereo_immersive.frameId;
-  return true;
+#else
+  int64_t generation = ExternalVRTransport::GetGeneration(m.browserGenerationB);
+  m.PullBrowserStateLockFree();
+  while (!m.CheckFrameSubmitted()) {
+    if (m.firstPresentingFrame || m.waitingForExit) {
+      return FrameResult::OnTime; // Do not block to show loading screen until the first frame arrives.
+    }
+    // Sleep until the browser publishes a new state. The writer is never blocked.
+    if (!ExternalVRTransport::WaitForGeneration(m.browserGenerationB, generation, deadline)) {
+      return m.OnMissedFrame();
+    }
+    generation = ExternalVRTransport::GetGeneration(m.browserGenerationB);
+    m.PullBrowserStateLockFree();
+  }
+#endif
+  return m.OnNewFrame();
+}
+
+void
+ExternalVR::CountMissedFrame(const bool aRepeated) {
+  if (aRepeated) {
+    m.counters.repeated++;
+  } else {
+    m.counters.discarded++;
+  }
+}
+
+const ExternalVR::FrameCounters&
+ExternalVR::GetFrameCounters() const {
+  return m.counters;
 }
 
 void
@@ -640,6 +786,13 @@ ExternalVR::OnResume() {
 
 void
 ExternalVR::StopPresenting() {
+  const FrameCounters& counters = m.counters;
+  if (counters.onTime + counters.late + counters.repeated + counters.discarded > 0) {
+    VRB_LOG("WebXR frames: %u on time, %u late, %u repeated, %u discarded", counters.onTime, counters.late,
+            counters.repeated, counters.discarded);
+  }
+  m.counters = FrameCounters();
+  m.missedFrames = 0;
   m.system.displayState.presentingGeneration++;
   PushSystemState();
   m.waitingForExit = true;
@@ -15,10 +15,9 @@
 #include <string>
 #include <vector>
 
-namespace mozilla { namespace gfx { struct VRExternalShmem; } }
-
 namespace crow {
 
+struct ExternalVRShmem;
 class ExternalVR;
 typedef std::shared_ptr<ExternalVR> ExternalVRPtr;
 
@@ -34,8 +33,19 @@ public:
     Gecko,
     Servo
   };
+  enum class FrameResult {
+    OnTime,  // A new frame arrived before the deadline.
+    Late,    // A new frame arrived after one or more Missed results.
+    Missed   // The deadline passed before the browser submitted a new frame.
+  };
+  struct FrameCounters {
+    uint32_t onTime = 0;
+    uint32_t late = 0;
+    uint32_t repeated = 0;
+    uint32_t discarded = 0;
+  };
   static ExternalVRPtr Create();
-  mozilla::gfx::VRExternalShmem* GetSharedData();
+  ExternalVRShmem* GetSharedData();
   // DeviceDisplay interface
   void SetDeviceName(const std::string& aName) override;
   void SetCapabilityFlags(const device::CapabilityFlags aFlags) override;
@@ -57,7 +67,12 @@ public:
   bool IsPresenting() const;
   VRState GetVRState() const;
   void PushFramePoses(const vrb::Matrix& aHeadTransform, const std::vector<Controller>& aControllers, const double aTimestamp);
-  bool WaitFrameResult();
+  // Waits for a new frame until aDeadline, in CLOCK_MONOTONIC seconds (see ExternalVRTransport).
+  // Never waits more than 100ms, which is also the timeout used when aDeadline is zero.
+  FrameResult WaitFrameResult(const double aDeadline);
+  // Records whether a Missed frame was repeated from the last good frame or discarded.
+  void CountMissedFrame(const bool aRepeated);
+  const FrameCounters& GetFrameCounters() const;
   void GetFrameResult(int32_t& aSurfaceHandle,
                       int32_t& aTextureWidth,
                       int32_t& aTextureHeight,
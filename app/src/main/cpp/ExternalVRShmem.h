@@ -0,0 +1,43 @@
+/* -*- Mode: C++; tab-width: 20; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#ifndef VRBROWSER_EXTERNALVR_SHMEM_H
+#define VRBROWSER_EXTERNALVR_SHMEM_H
+
+#include "moz_external_vr.h"
+
+// moz_external_vr.h is the browser engine's header and is kept as it is: its
+// VRExternalShmem carries mutex/condition pairs on Android and generation
+// counters everywhere else. EXTERNALVR_SEQLOCK selects the counters; it is
+// opt-in on Android, where the browser engine must be built with the layout
+// of ExternalVRShmem below.
+#if !defined(__ANDROID__) && !defined(EXTERNALVR_SEQLOCK)
+#  define EXTERNALVR_SEQLOCK
+#endif
+
+namespace crow {
+
+#if defined(__ANDROID__) && defined(EXTERNALVR_SEQLOCK)
+// The non-Android layout of VRExternalShmem.
+struct ExternalVRShmem {
+  int32_t version;
+  int32_t size;
+  int64_t generationA;
+  mozilla::gfx::VRSystemState state;
+  int64_t generationB;
+  int64_t geckoGenerationA;
+  int64_t servoGenerationA;
+  mozilla::gfx::VRBrowserState geckoState;
+  mozilla::gfx::VRBrowserState servoState;
+  int64_t geckoGenerationB;
+  int64_t servoGenerationB;
+};
+#else
+struct ExternalVRShmem : mozilla::gfx::VRExternalShmem {};
+#endif
+
+} // namespace crow
+
+#endif // VRBROWSER_EXTERNALVR_SHMEM_H
@@ -0,0 +1,130 @@
+/* -*- Mode: C++; tab-width: 20; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include "ExternalVRTransport.h"
+
+#include <atomic>
+#include <cerrno>
+#include <climits>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace {
+
+const int64_t kNanosecondsPerSecond = 1000000000LL;
+
+// Futexes are 32 bit wide: wait on the low word of the 64 bit counter, which
+// is the first one on the little endian ABIs we ship.
+volatile int32_t*
+FutexWord(volatile int64_t* aGeneration) {
+  return reinterpret_cast<volatile int32_t*>(aGeneration);
+}
+
+timespec
+ToTimespec(const int64_t aNanoseconds) {
+  timespec result = {};
+  result.tv_sec = (time_t)(aNanoseconds / kNanosecondsPerSecond);
+  result.tv_nsec = (long)(aNanoseconds % kNanosecondsPerSecond);
+  return result;
+}
+
+int64_t
+ToNanoseconds(const timespec& aTime) {
+  return (int64_t)aTime.tv_sec * kNanosecondsPerSecond + aTime.tv_nsec;
+}
+
+} // namespace
+
+namespace crow {
+
+timespec
+ExternalVRTransport::Deadline(const double aSeconds) {
+  return ToTimespec(NowNanoseconds() + (int64_t)(aSeconds * kNanosecondsPerSecond));
+}
+
+timespec
+ExternalVRTransport::DeadlineAt(const double aMonotonicSeconds) {
+  return ToTimespec((int64_t)(aMonotonicSeconds * kNanosecondsPerSecond));
+}
+
+double
+ExternalVRTransport::Remaining(const timespec& aDeadline) {
+  const int64_t remaining = ToNanoseconds(aDeadline) - NowNanoseconds();
+  return remaining > 0 ? (double)remaining / kNanosecondsPerSecond : 0.0;
+}
+
+int64_t
+ExternalVRTransport::NowNanoseconds() {
+  timespec now = {};
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return ToNanoseconds(now);
+}
+
+double
+ExternalVRTransport::NowSeconds() {
+  return (double)NowNanoseconds() / kNanosecondsPerSecond;
+}
+
+bool
+ExternalVRTransport::TimedWait(pthread_cond_t* aCond, pthread_mutex_t* aMutex, const timespec& aDeadline) {
+  timespec now = {};
+  clock_gettime(CLOCK_REALTIME, &now);
+  const timespec deadline = ToTimespec(ToNanoseconds(now) + ToNanoseconds(aDeadline) - NowNanoseconds());
+  return pthread_cond_timedwait(aCond, aMutex, &deadline) == 0;
+}
+
+void
+ExternalVRTransport::BeginWrite(volatile int64_t* aGenerationA) {
+  __atomic_store_n(aGenerationA, __atomic_load_n(aGenerationA, __ATOMIC_RELAXED) + 1, __ATOMIC_RELAXED);
+  // The new A must be visible before any of the data stores.
+  std::atomic_thread_fence(std::memory_order_release);
+}
+
+void
+ExternalVRTransport::EndWrite(volatile int64_t* aGenerationB) {
+  __atomic_store_n(aGenerationB, __atomic_load_n(aGenerationB, __ATOMIC_RELAXED) + 1, __ATOMIC_RELEASE);
+  // The counters live in memory shared with the browser engine process, so
+  // the futex can't be a process private one.
+  syscall(SYS_futex, FutexWord(aGenerationB), FUTEX_WAKE, INT_MAX, nullptr, nullptr, 0);
+}
+
+int64_t
+ExternalVRTransport::BeginRead(const volatile int64_t* aGenerationB) {
+  return __atomic_load_n(aGenerationB, __ATOMIC_ACQUIRE);
+}
+
+bool
+ExternalVRTransport::EndRead(const volatile int64_t* aGenerationA, const int64_t aGeneration) {
+  // The data loads must complete before A is read.
+  std::atomic_thread_fence(std::memory_order_acquire);
+  return __atomic_load_n(aGenerationA, __ATOMIC_RELAXED) == aGeneration;
+}
+
+int64_t
+ExternalVRTransport::GetGeneration(const volatile int64_t* aGenerationB) {
+  return __atomic_load_n(aGenerationB, __ATOMIC_ACQUIRE);
+}
+
+bool
+ExternalVRTransport::WaitForGeneration(volatile int64_t* aGenerationB, const int64_t aGeneration, const timespec& aDeadline) {
+  // Writers that do not wake the futex are still noticed within this interval.
+  const int64_t kMaxSleep = 2000000; // 2ms
+  while (GetGeneration(aGenerationB) == aGeneration) {
+    const int64_t remaining = ToNanoseconds(aDeadline) - NowNanoseconds();
+    if (remaining <= 0) {
+      return false;
+    }
+    const timespec timeout = ToTimespec(remaining < kMaxSleep ? remaining : kMaxSleep);
+    const int32_t expected = (int32_t)(aGeneration & 0xFFFFFFFF);
+    if (syscall(SYS_futex, FutexWord(aGenerationB), FUTEX_WAIT, expected, &timeout, nullptr, 0) != 0 &&
+        errno != EAGAIN && errno != ETIMEDOUT && errno != EINTR) {
+      return false;
+    }
+  }
+  return true;
+}
+
+} // namespace crow
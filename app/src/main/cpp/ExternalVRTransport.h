@@ -0,0 +1,62 @@
+/* -*- Mode: C++; tab-width: 20; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#ifndef VRBROWSER_EXTERNALVR_TRANSPORT_H
+#define VRBROWSER_EXTERNALVR_TRANSPORT_H
+
+#include "vrb/MacroUtils.h"
+
+#include <pthread.h>
+#include <stdint.h>
+#include <time.h>
+
+namespace crow {
+
+// Synchronization primitives for the VRExternalShmem exchange with the browser
+// engine.
+//
+// The Android layout of VRExternalShmem carries mutex/condition pairs. The
+// browser engine initializes and waits on them too, so the conditions keep
+// the default CLOCK_REALTIME; TimedWait converts the CLOCK_MONOTONIC deadline
+// right before each wait.
+//
+// The EXTERNALVR_SEQLOCK layout (see ExternalVRShmem.h) carries generation counters (generationA/B,
+// geckoGenerationA/B, servoGenerationA/B). A writer bumps A, writes the data
+// and then bumps B; a reader copies the data between reading B and A and
+// retries when they differ, so neither side ever blocks on the other. Readers
+// waiting for new data sleep on a futex on the low word of counter B, which
+// writers wake after each publication.
+class ExternalVRTransport {
+public:
+  // Returns a CLOCK_MONOTONIC time point aSeconds in the future.
+  static timespec Deadline(const double aSeconds);
+  // Seconds left until aDeadline, never negative.
+  static double Remaining(const timespec& aDeadline);
+  // Returns the CLOCK_MONOTONIC time point aMonotonicSeconds.
+  static timespec DeadlineAt(const double aMonotonicSeconds);
+  static int64_t NowNanoseconds();
+  static double NowSeconds();
+
+  // Waits on aCond (with aMutex locked) until signaled or the CLOCK_MONOTONIC
+  // aDeadline. aCond uses the default clock. Returns false on timeout or error.
+  static bool TimedWait(pthread_cond_t* aCond, pthread_mutex_t* aMutex, const timespec& aDeadline);
+
+  static void BeginWrite(volatile int64_t* aGenerationA);
+  // Publishes the data and wakes up the readers waiting in WaitForGeneration.
+  static void EndWrite(volatile int64_t* aGenerationB);
+  // Returns the generation to pass to EndRead.
+  static int64_t BeginRead(const volatile int64_t* aGenerationB);
+  // Returns true when no write happened since BeginRead, i.e. the copied data is consistent.
+  static bool EndRead(const volatile int64_t* aGenerationA, const int64_t aGeneration);
+  static int64_t GetGeneration(const volatile int64_t* aGenerationB);
+  // Blocks until counter B differs from aGeneration or aDeadline. Returns false on timeout.
+  static bool WaitForGeneration(volatile int64_t* aGenerationB, const int64_t aGeneration, const timespec& aDeadline);
+private:
+  VRB_NO_DEFAULTS(ExternalVRTransport)
+};
+
+} // namespace crow
+
+#endif // VRBROWSER_EXTERNALVR_TRANSPORT_H
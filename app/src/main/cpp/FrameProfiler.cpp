@@ -0,0 +1,289 @@
+/* -*- Mode: C++; tab-width: 20; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include "FrameProfiler.h"
+#include "vrb/ConcreteClass.h"
+#include "vrb/Logger.h"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <fstream>
+#include <sstream>
+#include <time.h>
+#include <vector>
+
+namespace {
+
+const char* const kFramePhaseNames[] = {
+  "ProcessEvents",
+  "PullBrowserState",
+  "UpdateControllers",
+  "SortWidgets",
+  "Cull",
+  "CullDraw",
+  "WaitFrameResult",
+  "DeviceEndFrame"
+};
+
+const size_t kPhaseCount = (size_t)crow::FramePhase::Count;
+static_assert(sizeof(kFramePhaseNames) / sizeof(kFramePhaseNames[0]) == kPhaseCount, "Missing phase names");
+
+const char* const kFrameCounterNames[] = {
+  "OutsideFrustumLayers",
+  "OccludedLayers"
+};
+
+const size_t kCounterCount = (size_t)crow::FrameCounter::Count;
+static_assert(sizeof(kFrameCounterNames) / sizeof(kFrameCounterNames[0]) == kCounterCount, "Missing counter names");
+
+const size_t kRingSize = 512;
+
+struct FrameRecord {
+  uint64_t frameIndex;
+  uint64_t start;
+  uint64_t end;
+  // Phases may run several times per frame (e.g. once per eye). Keep the first
+  // start and the accumulated duration.
+  std::array<uint64_t, kPhaseCount> phaseStart;
+  std::array<uint64_t, kPhaseCount> phaseDuration;
+  std::array<int32_t, kCounterCount> counters;
+};
+
+// Slots are written by the render thread only. Readers use the sequence
+// number to detect torn copies (odd while the slot is being written).
+struct FrameSlot {
+  std::atomic<uint64_t> sequence;
+  FrameRecord record;
+};
+
+double
+ToMs(const uint64_t aNanoseconds) {
+  return (double)aNanoseconds / 1000000.0;
+}
+
+double
+Percentile(const std::vector<uint64_t>& aSorted, const double aPercentile) {
+  if (aSorted.empty()) {
+    return 0.0;
+  }
+  size_t index = (size_t)(aPercentile * (double)(aSorted.size() - 1) + 0.5);
+  return ToMs(aSorted[std::min(index, aSorted.size() - 1)]);
+}
+
+} // namespace
+
+namespace crow {
+
+struct FrameProfiler::State {
+  std::array<FrameSlot, kRingSize> ring;
+  std::atomic<uint64_t> published;
+  FrameRecord current;
+  bool inFrame;
+  std::string tracePath;
+
+  State() : published(0), current(), inFrame(false) {
+    for (FrameSlot& slot: ring) {
+      slot.sequence.store(0, std::memory_order_relaxed);
+    }
+  }
+
+  void Publish() {
+    const uint64_t index = published.load(std::memory_order_relaxed);
+    FrameSlot& slot = ring[index % kRingSize];
+    const uint64_t sequence = slot.sequence.load(std::memory_order_relaxed);
+    slot.sequence.store(sequence + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    slot.record = current;
+    slot.record.frameIndex = index;
+    slot.sequence.store(sequence + 2, std::memory_order_release);
+    published.store(index + 1, std::memory_order_release);
+  }
+
+  // Copy the published frames, oldest first. Slots overwritten during the copy are skipped.
+  std::vector<FrameRecord> Snapshot() const {
+    std::vector<FrameRecord> result;
+    const uint64_t count = published.load(std::memory_order_acquire);
+    const uint64_t first = count > kRingSize ? count - kRingSize : 0;
+    result.reserve((size_t)(count - first));
+    for (uint64_t index = first; index < count; ++index) {
+      const FrameSlot& slot = ring[index % kRingSize];
+      const uint64_t before = slot.sequence.load(std::memory_order_acquire);
+      if (before & 1) {
+        continue;
+      }
+      FrameRecord record = slot.record;
+      std::atomic_thread_fence(std::memory_order_acquire);
+      if (slot.sequence.load(std::memory_order_relaxed) != before || record.frameIndex != index) {
+        continue;
+      }
+      result.push_back(record);
+    }
+    return result;
+  }
+
+  static Summary Summarize(std::vector<uint64_t>& aDurations) {
+    Summary result = {};
+    std::sort(aDurations.begin(), aDurations.end());
+    result.p50Ms = Percentile(aDurations, 0.50);
+    result.p95Ms = Percentile(aDurations, 0.95);
+    result.p99Ms = Percentile(aDurations, 0.99);
+    result.frames = (int32_t)aDurations.size();
+    return result;
+  }
+};
+
+FrameProfiler&
+FrameProfiler::Instance() {
+  static std::shared_ptr<FrameProfiler> sInstance = std::make_shared<vrb::ConcreteClass<FrameProfiler, FrameProfiler::State> >();
+  return *sInstance;
+}
+
+uint64_t
+FrameProfiler::Now() {
+  timespec spec = {};
+  clock_gettime(CLOCK_MONOTONIC, &spec);
+  return (uint64_t)spec.tv_sec * 1000000000ull + (uint64_t)spec.tv_nsec;
+}
+
+void
+FrameProfiler::BeginFrame() {
+  m.current = FrameRecord();
+  m.current.start = Now();
+  m.inFrame = true;
+}
+
+void
+FrameProfiler::EndFrame() {
+  if (!m.inFrame) {
+    return;
+  }
+  m.current.end = Now();
+  m.inFrame = false;
+  m.Publish();
+}
+
+void
+FrameProfiler::AddSample(const FramePhase aPhase, const uint64_t aStart, const uint64_t aEnd) {
+  if (!m.inFrame || aPhase == FramePhase::Count) {
+    return;
+  }
+  const size_t phase = (size_t)aPhase;
+  if (m.current.phaseDuration[phase] == 0) {
+    m.current.phaseStart[phase] = aStart;
+  }
+  m.current.phaseDuration[phase] += aEnd - aStart;
+}
+
+void
+FrameProfiler::SetCounter(const FrameCounter aCounter, const int32_t aValue) {
+  if (!m.inFrame || aCounter == FrameCounter::Count) {
+    return;
+  }
+  m.current.counters[(size_t)aCounter] = aValue;
+}
+
+FrameProfiler::Summary
+FrameProfiler::GetSummary(const FramePhase aPhase) const {
+  const std::vector<FrameRecord> frames = m.Snapshot();
+  std::vector<uint64_t> durations;
+  durations.reserve(frames.size());
+  for (const FrameRecord& frame: frames) {
+    durations.push_back(frame.phaseDuration[(size_t)aPhase]);
+  }
+  return State::Summarize(durations);
+}
+
+FrameProfiler::Summary
+FrameProfiler::GetFrameSummary() const {
+  const std::vector<FrameRecord> frames = m.Snapshot();
+  std::vector<uint64_t> durations;
+  durations.reserve(frames.size());
+  for (const FrameRecord& frame: frames) {
+    durations.push_back(frame.end - frame.start);
+  }
+  return State::Summarize(durations);
+}
+
+FrameProfiler::CounterSummary
+FrameProfiler::GetCounterSummary(const FrameCounter aCounter) const {
+  const std::vector<FrameRecord> frames = m.Snapshot();
+  CounterSummary result = {};
+  int64_t total = 0;
+  for (const FrameRecord& frame: frames) {
+    const int32_t value = frame.counters[(size_t)aCounter];
+    total += value;
+    result.max = std::max(result.max, value);
+  }
+  result.frames = (int32_t)frames.size();
+  result.average = frames.empty() ? 0.0 : (double)total / (double)frames.size();
+  return result;
+}
+
+std::string
+FrameProfiler::ToChromeTrace() const {
+  const std::vector<FrameRecord> frames = m.Snapshot();
+  std::ostringstream out;
+  out << "{\"traceEvents\":[";
+  bool first = true;
+  auto addEvent = [&](const std::string& aName, const uint64_t aStart, const uint64_t aDuration, const uint64_t aFrame) {
+    out << (first ? "" : ",") << "{\"name\":\"" << aName << "\",\"cat\":\"frame\",\"ph\":\"X\",\"pid\":0,\"tid\":0"
+        << ",\"ts\":" << aStart / 1000 << "." << (aStart % 1000) / 100
+        << ",\"dur\":" << aDuration / 1000 << "." << (aDuration % 1000) / 100
+        << ",\"args\":{\"frame\":" << aFrame << "}}";
+    first = false;
+  };
+  for (const FrameRecord& frame: frames) {
+    addEvent("Frame", frame.start, frame.end - frame.start, frame.frameIndex);
+    for (size_t phase = 0; phase < kPhaseCount; ++phase) {
+      if (frame.phaseDuration[phase] > 0) {
+        addEvent(kFramePhaseNames[phase], frame.phaseStart[phase], frame.phaseDuration[phase], frame.frameIndex);
+      }
+    }
+    for (size_t counter = 0; counter < kCounterCount; ++counter) {
+      out << ",{\"name\":\"" << kFrameCounterNames[counter] << "\",\"cat\":\"frame\",\"ph\":\"C\",\"pid\":0,\"tid\":0"
+          << ",\"ts\":" << frame.start / 1000 << "." << (frame.start % 1000) / 100
+          << ",\"args\":{\"value\":" << frame.counters[counter] << "}}";
+    }
+  }
+  out << "],\"displayTimeUnit\":\"ms\"}";
+  return out.str();
+}
+
+void
+FrameProfiler::SetTracePath(const std::string& aPath) {
+  m.tracePath = aPath;
+}
+
+void
+FrameProfiler::Dump() const {
+  const Summary frame = GetFrameSummary();
+  if (frame.frames == 0) {
+    return;
+  }
+  VRB_LOG("FrameProfiler: %d frames p50: %.2fms p95: %.2fms p99: %.2fms", frame.frames, frame.p50Ms, frame.p95Ms, frame.p99Ms);
+  for (size_t phase = 0; phase < kPhaseCount; ++phase) {
+    const Summary summary = GetSummary((FramePhase)phase);
+    VRB_LOG("FrameProfiler:   %-18s p50: %.2fms p95: %.2fms p99: %.2fms", kFramePhaseNames[phase],
+            summary.p50Ms, summary.p95Ms, summary.p99Ms);
+  }
+  for (size_t counter = 0; counter < kCounterCount; ++counter) {
+    const CounterSummary summary = GetCounterSummary((FrameCounter)counter);
+    VRB_LOG("FrameProfiler:   %-18s avg: %.2f max: %d", kFrameCounterNames[counter], summary.average, summary.max);
+  }
+  if (!m.tracePath.empty()) {
+    std::ofstream file(m.tracePath, std::ios::out | std::ios::trunc);
+    if (file) {
+      file << ToChromeTrace();
+      VRB_LOG("FrameProfiler: trace written to %s", m.tracePath.c_str());
+    } else {
+      VRB_ERROR("FrameProfiler: unable to write trace to %s", m.tracePath.c_str());
+    }
+  }
+}
+
+FrameProfiler::FrameProfiler(State& aState) : m(aState) {}
+
+} // namespace crow
@@ -0,0 +1,109 @@
+/* -*- Mode: C++; tab-width: 20; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#ifndef VRBROWSER_FRAME_PROFILER_H
+#define VRBROWSER_FRAME_PROFILER_H
+
+#include "vrb/MacroUtils.h"
+
+#include <memory>
+#include <string>
+
+namespace crow {
+
+// Phases of a BrowserWorld frame. Keep kFramePhaseNames in sync.
+enum class FramePhase {
+  ProcessEvents,
+  PullBrowserState,
+  UpdateControllers,
+  SortWidgets,
+  Cull,
+  CullDraw,
+  WaitFrameResult,
+  DeviceEndFrame,
+  Count
+};
+
+// Per-frame counts recorded next to the phase timings. Keep kFrameCounterNames in sync.
+enum class FrameCounter {
+  OutsideFrustumLayers,
+  OccludedLayers,
+  Count
+};
+
+// Per-frame CPU phase timings recorded by the render thread into a lock-free
+// ring buffer. Only compiled in when FRAME_PROFILER is defined; use the
+// CROW_PROFILE_* macros below so release builds pay nothing.
+class FrameProfiler {
+public:
+  struct Summary {
+    double p50Ms;
+    double p95Ms;
+    double p99Ms;
+    int32_t frames;
+  };
+  struct CounterSummary {
+    double average;
+    int32_t max;
+    int32_t frames;
+  };
+
+  static FrameProfiler& Instance();
+  static uint64_t Now();
+
+  void BeginFrame();
+  void EndFrame();
+  void AddSample(const FramePhase aPhase, const uint64_t aStart, const uint64_t aEnd);
+  void SetCounter(const FrameCounter aCounter, const int32_t aValue);
+
+  // The following may be called from any thread.
+  Summary GetSummary(const FramePhase aPhase) const;
+  Summary GetFrameSummary() const;
+  CounterSummary GetCounterSummary(const FrameCounter aCounter) const;
+  std::string ToChromeTrace() const;
+  void SetTracePath(const std::string& aPath);
+  void Dump() const;
+protected:
+  struct State;
+  FrameProfiler(State& aState);
+  ~FrameProfiler() = default;
+private:
+  State& m;
+  FrameProfiler() = delete;
+  VRB_NO_DEFAULTS(FrameProfiler)
+};
+
+class FrameProfilerScope {
+public:
+  explicit FrameProfilerScope(const FramePhase aPhase) : mPhase(aPhase), mStart(FrameProfiler::Now()) {}
+  ~FrameProfilerScope() { FrameProfiler::Instance().AddSample(mPhase, mStart, FrameProfiler::Now()); }
+private:
+  const FramePhase mPhase;
+  const uint64_t mStart;
+  VRB_NO_DEFAULTS(FrameProfilerScope)
+};
+
+} // namespace crow
+
+#if defined(FRAME_PROFILER)
+#define CROW_PROFILE_CONCAT_IMPL(a, b) a##b
+#define CROW_PROFILE_CONCAT(a, b) CROW_PROFILE_CONCAT_IMPL(a, b)
+#define CROW_PROFILE_BEGIN_FRAME() crow::FrameProfiler::Instance().BeginFrame()
+#define CROW_PROFILE_END_FRAME() crow::FrameProfiler::Instance().EndFrame()
+#define CROW_PROFILE_SCOPE(phase) \
+  crow::FrameProfilerScope CROW_PROFILE_CONCAT(profileScope, __LINE__)(crow::FramePhase::phase)
+#define CROW_PROFILE_COUNTER(counter, value) crow::FrameProfiler::Instance().SetCounter(crow::FrameCounter::counter, value)
+#define CROW_PROFILE_SET_TRACE_PATH(path) crow::FrameProfiler::Instance().SetTracePath(path)
+#define CROW_PROFILE_DUMP() crow::FrameProfiler::Instance().Dump()
+#else
+#define CROW_PROFILE_BEGIN_FRAME()
+#define CROW_PROFILE_END_FRAME()
+#define CROW_PROFILE_SCOPE(phase)
+#define CROW_PROFILE_COUNTER(counter, value)
+#define CROW_PROFILE_SET_TRACE_PATH(path)
+#define CROW_PROFILE_DUMP()
+#endif
+
+#endif // VRBROWSER_FRAME_PROFILER_H
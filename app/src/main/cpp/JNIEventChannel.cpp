@@ -0,0 +1,270 @@
+/* -*- Mode: C++; tab-width: 20; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include "JNIEventChannel.h"
+#include "vrb/ConcreteClass.h"
+
+#include <atomic>
+#include <unordered_map>
+#include <vector>
+
+namespace crow {
+
+static_assert(JNIEventChannel::kRecordSize == 32, "VRBrowserActivity expects 32 byte records");
+
+namespace {
+
+// Records the backlog may hold (128 KB) when Java stops draining the ring.
+const size_t kMaxBacklog = 4096;
+
+// Motion and scroll records coalesce per widget handle and controller.
+uint64_t
+PointerKey(const JNIEventChannel::Record& aRecord) {
+  return ((uint64_t)(uint32_t)aRecord.values[0].i << 32) | (uint32_t)aRecord.values[1].i;
+}
+
+// Resize, move end and widget visibility records coalesce per widget handle.
+uint64_t
+WidgetKey(const JNIEventChannel::Record& aRecord) {
+  return ((uint64_t)(uint32_t)aRecord.type << 32) | (uint32_t)aRecord.values[0].i;
+}
+
+} // namespace
+
+struct JNIEventChannel::State {
+  std::vector<Record> records;
+  uint32_t mask = 0;
+  // Producer owned.
+  uint32_t write = 0;
+  // Last value of |consumed| seen by the producer, so a push only reads the
+  // shared counter when the ring looks full.
+  uint32_t cachedConsumed = 0;
+  // Records pushed while the ring was full, in order. Producer owned.
+  std::vector<Record> backlog;
+  // Backlog size after the last compaction or move, so that a full backlog
+  // is only compacted again once it grew.
+  size_t compactedSize = 0;
+  std::vector<bool> removed;
+  // Last backlog index of the motion and scroll records of each pointer, and
+  // whether that motion record repeats the flags of the one before it.
+  std::unordered_map<uint64_t, std::pair<size_t, bool>> lastMotion;
+  std::unordered_map<uint64_t, size_t> lastScroll;
+  std::unordered_map<uint64_t, size_t> lastWidgetState;
+  uint32_t coalesced = 0;
+  uint32_t dropped = 0;
+  // Kept apart from |consumed| so the two sides do not share a cache line.
+  alignas(64) std::atomic<uint32_t> published;
+  alignas(64) std::atomic<uint32_t> consumed;
+
+  State() : published(0), consumed(0) {}
+
+  bool IsFull() {
+    if (write - cachedConsumed > mask) {
+      cachedConsumed = consumed.load(std::memory_order_acquire);
+    }
+    return write - cachedConsumed > mask;
+  }
+
+  void Remove(const size_t aIndex) {
+    removed[aIndex] = true;
+    coalesced++;
+  }
+
+  // Removes the backlog records that a later one supersedes. A motion record
+  // is only removed when the records before and after it have the same
+  // flags, so every focus, press and release change reaches Java at the
+  // position where it happened. Only the last resize, move end and
+  // visibility record of a widget is kept.
+  void CompactBacklog() {
+    removed.assign(backlog.size(), false);
+    lastMotion.clear();
+    lastScroll.clear();
+    lastWidgetState.clear();
+    size_t lastAudioPose = SIZE_MAX;
+    size_t lastBatteryLevels = SIZE_MAX;
+    for (size_t index = 0; index < backlog.size(); ++index) {
+      Record& record = backlog[index];
+      switch ((EventType)record.type) {
+        case EventType::MotionEvent: {
+          const uint64_t key = PointerKey(record);
+          auto previous = lastMotion.find(key);
+          bool repeated = false;
+          if (previous != lastMotion.end() && backlog[previous->second.first].values[2].i == record.values[2].i) {
+            if (previous->second.second) {
+              Remove(previous->second.first);
+            }
+            repeated = true;
+          }
+          lastMotion[key] = std::make_pair(index, repeated);
+          // A scroll is not moved across a pointer motion.
+          lastScroll.erase(key);
+          break;
+        }
+        case EventType::ScrollEvent: {
+          const uint64_t key = PointerKey(record);
+          auto previous = lastScroll.find(key);
+          if (previous != lastScroll.end()) {
+            record.values[2].f += backlog[previous->second].values[2].f;
+            record.values[3].f += backlog[previous->second].values[3].f;
+            Remove(previous->second);
+          }
+          lastScroll[key] = index;
+          break;
+        }
+        case EventType::AudioPose:
+          if (lastAudioPose != SIZE_MAX) {
+            Remove(lastAudioPose);
+          }
+          lastAudioPose = index;
+          break;
+        case EventType::ControllerBatteryLevels:
+          if (lastBatteryLevels != SIZE_MAX) {
+            Remove(lastBatteryLevels);
+          }
+          lastBatteryLevels = index;
+          break;
+        case EventType::Resize:
+        case EventType::MoveEnd:
+        case EventType::WidgetOnScreen: {
+          const uint64_t key = WidgetKey(record);
+          auto previous = lastWidgetState.find(key);
+          if (previous != lastWidgetState.end()) {
+            Remove(previous->second);
+          }
+          lastWidgetState[key] = index;
+          break;
+        }
+        default:
+          break;
+      }
+    }
+    size_t kept = 0;
+    for (size_t index = 0; index < backlog.size(); ++index) {
+      if (!removed[index]) {
+        backlog[kept++] = backlog[index];
+      }
+    }
+    backlog.resize(kept);
+    compactedSize = kept;
+  }
+
+  void MoveBacklog() {
+    size_t moved = 0;
+    while (moved < backlog.size() && !IsFull()) {
+      records[write & mask] = backlog[moved++];
+      write++;
+    }
+    backlog.erase(backlog.begin(), backlog.begin() + moved);
+    compactedSize = backlog.size();
+  }
+};
+
+JNIEventChannelPtr
+JNIEventChannel::Create(const uint32_t aCapacity) {
+  return std::make_shared<vrb::ConcreteClass<JNIEventChannel, JNIEventChannel::State> >(aCapacity);
+}
+
+void*
+JNIEventChannel::GetBuffer() const {
+  return (void*)m.records.data();
+}
+
+size_t
+JNIEventChannel::GetBufferSize() const {
+  return m.records.size() * kRecordSize;
+}
+
+uint32_t
+JNIEventChannel::GetCapacity() const {
+  return (uint32_t)m.records.size();
+}
+
+JNIEventChannel::Record*
+JNIEventChannel::Push(const EventType aType) {
+  // Once records wait in the backlog the new ones queue behind them.
+  if (!m.backlog.empty() || m.IsFull()) {
+    if (m.backlog.size() >= kMaxBacklog && m.backlog.size() > m.compactedSize) {
+      m.CompactBacklog();
+    }
+    if (m.backlog.size() >= kMaxBacklog) {
+      // Java stopped draining the ring.
+      m.dropped++;
+      return nullptr;
+    }
+    m.backlog.push_back(Record());
+    m.backlog.back().type = (int32_t)aType;
+    return &m.backlog.back();
+  }
+  Record& record = m.records[m.write & m.mask];
+  m.write++;
+  record.type = (int32_t)aType;
+  return &record;
+}
+
+bool
+JNIEventChannel::HasUnpublished() const {
+  return !m.backlog.empty() || m.write != m.published.load(std::memory_order_relaxed);
+}
+
+uint32_t
+JNIEventChannel::Publish() {
+  if (!m.backlog.empty()) {
+    m.CompactBacklog();
+    m.MoveBacklog();
+  }
+  m.published.store(m.write, std::memory_order_release);
+  return m.write;
+}
+
+uint32_t
+JNIEventChannel::GetBacklogSize() const {
+  return (uint32_t)m.backlog.size();
+}
+
+uint32_t
+JNIEventChannel::GetCoalescedCount() const {
+  return m.coalesced;
+}
+
+uint32_t
+JNIEventChannel::GetDroppedCount() const {
+  return m.dropped;
+}
+
+uint32_t
+JNIEventChannel::GetPublished() const {
+  return m.published.load(std::memory_order_acquire);
+}
+
+const JNIEventChannel::Record&
+JNIEventChannel::GetRecord(const uint32_t aIndex) const {
+  return m.records[aIndex & m.mask];
+}
+
+void
+JNIEventChannel::Release(const uint32_t aIndex) {
+  m.consumed.store(aIndex, std::memory_order_release);
+}
+
+void
+JNIEventChannel::Reset() {
+  m.write = 0;
+  m.cachedConsumed = 0;
+  m.backlog.clear();
+  m.compactedSize = 0;
+  m.published.store(0, std::memory_order_relaxed);
+  m.consumed.store(0, std::memory_order_relaxed);
+}
+
+JNIEventChannel::JNIEventChannel(State& aState, const uint32_t aCapacity) : m(aState) {
+  uint32_t capacity = 1;
+  while (capacity < aCapacity) {
+    capacity <<= 1;
+  }
+  m.records.resize(capacity, Record());
+  m.mask = capacity - 1;
+}
+
+} // namespace crow
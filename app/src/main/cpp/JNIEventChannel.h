@@ -0,0 +1,103 @@
+/* -*- Mode: C++; tab-width: 20; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#ifndef VRBROWSER_JNI_EVENT_CHANNEL_DOT_H
+#define VRBROWSER_JNI_EVENT_CHANNEL_DOT_H
+
+#include "vrb/MacroUtils.h"
+
+#include <memory>
+#include <stddef.h>
+#include <stdint.h>
+
+namespace crow {
+
+class JNIEventChannel;
+typedef std::shared_ptr<JNIEventChannel> JNIEventChannelPtr;
+
+// Single producer, single consumer ring of fixed size event records sent from
+// the render thread to Java. The records live in one block of memory that
+// Java wraps in a direct ByteBuffer (native byte order), so pushing an event
+// neither allocates nor crosses JNI. Indices are free running counters; the
+// slot of index i is i & (capacity - 1).
+//
+// The producer pushes records during the frame and publishes them once with
+// Publish(). The consumer reads the records in [read, published) and hands
+// the slots back with Release(). When the ring is full records wait in a
+// native backlog, where motion, scroll, audio pose and battery records that
+// a later record of the same kind supersedes are coalesced, as are the
+// resize, move end and visibility records of a widget. Focus, press and
+// release changes and gestures are never coalesced; they are only dropped
+// once the backlog is full because Java stopped draining the ring.
+class JNIEventChannel {
+public:
+  // Values must match VRBrowserActivity.NATIVE_EVENT_*.
+  enum class EventType : int32_t {
+    MotionEvent = 1,             // handle, controller, flags, x, y
+    ScrollEvent = 2,             // handle, controller, x, y
+    AudioPose = 3,               // qx, qy, qz, qw, px, py, pz
+    Gesture = 4,                 // type
+    Resize = 5,                  // handle, width, height
+    MoveEnd = 6,                 // handle, x, y, z, rotation
+    ControllerBatteryLevels = 7, // left, right
+    WidgetOnScreen = 8,          // handle, on screen
+  };
+  // MotionEvent flags.
+  static const int32_t kFocused = 1 << 0;
+  static const int32_t kPressed = 1 << 1;
+
+  static const int32_t kMaxValues = 7;
+  struct Record {
+    int32_t type;
+    union Value {
+      int32_t i;
+      float f;
+    } values[kMaxValues];
+  };
+  static const size_t kRecordSize = sizeof(Record);
+
+  // aCapacity is rounded up to a power of two.
+  static JNIEventChannelPtr Create(const uint32_t aCapacity);
+
+  void* GetBuffer() const;
+  size_t GetBufferSize() const;
+  uint32_t GetCapacity() const;
+
+  // Producer side. Returns the record to fill, which is in the backlog when
+  // the ring is full, or null when the backlog is full too. Its values must
+  // be set before the next Push().
+  Record* Push(const EventType aType);
+  bool HasUnpublished() const;
+  // Moves what fits of the backlog to the ring, makes the pushed records
+  // visible to the consumer and returns the end index.
+  uint32_t Publish();
+  // Records waiting for ring slots.
+  uint32_t GetBacklogSize() const;
+  // Number of backlog records merged into a later one, since creation.
+  uint32_t GetCoalescedCount() const;
+  // Number of records not pushed because the backlog was full, since creation.
+  uint32_t GetDroppedCount() const;
+
+  // Consumer side.
+  uint32_t GetPublished() const;
+  const Record& GetRecord(const uint32_t aIndex) const;
+  // Hands back every slot before aIndex to the producer.
+  void Release(const uint32_t aIndex);
+
+  // Drops every record. Neither side may be using the channel.
+  void Reset();
+protected:
+  struct State;
+  JNIEventChannel(State& aState, const uint32_t aCapacity);
+  ~JNIEventChannel() = default;
+private:
+  State& m;
+  JNIEventChannel() = delete;
+  VRB_NO_DEFAULTS(JNIEventChannel)
+};
+
+} // namespace crow
+
+#endif // VRBROWSER_JNI_EVENT_CHANNEL_DOT_H
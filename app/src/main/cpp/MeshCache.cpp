@@ -0,0 +1,259 @@
+/* -*- Mode: C++; tab-width: 20; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include "MeshCache.h"
+#include "vrb/ConcreteClass.h"
+
+#include "vrb/Color.h"
+#include "vrb/CreationContext.h"
+#include "vrb/Geometry.h"
+#include "vrb/RenderState.h"
+#include "vrb/Vector.h"
+#include "vrb/VertexArray.h"
+
+#include <cmath>
+#include <map>
+#include <tuple>
+#include <vector>
+
+namespace {
+
+// Arcs and borders closer than this share a mesh.
+const float kKeyPrecision = 10000.0f;
+
+int32_t
+Quantize(const float aValue) {
+  return (int32_t)lroundf(aValue * kKeyPrecision);
+}
+
+uint32_t
+PackColor(const vrb::Color& aColor) {
+  const auto channel = [](const float aValue) -> uint32_t {
+    return (uint32_t)lroundf(fmaxf(0.0f, fminf(1.0f, aValue)) * 255.0f);
+  };
+  return (channel(aColor.Red()) << 24) | (channel(aColor.Green()) << 16) | (channel(aColor.Blue()) << 8) | channel(aColor.Alpha());
+}
+
+struct Entry {
+  vrb::CreationContextWeak context;
+  crow::MeshCachePtr cache;
+};
+
+// One cache per CreationContext, dropped when the context goes away.
+std::map<const vrb::CreationContext*, Entry> sCaches;
+
+} // namespace
+
+namespace crow {
+
+struct MeshCache::State {
+  // Segments, arc, border, solid color and border color.
+  typedef std::tuple<int32_t, int32_t, int32_t, uint32_t, uint32_t> CylinderKey;
+  // Segments and half sphere.
+  typedef std::pair<int32_t, bool> SphereKey;
+  struct Mesh {
+    vrb::VertexArrayPtr array;
+    // One based indices, four per cylinder face and three per sphere face.
+    std::vector<int> indices;
+  };
+
+  vrb::CreationContextWeak context;
+  std::map<CylinderKey, Mesh> cylinders;
+  std::map<SphereKey, Mesh> spheres;
+
+  State() {}
+
+  Mesh CreateCylinderMesh(const int32_t aSegments, const float aArc, const float aBorder,
+                          const vrb::Color& aSolidColor, const vrb::Color& aBorderColor) {
+    vrb::CreationContextPtr create = context.lock();
+    Mesh result;
+    result.array = vrb::VertexArray::Create(create);
+    const float startAngle = (float) M_PI * 0.5f + aArc * 0.5f;
+    const bool hasBorder = aBorder > 0.0f;
+    const int ySegments = 1 + (hasBorder ? 2 : 0);
+
+    // The sine and cosine of each column are shared by all the rows.
+    std::vector<float> sines((size_t)aSegments + 1);
+    std::vector<float> cosines((size_t)aSegments + 1);
+    for (int x = 0; x <= aSegments; ++x) {
+      const float theta = startAngle - aArc * ((float) x / (float) aSegments);
+      sines[x] = sinf(theta);
+      cosines[x] = cosf(theta);
+    }
+
+    for (int y = 0; y <= ySegments; ++y) {
+      float offset = 0.0f;
+      float v = (float) y;
+      vrb::Color vertexColor = aSolidColor;
+      if (hasBorder) {
+        if (y == 0) {
+          v = 0.0f;
+          offset = aBorder;
+          vertexColor = aBorderColor;
+        } else if (y == ySegments) {
+          v = 1.0f;
+          offset = -aBorder;
+          vertexColor = aBorderColor;
+        } else {
+          v = (float) (y - 1);
+        }
+      }
+
+      for (int x = 0; x <= aSegments; ++x) {
+        vrb::Vector vertex(cosines[x], -v + 0.5f + offset, -sines[x]);
+        result.array->AppendVertex(vertex);
+        result.array->AppendUV(vrb::Vector((float) x / (float) aSegments, v, 0.0f));
+        result.array->AppendNormal(vertex.Normalize());
+        if (hasBorder) {
+          result.array->AppendColor(vertexColor);
+        }
+      }
+    }
+
+    // Faces are ordered by column so that a range of columns can be drawn with SetRenderRange.
+    result.indices.reserve((size_t)aSegments * ySegments * 4);
+    for (int x = 0; x < aSegments; ++x) {
+      for (int y = 0; y < ySegments; ++y) {
+        const int a = 1 + y * (aSegments + 1) + x;
+        const int b = 1 + (y + 1) * (aSegments + 1) + x;
+        result.indices.push_back(b);
+        result.indices.push_back(b + 1);
+        result.indices.push_back(a + 1);
+        result.indices.push_back(a);
+      }
+    }
+    return result;
+  }
+
+  Mesh CreateSphereMesh(const int32_t aSegments, const bool aHalf) {
+    vrb::CreationContextPtr create = context.lock();
+    Mesh result;
+    result.array = vrb::VertexArray::Create(create);
+    const int rows = aSegments;
+    const int cols = aHalf ? aSegments : aSegments * 2;
+    const float arc = aHalf ? (float) M_PI : 2.0f * (float) M_PI;
+
+    std::vector<float> sines((size_t)cols + 1);
+    std::vector<float> cosines((size_t)cols + 1);
+    for (int col = 0; col <= cols; ++col) {
+      const float beta = arc * (float) col / (float) cols;
+      sines[col] = sinf(beta);
+      cosines[col] = cosf(beta);
+    }
+
+    for (int row = 0; row <= rows; ++row) {
+      const float alpha = (float) M_PI * (float) row / (float) rows;
+      const float sinAlpha = sinf(alpha);
+      const float cosAlpha = cosf(alpha);
+      for (int col = 0; col <= cols; ++col) {
+        vrb::Vector vertex(cosines[col] * sinAlpha, cosAlpha, sines[col] * sinAlpha);
+        result.array->AppendVertex(vertex);
+        result.array->AppendUV(vrb::Vector((float) col / (float) cols, (float) row / (float) rows, 0.0f));
+        result.array->AppendNormal(vertex);
+      }
+    }
+
+    result.indices.reserve((size_t)rows * cols * 6);
+    for (int row = 0; row < rows; ++row) {
+      for (int col = 0; col < cols; ++col) {
+        const int first = 1 + (row * (cols + 1)) + col;
+        const int second = first + cols + 1;
+        result.indices.insert(result.indices.end(), {first, second, first + 1, second, second + 1, first + 1});
+      }
+    }
+    return result;
+  }
+};
+
+MeshCachePtr
+MeshCache::Get(vrb::CreationContextPtr& aContext) {
+  for (auto iter = sCaches.begin(); iter != sCaches.end();) {
+    if (iter->second.context.expired()) {
+      iter = sCaches.erase(iter);
+    } else {
+      ++iter;
+    }
+  }
+  Entry& entry = sCaches[aContext.get()];
+  if (!entry.cache) {
+    entry.context = aContext;
+    entry.cache = std::make_shared<vrb::ConcreteClass<MeshCache, MeshCache::State> >(aContext);
+  }
+  return entry.cache;
+}
+
+vrb::GeometryPtr
+MeshCache::CreateCylinderGeometry(const int32_t aSegments, const float aArc, const float aBorder,
+                                  const vrb::Color& aSolidColor, const vrb::Color& aBorderColor) {
+  vrb::CreationContextPtr create = m.context.lock();
+  if (!create) {
+    return nullptr;
+  }
+  const bool hasBorder = aBorder > 0.0f;
+  const State::CylinderKey key(aSegments, Quantize(aArc), hasBorder ? Quantize(aBorder) : 0,
+                               PackColor(aSolidColor), hasBorder ? PackColor(aBorderColor) : 0);
+  auto iter = m.cylinders.find(key);
+  if (iter == m.cylinders.end()) {
+    iter = m.cylinders.emplace(key, m.CreateCylinderMesh(aSegments, aArc, aBorder, aSolidColor, aBorderColor)).first;
+  }
+  const State::Mesh& mesh = iter->second;
+
+  vrb::GeometryPtr geometry = vrb::Geometry::Create(create);
+  geometry->SetVertexArray(mesh.array);
+  std::vector<int> face(4);
+  for (size_t i = 0; i < mesh.indices.size(); i += 4) {
+    face.assign(mesh.indices.begin() + i, mesh.indices.begin() + i + 4);
+    geometry->AddFace(face, face, face);
+  }
+
+  vrb::RenderStatePtr state = vrb::RenderState::Create(create);
+  state->SetLightsEnabled(false);
+  geometry->SetRenderState(state);
+  return geometry;
+}
+
+vrb::GeometryPtr
+MeshCache::CreateSphereGeometry(const int32_t aSegments, const bool aHalf) {
+  vrb::CreationContextPtr create = m.context.lock();
+  if (!create) {
+    return nullptr;
+  }
+  const State::SphereKey key(aSegments, aHalf);
+  auto iter = m.spheres.find(key);
+  if (iter == m.spheres.end()) {
+    iter = m.spheres.emplace(key, m.CreateSphereMesh(aSegments, aHalf)).first;
+  }
+  const State::Mesh& mesh = iter->second;
+
+  vrb::GeometryPtr geometry = vrb::Geometry::Create(create);
+  geometry->SetVertexArray(mesh.array);
+  std::vector<int> face(3);
+  for (size_t i = 0; i < mesh.indices.size(); i += 3) {
+    face.assign(mesh.indices.begin() + i, mesh.indices.begin() + i + 3);
+    geometry->AddFace(face, face, face);
+  }
+
+  vrb::RenderStatePtr state = vrb::RenderState::Create(create);
+  state->SetLightsEnabled(false);
+  geometry->SetRenderState(state);
+  return geometry;
+}
+
+size_t
+MeshCache::GetMeshCount() const {
+  return m.cylinders.size() + m.spheres.size();
+}
+
+void
+MeshCache::Clear() {
+  m.cylinders.clear();
+  m.spheres.clear();
+}
+
+MeshCache::MeshCache(State& aState, vrb::CreationContextPtr& aContext) : m(aState) {
+  m.context = aContext;
+}
+
+} // namespace crow
@@ -0,0 +1,49 @@
+/* -*- Mode: C++; tab-width: 20; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#ifndef VRBROWSER_MESH_CACHE_DOT_H
+#define VRBROWSER_MESH_CACHE_DOT_H
+
+#include "vrb/Forward.h"
+#include "vrb/MacroUtils.h"
+
+#include <memory>
+
+namespace crow {
+
+class MeshCache;
+typedef std::shared_ptr<MeshCache> MeshCachePtr;
+
+// Tessellated meshes shared between the geometries created from the same
+// CreationContext. Meshes are unit sized so instances only differ by the
+// transform they are drawn with; each geometry still gets its own RenderState.
+// Render thread only.
+class MeshCache {
+public:
+  static MeshCachePtr Get(vrb::CreationContextPtr& aContext);
+  // Cylinder of radius 1 and height 1 around the Y axis, with aArc radians
+  // centered on -Z. aBorder is the height of the top and bottom border rows,
+  // relative to the cylinder height; there are no border rows when it is 0.
+  vrb::GeometryPtr CreateCylinderGeometry(const int32_t aSegments, const float aArc, const float aBorder,
+                                          const vrb::Color& aSolidColor, const vrb::Color& aBorderColor);
+  // Sphere of radius 1 seen from the inside, or its half facing +Z when
+  // aHalf, with aSegments rows and aSegments columns per 180 degrees. UVs
+  // cover [0, 1] so each eye picks its part of the texture with a UV transform.
+  vrb::GeometryPtr CreateSphereGeometry(const int32_t aSegments, const bool aHalf);
+  size_t GetMeshCount() const;
+  void Clear();
+protected:
+  struct State;
+  MeshCache(State& aState, vrb::CreationContextPtr& aContext);
+  ~MeshCache() = default;
+private:
+  State& m;
+  MeshCache() = delete;
+  VRB_NO_DEFAULTS(MeshCache)
+};
+
+} // namespace crow
+
+#endif // VRBROWSER_MESH_CACHE_DOT_H
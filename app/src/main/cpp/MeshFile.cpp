@@ -0,0 +1,528 @@
+/* -*- Mode: C++; tab-width: 20; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include "MeshFile.h"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <unordered_map>
+
+namespace {
+
+const char kMagic[4] = {'V', 'R', 'B', 'M'};
+// Bump when the layout changes, older cache files are then parsed again.
+const uint32_t kVersion = 1;
+
+struct FileHeader {
+  char magic[4];
+  uint32_t version;
+  uint64_t sourceHash;
+  uint32_t vertexCount;
+  uint32_t indexCount;
+  uint32_t rangeCount;
+  uint32_t materialCount;
+};
+static_assert(sizeof(FileHeader) == 32, "Mesh file header has to be 32 bytes");
+
+// Material floats in the file: ambient, diffuse, specular and exponent.
+const size_t kMaterialFloats = 10;
+// Bits of each OBJ index in the key of a vertex.
+const int kIndexBits = 21;
+const int64_t kMaxIndex = (1 << kIndexBits) - 2;
+
+// FNV-1a over 8 byte words, the source is hashed on every launch.
+uint64_t
+Hash(const char* aData, const size_t aSize, uint64_t aHash) {
+  const uint64_t kPrime = 1099511628211ULL;
+  size_t i = 0;
+  for (; i + sizeof(uint64_t) <= aSize; i += sizeof(uint64_t)) {
+    uint64_t word;
+    memcpy(&word, aData + i, sizeof(word));
+    aHash = (aHash ^ word) * kPrime;
+  }
+  for (; i < aSize; ++i) {
+    aHash = (aHash ^ (uint8_t)aData[i]) * kPrime;
+  }
+  return aHash;
+}
+
+const char*
+SkipSpaces(const char* aCursor, const char* aEnd) {
+  while (aCursor < aEnd && (*aCursor == ' ' || *aCursor == '\t')) {
+    aCursor++;
+  }
+  return aCursor;
+}
+
+// Rest of the line, without the surrounding white space.
+std::string
+GetArgument(const char* aCursor, const char* aEnd) {
+  aCursor = SkipSpaces(aCursor, aEnd);
+  while (aEnd > aCursor && (aEnd[-1] == ' ' || aEnd[-1] == '\t' || aEnd[-1] == '\r')) {
+    aEnd--;
+  }
+  return std::string(aCursor, aEnd);
+}
+
+bool
+MatchKeyword(const char*& aCursor, const char* aEnd, const char* aKeyword) {
+  const size_t length = strlen(aKeyword);
+  if ((size_t)(aEnd - aCursor) < length || strncmp(aCursor, aKeyword, length) != 0) {
+    return false;
+  }
+  const char* next = aCursor + length;
+  if (next < aEnd && *next != ' ' && *next != '\t') {
+    return false;
+  }
+  aCursor = next;
+  return true;
+}
+
+// Reads up to aCount floats from the line. The text has to be null terminated.
+int
+ReadFloats(const char* aCursor, const char* aEnd, float* aResult, const int aCount) {
+  int count = 0;
+  while (count < aCount) {
+    aCursor = SkipSpaces(aCursor, aEnd);
+    if (aCursor >= aEnd) {
+      break;
+    }
+    char* next = nullptr;
+    const float value = strtof(aCursor, &next);
+    if (next == aCursor || next > aEnd) {
+      break;
+    }
+    aResult[count++] = value;
+    aCursor = next;
+  }
+  return count;
+}
+
+template<typename Function>
+void
+ForEachLine(const std::string& aText, const Function& aFunction) {
+  const char* cursor = aText.c_str();
+  const char* end = cursor + aText.size();
+  while (cursor < end) {
+    const char* lineEnd = (const char*)memchr(cursor, '\n', end - cursor);
+    if (!lineEnd) {
+      lineEnd = end;
+    }
+    const char* line = SkipSpaces(cursor, lineEnd);
+    if (line < lineEnd && *line != '#') {
+      aFunction(line, lineEnd);
+    }
+    cursor = lineEnd + 1;
+  }
+}
+
+crow::MeshFile::Material
+CreateMaterial(const std::string& aName) {
+  crow::MeshFile::Material result;
+  result.name = aName;
+  for (int i = 0; i < 3; ++i) {
+    result.ambient[i] = 0.2f;
+    result.diffuse[i] = 0.8f;
+    result.specular[i] = 0.0f;
+  }
+  result.specularExponent = 0.0f;
+  return result;
+}
+
+void
+ParseMtl(const std::string& aText, std::vector<crow::MeshFile::Material>& aMaterials,
+         std::unordered_map<std::string, uint32_t>& aMaterialIndex) {
+  crow::MeshFile::Material* material = nullptr;
+  ForEachLine(aText, [&](const char* aCursor, const char* aEnd) {
+    if (MatchKeyword(aCursor, aEnd, "newmtl")) {
+      const std::string name = GetArgument(aCursor, aEnd);
+      auto iter = aMaterialIndex.find(name);
+      if (iter == aMaterialIndex.end()) {
+        iter = aMaterialIndex.emplace(name, (uint32_t)aMaterials.size()).first;
+        aMaterials.push_back(CreateMaterial(name));
+      }
+      material = &aMaterials[iter->second];
+    } else if (!material) {
+      return;
+    } else if (MatchKeyword(aCursor, aEnd, "Ka")) {
+      ReadFloats(aCursor, aEnd, material->ambient, 3);
+    } else if (MatchKeyword(aCursor, aEnd, "Kd")) {
+      ReadFloats(aCursor, aEnd, material->diffuse, 3);
+    } else if (MatchKeyword(aCursor, aEnd, "Ks")) {
+      ReadFloats(aCursor, aEnd, material->specular, 3);
+    } else if (MatchKeyword(aCursor, aEnd, "Ns")) {
+      ReadFloats(aCursor, aEnd, &material->specularExponent, 1);
+    } else if (MatchKeyword(aCursor, aEnd, "map_Kd")) {
+      // Map options are not supported, the file name is the last argument.
+      const std::string argument = GetArgument(aCursor, aEnd);
+      const size_t space = argument.find_last_of(" \t");
+      material->texture = space == std::string::npos ? argument : argument.substr(space + 1);
+    }
+  });
+}
+
+// Resolves an OBJ index, 1 based or relative to the end when negative, to a
+// 0 based one. -1 when it is missing or out of range.
+int64_t
+ResolveIndex(const long aIndex, const size_t aCount) {
+  int64_t result = aIndex < 0 ? (int64_t)aCount + aIndex : (int64_t)aIndex - 1;
+  return result >= 0 && result < (int64_t)aCount ? result : -1;
+}
+
+class Reader {
+public:
+  Reader(const uint8_t* aData, const size_t aSize) : mCursor(aData), mEnd(aData + aSize) {}
+  const uint8_t* Take(const uint64_t aBytes) {
+    if (aBytes > (uint64_t)(mEnd - mCursor)) {
+      return nullptr;
+    }
+    const uint8_t* result = mCursor;
+    mCursor += aBytes;
+    return result;
+  }
+  bool ReadString(std::string& aResult) {
+    const uint8_t* length = Take(sizeof(uint32_t));
+    if (!length) {
+      return false;
+    }
+    uint32_t size;
+    memcpy(&size, length, sizeof(size));
+    const uint8_t* data = Take(size);
+    if (!data) {
+      return false;
+    }
+    aResult.assign((const char*)data, size);
+    return true;
+  }
+private:
+  const uint8_t* mCursor;
+  const uint8_t* mEnd;
+};
+
+void
+WriteString(FILE* aFile, const std::string& aString) {
+  const uint32_t size = (uint32_t)aString.size();
+  fwrite(&size, sizeof(size), 1, aFile);
+  fwrite(aString.data(), 1, size, aFile);
+}
+
+} // namespace
+
+namespace crow {
+
+uint64_t
+MeshFile::HashSource(const char* aData, const size_t aSize, const ReadFileFunction& aReadFile) {
+  uint64_t result = Hash(aData, aSize, 14695981039346656037ULL);
+  const char* cursor = aData;
+  const char* end = aData + aSize;
+  while (cursor < end) {
+    const char* lineEnd = (const char*)memchr(cursor, '\n', end - cursor);
+    if (!lineEnd) {
+      lineEnd = end;
+    }
+    const char* line = SkipSpaces(cursor, lineEnd);
+    std::string content;
+    if (MatchKeyword(line, lineEnd, "mtllib") && aReadFile(GetArgument(line, lineEnd), content)) {
+      result = Hash(content.data(), content.size(), result);
+    }
+    cursor = lineEnd + 1;
+  }
+  return result;
+}
+
+MeshFile::MeshFile()
+    : mVertices(nullptr)
+    , mVertexCount(0)
+    , mIndices(nullptr)
+    , mIndexCount(0)
+    , mMapping(nullptr)
+    , mMappingSize(0)
+{}
+
+MeshFile::~MeshFile() {
+  Reset();
+}
+
+void
+MeshFile::Reset() {
+  if (mMapping) {
+    munmap(mMapping, mMappingSize);
+    mMapping = nullptr;
+    mMappingSize = 0;
+  }
+  mVertexData.clear();
+  mIndexData.clear();
+  mVertices = nullptr;
+  mVertexCount = 0;
+  mIndices = nullptr;
+  mIndexCount = 0;
+  mMaterials.clear();
+  mRanges.clear();
+}
+
+bool
+MeshFile::ParseObj(const std::string& aText, const ReadFileFunction& aReadFile) {
+  Reset();
+  std::vector<float> positions;
+  std::vector<float> normals;
+  std::vector<float> uvs;
+  std::unordered_map<uint64_t, uint32_t> vertexIndex;
+  std::unordered_map<std::string, uint32_t> materialIndex;
+  int64_t material = -1;
+  std::vector<uint32_t> polygon;
+  bool valid = true;
+
+  ForEachLine(aText, [&](const char* aCursor, const char* aEnd) {
+    if (!valid) {
+      return;
+    }
+    float values[3] = {0.0f, 0.0f, 0.0f};
+    if (MatchKeyword(aCursor, aEnd, "v")) {
+      ReadFloats(aCursor, aEnd, values, 3);
+      positions.insert(positions.end(), values, values + 3);
+    } else if (MatchKeyword(aCursor, aEnd, "vn")) {
+      ReadFloats(aCursor, aEnd, values, 3);
+      normals.insert(normals.end(), values, values + 3);
+    } else if (MatchKeyword(aCursor, aEnd, "vt")) {
+      ReadFloats(aCursor, aEnd, values, 2);
+      uvs.insert(uvs.end(), values, values + 2);
+    } else if (MatchKeyword(aCursor, aEnd, "mtllib")) {
+      std::string content;
+      const std::string name = GetArgument(aCursor, aEnd);
+      if (aReadFile(name, content)) {
+        ParseMtl(content, mMaterials, materialIndex);
+      }
+    } else if (MatchKeyword(aCursor, aEnd, "usemtl")) {
+      const std::string name = GetArgument(aCursor, aEnd);
+      auto iter = materialIndex.find(name);
+      if (iter == materialIndex.end()) {
+        iter = materialIndex.emplace(name, (uint32_t)mMaterials.size()).first;
+        mMaterials.push_back(CreateMaterial(name));
+      }
+      material = iter->second;
+    } else if (MatchKeyword(aCursor, aEnd, "f")) {
+      polygon.clear();
+      while (true) {
+        aCursor = SkipSpaces(aCursor, aEnd);
+        if (aCursor >= aEnd || *aCursor == '\r') {
+          break;
+        }
+        char* next = nullptr;
+        const int64_t position = ResolveIndex(strtol(aCursor, &next, 10), positions.size() / 3);
+        int64_t uv = -1;
+        int64_t normal = -1;
+        if (next == aCursor || position < 0 || position > kMaxIndex) {
+          valid = false;
+          return;
+        }
+        aCursor = next;
+        if (*aCursor == '/') {
+          aCursor++;
+          if (*aCursor != '/') {
+            uv = ResolveIndex(strtol(aCursor, &next, 10), uvs.size() / 2);
+            aCursor = next;
+          }
+          if (*aCursor == '/') {
+            aCursor++;
+            normal = ResolveIndex(strtol(aCursor, &next, 10), normals.size() / 3);
+            aCursor = next;
+          }
+        }
+        if (uv > kMaxIndex || normal > kMaxIndex) {
+          valid = false;
+          return;
+        }
+        const uint64_t key = (uint64_t)(position + 1) | ((uint64_t)(uv + 1) << kIndexBits) |
+                             ((uint64_t)(normal + 1) << (2 * kIndexBits));
+        auto iter = vertexIndex.find(key);
+        if (iter == vertexIndex.end()) {
+          iter = vertexIndex.emplace(key, (uint32_t)(mVertexData.size() / kVertexStride)).first;
+          const float* p = &positions[position * 3];
+          mVertexData.insert(mVertexData.end(), p, p + 3);
+          if (normal >= 0) {
+            const float* n = &normals[normal * 3];
+            mVertexData.insert(mVertexData.end(), n, n + 3);
+          } else {
+            mVertexData.insert(mVertexData.end(), 3, 0.0f);
+          }
+          // OBJ texture coordinates start at the bottom of the image.
+          mVertexData.push_back(uv >= 0 ? uvs[uv * 2] : 0.0f);
+          mVertexData.push_back(uv >= 0 ? 1.0f - uvs[uv * 2 + 1] : 0.0f);
+        }
+        polygon.push_back(iter->second);
+      }
+      if (polygon.size() < 3) {
+        return;
+      }
+      if (material < 0) {
+        material = (int64_t)mMaterials.size();
+        mMaterials.push_back(CreateMaterial(""));
+      }
+      if (mRanges.empty() || mRanges.back().material != (uint32_t)material) {
+        mRanges.push_back(Range{(uint32_t)material, (uint32_t)mIndexData.size(), 0});
+      }
+      for (size_t i = 1; i + 1 < polygon.size(); ++i) {
+        mIndexData.push_back(polygon[0]);
+        mIndexData.push_back(polygon[i]);
+        mIndexData.push_back(polygon[i + 1]);
+      }
+      mRanges.back().indexCount = (uint32_t)mIndexData.size() - mRanges.back().firstIndex;
+    }
+  });
+
+  if (!valid || mIndexData.empty()) {
+    Reset();
+    return false;
+  }
+  mVertices = mVertexData.data();
+  mVertexCount = mVertexData.size() / kVertexStride;
+  mIndices = mIndexData.data();
+  mIndexCount = mIndexData.size();
+  return true;
+}
+
+bool
+MeshFile::Read(const std::string& aPath, const uint64_t aSourceHash) {
+  Reset();
+  const int fd = open(aPath.c_str(), O_RDONLY);
+  if (fd < 0) {
+    return false;
+  }
+  struct stat info;
+  if (fstat(fd, &info) != 0 || info.st_size < (off_t)sizeof(FileHeader)) {
+    close(fd);
+    return false;
+  }
+  mMappingSize = (size_t)info.st_size;
+  mMapping = mmap(nullptr, mMappingSize, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (mMapping == MAP_FAILED) {
+    mMapping = nullptr;
+    mMappingSize = 0;
+    return false;
+  }
+
+  Reader reader((const uint8_t*)mMapping, mMappingSize);
+  FileHeader header;
+  memcpy(&header, reader.Take(sizeof(header)), sizeof(header));
+  if (memcmp(header.magic, kMagic, sizeof(kMagic)) != 0 || header.version != kVersion ||
+      header.sourceHash != aSourceHash) {
+    Reset();
+    return false;
+  }
+  mVertices = (const float*)reader.Take((uint64_t)header.vertexCount * kVertexStride * sizeof(float));
+  mIndices = (const uint32_t*)reader.Take((uint64_t)header.indexCount * sizeof(uint32_t));
+  const uint8_t* ranges = reader.Take((uint64_t)header.rangeCount * sizeof(Range));
+  bool valid = mVertices && mIndices && ranges;
+  for (uint32_t i = 0; valid && i < header.indexCount; ++i) {
+    valid = mIndices[i] < header.vertexCount;
+  }
+  if (valid) {
+    mRanges.resize(header.rangeCount);
+    memcpy(mRanges.data(), ranges, header.rangeCount * sizeof(Range));
+  }
+  for (uint32_t i = 0; valid && i < header.materialCount; ++i) {
+    Material material;
+    const uint8_t* values = nullptr;
+    valid = reader.ReadString(material.name) && (values = reader.Take(kMaterialFloats * sizeof(float))) &&
+            reader.ReadString(material.texture);
+    if (valid) {
+      float floats[kMaterialFloats];
+      memcpy(floats, values, sizeof(floats));
+      memcpy(material.ambient, floats, 3 * sizeof(float));
+      memcpy(material.diffuse, floats + 3, 3 * sizeof(float));
+      memcpy(material.specular, floats + 6, 3 * sizeof(float));
+      material.specularExponent = floats[9];
+      mMaterials.push_back(material);
+    }
+  }
+  for (const Range& range: mRanges) {
+    valid = valid && range.material < mMaterials.size() &&
+            (uint64_t)range.firstIndex + range.indexCount <= header.indexCount;
+  }
+  if (!valid) {
+    Reset();
+    return false;
+  }
+  mVertexCount = header.vertexCount;
+  mIndexCount = header.indexCount;
+  return true;
+}
+
+bool
+MeshFile::Write(const std::string& aPath, const uint64_t aSourceHash) const {
+  // Written next to the destination and renamed, a reader never sees half a file.
+  const std::string temporaryPath = aPath + ".tmp";
+  FILE* file = fopen(temporaryPath.c_str(), "wb");
+  if (!file) {
+    return false;
+  }
+  FileHeader header;
+  memcpy(header.magic, kMagic, sizeof(kMagic));
+  header.version = kVersion;
+  header.sourceHash = aSourceHash;
+  header.vertexCount = (uint32_t)mVertexCount;
+  header.indexCount = (uint32_t)mIndexCount;
+  header.rangeCount = (uint32_t)mRanges.size();
+  header.materialCount = (uint32_t)mMaterials.size();
+  fwrite(&header, sizeof(header), 1, file);
+  fwrite(mVertices, sizeof(float), mVertexCount * kVertexStride, file);
+  fwrite(mIndices, sizeof(uint32_t), mIndexCount, file);
+  fwrite(mRanges.data(), sizeof(Range), mRanges.size(), file);
+  for (const Material& material: mMaterials) {
+    WriteString(file, material.name);
+    const float values[kMaterialFloats] = {
+        material.ambient[0], material.ambient[1], material.ambient[2],
+        material.diffuse[0], material.diffuse[1], material.diffuse[2],
+        material.specular[0], material.specular[1], material.specular[2],
+        material.specularExponent
+    };
+    fwrite(values, sizeof(float), kMaterialFloats, file);
+    WriteString(file, material.texture);
+  }
+  const bool written = !ferror(file);
+  if (fclose(file) != 0 || !written || rename(temporaryPath.c_str(), aPath.c_str()) != 0) {
+    unlink(temporaryPath.c_str());
+    return false;
+  }
+  return true;
+}
+
+const float*
+MeshFile::GetVertices() const {
+  return mVertices;
+}
+
+size_t
+MeshFile::GetVertexCount() const {
+  return mVertexCount;
+}
+
+const uint32_t*
+MeshFile::GetIndices() const {
+  return mIndices;
+}
+
+size_t
+MeshFile::GetIndexCount() const {
+  return mIndexCount;
+}
+
+const std::vector<MeshFile::Material>&
+MeshFile::GetMaterials() const {
+  return mMaterials;
+}
+
+const std::vector<MeshFile::Range>&
+MeshFile::GetRanges() const {
+  return mRanges;
+}
+
+} // namespace crow
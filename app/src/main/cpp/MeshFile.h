@@ -0,0 +1,79 @@
+/* -*- Mode: C++; tab-width: 20; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#ifndef VRBROWSER_MESH_FILE_H
+#define VRBROWSER_MESH_FILE_H
+
+#include <functional>
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+namespace crow {
+
+// Triangle mesh of an OBJ model and its binary cache file. Vertices are
+// interleaved, each one a position, a normal and a UV; triangles are drawn in
+// ranges that share a material. A mesh read from a cache file points into
+// the memory mapped file until it is destroyed.
+// Does not depend on vrb or GL so it can be built for the host.
+class MeshFile {
+public:
+  struct Material {
+    std::string name;
+    float ambient[3];
+    float diffuse[3];
+    float specular[3];
+    float specularExponent;
+    // Diffuse map file, empty for none.
+    std::string texture;
+  };
+  struct Range {
+    uint32_t material;
+    uint32_t firstIndex;
+    uint32_t indexCount;
+  };
+  // Floats per vertex.
+  static const size_t kVertexStride = 8;
+  // Reads a file next to the OBJ file, such as its material libraries.
+  typedef std::function<bool(const std::string& aName, std::string& aContent)> ReadFileFunction;
+
+  // Hash of an OBJ file and of the material libraries it uses, that the
+  // cache file has to match.
+  static uint64_t HashSource(const char* aData, const size_t aSize, const ReadFileFunction& aReadFile);
+
+  MeshFile();
+  ~MeshFile();
+  bool ParseObj(const std::string& aText, const ReadFileFunction& aReadFile);
+  // False if there is no cache file for aSourceHash.
+  bool Read(const std::string& aPath, const uint64_t aSourceHash);
+  bool Write(const std::string& aPath, const uint64_t aSourceHash) const;
+
+  const float* GetVertices() const;
+  size_t GetVertexCount() const;
+  const uint32_t* GetIndices() const;
+  size_t GetIndexCount() const;
+  const std::vector<Material>& GetMaterials() const;
+  const std::vector<Range>& GetRanges() const;
+private:
+  void Reset();
+  std::vector<float> mVertexData;
+  std::vector<uint32_t> mIndexData;
+  const float* mVertices;
+  size_t mVertexCount;
+  const uint32_t* mIndices;
+  size_t mIndexCount;
+  std::vector<Material> mMaterials;
+  std::vector<Range> mRanges;
+  void* mMapping;
+  size_t mMappingSize;
+
+  MeshFile(const MeshFile&) = delete;
+  MeshFile& operator=(const MeshFile&) = delete;
+};
+
+} // namespace crow
+
+#endif // VRBROWSER_MESH_FILE_H
@@ -0,0 +1,230 @@
+/* -*- Mode: C++; tab-width: 20; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include "ModelCache.h"
+#include "MeshFile.h"
+#include "vrb/ConcreteClass.h"
+#include "vrb/Color.h"
+#include "vrb/CreationContext.h"
+#include "vrb/Geometry.h"
+#include "vrb/Group.h"
+#include "vrb/Logger.h"
+#include "vrb/ModelLoaderAndroid.h"
+#include "vrb/Program.h"
+#include "vrb/ProgramFactory.h"
+#include "vrb/RenderState.h"
+#include "vrb/TextureGL.h"
+#include "vrb/Vector.h"
+#include "vrb/VertexArray.h"
+
+#if defined(__ANDROID__)
+#include <android/asset_manager.h>
+#include <android/asset_manager_jni.h>
+#endif
+
+#include <algorithm>
+#include <future>
+#include <map>
+#include <mutex>
+#include <sys/stat.h>
+#include <vector>
+
+namespace {
+
+const char* kCacheDirectory = "/meshes";
+
+#if defined(__ANDROID__)
+bool
+ReadAsset(AAssetManager* aAssets, const std::string& aName, std::string& aContent) {
+  AAsset* asset = AAssetManager_open(aAssets, aName.c_str(), AASSET_MODE_BUFFER);
+  if (!asset) {
+    return false;
+  }
+  const char* data = (const char*)AAsset_getBuffer(asset);
+  if (data) {
+    aContent.assign(data, (size_t)AAsset_getLength(asset));
+  }
+  AAsset_close(asset);
+  return data != nullptr;
+}
+#endif
+
+// Runs on the loader thread.
+vrb::GroupPtr
+CreateModel(vrb::CreationContextPtr& aContext, const crow::MeshFile& aMesh) {
+  vrb::VertexArrayPtr array = vrb::VertexArray::Create(aContext);
+  const float* vertex = aMesh.GetVertices();
+  for (size_t i = 0; i < aMesh.GetVertexCount(); ++i, vertex += crow::MeshFile::kVertexStride) {
+    array->AppendVertex(vrb::Vector(vertex[0], vertex[1], vertex[2]));
+    array->AppendNormal(vrb::Vector(vertex[3], vertex[4], vertex[5]));
+    array->AppendUV(vrb::Vector(vertex[6], vertex[7], 0.0f));
+  }
+
+  vrb::GroupPtr result = vrb::Group::Create(aContext);
+  const uint32_t* indices = aMesh.GetIndices();
+  std::vector<int> face(3);
+  for (const crow::MeshFile::Range& range: aMesh.GetRanges()) {
+    const crow::MeshFile::Material& material = aMesh.GetMaterials()[range.material];
+    vrb::GeometryPtr geometry = vrb::Geometry::Create(aContext);
+    geometry->SetVertexArray(array);
+    for (uint32_t i = range.firstIndex; i + 2 < range.firstIndex + range.indexCount; i += 3) {
+      // Faces index the vertex array from 1.
+      face[0] = (int)indices[i] + 1;
+      face[1] = (int)indices[i + 1] + 1;
+      face[2] = (int)indices[i + 2] + 1;
+      geometry->AddFace(face, face, face);
+    }
+    vrb::TextureGLPtr texture;
+    if (!material.texture.empty()) {
+      texture = aContext->LoadTexture(material.texture);
+    }
+    vrb::ProgramPtr program = aContext->GetProgramFactory()->CreateProgram(aContext, texture ? vrb::FeatureTexture : 0);
+    vrb::RenderStatePtr state = vrb::RenderState::Create(aContext);
+    state->SetProgram(program);
+    state->SetMaterial(vrb::Color(material.ambient[0], material.ambient[1], material.ambient[2]),
+                       vrb::Color(material.diffuse[0], material.diffuse[1], material.diffuse[2]),
+                       vrb::Color(material.specular[0], material.specular[1], material.specular[2]),
+                       material.specularExponent);
+    if (texture) {
+      state->SetTexture(texture);
+    }
+    geometry->SetRenderState(state);
+    result->AddNode(geometry);
+  }
+  return result;
+}
+
+} // namespace
+
+namespace crow {
+
+typedef std::shared_ptr<MeshFile> MeshFilePtr;
+
+struct ModelCache::State {
+  jobject assetManager;
+  // Reads the OBJ and MTL files, null when the assets can't be reached.
+  MeshFile::ReadFileFunction readAsset;
+  std::mutex mutex;
+  std::string cachePath;
+  // Meshes read by Prepare(). An entry without a future was already loaded.
+  std::map<std::string, std::shared_future<MeshFilePtr>> prepared;
+  State()
+      : assetManager(nullptr)
+  {}
+
+  // Empty when there is no cache path yet.
+  std::string GetCacheFile(const std::string& aFileName) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (cachePath.empty()) {
+      return std::string();
+    }
+    const std::string directory = cachePath + kCacheDirectory;
+    mkdir(directory.c_str(), 0700);
+    std::string name = aFileName;
+    std::replace(name.begin(), name.end(), '/', '_');
+    return directory + "/" + name + ".mesh";
+  }
+
+  // Does not use GL, may run on any thread.
+  MeshFilePtr ReadMesh(const std::string& aFileName) {
+    std::string text;
+    if (!readAsset(aFileName, text)) {
+      VRB_ERROR("Failed to read model: %s", aFileName.c_str());
+      return nullptr;
+    }
+    const uint64_t hash = MeshFile::HashSource(text.data(), text.size(), readAsset);
+    const std::string cacheFile = GetCacheFile(aFileName);
+    MeshFilePtr mesh = std::make_shared<MeshFile>();
+    if (!cacheFile.empty() && mesh->Read(cacheFile, hash)) {
+      VRB_DEBUG("Loaded model %s from the mesh cache", aFileName.c_str());
+      return mesh;
+    }
+    if (!mesh->ParseObj(text, readAsset)) {
+      VRB_ERROR("Failed to parse model: %s", aFileName.c_str());
+      return nullptr;
+    }
+    if (!cacheFile.empty() && !mesh->Write(cacheFile, hash)) {
+      VRB_ERROR("Failed to write mesh cache file: %s", cacheFile.c_str());
+    }
+    return mesh;
+  }
+
+  // Runs on the loader thread.
+  vrb::GroupPtr Load(vrb::CreationContextPtr& aContext, const std::string& aFileName) {
+    std::shared_future<MeshFilePtr> future;
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      std::shared_future<MeshFilePtr>& entry = prepared[aFileName];
+      future = entry;
+      entry = std::shared_future<MeshFilePtr>();
+    }
+    // Waits for a Prepare() call that is still reading the mesh.
+    MeshFilePtr mesh = future.valid() ? future.get() : ReadMesh(aFileName);
+    return mesh ? CreateModel(aContext, *mesh) : nullptr;
+  }
+};
+
+ModelCachePtr
+ModelCache::Create() {
+  return std::make_shared<vrb::ConcreteClass<ModelCache, ModelCache::State> >();
+}
+
+void
+ModelCache::InitializeJava(JNIEnv* aEnv, jobject& aAssetManager) {
+  // The asset manager of the application outlives any activity, loader tasks
+  // may still use it after ShutdownJava().
+  if (m.readAsset || !aEnv || !aAssetManager) {
+    return;
+  }
+#if defined(__ANDROID__)
+  m.assetManager = aEnv->NewGlobalRef(aAssetManager);
+  AAssetManager* assets = AAssetManager_fromJava(aEnv, m.assetManager);
+  m.readAsset = [assets](const std::string& aName, std::string& aContent) {
+    return ReadAsset(assets, aName, aContent);
+  };
+#endif
+}
+
+void
+ModelCache::SetCachePath(const std::string& aPath) {
+  std::lock_guard<std::mutex> lock(m.mutex);
+  m.cachePath = aPath;
+}
+
+void
+ModelCache::Prepare(const std::string& aFileName) {
+  if (!m.readAsset) {
+    return;
+  }
+  std::promise<MeshFilePtr> promise;
+  {
+    std::lock_guard<std::mutex> lock(m.mutex);
+    if (m.prepared.count(aFileName)) {
+      return;
+    }
+    m.prepared[aFileName] = promise.get_future().share();
+  }
+  promise.set_value(m.ReadMesh(aFileName));
+}
+
+void
+ModelCache::LoadModel(const vrb::ModelLoaderAndroidPtr& aLoader, const std::string& aFileName,
+                      const vrb::GroupPtr& aTarget) {
+  vrb::GroupPtr target = aTarget;
+  if (!m.readAsset) {
+    aLoader->LoadModel(aFileName, target);
+    return;
+  }
+  State* state = &m;
+  const std::string fileName = aFileName;
+  vrb::LoadTask task = [state, fileName](vrb::CreationContextPtr& aContext) -> vrb::GroupPtr {
+    return state->Load(aContext, fileName);
+  };
+  aLoader->LoadModel(task, target);
+}
+
+ModelCache::ModelCache(State& aState) : m(aState) {}
+
+} // namespace crow
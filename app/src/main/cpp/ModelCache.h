@@ -0,0 +1,52 @@
+/* -*- Mode: C++; tab-width: 20; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#ifndef VRBROWSER_MODEL_CACHE_H
+#define VRBROWSER_MODEL_CACHE_H
+
+#include "vrb/Forward.h"
+#include "vrb/MacroUtils.h"
+
+#include <jni.h>
+#include <memory>
+#include <string>
+
+namespace crow {
+
+class ModelCache;
+typedef std::shared_ptr<ModelCache> ModelCachePtr;
+
+// Loads the OBJ models in the assets through a binary mesh file, see
+// MeshFile.h. The OBJ text is parsed on the first launch only, later launches
+// map the mesh file written then to the cache path.
+class ModelCache {
+public:
+  static ModelCachePtr Create();
+  // Off Android there is no asset manager, every model then goes through the
+  // loader's own OBJ parser.
+  void InitializeJava(JNIEnv* aEnv, jobject& aAssetManager);
+  // Models loaded before there is a cache path are parsed every time.
+  void SetCachePath(const std::string& aPath);
+  // Reads or parses the mesh of aFileName on the calling thread, which does
+  // not need a GL context, for a LoadModel() call to use. Does nothing if
+  // aFileName was prepared or loaded before.
+  void Prepare(const std::string& aFileName);
+  // Loads aFileName into aTarget on the loader thread. Falls back to the
+  // loader's own OBJ parser when the assets can't be reached.
+  void LoadModel(const vrb::ModelLoaderAndroidPtr& aLoader, const std::string& aFileName,
+                 const vrb::GroupPtr& aTarget);
+protected:
+  struct State;
+  ModelCache(State& aState);
+  ~ModelCache() = default;
+private:
+  State& m;
+  ModelCache() = delete;
+  VRB_NO_DEFAULTS(ModelCache)
+};
+
+} // namespace crow
+
+#endif // VRBROWSER_MODEL_CACHE_H
@@ -0,0 +1,276 @@
+/* -*- Mode: C++; tab-width: 20; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include "ProgramCache.h"
+#include "vrb/ConcreteClass.h"
+#include "vrb/CreationContext.h"
+#include "vrb/GLError.h"
+#include "vrb/Logger.h"
+#include "vrb/Program.h"
+#include "vrb/ProgramFactory.h"
+#include "vrb/ShaderUtil.h"
+
+#include <stdio.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+namespace {
+
+const char* kCacheDirectory = "/programs";
+const uint32_t kMagic = 0x50425256; // "VRBP"
+const uint32_t kVersion = 1;
+
+struct Header {
+  uint32_t magic;
+  uint32_t version;
+  uint64_t driverHash;
+  uint64_t sourceHash;
+  uint32_t binaryFormat;
+  uint32_t length;
+};
+
+struct Variant {
+  uint32_t features;
+  bool clearColor;
+};
+
+// Quads and cylinders with a surface or a texture, with and without the
+// clear color fragment, cylinders with vertex color borders, and the plain
+// variants of the pointers, controllers, environment, skybox and video.
+const Variant kPrewarmVariants[] = {
+    {vrb::FeatureHighPrecision | vrb::FeatureUVTransform | vrb::FeatureSurfaceTexture, false},
+    {vrb::FeatureHighPrecision | vrb::FeatureUVTransform | vrb::FeatureSurfaceTexture, true},
+    {vrb::FeatureHighPrecision | vrb::FeatureUVTransform | vrb::FeatureSurfaceTexture | vrb::FeatureVertexColor, false},
+    {vrb::FeatureHighPrecision | vrb::FeatureUVTransform | vrb::FeatureSurfaceTexture | vrb::FeatureVertexColor, true},
+    {vrb::FeatureHighPrecision | vrb::FeatureUVTransform | vrb::FeatureTexture, false},
+    {vrb::FeatureHighPrecision | vrb::FeatureUVTransform | vrb::FeatureTexture, true},
+    {vrb::FeatureHighPrecision | vrb::FeatureUVTransform | vrb::FeatureTexture | vrb::FeatureVertexColor, true},
+    {vrb::FeatureVertexColor, false},
+    {0, false},
+    {vrb::FeatureTexture, false},
+    {vrb::FeatureCubeTexture, false},
+    {vrb::FeatureSurfaceTexture, false},
+    {vrb::FeatureSurfaceTexture | vrb::FeatureHighPrecision | vrb::FeatureUVTransform, false},
+};
+
+uint64_t
+Hash(const char* aText, uint64_t aHash = 0xcbf29ce484222325ULL) {
+  for (const char* c = aText; c && *c; ++c) {
+    aHash = (aHash ^ (uint8_t)*c) * 0x100000001b3ULL;
+  }
+  return aHash;
+}
+
+std::string
+GetString(const GLenum aName) {
+  const char* value = (const char*)glGetString(aName);
+  return value ? value : "";
+}
+
+} // namespace
+
+namespace crow {
+
+struct ProgramCache::State {
+  std::string cachePath;
+  bool driverChecked;
+  bool supported;
+  uint64_t driverHash;
+  // Binaries linked while there was no cache path yet.
+  std::vector<std::pair<Header, std::vector<uint8_t>>> unsaved;
+  std::vector<vrb::ProgramPtr> prewarmed;
+  State()
+      : driverChecked(false)
+      , supported(false)
+      , driverHash(0)
+  {}
+
+  void CheckDriver() {
+    if (driverChecked) {
+      return;
+    }
+    driverChecked = true;
+    GLint formats = 0;
+    VRB_GL_CHECK(glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats));
+    supported = formats > 0;
+    const std::string driver = GetString(GL_VENDOR) + "\n" + GetString(GL_RENDERER) + "\n" + GetString(GL_VERSION);
+    driverHash = Hash(driver.c_str());
+    if (!supported) {
+      VRB_LOG("Program binaries are not supported by the driver");
+    }
+  }
+
+  std::string GetCacheFile(const uint64_t aSourceHash) const {
+    char name[24];
+    snprintf(name, sizeof(name), "/%016llx.bin", (unsigned long long)aSourceHash);
+    return cachePath + kCacheDirectory + name;
+  }
+
+  GLuint Load(const uint64_t aSourceHash) {
+    const std::string path = GetCacheFile(aSourceHash);
+    FILE* file = fopen(path.c_str(), "rb");
+    if (!file) {
+      return 0;
+    }
+    Header header = {};
+    std::vector<uint8_t> binary;
+    bool valid = fread(&header, sizeof(header), 1, file) == 1 && header.magic == kMagic &&
+                 header.version == kVersion && header.driverHash == driverHash &&
+                 header.sourceHash == aSourceHash && header.length > 0;
+    if (valid) {
+      binary.resize(header.length);
+      valid = fread(binary.data(), binary.size(), 1, file) == 1;
+    }
+    fclose(file);
+    GLuint program = 0;
+    if (valid) {
+      program = glCreateProgram();
+      VRB_GL_CHECK(glProgramBinary(program, header.binaryFormat, binary.data(), (GLsizei)binary.size()));
+      GLint linked = GL_FALSE;
+      VRB_GL_CHECK(glGetProgramiv(program, GL_LINK_STATUS, &linked));
+      if (!linked) {
+        VRB_GL_CHECK(glDeleteProgram(program));
+        program = 0;
+      }
+    }
+    if (program) {
+      VRB_DEBUG("Loaded program binary: %s", path.c_str());
+    } else {
+      // Written by another driver or by an older version of the cache.
+      VRB_LOG("Discarding stale program binary: %s", path.c_str());
+      unlink(path.c_str());
+    }
+    return program;
+  }
+
+  GLuint Link(const char* aVertexShader, const char* aFragmentShader) {
+    GLuint vertexShader = vrb::LoadShader(GL_VERTEX_SHADER, aVertexShader);
+    GLuint fragmentShader = vrb::LoadShader(GL_FRAGMENT_SHADER, aFragmentShader);
+    GLuint program = 0;
+    if (vertexShader && fragmentShader) {
+      program = glCreateProgram();
+      VRB_GL_CHECK(glAttachShader(program, vertexShader));
+      VRB_GL_CHECK(glAttachShader(program, fragmentShader));
+      if (supported) {
+        VRB_GL_CHECK(glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE));
+      }
+      VRB_GL_CHECK(glLinkProgram(program));
+      GLint linked = GL_FALSE;
+      VRB_GL_CHECK(glGetProgramiv(program, GL_LINK_STATUS, &linked));
+      if (!linked) {
+        char log[512] = {};
+        VRB_GL_CHECK(glGetProgramInfoLog(program, sizeof(log), nullptr, log));
+        VRB_ERROR("Failed to link program: %s", log);
+        VRB_GL_CHECK(glDeleteProgram(program));
+        program = 0;
+      } else {
+        VRB_GL_CHECK(glDetachShader(program, vertexShader));
+        VRB_GL_CHECK(glDetachShader(program, fragmentShader));
+      }
+    }
+    if (vertexShader) {
+      VRB_GL_CHECK(glDeleteShader(vertexShader));
+    }
+    if (fragmentShader) {
+      VRB_GL_CHECK(glDeleteShader(fragmentShader));
+    }
+    return program;
+  }
+
+  void Store(const GLuint aProgram, const uint64_t aSourceHash) {
+    GLint length = 0;
+    VRB_GL_CHECK(glGetProgramiv(aProgram, GL_PROGRAM_BINARY_LENGTH, &length));
+    if (length <= 0) {
+      return;
+    }
+    std::vector<uint8_t> binary((size_t)length);
+    GLenum format = 0;
+    GLsizei written = 0;
+    VRB_GL_CHECK(glGetProgramBinary(aProgram, length, &written, &format, binary.data()));
+    if (written <= 0) {
+      return;
+    }
+    binary.resize((size_t)written);
+    Header header = {kMagic, kVersion, driverHash, aSourceHash, format, (uint32_t)written};
+    if (cachePath.empty()) {
+      unsaved.emplace_back(header, std::move(binary));
+      return;
+    }
+    Write(header, binary);
+  }
+
+  void Write(const Header& aHeader, const std::vector<uint8_t>& aBinary) const {
+    mkdir((cachePath + kCacheDirectory).c_str(), 0700);
+    const std::string path = GetCacheFile(aHeader.sourceHash);
+    // Renamed into place so that a partially written file is never read.
+    const std::string temporaryPath = path + ".tmp";
+    FILE* file = fopen(temporaryPath.c_str(), "wb");
+    if (!file) {
+      VRB_ERROR("Failed to write program binary: %s", path.c_str());
+      return;
+    }
+    bool written = fwrite(&aHeader, sizeof(aHeader), 1, file) == 1 &&
+                   fwrite(aBinary.data(), aBinary.size(), 1, file) == 1;
+    written = fclose(file) == 0 && written;
+    if (!written || rename(temporaryPath.c_str(), path.c_str()) != 0) {
+      VRB_ERROR("Failed to write program binary: %s", path.c_str());
+      unlink(temporaryPath.c_str());
+    }
+  }
+};
+
+ProgramCachePtr
+ProgramCache::Create() {
+  return std::make_shared<vrb::ConcreteClass<ProgramCache, ProgramCache::State> >();
+}
+
+void
+ProgramCache::SetCachePath(const std::string& aPath) {
+  m.cachePath = aPath;
+  if (m.cachePath.empty()) {
+    return;
+  }
+  for (const auto& entry: m.unsaved) {
+    m.Write(entry.first, entry.second);
+  }
+  m.unsaved.clear();
+}
+
+GLuint
+ProgramCache::CreateProgram(const char* aVertexShader, const char* aFragmentShader) {
+  m.CheckDriver();
+  const uint64_t sourceHash = Hash(aFragmentShader, Hash(aVertexShader));
+  if (m.supported && !m.cachePath.empty()) {
+    GLuint program = m.Load(sourceHash);
+    if (program) {
+      return program;
+    }
+  }
+  GLuint program = m.Link(aVertexShader, aFragmentShader);
+  if (program && m.supported) {
+    m.Store(program, sourceHash);
+  }
+  return program;
+}
+
+void
+ProgramCache::Prewarm(vrb::CreationContextPtr& aContext) {
+  if (!m.prewarmed.empty()) {
+    return;
+  }
+  const std::string clearColor =
+#include "shaders/clear_color.fs"
+  ;
+  for (const Variant& variant: kPrewarmVariants) {
+    m.prewarmed.push_back(aContext->GetProgramFactory()->CreateProgram(
+        aContext, variant.features, variant.clearColor ? clearColor : std::string()));
+  }
+  VRB_DEBUG("Requested %d program variants", (int)m.prewarmed.size());
+}
+
+ProgramCache::ProgramCache(State& aState) : m(aState) {}
+
+} // namespace crow
@@ -0,0 +1,49 @@
+/* -*- Mode: C++; tab-width: 20; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#ifndef VRBROWSER_PROGRAM_CACHE_H
+#define VRBROWSER_PROGRAM_CACHE_H
+
+#include "vrb/Forward.h"
+#include "vrb/MacroUtils.h"
+#include "vrb/gl.h"
+
+#include <memory>
+#include <string>
+
+namespace crow {
+
+class ProgramCache;
+typedef std::shared_ptr<ProgramCache> ProgramCachePtr;
+
+// Links GL programs through program binaries kept in the cache path. A binary
+// is found by the hash of its shader sources and is only used with the driver
+// that wrote it, so a driver update makes every program compile once again.
+class ProgramCache {
+public:
+  static ProgramCachePtr Create();
+  // Programs linked before there is a cache path are written once it is set.
+  void SetCachePath(const std::string& aPath);
+  // Render thread only. Returns 0 when the program fails to compile or link.
+  GLuint CreateProgram(const char* aVertexShader, const char* aFragmentShader);
+  // Render thread only. Requests the ProgramFactory variants that the widgets,
+  // pointers, controllers and environment use, so they compile at startup
+  // rather than when they first show up. Their binaries are not cached: vrb's
+  // ProgramFactory owns those sources and program objects, so they compile
+  // again on every launch.
+  void Prewarm(vrb::CreationContextPtr& aContext);
+protected:
+  struct State;
+  ProgramCache(State& aState);
+  ~ProgramCache() = default;
+private:
+  State& m;
+  ProgramCache() = delete;
+  VRB_NO_DEFAULTS(ProgramCache)
+};
+
+} // namespace crow
+
+#endif // VRBROWSER_PROGRAM_CACHE_H
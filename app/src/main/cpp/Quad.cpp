@@ -22,6 +22,8 @@
 #include "vrb/Vector.h"
 #include "vrb/VertexArray.h"
 
+#include <algorithm>
+
 namespace crow {
 
 struct Quad::State {
@@ -39,6 +41,7 @@ struct Quad::State {
   vrb::TransformPtr backgroundTransform;
   vrb::GeometryPtr backgroundGeometry;
   vrb::Color backgroundColor;
+  float surfaceScale;
 
   State()
       : textureWidth(0)
@@ -46,6 +49,7 @@ struct Quad::State {
       , scaleMode(ScaleMode::Fill)
       , worldMin(0.0f, 0.0f, 0.0f)
       , worldMax(0.0f, 0.0f, 0.0f)
+      , surfaceScale(1.0f)
   {}
 
   void Initialize() {
@@ -76,6 +80,10 @@ struct Quad::State {
     return worldMax.y() - worldMin.y();
   }
 
+  int32_t GetSurfaceSize(const int32_t aTextureSize) const {
+    return std::max(1, (int32_t)ceilf(aTextureSize * surfaceScale));
+  }
+
   void UpdateVertexArray() {
     if (textureWidth == 0|| textureHeight == 0) {
       return;
@@ -329,18 +337,19 @@ Quad::GetTextureSize(int32_t& aWidth, int32_t& aHeight) const {
 }
 
 void
-Quad::SetTextureSize(int32_t aWidth, int32_t aHeight) {
+Quad::SetTextureSize(int32_t aWidth, int32_t aHeight, const float aSurfaceScale) {
   m.textureWidth = aWidth;
   m.textureHeight = aHeight;
+  m.surfaceScale = aSurfaceScale;
   if (m.layer) {
-    m.layer->Resize(aWidth, aHeight);
+    m.layer->Resize(m.GetSurfaceSize(aWidth), m.GetSurfaceSize(aHeight));
   }
 }
 
 void Quad::RecreateSurface() {
   if (m.layer) {
     bool force = true;
-    m.layer->Resize(m.textureWidth , m.textureHeight, force);
+    m.layer->Resize(m.GetSurfaceSize(m.textureWidth), m.GetSurfaceSize(m.textureHeight), force);
   }
 }
 
@@ -446,7 +455,18 @@ Quad::TestIntersection(const vrb::Vector& aStartPoint, const vrb::Vector& aDirec
     return false;
   }
   vrb::Matrix worldTransform = m.transform->GetWorldTransform();
-  vrb::Matrix modelView = worldTransform.AfineInverse();
+  return TestIntersection(worldTransform, worldTransform.AfineInverse(), aStartPoint, aDirection, aResult, aNormal, aClamp, aIsInside, aDistance);
+}
+
+bool
+Quad::TestIntersection(const vrb::Matrix& aTransform, const vrb::Matrix& aInverse, const vrb::Vector& aStartPoint, const vrb::Vector& aDirection,
+                       vrb::Vector& aResult, vrb::Vector& aNormal, bool aClamp, bool& aIsInside, float& aDistance) const {
+  aDistance = -1.0f;
+  if (!m.root->IsEnabled(*m.transform)) {
+    return false;
+  }
+  const vrb::Matrix& worldTransform = aTransform;
+  const vrb::Matrix& modelView = aInverse;
   vrb::Vector point = modelView.MultiplyPosition(aStartPoint);
   vrb::Vector direction = modelView.MultiplyDirection(aDirection);
   vrb::Vector normal = GetNormal();
@@ -43,7 +43,9 @@ public:
   void SetScaleMode(ScaleMode aScaleMode);
   void SetBackgroundColor(const vrb::Color& aColor);
   void GetTextureSize(int32_t& aWidth, int32_t& aHeight) const;
-  void SetTextureSize(int32_t aWidth, int32_t aHeight);
+  // aSurfaceScale is the resolution of the layer surface relative to the texture size. Widget
+  // coordinates stay in texture pixels.
+  void SetTextureSize(int32_t aWidth, int32_t aHeight, const float aSurfaceScale = 1.0f);
   void RecreateSurface();
   void GetWorldMinAndMax(vrb::Vector& aMin, vrb::Vector& aMax) const;
   const vrb::Vector& GetWorldMin() const;
@@ -60,6 +62,9 @@ public:
   vrb::TransformPtr GetTransformNode() const;
   VRLayerQuadPtr GetLayer() const;
   bool TestIntersection(const vrb::Vector& aStartPoint, const vrb::Vector& aDirection, vrb::Vector& aResult, vrb::Vector& aNormal, bool aClamp, bool& aIsInside, float& aDistance) const;
+  // Same as above with the world transform of the geometry and its inverse supplied by the caller.
+  bool TestIntersection(const vrb::Matrix& aTransform, const vrb::Matrix& aInverse, const vrb::Vector& aStartPoint, const vrb::Vector& aDirection,
+                        vrb::Vector& aResult, vrb::Vector& aNormal, bool aClamp, bool& aIsInside, float& aDistance) const;
   void ConvertToQuadCoordinates(const vrb::Vector& point, float& aX, float& aY, bool aClamp) const;
 protected:
   struct State;
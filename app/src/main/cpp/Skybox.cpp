@@ -4,12 +4,17 @@
  * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
 
 #include "Skybox.h"
+#include "CubemapKTX2.h"
+#include "DeviceDelegate.h"
 #include "VRLayer.h"
 #include "VRLayerNode.h"
 #include "vrb/ConcreteClass.h"
 #include "vrb/Color.h"
 #include "vrb/CreationContext.h"
 #include "vrb/Geometry.h"
+#include "vrb/GLError.h"
+#include "vrb/Group.h"
+#include "vrb/Logger.h"
 #include "vrb/Matrix.h"
 #include "vrb/ModelLoaderAndroid.h"
 #include "vrb/Program.h"
@@ -23,6 +28,7 @@
 
 #include <array>
 #include <list>
+#include <vector>
 #include <sys/stat.h>
 
 using namespace vrb;
@@ -41,6 +47,19 @@ static const std::list<std::string> sBaseNameList = std::list<std::string>({
 static const std::list<std::string> sFileExt = std::list<std::string>({
     ".ktx", ".jpg", ".png"
 });
+static const std::string sVoidEnvironment = "cubemap/void";
+static const std::string sKTX2FileName = "cubemap.ktx2";
+// Size of the layers of the skyboxes made of six face images.
+static const int32_t sFaceImageSize = 1024;
+// Largest KTX2 mip shown while the sharper one loads.
+static const int32_t sPreviewSize = 256;
+static const int32_t sMaxSize = 2048;
+
+static bool
+FileDoesNotExist (const std::string& aName) {
+  struct stat buffer;
+  return (stat(aName.c_str(), &buffer) != 0);
+}
 
 static TextureCubeMapPtr LoadTextureCube(vrb::CreationContextPtr& aContext, const std::string& aBasePath,
                                          const std::string& aExtension, bool srgb, GLuint targetTexture = 0) {
@@ -60,20 +79,124 @@ static TextureCubeMapPtr LoadTextureCube(vrb::CreationContextPtr& aContext, cons
   return cubemap;
 }
 
+// Largest KTX2 level that is not over sMaxSize.
+static int32_t
+GetFirstLevel(const CubemapKTX2& aCubemap) {
+  for (int32_t level = 0; level < aCubemap.GetLevelCount(); ++level) {
+    if (aCubemap.GetLevelSize(level) <= sMaxSize) {
+      return level;
+    }
+  }
+  return aCubemap.GetLevelCount() - 1;
+}
+
+namespace {
+
+// Where the files of an environment are. Either a KTX2 cubemap or six face
+// images with the given extension.
+struct SkyboxSource {
+  std::string basePath;
+  std::string extension;
+  CubemapKTX2 ktx2;
+};
+
+// A layer is loaded from a single KTX2 level or from the face images.
+struct SkyboxStage {
+  int32_t size;
+  GLenum format;
+  int32_t level;
+};
+
+struct SkyboxLayer {
+  VRLayerCubePtr layer;
+  vrb::NodePtr node;
+  SkyboxSource source;
+  SkyboxStage stage;
+};
+
+struct GeometryResult {
+  vrb::GeometryPtr geometry;
+  GLuint texture = 0;
+};
+
+// Runs on the loader thread, the files may be slow to reach.
+SkyboxSource
+ResolveSource(const std::string& aBasePath, const std::string& aOverridePath) {
+  SkyboxSource result;
+  result.basePath = aBasePath;
+  const bool overridden = !aOverridePath.empty() && !FileDoesNotExist(aOverridePath);
+  if (overridden) {
+    result.basePath = aOverridePath;
+  } else if (!aOverridePath.empty()) {
+    VRB_ERROR("Failed to find override skybox storage path %s", aOverridePath.c_str());
+  }
+  if (result.basePath == sVoidEnvironment) {
+    result.basePath.clear();
+    return result;
+  }
+  if (result.ktx2.Open(result.basePath + "/" + sKTX2FileName)) {
+    VRB_DEBUG("Found KTX2 skybox: %s", result.ktx2.GetPath().c_str());
+    return result;
+  }
+  result.extension = Skybox::ValidateCustomSkyboxAndFindFileExtension(result.basePath);
+  if (overridden) {
+    if (!result.extension.empty()) {
+      VRB_DEBUG("Found custom skybox file extension: %s", result.extension.c_str());
+    } else {
+      VRB_ERROR("Failed to find custom skybox files.");
+    }
+  }
+  // The built-in environments are assets that stat() does not see.
+  if (result.extension.empty()) {
+    result.extension = ".ktx";
+  }
+  return result;
+}
+
+// Runs on the loader thread, its context shares the layer textures.
+void
+UploadLayer(vrb::CreationContextPtr& aContext, const SkyboxSource& aSource, const SkyboxStage& aStage,
+            const GLuint aTexture) {
+  if (aStage.level >= 0) {
+    VRB_GL_CHECK(glBindTexture(GL_TEXTURE_CUBE_MAP, aTexture));
+    aSource.ktx2.Upload(aStage.level, 0, true);
+    VRB_GL_CHECK(glBindTexture(GL_TEXTURE_CUBE_MAP, 0));
+  } else {
+    const bool srgb = aStage.format == GL_SRGB8_ALPHA8 || aStage.format == GL_COMPRESSED_SRGB8_ETC2;
+    TextureCubeMapPtr texture = LoadTextureCube(aContext, aSource.basePath, aSource.extension, srgb, aTexture);
+    texture->Bind();
+  }
+  // The render thread shows the layer as soon as the task is done.
+  VRB_GL_CHECK(glFinish());
+}
+
+} // namespace
+
 struct Skybox::State {
   vrb::CreationContextWeak context;
+  std::weak_ptr<DeviceDelegate> deviceWeak;
   vrb::TogglePtr root;
-  VRLayerCubePtr layer;
-  GLuint layerTextureHandle;
   vrb::TransformPtr transform;
+  vrb::GroupPtr geometryGroup;
   vrb::GeometryPtr geometry;
+  GLuint geometryTexture;
   vrb::ModelLoaderAndroidPtr loader;
   std::string basePath;
-  std::string extension;
-  TextureCubeMapPtr texture;
+  std::string overridePath;
+  // Incremented by every load, tasks of an older one are dropped.
+  uint32_t generation;
+  SkyboxSource source;
+  std::vector<SkyboxStage> stages;
+  size_t nextStage;
+  // The layer on screen and the one being loaded to replace it.
+  SkyboxLayer current;
+  SkyboxLayer pending;
   vrb::Color tintColor;
+  std::function<void()> loadedCallback;
   State():
-      layerTextureHandle(0),
+      geometryTexture(0),
+      generation(0),
+      nextStage(0),
       tintColor(1.0f, 1.0f, 1.0f, 1.0f)
   {}
 
@@ -81,21 +204,160 @@ struct Skybox::State {
     vrb::CreationContextPtr create = context.lock();
     root = vrb::Toggle::Create(create);
     transform = vrb::Transform::Create(create);
-    if (layer) {
-      root->AddNode(VRLayerNode::Create(create, layer));
-      layer->SetSurfaceChangedDelegate([=](const VRLayer& aLayer, VRLayer::SurfaceChange aChange, const std::function<void()>& aCallback) {
-        this->layerTextureHandle = layer->GetTextureHandle();
-        LoadLayer();
-        if (aCallback) {
-          aCallback();
+    root->AddNode(transform);
+  }
+
+  void Resolve() {
+    const uint32_t loadGeneration = ++generation;
+    const std::string path = basePath;
+    const std::string storagePath = overridePath;
+    std::shared_ptr<SkyboxSource> result = std::make_shared<SkyboxSource>();
+    LoadTask task = [=](CreationContextPtr& aContext) -> GroupPtr {
+      *result = ResolveSource(path, storagePath);
+      return vrb::Group::Create(aContext);
+    };
+    LoadFinishedCallback callback = [=](GroupPtr& aGroup) {
+      if (aGroup) {
+        aGroup->RemoveFromParents();
+      }
+      if (loadGeneration == generation) {
+        StartLoad(*result);
+      }
+    };
+    loader->RunLoadTask(transform, task, callback);
+  }
+
+  void StartLoad(const SkyboxSource& aSource) {
+    source = aSource;
+    stages.clear();
+    nextStage = 0;
+    ReleaseLayer(pending);
+    if (source.basePath.empty()) {
+      Clear();
+      NotifyLoaded();
+      return;
+    }
+    if (source.ktx2.IsValid()) {
+      const GLenum format = source.ktx2.GetInternalFormat();
+      const int32_t first = GetFirstLevel(source.ktx2);
+      for (int32_t level = first + 1; level < source.ktx2.GetLevelCount(); ++level) {
+        const int32_t size = source.ktx2.GetLevelSize(level);
+        if (size <= sPreviewSize) {
+          stages.push_back(SkyboxStage{size, format, level});
+          break;
         }
-      });
+      }
+      stages.push_back(SkyboxStage{source.ktx2.GetLevelSize(first), format, first});
     } else {
-      root->AddNode(transform);
+      GLenum format = GL_RGBA8;
+      if (source.extension == ".ktx") {
+#if defined(OPENXR) && defined(OCULUSVR)
+        format = GL_COMPRESSED_SRGB8_ETC2;
+#else
+        format = GL_COMPRESSED_RGB8_ETC2;
+#endif
+      }
+      stages.push_back(SkyboxStage{sFaceImageSize, format, -1});
+    }
+    LoadNextStage();
+  }
+
+  void LoadNextStage() {
+    if (nextStage >= stages.size()) {
+      return;
+    }
+    const SkyboxStage& stage = stages[nextStage++];
+    DeviceDelegatePtr device = deviceWeak.lock();
+    VRLayerCubePtr layer = device ? device->CreateLayerCube(stage.size, stage.size, stage.format) : nullptr;
+    if (!layer) {
+      stages.clear();
+      LoadGeometry();
+      return;
+    }
+    pending.layer = layer;
+    pending.source = source;
+    pending.stage = stage;
+    layer->SetTintColor(tintColor);
+    std::weak_ptr<VRLayerCube> weakLayer = layer;
+    layer->SetSurfaceChangedDelegate([=](const VRLayer& aLayer, VRLayer::SurfaceChange aChange, const std::function<void()>& aCallback) {
+      VRLayerCubePtr cubeLayer = weakLayer.lock();
+      if (cubeLayer && aChange == VRLayer::SurfaceChange::Create) {
+        LoadLayer(cubeLayer);
+      }
+      if (aCallback) {
+        aCallback();
+      }
+    });
+  }
+
+  // Called again with a new texture when the device recreates the layer surface.
+  void LoadLayer(const VRLayerCubePtr& aLayer) {
+    const SkyboxLayer* target = aLayer == current.layer ? &current : (aLayer == pending.layer ? &pending : nullptr);
+    const GLuint texture = aLayer->GetTextureHandle();
+    if (!target || texture == 0) {
+      return;
+    }
+    const SkyboxSource layerSource = target->source;
+    const SkyboxStage stage = target->stage;
+    std::weak_ptr<VRLayerCube> weakLayer = aLayer;
+    LoadTask task = [=](CreationContextPtr& aContext) -> GroupPtr {
+      UploadLayer(aContext, layerSource, stage, texture);
+      return vrb::Group::Create(aContext);
+    };
+    LoadFinishedCallback callback = [=](GroupPtr& aGroup) {
+      if (aGroup) {
+        aGroup->RemoveFromParents();
+      }
+      VRLayerCubePtr layer = weakLayer.lock();
+      if (layer && layer->GetTextureHandle() == texture) {
+        LayerLoaded(layer);
+      }
+    };
+    loader->RunLoadTask(transform, task, callback);
+  }
+
+  void LayerLoaded(const VRLayerCubePtr& aLayer) {
+    if (aLayer == current.layer) {
+      aLayer->SetLoaded(true);
+      return;
+    }
+    if (aLayer != pending.layer) {
+      return;
+    }
+    // The new layer is drawn in the same frame the old one is deleted.
+    aLayer->SetLoaded(true);
+    vrb::CreationContextPtr create = context.lock();
+    pending.node = VRLayerNode::Create(create, aLayer);
+    root->AddNode(pending.node);
+    ReleaseLayer(current);
+    current = pending;
+    pending = SkyboxLayer();
+    RemoveGeometry();
+    NotifyLoaded();
+    LoadNextStage();
+  }
+
+  void NotifyLoaded() {
+    if (loadedCallback) {
+      loadedCallback();
     }
   }
 
+  void ReleaseLayer(SkyboxLayer& aLayer) {
+    if (aLayer.node) {
+      root->RemoveNode(*aLayer.node);
+    }
+    DeviceDelegatePtr device = deviceWeak.lock();
+    if (aLayer.layer && device) {
+      device->DeleteLayer(aLayer.layer);
+    }
+    aLayer = SkyboxLayer();
+  }
+
   void LoadGeometry() {
+    const uint32_t loadGeneration = generation;
+    const SkyboxSource geometrySource = source;
+    std::shared_ptr<GeometryResult> result = std::make_shared<GeometryResult>();
     LoadTask task = [=](CreationContextPtr &aContext) -> GroupPtr {
       std::array<GLfloat, 24> cubeVertices{
           -1.0f, 1.0f, 1.0f, // 0
@@ -127,7 +389,7 @@ struct Skybox::State {
                                -kLength * cubeVertices[i + 2]));
       }
 
-      geometry = vrb::Geometry::Create(aContext);
+      GeometryPtr geometry = vrb::Geometry::Create(aContext);
       geometry->SetVertexArray(array);
 
       for (int i = 0; i < cubeIndices.size(); i += 4) {
@@ -140,81 +402,104 @@ struct Skybox::State {
       state->SetProgram(program);
       geometry->SetRenderState(state);
 
-      bool srgb = false;
-      texture = LoadTextureCube(aContext, basePath, extension, srgb);
+      TextureCubeMapPtr texture;
+      if (geometrySource.ktx2.IsValid()) {
+        // All the mips fit in a texture that is not a compositor swapchain, smallest first.
+        const CubemapKTX2& ktx2 = geometrySource.ktx2;
+        const int32_t first = GetFirstLevel(ktx2);
+        const int32_t levels = ktx2.GetLevelCount() - first;
+        VRB_GL_CHECK(glGenTextures(1, &result->texture));
+        VRB_GL_CHECK(glBindTexture(GL_TEXTURE_CUBE_MAP, result->texture));
+        for (int32_t level = ktx2.GetLevelCount() - 1; level >= first; --level) {
+          ktx2.Upload(level, level - first, false);
+        }
+        VRB_GL_CHECK(glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAX_LEVEL, levels - 1));
+        VRB_GL_CHECK(glBindTexture(GL_TEXTURE_CUBE_MAP, 0));
+        texture = vrb::TextureCubeMap::Create(aContext, result->texture);
+        texture->SetTextureParameter(GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        texture->SetTextureParameter(GL_TEXTURE_MIN_FILTER, levels > 1 ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+        texture->SetTextureParameter(GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        texture->SetTextureParameter(GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        texture->SetTextureParameter(GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+      } else {
+        bool srgb = false;
+        texture = LoadTextureCube(aContext, geometrySource.basePath, geometrySource.extension, srgb);
+      }
       state->SetTexture(texture);
       state->SetMaterial(Color(1.0f, 1.0f, 1.0f), Color(1.0f, 1.0f, 1.0f), Color(0.0f, 0.0f, 0.0f),
                          0.0f);
       geometry->SetRenderState(state);
+      result->geometry = geometry;
       vrb::GroupPtr group = vrb::Transform::Create(aContext);
       group->AddNode(geometry);
       return group;
     };
 
-    vrb::GeometryPtr oldGeometry = geometry;
-    LoadFinishedCallback loadedCallback = [=](GroupPtr&) {
+    LoadFinishedCallback loadedCallback = [=](GroupPtr& aGroup) {
+      if (loadGeneration != generation) {
+        if (aGroup) {
+          aGroup->RemoveFromParents();
+        }
+        if (result->texture) {
+          VRB_GL_CHECK(glDeleteTextures(1, &result->texture));
+        }
+        return;
+      }
+      RemoveGeometry();
+      geometryGroup = aGroup;
+      geometry = result->geometry;
+      geometryTexture = result->texture;
       if (geometry) {
         geometry->GetRenderState()->SetTintColor(tintColor);
       }
-      if (oldGeometry) {
-        oldGeometry->RemoveFromParents();
-      }
+      NotifyLoaded();
     };
 
     loader->RunLoadTask(transform, task, loadedCallback);
   }
 
-  void LoadLayer() {
-    if (basePath.empty() || layerTextureHandle == 0) {
-      return;
+  void RemoveGeometry() {
+    if (geometryGroup) {
+      geometryGroup->RemoveFromParents();
+      geometryGroup = nullptr;
+    }
+    geometry = nullptr;
+    if (geometryTexture) {
+      VRB_GL_CHECK(glDeleteTextures(1, &geometryTexture));
+      geometryTexture = 0;
     }
-    vrb::CreationContextPtr create = context.lock();
-    bool srgb = layer->GetFormat() == GL_SRGB8_ALPHA8 || layer->GetFormat() == GL_COMPRESSED_SRGB8_ETC2;
-    texture = LoadTextureCube(create, basePath, extension, srgb, layerTextureHandle);
-    texture->Bind();
-    layer->SetLoaded(true);
+  }
+
+  void Clear() {
+    stages.clear();
+    ReleaseLayer(pending);
+    ReleaseLayer(current);
+    RemoveGeometry();
   }
 };
 
 void
-Skybox::Load(const vrb::ModelLoaderAndroidPtr& aLoader, const std::string& aBasePath, const std::string& aExtension) {
-  if (m.basePath == aBasePath) {
+Skybox::Load(const vrb::ModelLoaderAndroidPtr& aLoader, const std::string& aBasePath, const std::string& aOverridePath) {
+  if (m.basePath == aBasePath && m.overridePath == aOverridePath) {
     return;
   }
   m.loader = aLoader;
   m.basePath = aBasePath;
-  m.extension = aExtension;
-  if (m.layer) {
-    m.LoadLayer();
-  } else {
-    m.LoadGeometry();
-  }
+  m.overridePath = aOverridePath;
+  m.Resolve();
 }
 
-VRLayerCubePtr
-Skybox::GetLayer() const {
-  return m.layer;
+void
+Skybox::SetLoadedCallback(const std::function<void()>& aCallback) {
+  m.loadedCallback = aCallback;
 }
 
 void
-Skybox::SetLayer(const VRLayerCubePtr& aLayer) {
-  m.basePath = "";
-  m.layerTextureHandle = 0;
-  if (m.root->GetNodeCount() > 0) {
-    vrb::NodePtr layerNode = m.root->GetNode(0);
-    m.root->RemoveNode(*layerNode);
-  }
-  m.layer = aLayer;
-  m.layer->SetTintColor(m.tintColor);
-  vrb::CreationContextPtr create = m.context.lock();
-  m.root->AddNode(VRLayerNode::Create(create, m.layer));
-  m.layer->SetSurfaceChangedDelegate([=](const VRLayer& aLayer, VRLayer::SurfaceChange aChange, const std::function<void()>& aCallback) {
-    m.layerTextureHandle = m.layer->GetTextureHandle();
-    m.LoadLayer();
-    if (aCallback) {
-      aCallback();
-    }
-  });
+Skybox::Unload() {
+  m.generation++;
+  m.basePath.clear();
+  m.overridePath.clear();
+  m.Clear();
 }
 
 void
@@ -232,12 +517,15 @@ Skybox::SetTransform(const vrb::Matrix& aTransform) {
 void
 Skybox::SetTintColor(const vrb::Color &aTintColor) {
   m.tintColor = aTintColor;
-  if (m.layer) {
-    m.layer->SetTintColor(aTintColor);
-  } else if (m.geometry) {
+  if (m.current.layer) {
+    m.current.layer->SetTintColor(aTintColor);
+  }
+  if (m.pending.layer) {
+    m.pending.layer->SetTintColor(aTintColor);
+  }
+  if (m.geometry) {
     m.geometry->GetRenderState()->SetTintColor(aTintColor);
   }
-
 }
 
 vrb::NodePtr
@@ -245,12 +533,6 @@ Skybox::GetRoot() const {
   return m.root;
 }
 
-static bool
-FileDoesNotExist (const std::string& aName) {
-  struct stat buffer;
-  return (stat(aName.c_str(), &buffer) != 0);
-}
-
 std::string
 Skybox::ValidateCustomSkyboxAndFindFileExtension(const std::string& aBasePath) {
   for (const std::string& ext: sFileExt) {
@@ -274,9 +556,9 @@ Skybox::ValidateCustomSkyboxAndFindFileExtension(const std::string& aBasePath) {
 }
 
 SkyboxPtr
-Skybox::Create(vrb::CreationContextPtr aContext, const VRLayerCubePtr& aLayer) {
+Skybox::Create(vrb::CreationContextPtr aContext, const DeviceDelegatePtr& aDevice) {
   SkyboxPtr result = std::make_shared<vrb::ConcreteClass<Skybox, Skybox::State> >(aContext);
-  result->m.layer = aLayer;
+  result->m.deviceWeak = aDevice;
   result->m.Initialize();
   return result;
 }
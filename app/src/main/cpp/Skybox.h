@@ -9,21 +9,31 @@
 #include "vrb/Forward.h"
 #include "vrb/MacroUtils.h"
 
+#include <functional>
+
 namespace crow {
 
 class Skybox;
 typedef std::shared_ptr<Skybox> SkyboxPtr;
 
-class VRLayerCube;
-typedef std::shared_ptr<VRLayerCube> VRLayerCubePtr;
+class DeviceDelegate;
+typedef std::shared_ptr<DeviceDelegate> DeviceDelegatePtr;
 
+// Environment cubemap, drawn in a compositor cube layer when the device
+// supports them and as geometry otherwise. Files are found, decoded and
+// uploaded on the loader thread; the previous environment stays on screen
+// until the new one is ready. A single file KTX2 cubemap is shown at a low
+// resolution mip first and then swapped for a sharper one.
 class Skybox {
 public:
   static std::string ValidateCustomSkyboxAndFindFileExtension(const std::string& aBasePath);
-  static SkyboxPtr Create(vrb::CreationContextPtr aContext, const VRLayerCubePtr& aLayer = nullptr);
-  void Load(const vrb::ModelLoaderAndroidPtr& aLoader, const std::string& aBasePath, const std::string& aExtension);
-  VRLayerCubePtr GetLayer() const;
-  void SetLayer(const VRLayerCubePtr& aLayer);
+  static SkyboxPtr Create(vrb::CreationContextPtr aContext, const DeviceDelegatePtr& aDevice);
+  // aOverridePath replaces aBasePath when it exists, empty for none.
+  void Load(const vrb::ModelLoaderAndroidPtr& aLoader, const std::string& aBasePath, const std::string& aOverridePath);
+  // Called when a loaded environment, or a sharper stage of it, is shown.
+  void SetLoadedCallback(const std::function<void()>& aCallback);
+  // Drops the loaded environment and any load in progress.
+  void Unload();
   void SetVisible(bool aVisible);
   void SetTransform(const vrb::Matrix& aTransform);
   void SetTintColor(const vrb::Color& aTintColor);
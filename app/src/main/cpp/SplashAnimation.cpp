@@ -23,6 +23,11 @@
 
 #include "Quad.h"
 
+#include <algorithm>
+
+// The splash fades out once startup is done, after SPLASH_MIN_SECONDS at the
+// earliest and SPLASH_SECONDS at the latest.
+#define SPLASH_MIN_SECONDS 0.5f
 #define SPLASH_SECONDS 2.3f
 #define FADE_OUT_TIME 0.3f
 
@@ -36,8 +41,10 @@ struct SplashAnimation::State {
   VRLayerQuadPtr layer;
   timespec start;
   float time;
+  float fadeStart;
+  bool ready;
   bool firstDraw;
-  State(): time(-1), firstDraw(true)
+  State(): time(-1), fadeStart(SPLASH_SECONDS), ready(false), firstDraw(true)
   {
   }
 
@@ -127,11 +134,19 @@ SplashAnimation::Update(const vrb::Matrix& aHeadTransform) {
     m.firstDraw = false;
   }
   m.UpdateTime();
-  if (m.time >= SPLASH_SECONDS && m.time <= (SPLASH_SECONDS + FADE_OUT_TIME)) {
-    float t = 1.0f - (m.time - SPLASH_SECONDS) / FADE_OUT_TIME;
+  if (m.ready && m.time < m.fadeStart) {
+    m.fadeStart = std::max(m.time, SPLASH_MIN_SECONDS);
+  }
+  if (m.time >= m.fadeStart && m.time <= (m.fadeStart + FADE_OUT_TIME)) {
+    float t = 1.0f - (m.time - m.fadeStart) / FADE_OUT_TIME;
     m.logo->SetTintColor(vrb::Color(t, t, t, 1.0f));
   }
-  return m.time >= SPLASH_SECONDS + FADE_OUT_TIME;
+  return m.time >= m.fadeStart + FADE_OUT_TIME;
+}
+
+void
+SplashAnimation::SetReady() {
+  m.ready = true;
 }
 
 vrb::NodePtr
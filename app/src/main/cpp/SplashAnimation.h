@@ -30,6 +30,8 @@ public:
   static SplashAnimationPtr Create(vrb::CreationContextPtr aContext);
   void Load(vrb::RenderContextPtr& aContext, const DeviceDelegatePtr& aDeviceDelegate);
   bool Update(const vrb::Matrix& aHeadTransform);
+  // Lets the splash fade out before its full duration.
+  void SetReady();
   vrb::NodePtr GetRoot() const;
   VRLayerQuadPtr GetLayer() const;
 protected:
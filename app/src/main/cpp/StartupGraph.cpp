@@ -0,0 +1,237 @@
+/* -*- Mode: C++; tab-width: 20; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include "StartupGraph.h"
+#include "vrb/ConcreteClass.h"
+#include "vrb/Logger.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+namespace {
+
+const size_t kWorkerCount = 2;
+
+typedef std::chrono::steady_clock Clock;
+
+double
+Milliseconds(const Clock::time_point& aStart, const Clock::time_point& aEnd) {
+  return std::chrono::duration<double, std::milli>(aEnd - aStart).count();
+}
+
+} // namespace
+
+namespace crow {
+
+struct StartupGraph::State {
+  enum class Status { Waiting, Running, Done };
+  struct Task {
+    std::string name;
+    std::vector<uint32_t> dependencies;
+    bool critical;
+    Work work;
+    bool worker;
+    bool async;
+    Status status;
+    Clock::time_point start;
+    Clock::time_point end;
+  };
+  Clock::time_point created;
+  Clock::time_point criticalPathEnd;
+  bool criticalPathDone;
+  bool interactive;
+  std::vector<Task> tasks;
+  // Shared with the worker threads.
+  std::mutex mutex;
+  std::condition_variable condition;
+  std::deque<uint32_t> queue;
+  std::vector<std::pair<uint32_t, Clock::time_point>> finished;
+  std::vector<std::thread> workers;
+  bool quit;
+
+  State()
+      : created(Clock::now())
+      , criticalPathDone(false)
+      , interactive(false)
+      , quit(false)
+  {}
+
+  ~State() {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      quit = true;
+    }
+    condition.notify_all();
+    for (std::thread& worker: workers) {
+      worker.join();
+    }
+  }
+
+  bool IsReady(const Task& aTask) const {
+    for (uint32_t dependency: aTask.dependencies) {
+      if (tasks[dependency].status != Status::Done) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  void RunWorker() {
+    while (true) {
+      uint32_t index = 0;
+      Work work;
+      {
+        std::unique_lock<std::mutex> lock(mutex);
+        condition.wait(lock, [this]() { return quit || !queue.empty(); });
+        if (quit) {
+          return;
+        }
+        index = queue.front();
+        queue.pop_front();
+        work = tasks[index].work;
+      }
+      work();
+      std::lock_guard<std::mutex> lock(mutex);
+      finished.emplace_back(index, Clock::now());
+    }
+  }
+
+  void Start(const uint32_t aIndex) {
+    Task& task = tasks[aIndex];
+    task.status = Status::Running;
+    task.start = Clock::now();
+    if (task.worker) {
+      std::lock_guard<std::mutex> lock(mutex);
+      if (workers.empty()) {
+        for (size_t i = 0; i < kWorkerCount; ++i) {
+          workers.emplace_back([this]() { RunWorker(); });
+        }
+      }
+      queue.push_back(aIndex);
+      condition.notify_one();
+      return;
+    }
+    // The work may add tasks, which moves this one.
+    const Work work = task.work;
+    const bool async = task.async;
+    work();
+    if (!async) {
+      Done(aIndex, Clock::now());
+    }
+  }
+
+  void Done(const uint32_t aIndex, const Clock::time_point& aEnd) {
+    Task& task = tasks[aIndex];
+    if (task.status == Status::Waiting) {
+      task.start = aEnd;
+    }
+    task.status = Status::Done;
+    task.end = aEnd;
+  }
+};
+
+StartupGraphPtr
+StartupGraph::Create() {
+  return std::make_shared<vrb::ConcreteClass<StartupGraph, StartupGraph::State> >();
+}
+
+uint32_t
+StartupGraph::AddTask(const std::string& aName, const std::vector<uint32_t>& aDependencies, const bool aCritical) {
+  State::Task task = {aName, aDependencies, aCritical, nullptr, false, false, State::Status::Waiting};
+  // The worker threads read the work of queued tasks.
+  std::lock_guard<std::mutex> lock(m.mutex);
+  m.tasks.push_back(task);
+  if (aCritical) {
+    m.criticalPathDone = false;
+  }
+  return (uint32_t)m.tasks.size() - 1;
+}
+
+void
+StartupGraph::RunOnWorker(const uint32_t aTask, const Work& aWork) {
+  m.tasks[aTask].work = aWork;
+  m.tasks[aTask].worker = true;
+}
+
+void
+StartupGraph::RunOnRenderThread(const uint32_t aTask, const Work& aWork, const bool aAsync) {
+  m.tasks[aTask].work = aWork;
+  m.tasks[aTask].async = aAsync;
+}
+
+void
+StartupGraph::Finish(const uint32_t aTask) {
+  if (m.tasks[aTask].status != State::Status::Done) {
+    m.Done(aTask, Clock::now());
+  }
+}
+
+bool
+StartupGraph::IsFinished(const uint32_t aTask) const {
+  return m.tasks[aTask].status == State::Status::Done;
+}
+
+bool
+StartupGraph::IsCriticalPathDone() const {
+  return m.criticalPathDone;
+}
+
+void
+StartupGraph::Update() {
+  {
+    std::lock_guard<std::mutex> lock(m.mutex);
+    for (const auto& entry: m.finished) {
+      m.Done(entry.first, entry.second);
+    }
+    m.finished.clear();
+  }
+  // Render thread work may finish the dependencies of later tasks.
+  bool started = true;
+  while (started) {
+    started = false;
+    for (uint32_t index = 0; index < m.tasks.size(); ++index) {
+      const State::Task& task = m.tasks[index];
+      if (task.status == State::Status::Waiting && task.work && m.IsReady(task)) {
+        m.Start(index);
+        started = true;
+      }
+    }
+  }
+  if (m.criticalPathDone) {
+    return;
+  }
+  for (const State::Task& task: m.tasks) {
+    if (task.critical && task.status != State::Status::Done) {
+      return;
+    }
+  }
+  m.criticalPathDone = true;
+  m.criticalPathEnd = Clock::now();
+  VRB_LOG("Startup critical path done in %.1f ms", Milliseconds(m.created, m.criticalPathEnd));
+}
+
+void
+StartupGraph::FirstInteractiveFrame() {
+  if (m.interactive) {
+    return;
+  }
+  m.interactive = true;
+  VRB_LOG("Time to first interactive frame: %.1f ms", Milliseconds(m.created, Clock::now()));
+  for (const State::Task& task: m.tasks) {
+    if (task.status == State::Status::Done) {
+      VRB_LOG("  %s%s: %.1f - %.1f ms", task.name.c_str(), task.critical ? " (critical)" : "",
+              Milliseconds(m.created, task.start), Milliseconds(m.created, task.end));
+    } else {
+      VRB_LOG("  %s%s: not done", task.name.c_str(), task.critical ? " (critical)" : "");
+    }
+  }
+}
+
+StartupGraph::StartupGraph(State& aState) : m(aState) {}
+
+} // namespace crow
@@ -0,0 +1,59 @@
+/* -*- Mode: C++; tab-width: 20; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#ifndef VRBROWSER_STARTUP_GRAPH_H
+#define VRBROWSER_STARTUP_GRAPH_H
+
+#include "vrb/MacroUtils.h"
+
+#include <functional>
+#include <memory>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+namespace crow {
+
+class StartupGraph;
+typedef std::shared_ptr<StartupGraph> StartupGraphPtr;
+
+// Startup work as a graph of tasks, each one started as soon as the tasks it
+// depends on are done. CPU only work runs on a small pool of worker threads;
+// work that needs the render thread or GL runs in Update(). Startup is done
+// once every critical task is, which is when the splash may end.
+// Everything but the worker functions runs on the render thread.
+class StartupGraph {
+public:
+  typedef std::function<void()> Work;
+  static StartupGraphPtr Create();
+  // Tasks may be added at any time, after the tasks they depend on.
+  uint32_t AddTask(const std::string& aName, const std::vector<uint32_t>& aDependencies, const bool aCritical);
+  // The task is done when aWork returns on a worker thread. aWork must not use GL.
+  void RunOnWorker(const uint32_t aTask, const Work& aWork);
+  // aWork runs from Update(). The task is done when it returns, or when
+  // Finish() is called if aAsync is true.
+  void RunOnRenderThread(const uint32_t aTask, const Work& aWork, const bool aAsync = false);
+  // Finishes a task that has no work or runs asynchronously.
+  void Finish(const uint32_t aTask);
+  bool IsFinished(const uint32_t aTask) const;
+  bool IsCriticalPathDone() const;
+  // Called every frame.
+  void Update();
+  // Logs the time from creation to the first frame that takes input and the
+  // time of each task. Does nothing after the first call.
+  void FirstInteractiveFrame();
+protected:
+  struct State;
+  StartupGraph(State& aState);
+  ~StartupGraph() = default;
+private:
+  State& m;
+  StartupGraph() = delete;
+  VRB_NO_DEFAULTS(StartupGraph)
+};
+
+} // namespace crow
+
+#endif // VRBROWSER_STARTUP_GRAPH_H
@@ -0,0 +1,57 @@
+/* -*- Mode: C++; tab-width: 20; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include "TransparentSort.h"
+
+#include <algorithm>
+
+namespace crow {
+
+uint64_t
+PackTransparentSortKey(const int32_t aLayerPriority, const float aZ) {
+  const uint64_t invertedPriority = (uint64_t)((int64_t)INT32_MAX - (int64_t)aLayerPriority);
+  const float z = std::max(-1.0f, std::min(aZ, 1.0f));
+  const uint64_t depth = (uint64_t)((double)(z + 1.0f) * 0.5 * (double)0xFFFFFFFFu);
+  return (invertedPriority << 32) | (depth & 0xFFFFFFFF);
+}
+
+bool
+SortTransparentEntries(std::vector<TransparentSortEntry>& aEntries, const TransparentSortIsParent& aIsParent) {
+  bool changed = false;
+  for (size_t i = 1; i < aEntries.size(); ++i) {
+    const TransparentSortEntry entry = aEntries[i];
+    size_t j = i;
+    while (j > 0 && aEntries[j - 1].key > entry.key) {
+      aEntries[j] = aEntries[j - 1];
+      j--;
+    }
+    if (j != i) {
+      aEntries[j] = entry;
+      changed = true;
+    }
+  }
+
+  // Move each child right before the first of its ancestors. Everything ahead
+  // of i already precedes its own ancestors, and any descendant of the moved
+  // entry also descends from that ancestor, so it is still ahead of it.
+  for (size_t i = 1; i < aEntries.size(); ++i) {
+    const TransparentSortEntry entry = aEntries[i];
+    if (!entry.widget || entry.depth <= 0) {
+      continue;
+    }
+    size_t j = 0;
+    while (j < i && (!aEntries[j].widget || aEntries[j].widget == entry.widget ||
+                     !aIsParent(*entry.widget, *aEntries[j].widget))) {
+      j++;
+    }
+    if (j < i) {
+      std::rotate(aEntries.begin() + j, aEntries.begin() + i, aEntries.begin() + i + 1);
+      changed = true;
+    }
+  }
+  return changed;
+}
+
+} // namespace crow
@@ -0,0 +1,46 @@
+/* -*- Mode: C++; tab-width: 20; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#ifndef VRBROWSER_TRANSPARENT_SORT_H
+#define VRBROWSER_TRANSPARENT_SORT_H
+
+#include <functional>
+#include <stdint.h>
+#include <vector>
+
+namespace vrb {
+class Node;
+}
+
+namespace crow {
+
+class Widget;
+
+// A rootTransparent node and the widget it is sorted against. Nodes without
+// a visible widget use the largest key and go last.
+struct TransparentSortEntry {
+  uint64_t key;
+  vrb::Node* node;
+  const Widget* widget;
+  int depth; // Parent count of the widget.
+};
+
+typedef std::function<bool(const Widget& aChild, const Widget& aParent)> TransparentSortIsParent;
+
+// Sort key compared as a single integer:
+// [63..32] layer priority: higher priority first.
+// [31..0]  normalized device z: nearer first.
+uint64_t PackTransparentSortKey(const int32_t aLayerPriority, const float aZ);
+
+// Orders the entries by key, keeping the current order of equal keys, then
+// moves every widget ahead of its ancestors. Ancestry only orders a widget
+// against its own parents; unrelated widgets keep the key order whatever
+// their depth. Entries are expected in last frame's order, which keeps the
+// sort close to linear. Returns true when the order changed.
+bool SortTransparentEntries(std::vector<TransparentSortEntry>& aEntries, const TransparentSortIsParent& aIsParent);
+
+} // namespace crow
+
+#endif // VRBROWSER_TRANSPARENT_SORT_H
@@ -6,6 +6,8 @@
 #include "VRBrowser.h"
 #include "vrb/ConcreteClass.h"
 #include "vrb/Logger.h"
+#include "CallbackRegistry.h"
+#include "JNIEventChannel.h"
 #include "JNIUtil.h"
 
 namespace {
@@ -14,18 +16,10 @@ const char* const kDispatchCreateWidgetName = "dispatchCreateWidget";
 const char* const kDispatchCreateWidgetSignature = "(ILandroid/graphics/SurfaceTexture;II)V";
 const char* const kDispatchCreateWidgetLayerName = "dispatchCreateWidgetLayer";
 const char* const kDispatchCreateWidgetLayerSignature = "(ILandroid/view/Surface;IIJ)V";
-const char* const kHandleMotionEventName = "handleMotionEvent";
-const char* const kHandleMotionEventSignature = "(IIZZFF)V";
-const char* const kHandleScrollEventName = "handleScrollEvent";
-const char* const kHandleScrollEventSignature = "(IIFF)V";
-const char* const kHandleAudioPoseName = "handleAudioPose";
-const char* const kHandleAudioPoseSignature = "(FFFFFFF)V";
-const char* const kHandleGestureName = "handleGesture";
-const char* const kHandleGestureSignature = "(I)V";
-const char* const kHandleResizeName = "handleResize";
-const char* const kHandleResizeSignature = "(IFF)V";
-const char* const kHandleMoveEndName = "handleMoveEnd";
-const char* const kHandleMoveEndSignature = "(IFFFF)V";
+const char* const kSetNativeEventBufferName = "setNativeEventBuffer";
+const char* const kSetNativeEventBufferSignature = "(Ljava/nio/ByteBuffer;I)V";
+const char* const kDrainNativeEventsName = "drainNativeEvents";
+const char* const kDrainNativeEventsSignature = "(I)V";
 const char* const kHandleBackEventName = "handleBack";
 const char* const kHandleBackEventSignature = "()V";
 const char* const kRegisterExternalContextName = "registerExternalContext";
@@ -42,6 +36,8 @@ const char* const kRenderPointerLayerName = "renderPointerLayer";
 const char* const kRenderPointerLayerSignature = "(Landroid/view/Surface;J)V";
 const char* const kGetStorageAbsolutePathName = "getStorageAbsolutePath";
 const char* const kGetStorageAbsolutePathSignature = "()Ljava/lang/String;";
+const char* const kGetCacheAbsolutePathName = "getCacheAbsolutePath";
+const char* const kGetCacheAbsolutePathSignature = "()Ljava/lang/String;";
 const char* const kIsOverrideEnvPathEnabledName = "isOverrideEnvPathEnabled";
 const char* const kIsOverrideEnvPathEnabledSignature = "()Z";
 const char* const kGetActiveEnvironment = "getActiveEnvironment";
@@ -62,20 +58,14 @@ const char* const kDisableLayers = "disableLayers";
 const char* const kDisableLayersSignature = "()V";
 const char* const kAppendAppNotesToCrashReport = "appendAppNotesToCrashReport";
 const char* const kAppendAppNotesToCrashReportSignature = "(Ljava/lang/String;)V";
-const char* const kUpdateControllerBatteryLevelsName = "updateControllerBatteryLevels";
-const char* const kUpdateControllerBatteryLevelsSignature = "(II)V";
 
 JNIEnv* sEnv = nullptr;
 jclass sBrowserClass = nullptr;
 jobject sActivity = nullptr;
 jmethodID sDispatchCreateWidget = nullptr;
 jmethodID sDispatchCreateWidgetLayer = nullptr;
-jmethodID sHandleMotionEvent = nullptr;
-jmethodID sHandleScrollEvent = nullptr;
-jmethodID sHandleAudioPose = nullptr;
-jmethodID sHandleGesture = nullptr;
-jmethodID sHandleResize = nullptr;
-jmethodID sHandleMoveEnd = nullptr;
+jmethodID sSetNativeEventBuffer = nullptr;
+jmethodID sDrainNativeEvents = nullptr;
 jmethodID sHandleBack = nullptr;
 jmethodID sRegisterExternalContext = nullptr;
 jmethodID sOnEnterWebXR = nullptr;
@@ -84,6 +74,7 @@ jmethodID sOnDismissWebXRInterstitial = nullptr;
 jmethodID sOnWebXRRenderStateChange = nullptr;
 jmethodID sRenderPointerLayer = nullptr;
 jmethodID sGetStorageAbsolutePath = nullptr;
+jmethodID sGetCacheAbsolutePath = nullptr;
 jmethodID sIsOverrideEnvPathEnabled = nullptr;
 jmethodID sGetActiveEnvironment = nullptr;
 jmethodID sGetPointerColor = nullptr;
@@ -94,7 +85,30 @@ jmethodID sHandlePoorPerformance = nullptr;
 jmethodID sOnAppLink = nullptr;
 jmethodID sDisableLayers = nullptr;
 jmethodID sAppendAppNotesToCrashReport = nullptr;
-jmethodID sUpdateControllerBatteryLevels = nullptr;
+
+// Fire and forget events are queued here during the frame and sent to Java
+// with a single call in FlushEvents().
+const uint32_t kEventCapacity = 1024;
+crow::JNIEventChannelPtr sEvents;
+uint32_t sReportedCoalesced = 0;
+uint32_t sReportedDropped = 0;
+crow::CallbackRegistryPtr sCallbacks;
+
+crow::JNIEventChannel::Record*
+PushEvent(const crow::JNIEventChannel::EventType aType) {
+  if (!sEnv || !sEvents || !sDrainNativeEvents) {
+    return nullptr;
+  }
+  return sEvents->Push(aType);
+}
+
+jlong
+RegisterCallback(const std::function<void()>& aCallback) {
+  if (!sCallbacks) {
+    sCallbacks = crow::CallbackRegistry::Create();
+  }
+  return (jlong)sCallbacks->Register(aCallback);
+}
 }
 
 namespace crow {
@@ -116,12 +130,8 @@ VRBrowser::InitializeJava(JNIEnv* aEnv, jobject aActivity) {
 
   sDispatchCreateWidget = FindJNIMethodID(sEnv, sBrowserClass, kDispatchCreateWidgetName, kDispatchCreateWidgetSignature);
   sDispatchCreateWidgetLayer = FindJNIMethodID(sEnv, sBrowserClass, kDispatchCreateWidgetLayerName, kDispatchCreateWidgetLayerSignature);
-  sHandleMotionEvent = FindJNIMethodID(sEnv, sBrowserClass, kHandleMotionEventName, kHandleMotionEventSignature);
-  sHandleScrollEvent = FindJNIMethodID(sEnv, sBrowserClass, kHandleScrollEventName, kHandleScrollEventSignature);
-  sHandleAudioPose = FindJNIMethodID(sEnv, sBrowserClass, kHandleAudioPoseName, kHandleAudioPoseSignature);
-  sHandleGesture = FindJNIMethodID(sEnv, sBrowserClass, kHandleGestureName, kHandleGestureSignature);
-  sHandleResize = FindJNIMethodID(sEnv, sBrowserClass, kHandleResizeName, kHandleResizeSignature);
-  sHandleMoveEnd = FindJNIMethodID(sEnv, sBrowserClass, kHandleMoveEndName, kHandleMoveEndSignature);
+  sSetNativeEventBuffer = FindJNIMethodID(sEnv, sBrowserClass, kSetNativeEventBufferName, kSetNativeEventBufferSignature);
+  sDrainNativeEvents = FindJNIMethodID(sEnv, sBrowserClass, kDrainNativeEventsName, kDrainNativeEventsSignature);
   sHandleBack = FindJNIMethodID(sEnv, sBrowserClass, kHandleBackEventName, kHandleBackEventSignature);
   sRegisterExternalContext = FindJNIMethodID(sEnv, sBrowserClass, kRegisterExternalContextName, kRegisterExternalContextSignature);
   sOnEnterWebXR = FindJNIMethodID(sEnv, sBrowserClass, kOnEnterWebXRName, kOnEnterWebXRSignature);
@@ -130,6 +140,7 @@ VRBrowser::InitializeJava(JNIEnv* aEnv, jobject aActivity) {
   sOnWebXRRenderStateChange = FindJNIMethodID(sEnv, sBrowserClass, kOnWebXRRenderStateChangeName, kOnWebXRRenderStateChangeSignature);
   sRenderPointerLayer = FindJNIMethodID(sEnv, sBrowserClass, kRenderPointerLayerName, kRenderPointerLayerSignature);
   sGetStorageAbsolutePath = FindJNIMethodID(sEnv, sBrowserClass, kGetStorageAbsolutePathName, kGetStorageAbsolutePathSignature);
+  sGetCacheAbsolutePath = FindJNIMethodID(sEnv, sBrowserClass, kGetCacheAbsolutePathName, kGetCacheAbsolutePathSignature);
   sIsOverrideEnvPathEnabled = FindJNIMethodID(sEnv, sBrowserClass, kIsOverrideEnvPathEnabledName, kIsOverrideEnvPathEnabledSignature);
   sGetActiveEnvironment = FindJNIMethodID(sEnv, sBrowserClass, kGetActiveEnvironment, kGetActiveEnvironmentSignature);
   sGetPointerColor = FindJNIMethodID(sEnv, sBrowserClass, kGetPointerColor, kGetPointerColorSignature);
@@ -140,7 +151,17 @@ VRBrowser::InitializeJava(JNIEnv* aEnv, jobject aActivity) {
   sOnAppLink = FindJNIMethodID(sEnv, sBrowserClass, kOnAppLink, kOnAppLinkSignature);
   sDisableLayers = FindJNIMethodID(sEnv, sBrowserClass, kDisableLayers, kDisableLayersSignature);
   sAppendAppNotesToCrashReport = FindJNIMethodID(sEnv, sBrowserClass, kAppendAppNotesToCrashReport, kAppendAppNotesToCrashReportSignature);
-  sUpdateControllerBatteryLevels = FindJNIMethodID(sEnv, sBrowserClass, kUpdateControllerBatteryLevelsName, kUpdateControllerBatteryLevelsSignature);
+
+  if (!sEvents) {
+    sEvents = JNIEventChannel::Create(kEventCapacity);
+  }
+  sEvents->Reset();
+  if (ValidateMethodID(sEnv, sActivity, sSetNativeEventBuffer, __FUNCTION__)) {
+    jobject buffer = sEnv->NewDirectByteBuffer(sEvents->GetBuffer(), (jlong)sEvents->GetBufferSize());
+    sEnv->CallVoidMethod(sActivity, sSetNativeEventBuffer, buffer, (jint)sEvents->GetCapacity());
+    sEnv->DeleteLocalRef(buffer);
+    CheckJNIException(sEnv, __FUNCTION__);
+  }
 }
 
 JNIEnv * VRBrowser::Env()
@@ -159,15 +180,15 @@ VRBrowser::ShutdownJava() {
   }
 
   sBrowserClass = nullptr;
+  // Java drops the pending callbacks with the activity.
+  if (sCallbacks) {
+    sCallbacks->Clear();
+  }
 
   sDispatchCreateWidget = nullptr;
   sDispatchCreateWidgetLayer = nullptr;
-  sHandleMotionEvent = nullptr;
-  sHandleScrollEvent = nullptr;
-  sHandleAudioPose = nullptr;
-  sHandleGesture = nullptr;
-  sHandleResize = nullptr;
-  sHandleMoveEnd = nullptr;
+  sSetNativeEventBuffer = nullptr;
+  sDrainNativeEvents = nullptr;
   sHandleBack = nullptr;
   sRegisterExternalContext = nullptr;
   sOnEnterWebXR = nullptr;
@@ -176,6 +197,7 @@ VRBrowser::ShutdownJava() {
   sOnWebXRRenderStateChange = nullptr;
   sRenderPointerLayer = nullptr;
   sGetStorageAbsolutePath = nullptr;
+  sGetCacheAbsolutePath = nullptr;
   sIsOverrideEnvPathEnabled = nullptr;
   sGetActiveEnvironment = nullptr;
   sGetPointerColor = nullptr;
@@ -199,10 +221,7 @@ VRBrowser::DispatchCreateWidget(jint aWidgetHandle, jobject aSurface, jint aWidt
 void
 VRBrowser::DispatchCreateWidgetLayer(jint aWidgetHandle, jobject aSurface, jint aWidth, jint aHeight, const std::function<void()>& aFirstCompositeCallback) {
   if (!ValidateMethodID(sEnv, sActivity, sDispatchCreateWidgetLayer, __FUNCTION__)) { return; }
-  jlong callback = 0;
-  if (aFirstCompositeCallback) {
-    callback = reinterpret_cast<jlong>(new std::function<void()>(aFirstCompositeCallback));
-  }
+  const jlong callback = RegisterCallback(aFirstCompositeCallback);
   sEnv->CallVoidMethod(sActivity, sDispatchCreateWidgetLayer, aWidgetHandle, aSurface, aWidth, aHeight, callback);
   CheckJNIException(sEnv, __FUNCTION__);
 }
@@ -210,46 +229,110 @@ VRBrowser::DispatchCreateWidgetLayer(jint aWidgetHandle, jobject aSurface, jint
 
 void
 VRBrowser::HandleMotionEvent(jint aWidgetHandle, jint aController, jboolean aFocused, jboolean aPressed, jfloat aX, jfloat aY) {
-  if (!ValidateMethodID(sEnv, sActivity, sHandleMotionEvent, __FUNCTION__)) { return; }
-  sEnv->CallVoidMethod(sActivity, sHandleMotionEvent, aWidgetHandle, aController, aFocused, aPressed, aX, aY);
-  CheckJNIException(sEnv, __FUNCTION__);
+  JNIEventChannel::Record* event = PushEvent(JNIEventChannel::EventType::MotionEvent);
+  if (!event) { return; }
+  event->values[0].i = aWidgetHandle;
+  event->values[1].i = aController;
+  event->values[2].i = (aFocused ? JNIEventChannel::kFocused : 0) | (aPressed ? JNIEventChannel::kPressed : 0);
+  event->values[3].f = aX;
+  event->values[4].f = aY;
 }
 
 void
 VRBrowser::HandleScrollEvent(jint aWidgetHandle, jint aController, jfloat aX, jfloat aY) {
-  if (!ValidateMethodID(sEnv, sActivity, sHandleScrollEvent, __FUNCTION__)) { return; }
-  sEnv->CallVoidMethod(sActivity, sHandleScrollEvent, aWidgetHandle, aController, aX, aY);
-  CheckJNIException(sEnv, __FUNCTION__);
+  JNIEventChannel::Record* event = PushEvent(JNIEventChannel::EventType::ScrollEvent);
+  if (!event) { return; }
+  event->values[0].i = aWidgetHandle;
+  event->values[1].i = aController;
+  event->values[2].f = aX;
+  event->values[3].f = aY;
 }
 
 void
 VRBrowser::HandleAudioPose(jfloat qx, jfloat qy, jfloat qz, jfloat qw, jfloat px, jfloat py, jfloat pz) {
-  if (!ValidateMethodID(sEnv, sActivity, sHandleAudioPose, __FUNCTION__)) { return; }
-  sEnv->CallVoidMethod(sActivity, sHandleAudioPose, qx, qy, qz, qw, px, py, pz);
-  CheckJNIException(sEnv, __FUNCTION__);
+  JNIEventChannel::Record* event = PushEvent(JNIEventChannel::EventType::AudioPose);
+  if (!event) { return; }
+  event->values[0].f = qx;
+  event->values[1].f = qy;
+  event->values[2].f = qz;
+  event->values[3].f = qw;
+  event->values[4].f = px;
+  event->values[5].f = py;
+  event->values[6].f = pz;
 }
 
 void
 VRBrowser::HandleGesture(jint aType) {
-  if (!ValidateMethodID(sEnv, sActivity, sHandleGesture, __FUNCTION__)) { return; }
-  sEnv->CallVoidMethod(sActivity, sHandleGesture, aType);
-  CheckJNIException(sEnv, __FUNCTION__);
+  JNIEventChannel::Record* event = PushEvent(JNIEventChannel::EventType::Gesture);
+  if (!event) { return; }
+  event->values[0].i = aType;
 }
 
 void
 VRBrowser::HandleResize(jint aWidgetHandle, jfloat aWorldWidth, jfloat aWorldHeight) {
-  if (!ValidateMethodID(sEnv, sActivity, sHandleResize, __FUNCTION__)) { return; }
-  sEnv->CallVoidMethod(sActivity, sHandleResize, aWidgetHandle, aWorldWidth, aWorldHeight);
-  CheckJNIException(sEnv, __FUNCTION__);
+  JNIEventChannel::Record* event = PushEvent(JNIEventChannel::EventType::Resize);
+  if (!event) { return; }
+  event->values[0].i = aWidgetHandle;
+  event->values[1].f = aWorldWidth;
+  event->values[2].f = aWorldHeight;
 }
 
 void
 VRBrowser::HandleMoveEnd(jint aWidgetHandle, jfloat aX, jfloat aY, jfloat aZ, jfloat aRotation) {
-  if (!ValidateMethodID(sEnv, sActivity, sHandleMoveEnd, __FUNCTION__)) { return; }
-  sEnv->CallVoidMethod(sActivity, sHandleMoveEnd, aWidgetHandle, aX, aY, aZ, aRotation);
+  JNIEventChannel::Record* event = PushEvent(JNIEventChannel::EventType::MoveEnd);
+  if (!event) { return; }
+  event->values[0].i = aWidgetHandle;
+  event->values[1].f = aX;
+  event->values[2].f = aY;
+  event->values[3].f = aZ;
+  event->values[4].f = aRotation;
+}
+
+bool
+VRBrowser::HandleWidgetOnScreen(jint aWidgetHandle, jboolean aOnScreen) {
+  JNIEventChannel::Record* event = PushEvent(JNIEventChannel::EventType::WidgetOnScreen);
+  if (!event) { return false; }
+  event->values[0].i = aWidgetHandle;
+  event->values[1].i = aOnScreen ? 1 : 0;
+  return true;
+}
+
+void
+VRBrowser::FlushEvents() {
+  if (!sEvents || !sEvents->HasUnpublished()) {
+    return;
+  }
+  const uint32_t end = sEvents->Publish();
+  const uint32_t coalesced = sEvents->GetCoalescedCount();
+  if (coalesced != sReportedCoalesced) {
+    VRB_ERROR("Java event queue full, %u events coalesced, %u waiting", coalesced - sReportedCoalesced,
+              sEvents->GetBacklogSize());
+    sReportedCoalesced = coalesced;
+  }
+  const uint32_t dropped = sEvents->GetDroppedCount();
+  if (dropped != sReportedDropped) {
+    VRB_ERROR("Java stopped draining events, %u events dropped", dropped - sReportedDropped);
+    sReportedDropped = dropped;
+  }
+  if (!ValidateMethodID(sEnv, sActivity, sDrainNativeEvents, __FUNCTION__)) { return; }
+  sEnv->CallVoidMethod(sActivity, sDrainNativeEvents, (jint)end);
   CheckJNIException(sEnv, __FUNCTION__);
 }
 
+void
+VRBrowser::ReleaseEvents(jint aIndex) {
+  if (sEvents) {
+    sEvents->Release((uint32_t)aIndex);
+  }
+}
+
+void
+VRBrowser::RunCallback(jlong aCallback) {
+  if (!sCallbacks || !sCallbacks->Run((uint64_t)aCallback)) {
+    VRB_ERROR("Unknown native callback: %lld", (long long)aCallback);
+  }
+}
+
 void
 VRBrowser::HandleBack() {
   if (!ValidateMethodID(sEnv, sActivity, sHandleBack, __FUNCTION__)) { return; }
@@ -274,10 +357,7 @@ VRBrowser::OnEnterWebXR() {
 void
 VRBrowser::OnExitWebXR(const std::function<void()>& aCallback) {
   if (!ValidateMethodID(sEnv, sActivity, sOnExitWebXR, __FUNCTION__)) { return; }
-  jlong callback = 0;
-  if (aCallback) {
-    callback = reinterpret_cast<jlong>(new std::function<void()>(aCallback));
-  }
+  const jlong callback = RegisterCallback(aCallback);
   sEnv->CallVoidMethod(sActivity, sOnExitWebXR, callback);
   CheckJNIException(sEnv, __FUNCTION__);
 }
@@ -297,10 +377,7 @@ void VRBrowser::OnWebXRRenderStateChange(const bool aRendering) {
 void
 VRBrowser::RenderPointerLayer(jobject aSurface, const std::function<void()>& aFirstCompositeCallback) {
   if (!ValidateMethodID(sEnv, sActivity, sRenderPointerLayer, __FUNCTION__)) { return; }
-  jlong callback = 0;
-  if (aFirstCompositeCallback) {
-    callback = reinterpret_cast<jlong>(new std::function<void()>(aFirstCompositeCallback));
-  }
+  const jlong callback = RegisterCallback(aFirstCompositeCallback);
   sEnv->CallVoidMethod(sActivity, sRenderPointerLayer, aSurface, callback);
   CheckJNIException(sEnv, __FUNCTION__);
 }
@@ -325,6 +402,21 @@ VRBrowser::GetStorageAbsolutePath(const std::string& aRelativePath) {
   }
 }
 
+std::string
+VRBrowser::GetCacheAbsolutePath() {
+  if (!ValidateMethodID(sEnv, sActivity, sGetCacheAbsolutePath, __FUNCTION__)) { return ""; }
+  jstring jStr = (jstring) sEnv->CallObjectMethod(sActivity, sGetCacheAbsolutePath);
+  CheckJNIException(sEnv, __FUNCTION__);
+  if (!jStr) {
+    return "";
+  }
+
+  const char *cstr = sEnv->GetStringUTFChars(jStr, nullptr);
+  std::string str = std::string(cstr);
+  sEnv->ReleaseStringUTFChars(jStr, cstr);
+  return str;
+}
+
 bool
 VRBrowser::isOverrideEnvPathEnabled() {
   if (!ValidateMethodID(sEnv, sActivity, sIsOverrideEnvPathEnabled, __FUNCTION__)) { return false; }
@@ -416,9 +508,10 @@ VRBrowser::AppendAppNotesToCrashLog(const std::string& aNotes) {
 
 void
 VRBrowser::UpdateControllerBatteryLevels(const jint aLeftBatteryLevel, const jint aRightBatteryLevel) {
-  if (!ValidateMethodID(sEnv, sActivity, sUpdateControllerBatteryLevels, __FUNCTION__)) { return; }
-  sEnv->CallVoidMethod(sActivity, sUpdateControllerBatteryLevels, aLeftBatteryLevel, aRightBatteryLevel);
-  CheckJNIException(sEnv, __FUNCTION__);
+  JNIEventChannel::Record* event = PushEvent(JNIEventChannel::EventType::ControllerBatteryLevels);
+  if (!event) { return; }
+  event->values[0].i = aLeftBatteryLevel;
+  event->values[1].i = aRightBatteryLevel;
 }
 
 
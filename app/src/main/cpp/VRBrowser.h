@@ -21,13 +21,24 @@ JNIEnv * Env();
 void ShutdownJava();
 void DispatchCreateWidget(jint aWidgetHandle, jobject aSurfaceTexture, jint aWidth, jint aHeight);
 void DispatchCreateWidgetLayer(jint aWidgetHandle, jobject aSurface, jint aWidth, jint aHeight, const std::function<void()>& aFirstCompositeCallback);
+// HandleMotionEvent to HandleMoveEnd and UpdateControllerBatteryLevels only
+// queue the event; FlushEvents() sends the queue to Java once per frame.
 void HandleMotionEvent(jint aWidgetHandle, jint aController, jboolean aFocused, jboolean aPressed, jfloat aX, jfloat aY);
 void HandleScrollEvent(jint aWidgetHandle, jint aController, jfloat aX, jfloat aY);
 void HandleAudioPose(jfloat qx, jfloat qy, jfloat qz, jfloat qw, jfloat px, jfloat py, jfloat pz);
 void HandleGesture(jint aType);
 void HandleResize(jint aWidgetHandle, jfloat aWorldWidth, jfloat aWorldHeight);
 void HandleMoveEnd(jint aWidgetHandle, jfloat aX, jfloat aY, jfloat aZ, jfloat aRotation);
+// Queued like the events above. Returns false when the event can't be queued:
+// there is no JNI env, event channel or Java drain method, or Java stopped
+// draining the events.
+bool HandleWidgetOnScreen(jint aWidgetHandle, jboolean aOnScreen);
 void HandleBack();
+void FlushEvents();
+// Called by Java once it has handled every queued event before aIndex.
+void ReleaseEvents(jint aIndex);
+// Runs a callback passed to Java by DispatchCreateWidgetLayer, OnExitWebXR or RenderPointerLayer.
+void RunCallback(jlong aCallback);
 void RegisterExternalContext(jlong aContext);
 void OnEnterWebXR();
 void OnExitWebXR(const std::function<void()>& aCallback);
@@ -35,6 +46,7 @@ void OnDismissWebXRInterstitial();
 void OnWebXRRenderStateChange(const bool aRendering);
 void RenderPointerLayer(jobject aSurface, const std::function<void()>& aFirstCompositeCallback);
 std::string GetStorageAbsolutePath(const std::string& aRelativePath);
+std::string GetCacheAbsolutePath();
 bool isOverrideEnvPathEnabled();
 std::string GetActiveEnvironment();
 int32_t GetPointerColor();
@@ -5,6 +5,7 @@
 
 #include "VRVideo.h"
 #include "DeviceDelegate.h"
+#include "MeshCache.h"
 #include "VRLayer.h"
 #include "VRLayerNode.h"
 #include "vrb/ConcreteClass.h"
@@ -26,6 +27,21 @@
 #include "Quad.h"
 #include "Widget.h"
 
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+const float kSphereRadius = 10.0f;
+// Used when neither the display nor the video resolution is known.
+const int32_t kDefaultSphereSegments = 48;
+const int32_t kMinSphereSegments = 24;
+const int32_t kMaxSphereSegments = 96;
+const int32_t kSphereSegmentStep = 8;
+const float kMaxSphereError = 0.5f;
+
+} // namespace
+
 namespace crow {
 
 struct VRVideo::State {
@@ -120,77 +136,22 @@ struct VRVideo::State {
   }
 
   vrb::TogglePtr createSphereProjection(bool half, device::EyeRect aUVRect) {
-    const int kCols = 70;
-    const int kRows = 70;
-    const float kRadius = 10.0f;
-
     vrb::CreationContextPtr create = context.lock();
-    vrb::VertexArrayPtr array = vrb::VertexArray::Create(create);
-
-    for (float row = 0; row <= kRows; row+= 1.0f) {
-      const float alpha = row * (float)M_PI / kRows;
-      const float sinAlpha = sinf(alpha);
-      const float cosAlpha = cosf(alpha);
-
-      for (float col = 0; col <= kCols; col++) {
-        const float beta = col * (half ? 1.0f : 2.0f) * (float)M_PI / kCols;
-        const float sinBeta = sinf(beta);
-        const float cosBeta = cosf(beta);
-
-        vrb::Vector vertex;
-        vrb::Vector uv;
-        vrb::Vector normal;
-        normal.x() = cosBeta * sinAlpha;
-        normal.y() = cosAlpha;
-        normal.z() = sinBeta * sinAlpha;
-        uv.x() = aUVRect.mX + (col / kCols) * aUVRect.mWidth;  // u
-        uv.y() = aUVRect.mY + (row / kRows) * aUVRect.mHeight; // v
-        vertex.x() = kRadius * normal.x();
-        vertex.y() = kRadius * normal.y();
-        vertex.z() = kRadius * normal.z();
-
-        array->AppendVertex(vertex);
-        array->AppendUV(uv);
-        array->AppendNormal(vertex.Normalize());
-      }
-    }
-
-    std::vector<int> indices;
-
-    vrb::ProgramPtr program = create->GetProgramFactory()->CreateProgram(create, vrb::FeatureSurfaceTexture | vrb::FeatureHighPrecision);
-    vrb::RenderStatePtr state = vrb::RenderState::Create(create);
+    vrb::GeometryPtr geometry = MeshCache::Get(create)->CreateSphereGeometry(getSphereSegments(half, aUVRect), half);
+    vrb::ProgramPtr program = create->GetProgramFactory()->CreateProgram(create,
+        vrb::FeatureSurfaceTexture | vrb::FeatureHighPrecision | vrb::FeatureUVTransform);
+    vrb::RenderStatePtr state = geometry->GetRenderState();
     state->SetProgram(program);
-    state->SetLightsEnabled(false);
     vrb::TexturePtr texture = std::dynamic_pointer_cast<vrb::Texture>(window->GetSurfaceTexture());
     state->SetTexture(texture);
-    vrb::GeometryPtr geometry = vrb::Geometry::Create(create);
-    geometry->SetVertexArray(array);
-    geometry->SetRenderState(state);
-
-    for (int row = 0; row < kRows; row++) {
-      for (int col = 0; col < kCols; col++) {
-        int first = 1 + (row * (kCols + 1)) + col;
-        int second = first + kCols + 1;
-
-        indices.clear();
-        indices.push_back(first);
-        indices.push_back(second);
-        indices.push_back(first + 1);
-
-        indices.push_back(second);
-        indices.push_back(second + 1);
-        indices.push_back(first + 1);
-        geometry->AddFace(indices, indices, indices);
-      }
-    }
+    vrb::Matrix uvTransform = vrb::Matrix::Position(vrb::Vector(aUVRect.mX, aUVRect.mY, 0.0f));
+    uvTransform.ScaleInPlace(vrb::Vector(aUVRect.mWidth, aUVRect.mHeight, 1.0f));
+    state->SetUVTransform(uvTransform);
 
+    vrb::Matrix matrix = vrb::Matrix::Rotation(vrb::Vector(0.0f, 1.0f, 0.0f), half ? (float) M_PI : (float) M_PI * -0.5f);
+    matrix.ScaleInPlace(vrb::Vector(kSphereRadius, kSphereRadius, kSphereRadius));
     vrb::TransformPtr transform = vrb::Transform::Create(create);
-    if (half) {
-      vrb::Matrix matrix = vrb::Matrix::Rotation(vrb::Vector(0.0f, 1.0f, 0.0f), (float) M_PI);
-      transform->SetTransform(matrix);
-    } else {
-      transform->SetTransform(vrb::Matrix::Rotation(vrb::Vector(0.0f, 1.0f, 0.0f), (float) M_PI * -0.5f));
-    }
+    transform->SetTransform(matrix);
     transform->AddNode(geometry);
 
     vrb::TogglePtr result = vrb::Toggle::Create(create);
@@ -198,6 +159,33 @@ struct VRVideo::State {
     return result;
   }
 
+  // Sphere segments per 180 degrees for the coarser of the display and the
+  // part of the video an eye sees: detail past the lower density is not seen.
+  int32_t getSphereSegments(bool half, const device::EyeRect& aUVRect) const {
+    int32_t width = 0;
+    int32_t height = 0;
+    window->GetSurfaceTextureSize(width, height);
+    const float videoPixelsPerDegree = std::max(width * aUVRect.mWidth / (half ? 180.0f : 360.0f),
+                                                height * aUVRect.mHeight / 180.0f);
+    DeviceDelegatePtr device = deviceWeak.lock();
+    const float displayPixelsPerDegree = device ? device->GetPixelsPerDegree() : 0.0f;
+    float pixelsPerDegree = videoPixelsPerDegree;
+    if (displayPixelsPerDegree > 0.0f && (pixelsPerDegree <= 0.0f || displayPixelsPerDegree < pixelsPerDegree)) {
+      pixelsPerDegree = displayPixelsPerDegree;
+    }
+    if (pixelsPerDegree <= 0.0f) {
+      return kDefaultSphereSegments;
+    }
+    // A segment spanning an angle a rad is off the sphere by about
+    // a * a / 8 rad in its middle; keep that under kMaxSphereError pixels.
+    const float pixelsPerRadian = pixelsPerDegree * 180.0f / (float) M_PI;
+    const float angle = sqrtf(8.0f * kMaxSphereError / pixelsPerRadian);
+    const int32_t segments = (int32_t) ceilf((float) M_PI / angle);
+    // Rounded up so that close resolutions share a mesh.
+    const int32_t rounded = (segments + kSphereSegmentStep - 1) / kSphereSegmentStep * kSphereSegmentStep;
+    return std::min(std::max(rounded, kMinSphereSegments), kMaxSphereSegments);
+  }
+
   void create360ProjectionLayer() {
     vrb::CreationContextPtr create = context.lock();
     DeviceDelegatePtr device = deviceWeak.lock();
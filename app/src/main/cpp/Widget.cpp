@@ -59,12 +59,16 @@ struct Widget::State {
   vrb::TogglePtr bordersContainer;
   std::vector<WidgetBorderPtr> borders;
   vrb::TogglePtr layerProxy;
+  // Shown in place of the layer while its surface is released.
+  vrb::TogglePtr snapshot;
+  float surfaceScale;
 
   State()
       : handle(0)
       , resizing(false)
       , toggleState(false)
       , cylinderDensity(4680.0f)
+      , surfaceScale(1.0f)
   {}
 
   void Initialize(const int aHandle, const WidgetPlacementPtr& aPlacement, const int32_t aTextureWidth, const int32_t aTextureHeight,
@@ -102,7 +106,21 @@ struct Widget::State {
     if (layer) {
       layer->SetSurfaceChangedDelegate([=](const VRLayer& aLayer, VRLayer::SurfaceChange aChange, const std::function<void()>& aCallback) {
         const VRLayerQuad& layerQuad = static_cast<const VRLayerQuad&>(aLayer);
-        VRBrowser::DispatchCreateWidgetLayer((jint)handle, layerQuad.GetSurface(), layerQuad.GetWidth(), layerQuad.GetHeight(), aCallback);
+        std::function<void()> callback = aCallback;
+        if (snapshot && aChange == VRLayer::SurfaceChange::Create) {
+          // The snapshot stays until the new surface is first composited.
+          std::weak_ptr<vrb::Toggle> weakSnapshot = snapshot;
+          callback = [aCallback, weakSnapshot]() {
+            if (aCallback) {
+              aCallback();
+            }
+            vrb::TogglePtr toggle = weakSnapshot.lock();
+            if (toggle) {
+              toggle->ToggleAll(false);
+            }
+          };
+        }
+        VRBrowser::DispatchCreateWidgetLayer((jint)handle, layerQuad.GetSurface(), layerQuad.GetWidth(), layerQuad.GetHeight(), callback);
       });
     } else {
       if (!surface) {
@@ -198,6 +216,13 @@ struct Widget::State {
     resizing = false;
   }
 
+  void RemoveSnapshot() {
+    if (snapshot) {
+      snapshot->RemoveFromParents();
+      snapshot = nullptr;
+    }
+  }
+
   void RemoveBorder() {
     if (bordersContainer) {
       bordersContainer->RemoveFromParents();
@@ -241,6 +266,7 @@ void
 Widget::ResetFirstDraw() {
   if (m.placement) {
     m.placement->composited = false;
+    m.placement->version = 0;
   }
   if (m.root) {
     m.root->ToggleAll(false);
@@ -269,13 +295,33 @@ Widget::GetSurfaceTextureSize(int32_t& aWidth, int32_t& aHeight) const {
 void
 Widget::SetSurfaceTextureSize(int32_t aWidth, int32_t aHeight) {
   if (m.quad) {
-    m.quad->SetTextureSize(aWidth, aHeight);
+    m.quad->SetTextureSize(aWidth, aHeight, m.surfaceScale);
   } else {
-    m.cylinder->SetTextureSize(aWidth, aHeight);
+    m.cylinder->SetTextureSize(aWidth, aHeight, m.surfaceScale);
     m.UpdateCylinderMatrix();
   }
 }
 
+float
+Widget::GetSurfaceScale() const {
+  return m.surfaceScale;
+}
+
+void
+Widget::SetSurfaceScale(const float aScale) {
+  if (m.surfaceScale == aScale) {
+    return;
+  }
+  m.surfaceScale = aScale;
+  int32_t textureWidth, textureHeight;
+  GetSurfaceTextureSize(textureWidth, textureHeight);
+  if (m.quad) {
+    m.quad->SetTextureSize(textureWidth, textureHeight, aScale);
+  } else {
+    m.cylinder->SetTextureSize(textureWidth, textureHeight, aScale);
+  }
+}
+
 void
 Widget::RecreateSurface() {
   if (m.quad) {
@@ -347,6 +393,20 @@ Widget::TestControllerIntersection(const vrb::Vector& aStartPoint, const vrb::Ve
   return result;
 }
 
+bool
+Widget::TestControllerIntersection(const vrb::Matrix& aTransform, const vrb::Matrix& aInverse, const vrb::Vector& aStartPoint, const vrb::Vector& aDirection,
+                                   vrb::Vector& aResult, vrb::Vector& aNormal, const bool aClamp, bool& aIsInWidget, float& aDistance) const {
+  aDistance = -1.0f;
+  if (!m.root->IsEnabled(*m.transformContainer)) {
+    return false;
+  }
+
+  if (m.quad) {
+    return m.quad->TestIntersection(aTransform, aInverse, aStartPoint, aDirection, aResult, aNormal, aClamp, aIsInWidget, aDistance);
+  }
+  return m.cylinder->TestIntersection(aTransform, aInverse, aStartPoint, aDirection, aResult, aNormal, aClamp, aIsInWidget, aDistance);
+}
+
 void
 Widget::ConvertToWidgetCoordinates(const vrb::Vector& point, float& aX, float& aY, bool aClamp) const {
   bool clamp = !m.resizing;
@@ -418,9 +478,14 @@ Widget::SetQuad(const QuadPtr& aQuad) {
   m.quad = aQuad;
   m.transform->AddNode(aQuad->GetRoot());
   m.transformContainer->SetTransform(vrb::Matrix::Identity());
+  if (m.surfaceScale != 1.0f) {
+    // The moved layer keeps its reduced size, which the quad took as its texture size.
+    aQuad->SetTextureSize(textureWidth, textureHeight, m.surfaceScale);
+  }
 
   m.RemoveResizer();
   m.RemoveBorder();
+  m.RemoveSnapshot();
   m.UpdateSurface(textureWidth, textureHeight);
 }
 
@@ -438,9 +503,14 @@ Widget::SetCylinder(const CylinderPtr& aCylinder) {
 
   m.cylinder = aCylinder;
   m.transform->AddNode(aCylinder->GetRoot());
+  if (m.surfaceScale != 1.0f) {
+    // The moved layer keeps its reduced size, which the cylinder took as its texture size.
+    aCylinder->SetTextureSize(textureWidth, textureHeight, m.surfaceScale);
+  }
 
   m.RemoveResizer();
   m.RemoveBorder();
+  m.RemoveSnapshot();
   m.UpdateSurface(textureWidth, textureHeight);
 }
 
@@ -645,6 +715,32 @@ Widget::SetProxifyLayer(const bool aValue) {
   m.layerProxy->ToggleAll(true);
 }
 
+void
+Widget::SetSnapshot(const vrb::TexturePtr& aTexture, const int32_t aWidth, const int32_t aHeight) {
+  m.RemoveSnapshot();
+  vrb::RenderContextPtr render = m.context.lock();
+  if (!aTexture || !render) {
+    return;
+  }
+  vrb::CreationContextPtr create = render->GetRenderThreadCreationContext();
+  m.snapshot = vrb::Toggle::Create(create);
+  if (m.cylinder) {
+    CylinderPtr snapshot = Cylinder::Create(create, *m.cylinder);
+    snapshot->SetCylinderTheta(m.cylinder->GetCylinderTheta());
+    snapshot->SetTexture(aTexture, aWidth, aHeight);
+    snapshot->SetTransform(m.cylinder->GetTransformNode()->GetTransform());
+    snapshot->UpdateProgram("");
+    m.snapshot->AddNode(snapshot->GetRoot());
+  } else {
+    QuadPtr snapshot = Quad::Create(create, *m.quad);
+    snapshot->SetTexture(aTexture, aWidth, aHeight);
+    snapshot->UpdateProgram("");
+    m.snapshot->AddNode(snapshot->GetRoot());
+  }
+  m.transform->AddNode(m.snapshot);
+  m.snapshot->ToggleAll(true);
+}
+
 void Widget::LayoutQuadWithCylinderParent(const WidgetPtr& aParent) {
   if (!aParent) {
     // No parent, reset the container transform.
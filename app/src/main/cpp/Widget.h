@@ -48,12 +48,18 @@ public:
   const vrb::TextureSurfacePtr GetSurfaceTexture() const;
   void GetSurfaceTextureSize(int32_t& aWidth, int32_t& aHeight) const;
   void SetSurfaceTextureSize(int32_t aWidth, int32_t aHeight);
+  // Resolution of the layer surface relative to the texture size, see WidgetPlacement::textureLOD.
+  float GetSurfaceScale() const;
+  void SetSurfaceScale(const float aScale);
   void RecreateSurface();
   void GetWidgetMinAndMax(vrb::Vector& aMin, vrb::Vector& aMax) const;
   void SetWorldWidth(float aWorldWidth) const;
   void GetWorldSize(float& aWidth, float& aHeight) const;
   bool TestControllerIntersection(const vrb::Vector& aStartPoint, const vrb::Vector& aDirection, vrb::Vector& aResult, vrb::Vector& aNormal,
                                   const bool aClamp, bool& aIsInWidget, float& aDistance) const;
+  // Uses a cached world transform of the quad or cylinder. Resize handles are not tested.
+  bool TestControllerIntersection(const vrb::Matrix& aTransform, const vrb::Matrix& aInverse, const vrb::Vector& aStartPoint, const vrb::Vector& aDirection,
+                                  vrb::Vector& aResult, vrb::Vector& aNormal, const bool aClamp, bool& aIsInWidget, float& aDistance) const;
   void ConvertToWidgetCoordinates(const vrb::Vector& aPoint, float& aX, float& aY, bool aClamp = true) const;
   vrb::Vector ConvertToWorldCoordinates(const vrb::Vector& aLocalPoint) const;
   vrb::Vector ConvertToWorldCoordinates(const float aWidgetX, const float aWidgetY) const;
@@ -80,6 +86,8 @@ public:
   float GetCylinderDensity() const;
   void SetBorderColor(const vrb::Color& aColor);
   void SetProxifyLayer(const bool aValue);
+  // Draws aTexture over the widget until its layer surface is created again. Null removes it.
+  void SetSnapshot(const vrb::TexturePtr& aTexture, const int32_t aWidth, const int32_t aHeight);
   void LayoutQuadWithCylinderParent(const WidgetPtr& aParent);
 protected:
   struct State;
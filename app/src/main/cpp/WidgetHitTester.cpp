@@ -0,0 +1,220 @@
+/* -*- Mode: C++; tab-width: 20; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include "WidgetHitTester.h"
+#include "Cylinder.h"
+#include "Quad.h"
+#include "Widget.h"
+#include "WidgetRegistry.h"
+#include "vrb/ConcreteClass.h"
+#include "vrb/Matrix.h"
+#include "vrb/Transform.h"
+#include "vrb/Vector.h"
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+namespace {
+
+// Quad::TestIntersection accepts hits slightly in front and behind the quad.
+const float kQuadDepthTolerance = 0.1f;
+const float kBoundsMargin = 1.01f;
+// Rays past this index are never culled.
+const int kMaxCulledRays = 32;
+
+bool
+SameVector(const vrb::Vector& aA, const vrb::Vector& aB) {
+  return aA.x() == aB.x() && aA.y() == aB.y() && aA.z() == aB.z();
+}
+
+bool
+SameTransform(const vrb::Matrix& aA, const vrb::Matrix& aB) {
+  const vrb::Vector x(1.0f, 0.0f, 0.0f);
+  const vrb::Vector y(0.0f, 1.0f, 0.0f);
+  const vrb::Vector z(0.0f, 0.0f, 1.0f);
+  return SameVector(aA.GetTranslation(), aB.GetTranslation()) &&
+         SameVector(aA.MultiplyDirection(x), aB.MultiplyDirection(x)) &&
+         SameVector(aA.MultiplyDirection(y), aB.MultiplyDirection(y)) &&
+         SameVector(aA.MultiplyDirection(z), aB.MultiplyDirection(z));
+}
+
+float
+MaxScale(const vrb::Matrix& aTransform) {
+  return std::max(aTransform.MultiplyDirection(vrb::Vector(1.0f, 0.0f, 0.0f)).Magnitude(),
+         std::max(aTransform.MultiplyDirection(vrb::Vector(0.0f, 1.0f, 0.0f)).Magnitude(),
+                  aTransform.MultiplyDirection(vrb::Vector(0.0f, 0.0f, 1.0f)).Magnitude()));
+}
+
+} // namespace
+
+namespace crow {
+
+struct WidgetHitTester::State {
+  struct Entry {
+    WidgetPtr widget;
+    vrb::Matrix transform;
+    vrb::Matrix inverse;
+  };
+
+  bool valid;
+  uint32_t layoutGeneration;
+  vrb::Matrix rootTransform;
+  std::vector<Entry> entries;
+  // Bounding spheres, stored as separate arrays so the broad phase vectorizes.
+  std::vector<float> centerX;
+  std::vector<float> centerY;
+  std::vector<float> centerZ;
+  std::vector<float> radius2;
+  // Bit N is set when ray N may hit the widget.
+  std::vector<uint32_t> candidates;
+  std::vector<vrb::Vector> rayStarts;
+  std::vector<vrb::Vector> rayDirections;
+
+  State()
+      : valid(false)
+      , layoutGeneration(0)
+      , rootTransform(vrb::Matrix::Identity())
+  {}
+
+  void UpdateEntry(const size_t aIndex, const WidgetPtr& aWidget) {
+    Entry& entry = entries[aIndex];
+    vrb::TransformPtr node = aWidget->GetQuad() ? aWidget->GetQuad()->GetTransformNode() : aWidget->GetCylinder()->GetTransformNode();
+    const vrb::Matrix transform = node->GetWorldTransform();
+    if (entry.widget != aWidget || !SameTransform(entry.transform, transform)) {
+      entry.widget = aWidget;
+      entry.transform = transform;
+      entry.inverse = transform.AfineInverse();
+    }
+
+    vrb::Vector center;
+    float radius = 0.0f;
+    if (aWidget->GetQuad()) {
+      vrb::Vector min, max;
+      aWidget->GetQuad()->GetWorldMinAndMax(min, max);
+      center = (min + max) * 0.5f;
+      radius = (max - min).Magnitude() * 0.5f + kQuadDepthTolerance;
+    } else {
+      const CylinderPtr& cylinder = aWidget->GetCylinder();
+      const float halfHeight = cylinder->GetCylinderHeight() * 0.5f;
+      radius = std::sqrt(cylinder->GetCylinderRadius() * cylinder->GetCylinderRadius() + halfHeight * halfHeight);
+    }
+    center = transform.MultiplyPosition(center);
+    radius *= MaxScale(transform) * kBoundsMargin;
+    centerX[aIndex] = center.x();
+    centerY[aIndex] = center.y();
+    centerZ[aIndex] = center.z();
+    radius2[aIndex] = radius * radius;
+  }
+};
+
+WidgetHitTesterPtr
+WidgetHitTester::Create() {
+  return std::make_shared<vrb::ConcreteClass<WidgetHitTester, WidgetHitTester::State> >();
+}
+
+void
+WidgetHitTester::Update(const WidgetRegistry& aWidgets, const uint32_t aLayoutGeneration, const vrb::Matrix& aRootTransform) {
+  if (m.valid && m.layoutGeneration == aLayoutGeneration && m.entries.size() == aWidgets.Size() &&
+      SameTransform(m.rootTransform, aRootTransform)) {
+    return;
+  }
+  m.valid = true;
+  m.layoutGeneration = aLayoutGeneration;
+  m.rootTransform = aRootTransform;
+
+  const size_t count = aWidgets.Size();
+  m.entries.resize(count);
+  m.centerX.resize(count);
+  m.centerY.resize(count);
+  m.centerZ.resize(count);
+  m.radius2.resize(count);
+  m.candidates.assign(count, 0);
+  size_t index = 0;
+  for (const WidgetPtr& widget: aWidgets) {
+    m.UpdateEntry(index++, widget);
+  }
+}
+
+void
+WidgetHitTester::ClearRays() {
+  m.rayStarts.clear();
+  m.rayDirections.clear();
+}
+
+int
+WidgetHitTester::AddRay(const vrb::Vector& aStartPoint, const vrb::Vector& aDirection) {
+  m.rayStarts.push_back(aStartPoint);
+  m.rayDirections.push_back(aDirection);
+  return (int)m.rayStarts.size() - 1;
+}
+
+void
+WidgetHitTester::Cull() {
+  const size_t count = m.entries.size();
+  std::fill(m.candidates.begin(), m.candidates.end(), 0);
+  const float* centerX = m.centerX.data();
+  const float* centerY = m.centerY.data();
+  const float* centerZ = m.centerZ.data();
+  const float* radius2 = m.radius2.data();
+  uint32_t* candidates = m.candidates.data();
+  const int rays = std::min((int)m.rayStarts.size(), kMaxCulledRays);
+  for (int ray = 0; ray < rays; ++ray) {
+    const float ox = m.rayStarts[ray].x();
+    const float oy = m.rayStarts[ray].y();
+    const float oz = m.rayStarts[ray].z();
+    const float dx = m.rayDirections[ray].x();
+    const float dy = m.rayDirections[ray].y();
+    const float dz = m.rayDirections[ray].z();
+    const float invLength2 = 1.0f / std::max(dx * dx + dy * dy + dz * dz, 1e-12f);
+    const uint32_t bit = 1u << ray;
+    // Branch free so the compiler can vectorize it.
+    for (size_t i = 0; i < count; ++i) {
+      const float cx = centerX[i] - ox;
+      const float cy = centerY[i] - oy;
+      const float cz = centerZ[i] - oz;
+      const float distance2 = cx * cx + cy * cy + cz * cz;
+      const float t = cx * dx + cy * dy + cz * dz;
+      const float closest2 = distance2 - t * t * invLength2;
+      const bool inside = distance2 <= radius2[i];
+      const bool hit = inside | ((t >= 0.0f) & (closest2 <= radius2[i]));
+      candidates[i] |= hit ? bit : 0u;
+    }
+  }
+}
+
+size_t
+WidgetHitTester::GetWidgetCount() const {
+  return m.entries.size();
+}
+
+const WidgetPtr&
+WidgetHitTester::GetWidget(const size_t aIndex) const {
+  return m.entries[aIndex].widget;
+}
+
+bool
+WidgetHitTester::IsCandidate(const size_t aIndex, const int aRay) const {
+  if (aRay < 0 || aRay >= kMaxCulledRays) {
+    return true;
+  }
+  // Resize handles extend outside the widget bounds.
+  return (m.candidates[aIndex] & (1u << aRay)) != 0 || m.entries[aIndex].widget->IsResizing();
+}
+
+bool
+WidgetHitTester::TestIntersection(const size_t aIndex, const vrb::Vector& aStartPoint, const vrb::Vector& aDirection, vrb::Vector& aResult,
+                                  vrb::Vector& aNormal, const bool aClamp, bool& aIsInWidget, float& aDistance) const {
+  const State::Entry& entry = m.entries[aIndex];
+  if (entry.widget->IsResizing()) {
+    return entry.widget->TestControllerIntersection(aStartPoint, aDirection, aResult, aNormal, aClamp, aIsInWidget, aDistance);
+  }
+  return entry.widget->TestControllerIntersection(entry.transform, entry.inverse, aStartPoint, aDirection, aResult, aNormal,
+                                                  aClamp, aIsInWidget, aDistance);
+}
+
+WidgetHitTester::WidgetHitTester(State& aState) : m(aState) {}
+
+} // namespace crow
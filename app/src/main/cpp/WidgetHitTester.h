@@ -0,0 +1,56 @@
+/* -*- Mode: C++; tab-width: 20; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#ifndef VRBROWSER_WIDGET_HIT_TESTER_DOT_H
+#define VRBROWSER_WIDGET_HIT_TESTER_DOT_H
+
+#include "vrb/Forward.h"
+#include "vrb/MacroUtils.h"
+
+#include <memory>
+
+namespace crow {
+
+class Widget;
+class WidgetRegistry;
+class WidgetHitTester;
+typedef std::shared_ptr<Widget> WidgetPtr;
+typedef std::shared_ptr<WidgetHitTester> WidgetHitTesterPtr;
+
+// Controller ray vs widget hit testing. The world transform, its inverse and a
+// bounding sphere of every widget are cached and only recomputed when the
+// layout changed. All the controller rays of a frame are first tested against
+// the bounding spheres in one pass; the exact quad or cylinder intersection is
+// only computed for the widgets that survive it.
+class WidgetHitTester {
+public:
+  static WidgetHitTesterPtr Create();
+  // Refreshes the cache when aLayoutGeneration or aRootTransform changed since the last call.
+  void Update(const WidgetRegistry& aWidgets, const uint32_t aLayoutGeneration, const vrb::Matrix& aRootTransform);
+  // Starts a new batch of rays.
+  void ClearRays();
+  // Returns the index of the ray, to be used with IsCandidate.
+  int AddRay(const vrb::Vector& aStartPoint, const vrb::Vector& aDirection);
+  // Runs the broad phase for all the rays added since ClearRays.
+  void Cull();
+
+  size_t GetWidgetCount() const;
+  const WidgetPtr& GetWidget(const size_t aIndex) const;
+  bool IsCandidate(const size_t aIndex, const int aRay) const;
+  bool TestIntersection(const size_t aIndex, const vrb::Vector& aStartPoint, const vrb::Vector& aDirection, vrb::Vector& aResult,
+                        vrb::Vector& aNormal, const bool aClamp, bool& aIsInWidget, float& aDistance) const;
+protected:
+  struct State;
+  WidgetHitTester(State& aState);
+  ~WidgetHitTester() = default;
+private:
+  State& m;
+  WidgetHitTester() = delete;
+  VRB_NO_DEFAULTS(WidgetHitTester)
+};
+
+} // namespace crow
+
+#endif // VRBROWSER_WIDGET_HIT_TESTER_DOT_H
@@ -4,84 +4,111 @@
  * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
 
 #include "WidgetPlacement.h"
+#include "vrb/Logger.h"
+
+#include <array>
+#include <cstring>
 
 namespace crow {
 
 const float WidgetPlacement::kWorldDPIRatio = 2.0f/720.0f;
 
 WidgetPlacementPtr
-WidgetPlacement::FromJava(JNIEnv* aEnv, jobject& aObject) {
-  if (!aObject || !aEnv) {
+WidgetPlacement::FromJava(JNIEnv* aEnv, jintArray aPacked, jstring aName) {
+  if (!aPacked || !aEnv) {
     return nullptr;
   }
-
-  jclass clazz = aEnv->GetObjectClass(aObject);
-
-  std::shared_ptr<WidgetPlacement> result(new WidgetPlacement());
-
-#define GET_INT_FIELD(name) { \
-  jfieldID f = aEnv->GetFieldID(clazz, #name, "I"); \
-  result->name = aEnv->GetIntField(aObject, f); \
-}
-
-#define GET_FLOAT_FIELD(to, name) { \
-  jfieldID f = aEnv->GetFieldID(clazz, name, "F"); \
-  result->to = aEnv->GetFloatField(aObject, f); \
-}
-
-#define GET_BOOLEAN_FIELD(name) { \
-  jfieldID f = aEnv->GetFieldID(clazz, #name, "Z"); \
-  result->name = aEnv->GetBooleanField(aObject, f); \
+  if (aEnv->GetArrayLength(aPacked) != kPackedSize) {
+    VRB_ERROR("Invalid packed WidgetPlacement size: %d", (int)aEnv->GetArrayLength(aPacked));
+    return nullptr;
+  }
+  std::array<jint, kPackedSize> data;
+  aEnv->GetIntArrayRegion(aPacked, 0, kPackedSize, data.data());
+  WidgetPlacementPtr result = FromPacked(data.data());
+  if (result->hasName && aName) {
+    const char* nativeString = aEnv->GetStringUTFChars(aName, 0);
+    result->name = nativeString;
+    aEnv->ReleaseStringUTFChars(aName, nativeString);
+  }
+  return result;
 }
 
-#define GET_STRING_FIELD(name) { \
-  jfieldID f = aEnv->GetFieldID(clazz, #name, "Ljava/lang/String;"); \
-  jstring javaString = (jstring)aEnv->GetObjectField(aObject, f); \
-  if (javaString) { \
-    const char* nativeString = aEnv->GetStringUTFChars(javaString, 0); \
-    result->name = nativeString; \
-    aEnv->ReleaseStringUTFChars(javaString, nativeString); \
-  } \
+WidgetPlacementPtr
+WidgetPlacement::FromPacked(const jint* aData) {
+  std::shared_ptr<WidgetPlacement> result(new WidgetPlacement());
+  // Must match the layout written by WidgetPlacement.pack() in Java.
+  const auto getFloat = [aData](const int32_t aIndex) -> float {
+    float value;
+    memcpy(&value, &aData[aIndex], sizeof(value));
+    return value;
+  };
+  result->version = (uint32_t)aData[0];
+  result->hasName = (aData[1] & kPackedHasName) != 0;
+  result->width = aData[2];
+  result->height = aData[3];
+  result->anchor = vrb::Vector(getFloat(4), getFloat(5), 0.0f);
+  result->translation = vrb::Vector(getFloat(6), getFloat(7), getFloat(8));
+  result->rotationAxis = vrb::Vector(getFloat(9), getFloat(10), getFloat(11));
+  result->rotation = getFloat(12);
+  result->parentHandle = aData[13];
+  result->parentAnchor = vrb::Vector(getFloat(14), getFloat(15), 0.0f);
+  result->density = getFloat(16);
+  result->worldWidth = getFloat(17);
+  result->visible = aData[18] != 0;
+  result->scene = aData[19];
+  result->showPointer = aData[20] != 0;
+  result->composited = aData[21] != 0;
+  result->layer = aData[22] != 0;
+  result->layerPriority = aData[23];
+  result->proxifyLayer = aData[24] != 0;
+  result->textureScale = getFloat(25);
+  result->cylinder = aData[26] != 0;
+  result->cylinderMapRadius = getFloat(27);
+  result->tintColor = aData[28];
+  result->borderColor = aData[29];
+  result->clearColor = aData[30];
+  result->textureLOD = aData[31] != 0;
+  result->opaque = aData[32] != 0;
+  return result;
 }
 
-
-  GET_INT_FIELD(width);
-  GET_INT_FIELD(height);
-  GET_FLOAT_FIELD(anchor.x(), "anchorX");
-  GET_FLOAT_FIELD(anchor.y(), "anchorY");
-  GET_FLOAT_FIELD(translation.x(), "translationX");
-  GET_FLOAT_FIELD(translation.y(), "translationY");
-  GET_FLOAT_FIELD(translation.z(), "translationZ");
-  GET_FLOAT_FIELD(rotationAxis.x(), "rotationAxisX");
-  GET_FLOAT_FIELD(rotationAxis.y(), "rotationAxisY");
-  GET_FLOAT_FIELD(rotationAxis.z(), "rotationAxisZ");
-  GET_FLOAT_FIELD(rotation, "rotation");
-  GET_INT_FIELD(parentHandle);
-  GET_FLOAT_FIELD(parentAnchor.x(), "parentAnchorX");
-  GET_FLOAT_FIELD(parentAnchor.y(), "parentAnchorY");
-  GET_FLOAT_FIELD(density, "density");
-  GET_FLOAT_FIELD(worldWidth, "worldWidth");
-  GET_BOOLEAN_FIELD(visible);
-  GET_INT_FIELD(scene);
-  GET_BOOLEAN_FIELD(showPointer);
-  GET_BOOLEAN_FIELD(composited);
-  GET_BOOLEAN_FIELD(layer);
-  GET_INT_FIELD(layerPriority);
-  GET_BOOLEAN_FIELD(proxifyLayer);
-  GET_FLOAT_FIELD(textureScale, "textureScale");
-  GET_BOOLEAN_FIELD(cylinder);
-  GET_FLOAT_FIELD(cylinderMapRadius, "cylinderMapRadius");
-  GET_INT_FIELD(tintColor);
-  GET_INT_FIELD(borderColor);
-  GET_STRING_FIELD(name);
-  GET_INT_FIELD(clearColor);
-
+WidgetPlacementPtr
+WidgetPlacement::Create(const WidgetPlacement& aPlacement) {
+  WidgetPlacementPtr result(new WidgetPlacement(aPlacement));
+  // Native changes to the copy must not be mistaken for the Java version.
+  result->version = 0;
   return result;
 }
 
 WidgetPlacementPtr
-WidgetPlacement::Create(const WidgetPlacement& aPlacement) {
-  return WidgetPlacementPtr(new WidgetPlacement(aPlacement));
+WidgetPlacement::Create(const int32_t aWidth, const int32_t aHeight) {
+  WidgetPlacementPtr result(new WidgetPlacement());
+  result->width = aWidth;
+  result->height = aHeight;
+  result->anchor = vrb::Vector(0.5f, 0.5f, 0.0f);
+  result->rotation = 0.0f;
+  result->parentHandle = -1;
+  result->parentAnchor = vrb::Vector(0.5f, 0.5f, 0.0f);
+  result->density = 1.0f;
+  result->worldWidth = -1.0f;
+  result->visible = true;
+  result->scene = 0;
+  result->showPointer = true;
+  result->composited = false;
+  result->layer = false;
+  result->layerPriority = 0;
+  result->proxifyLayer = false;
+  result->textureScale = 1.0f;
+  result->cylinder = false;
+  result->cylinderMapRadius = 0.0f;
+  result->tintColor = 0xFFFFFFFF;
+  result->borderColor = 0;
+  result->clearColor = 0;
+  result->textureLOD = false;
+  result->opaque = false;
+  result->version = 0;
+  result->hasName = true;
+  return result;
 }
 
 int32_t
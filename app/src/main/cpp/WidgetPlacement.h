@@ -47,6 +47,15 @@ struct WidgetPlacement {
   int borderColor;
   std::string name;
   int clearColor;
+  // The surface may be rendered at a lower resolution while the widget is small in view.
+  bool textureLOD;
+  // The widget hides whatever is entirely behind it, see WidgetVisibility.
+  bool opaque;
+  // Stamp of the Java placement this was decoded from. Java only bumps it
+  // when the content changes; 0 for placements created or copied natively.
+  uint32_t version;
+  // False when Java did not send the name because it did not change.
+  bool hasName;
 
   int32_t GetTextureWidth() const;
   int32_t GetTextureHeight() const;
@@ -55,8 +64,18 @@ struct WidgetPlacement {
   WidgetPlacement::Scene GetScene() const;
 
   static const float kWorldDPIRatio;
-  static WidgetPlacementPtr FromJava(JNIEnv* aEnv, jobject& aObject);
+  // Number of ints in the placements packed by WidgetPlacement.pack() in Java.
+  static const int32_t kPackedSize = 33;
+  // Header flags in the second packed int.
+  static const int32_t kPackedHasName = 1 << 0;
+  // Decodes a packed placement with a single JNI call. aName is only read when
+  // the header says the name changed since the last packed placement of the
+  // widget; a null aName then clears it.
+  static WidgetPlacementPtr FromJava(JNIEnv* aEnv, jintArray aPacked, jstring aName);
+  static WidgetPlacementPtr FromPacked(const jint* aData);
   static WidgetPlacementPtr Create(const WidgetPlacement& aPlacement);
+  // Visible, unparented placement with unit density. Used when there is no Java peer (e.g. host builds).
+  static WidgetPlacementPtr Create(const int32_t aWidth, const int32_t aHeight);
 private:
   WidgetPlacement() = default;
   WidgetPlacement(const WidgetPlacement&) = default;
@@ -0,0 +1,182 @@
+/* -*- Mode: C++; tab-width: 20; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include "WidgetRegistry.h"
+#include "Widget.h"
+#include "WidgetPlacement.h"
+#include "vrb/Node.h"
+
+#include <algorithm>
+
+namespace crow {
+
+static int32_t
+GetParentHandle(const Widget& aWidget) {
+  return aWidget.GetPlacement() ? aWidget.GetPlacement()->parentHandle : 0;
+}
+
+WidgetRegistry::WidgetRegistry() : mHasDirty(false), mHierarchyDirty(false) {}
+
+void
+WidgetRegistry::Add(const WidgetPtr& aWidget) {
+  mSlots[(int32_t)aWidget->GetHandle()] = mWidgets.size();
+  mWidgets.push_back(aWidget);
+  mRoots[aWidget->GetRoot().get()] = aWidget.get();
+  mParentHandles.push_back(GetParentHandle(*aWidget));
+  mDirty.push_back(0);
+  mHierarchyDirty = true;
+}
+
+void
+WidgetRegistry::Remove(const int32_t aHandle) {
+  auto it = mSlots.find(aHandle);
+  if (it == mSlots.end()) {
+    return;
+  }
+  const size_t slot = it->second;
+  mSlots.erase(it);
+  mRoots.erase(mWidgets[slot]->GetRoot().get());
+  mWidgets.erase(mWidgets.begin() + slot);
+  mParentHandles.erase(mParentHandles.begin() + slot);
+  mDirty.erase(mDirty.begin() + slot);
+  for (size_t index = slot; index < mWidgets.size(); ++index) {
+    mSlots[(int32_t)mWidgets[index]->GetHandle()] = index;
+  }
+  mHierarchyDirty = true;
+}
+
+WidgetPtr
+WidgetRegistry::Get(const int32_t aHandle) const {
+  const int32_t slot = SlotOf(aHandle);
+  return slot >= 0 ? mWidgets[slot] : nullptr;
+}
+
+Widget*
+WidgetRegistry::Find(const int32_t aHandle) const {
+  const int32_t slot = SlotOf(aHandle);
+  return slot >= 0 ? mWidgets[slot].get() : nullptr;
+}
+
+Widget*
+WidgetRegistry::FindByRoot(const vrb::Node* aRoot) const {
+  auto it = mRoots.find(aRoot);
+  return it != mRoots.end() ? it->second : nullptr;
+}
+
+void
+WidgetRegistry::UpdateParent(const Widget& aWidget) {
+  const int32_t slot = SlotOf((int32_t)aWidget.GetHandle());
+  if (slot < 0) {
+    return;
+  }
+  const int32_t parentHandle = GetParentHandle(aWidget);
+  if (mParentHandles[slot] != parentHandle) {
+    mParentHandles[slot] = parentHandle;
+    mHierarchyDirty = true;
+  }
+}
+
+bool
+WidgetRegistry::IsParent(const Widget& aChild, const Widget& aParent) const {
+  const int32_t parentHandle = (int32_t)aParent.GetHandle();
+  if (GetParentHandle(aChild) == parentHandle) {
+    return true;
+  }
+  UpdateHierarchy();
+  int32_t slot = SlotOf((int32_t)aChild.GetHandle());
+  if (slot < 0) {
+    return false;
+  }
+  // Depth bounds the walk and guards against parenting cycles.
+  for (int32_t depth = mDepths[slot]; depth > 0 && slot >= 0; --depth) {
+    if (mParentHandles[slot] == parentHandle) {
+      return true;
+    }
+    slot = mParentSlots[slot];
+  }
+  return false;
+}
+
+int
+WidgetRegistry::ParentCount(const Widget& aWidget) const {
+  UpdateHierarchy();
+  const int32_t slot = SlotOf((int32_t)aWidget.GetHandle());
+  return slot >= 0 ? mDepths[slot] : 0;
+}
+
+const std::vector<WidgetPtr>&
+WidgetRegistry::GetParentFirstOrder() const {
+  UpdateHierarchy();
+  return mParentFirstOrder;
+}
+
+void
+WidgetRegistry::MarkDirty(const int32_t aHandle, const uint32_t aFlags) {
+  const int32_t slot = SlotOf(aHandle);
+  if (slot >= 0 && aFlags) {
+    mDirty[slot] |= aFlags;
+    mHasDirty = true;
+  }
+}
+
+uint32_t
+WidgetRegistry::GetDirty(const int32_t aHandle) const {
+  const int32_t slot = SlotOf(aHandle);
+  return slot >= 0 ? mDirty[slot] : 0;
+}
+
+void
+WidgetRegistry::ClearDirty() {
+  if (mHasDirty) {
+    std::fill(mDirty.begin(), mDirty.end(), 0);
+    mHasDirty = false;
+  }
+}
+
+int32_t
+WidgetRegistry::SlotOf(const int32_t aHandle) const {
+  auto it = mSlots.find(aHandle);
+  return it != mSlots.end() ? (int32_t)it->second : -1;
+}
+
+void
+WidgetRegistry::UpdateHierarchy() const {
+  if (!mHierarchyDirty) {
+    return;
+  }
+  const size_t count = mWidgets.size();
+  mParentSlots.assign(count, -1);
+  mDepths.assign(count, -1);
+  for (size_t index = 0; index < count; ++index) {
+    if (mParentHandles[index] > 0) {
+      mParentSlots[index] = SlotOf(mParentHandles[index]);
+    }
+  }
+  for (size_t index = 0; index < count; ++index) {
+    // Walk up until a slot with a known depth (or the root) is found, then unwind.
+    int32_t depth = 0;
+    int32_t current = (int32_t)index;
+    while (mDepths[current] < 0 && mParentSlots[current] >= 0 && depth <= (int32_t)count) {
+      current = mParentSlots[current];
+      depth++;
+    }
+    int32_t base = mDepths[current] >= 0 ? mDepths[current] : 0;
+    current = (int32_t)index;
+    for (int32_t step = depth; step > 0 && mDepths[current] < 0; --step) {
+      mDepths[current] = base + step;
+      current = mParentSlots[current];
+    }
+    if (mDepths[current] < 0) {
+      mDepths[current] = base;
+    }
+  }
+  mParentFirstOrder = mWidgets;
+  std::stable_sort(mParentFirstOrder.begin(), mParentFirstOrder.end(), [this](const WidgetPtr& a, const WidgetPtr& b) {
+    return mDepths[mSlots.at((int32_t)a->GetHandle())] < mDepths[mSlots.at((int32_t)b->GetHandle())];
+  });
+  mHierarchyDirty = false;
+}
+
+} // namespace crow
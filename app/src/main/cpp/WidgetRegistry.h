@@ -0,0 +1,71 @@
+/* -*- Mode: C++; tab-width: 20; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#ifndef VRBROWSER_WIDGET_REGISTRY_H
+#define VRBROWSER_WIDGET_REGISTRY_H
+
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+namespace vrb {
+class Node;
+}
+
+namespace crow {
+
+class Widget;
+typedef std::shared_ptr<Widget> WidgetPtr;
+
+// Owns the widgets of a BrowserWorld. Widgets are kept densely in insertion
+// order (used for iteration and drawing) with a handle -> slot map for O(1)
+// lookups. Parent depth and parent slot are cached and only recomputed after
+// a widget was added, removed or its parentHandle changed. Each widget also
+// carries a set of layout dirty flags, whose meaning is up to the caller.
+class WidgetRegistry {
+public:
+  typedef std::vector<WidgetPtr>::const_iterator const_iterator;
+
+  WidgetRegistry();
+  void Add(const WidgetPtr& aWidget);
+  void Remove(const int32_t aHandle);
+  WidgetPtr Get(const int32_t aHandle) const;
+  Widget* Find(const int32_t aHandle) const;
+  Widget* FindByRoot(const vrb::Node* aRoot) const;
+  // Must be called after a widget placement is replaced.
+  void UpdateParent(const Widget& aWidget);
+
+  bool IsParent(const Widget& aChild, const Widget& aParent) const;
+  int ParentCount(const Widget& aWidget) const;
+  // Widgets sorted so that parents always come before their children.
+  const std::vector<WidgetPtr>& GetParentFirstOrder() const;
+
+  void MarkDirty(const int32_t aHandle, const uint32_t aFlags);
+  uint32_t GetDirty(const int32_t aHandle) const;
+  bool HasDirty() const { return mHasDirty; }
+  void ClearDirty();
+
+  size_t Size() const { return mWidgets.size(); }
+  const_iterator begin() const { return mWidgets.begin(); }
+  const_iterator end() const { return mWidgets.end(); }
+private:
+  int32_t SlotOf(const int32_t aHandle) const;
+  void UpdateHierarchy() const;
+
+  std::vector<WidgetPtr> mWidgets;
+  std::unordered_map<int32_t, size_t> mSlots;
+  std::unordered_map<const vrb::Node*, Widget*> mRoots;
+  std::vector<int32_t> mParentHandles;
+  std::vector<uint32_t> mDirty;
+  bool mHasDirty;
+  mutable bool mHierarchyDirty;
+  mutable std::vector<int32_t> mParentSlots;
+  mutable std::vector<int32_t> mDepths;
+  mutable std::vector<WidgetPtr> mParentFirstOrder;
+};
+
+} // namespace crow
+
+#endif // VRBROWSER_WIDGET_REGISTRY_H
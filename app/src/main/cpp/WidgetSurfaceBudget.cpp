@@ -0,0 +1,95 @@
+/* -*- Mode: C++; tab-width: 20; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include "WidgetSurfaceBudget.h"
+
+namespace {
+
+const int64_t kBytesPerPixel = 4;
+const int64_t kBuffersPerSurface = 3;
+// Seconds a widget has to stay hidden before its surface can be released.
+const double kMinHiddenTime = 5.0;
+
+} // namespace
+
+namespace crow {
+
+WidgetSurfaceBudget::WidgetSurfaceBudget() : mBudget(0), mUsed(0) {}
+
+int64_t
+WidgetSurfaceBudget::GetSurfaceBytes(const int32_t aWidth, const int32_t aHeight) {
+  if (aWidth <= 0 || aHeight <= 0) {
+    return 0;
+  }
+  return (int64_t)aWidth * (int64_t)aHeight * kBytesPerPixel * kBuffersPerSurface;
+}
+
+void
+WidgetSurfaceBudget::SetBudget(const int64_t aBytes) {
+  mBudget = aBytes > 0 ? aBytes : 0;
+}
+
+int64_t
+WidgetSurfaceBudget::GetBudget() const {
+  return mBudget;
+}
+
+void
+WidgetSurfaceBudget::Update(const int32_t aHandle, const int32_t aWidth, const int32_t aHeight, const bool aShown,
+                            const double aTime) {
+  auto iter = mEntries.find(aHandle);
+  if (iter == mEntries.end()) {
+    iter = mEntries.emplace(aHandle, Entry{0, aShown, aTime}).first;
+  }
+  Entry& entry = iter->second;
+  const int64_t bytes = GetSurfaceBytes(aWidth, aHeight);
+  mUsed += bytes - entry.bytes;
+  entry.bytes = bytes;
+  if (aShown || entry.shown) {
+    entry.lastShown = aTime;
+  }
+  entry.shown = aShown;
+}
+
+void
+WidgetSurfaceBudget::Defer(const int32_t aHandle, const double aTime) {
+  auto iter = mEntries.find(aHandle);
+  if (iter != mEntries.end()) {
+    iter->second.lastShown = aTime;
+  }
+}
+
+void
+WidgetSurfaceBudget::Remove(const int32_t aHandle) {
+  auto iter = mEntries.find(aHandle);
+  if (iter != mEntries.end()) {
+    mUsed -= iter->second.bytes;
+    mEntries.erase(iter);
+  }
+}
+
+int64_t
+WidgetSurfaceBudget::GetUsedBytes() const {
+  return mUsed;
+}
+
+int32_t
+WidgetSurfaceBudget::PickEviction(const double aTime) const {
+  if (mBudget <= 0 || mUsed <= mBudget) {
+    return -1;
+  }
+  int32_t result = -1;
+  double oldest = aTime - kMinHiddenTime;
+  for (const auto& item: mEntries) {
+    const Entry& entry = item.second;
+    if (!entry.shown && entry.bytes > 0 && entry.lastShown <= oldest) {
+      oldest = entry.lastShown;
+      result = item.first;
+    }
+  }
+  return result;
+}
+
+} // namespace crow
@@ -0,0 +1,53 @@
+/* -*- Mode: C++; tab-width: 20; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#ifndef VRBROWSER_WIDGET_SURFACE_BUDGET_H
+#define VRBROWSER_WIDGET_SURFACE_BUDGET_H
+
+#include <stdint.h>
+#include <unordered_map>
+
+namespace crow {
+
+// Accounts for the memory held by the widget layer surfaces and picks which
+// surface to release when they take more than the budget: the one of the
+// widget that has been hidden the longest. Widgets that were hidden only a
+// moment ago are left alone, menus and dialogs often come back right away.
+class WidgetSurfaceBudget {
+public:
+  WidgetSurfaceBudget();
+  // In bytes, 0 for no budget.
+  void SetBudget(const int64_t aBytes);
+  int64_t GetBudget() const;
+  // Records the surface size of a widget at aTime, in seconds. The size is 0
+  // while the widget holds no surface.
+  void Update(const int32_t aHandle, const int32_t aWidth, const int32_t aHeight, const bool aShown, const double aTime);
+  // Keeps a widget from being picked again for a while, for when its surface
+  // could not be released.
+  void Defer(const int32_t aHandle, const double aTime);
+  void Remove(const int32_t aHandle);
+  int64_t GetUsedBytes() const;
+  // Handle of the widget whose surface should be released at aTime, -1 when
+  // the surfaces fit in the budget or none can be released yet.
+  int32_t PickEviction(const double aTime) const;
+
+  // Estimated memory of a layer surface. The compositor keeps a queue of
+  // three buffers for each of them.
+  static int64_t GetSurfaceBytes(const int32_t aWidth, const int32_t aHeight);
+private:
+  struct Entry {
+    int64_t bytes;
+    bool shown;
+    // Time the widget was last shown, or first seen hidden.
+    double lastShown;
+  };
+  std::unordered_map<int32_t, Entry> mEntries;
+  int64_t mBudget;
+  int64_t mUsed;
+};
+
+} // namespace crow
+
+#endif // VRBROWSER_WIDGET_SURFACE_BUDGET_H
@@ -0,0 +1,67 @@
+/* -*- Mode: C++; tab-width: 20; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include "WidgetSurfaceLOD.h"
+
+namespace {
+
+// About one level per halving of the pixel count.
+const float kLevels[] = {0.25f, 0.35f, 0.5f, 0.7f, 1.0f};
+// A lower level is only used once the widget needs this much less than it.
+const float kDowngradeMargin = 0.2f;
+// Seconds a lower level has to hold before the surface is shrunk.
+const double kDowngradeDelay = 2.0;
+
+} // namespace
+
+namespace crow {
+
+WidgetSurfaceLOD::WidgetSurfaceLOD() = default;
+
+float
+WidgetSurfaceLOD::GetLevel(const float aRequiredScale) {
+  for (const float level: kLevels) {
+    if (level >= aRequiredScale) {
+      return level;
+    }
+  }
+  return 1.0f;
+}
+
+float
+WidgetSurfaceLOD::Update(const int32_t aHandle, const float aCurrentScale, const float aRequiredScale, const double aTime) {
+  const float target = GetLevel(aRequiredScale);
+  if (target >= aCurrentScale) {
+    mDowngradeStart.erase(aHandle);
+    return target;
+  }
+  const float lower = GetLevel(aRequiredScale * (1.0f + kDowngradeMargin));
+  if (lower >= aCurrentScale) {
+    mDowngradeStart.erase(aHandle);
+    return aCurrentScale;
+  }
+  auto iter = mDowngradeStart.find(aHandle);
+  if (iter == mDowngradeStart.end()) {
+    mDowngradeStart.emplace(aHandle, aTime);
+    return aCurrentScale;
+  }
+  if (aTime - iter->second < kDowngradeDelay) {
+    return aCurrentScale;
+  }
+  mDowngradeStart.erase(iter);
+  return lower;
+}
+
+void
+WidgetSurfaceLOD::Remove(const int32_t aHandle) {
+  mDowngradeStart.erase(aHandle);
+}
+
+void
+WidgetSurfaceLOD::Clear() {
+  mDowngradeStart.clear();
+}
+
+} // namespace crow
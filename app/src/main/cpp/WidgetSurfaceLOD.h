@@ -0,0 +1,38 @@
+/* -*- Mode: C++; tab-width: 20; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#ifndef VRBROWSER_WIDGET_SURFACE_LOD_H
+#define VRBROWSER_WIDGET_SURFACE_LOD_H
+
+#include <stdint.h>
+#include <unordered_map>
+
+namespace crow {
+
+// Picks the resolution of the widget layer surfaces from the resolution they
+// need on the display. Scales snap to a few levels. A widget moves to a
+// higher level as soon as it needs it, and to a lower level only once it has
+// needed clearly less for a while, because every change recreates the
+// surface and has the widget paint again.
+class WidgetSurfaceLOD {
+public:
+  WidgetSurfaceLOD();
+  // aRequiredScale is the surface resolution, relative to the texture size,
+  // that the widget needs to be drawn at one texel per display pixel.
+  // Returns the scale the widget surface should use at aTime, in seconds.
+  float Update(const int32_t aHandle, const float aCurrentScale, const float aRequiredScale, const double aTime);
+  void Remove(const int32_t aHandle);
+  void Clear();
+
+  // Smallest level that holds aRequiredScale.
+  static float GetLevel(const float aRequiredScale);
+private:
+  // Time since each widget could use a lower level.
+  std::unordered_map<int32_t, double> mDowngradeStart;
+};
+
+} // namespace crow
+
+#endif // VRBROWSER_WIDGET_SURFACE_LOD_H
@@ -0,0 +1,209 @@
+/* -*- Mode: C++; tab-width: 20; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include "WidgetVisibility.h"
+#include "vrb/Camera.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace {
+
+// Widgets up to this far outside the frustum, in NDC units, are still visible.
+const float kFrustumMargin = 0.05f;
+// In meters. Corners nearer than this are treated as behind the eye.
+const float kNearDistance = 0.01f;
+// An occludee has to be this far inside its occluder, in NDC units.
+const float kOcclusionMargin = 0.02f;
+const float kMinOccluderArea = 0.0001f;
+// Seconds a widget has to stay culled before it is reported off screen.
+const double kOffScreenDelay = 1.0;
+
+} // namespace
+
+namespace crow {
+
+WidgetVisibility::WidgetVisibility() : mTime(0.0) {}
+
+void
+WidgetVisibility::Begin(const vrb::Camera& aLeft, const vrb::Camera& aRight) {
+  const vrb::Camera* cameras[] = {&aLeft, &aRight};
+  for (int index = 0; index < 2; ++index) {
+    Eye& eye = mEyes[index];
+    eye.view = cameras[index]->GetView();
+    // At a view space z of -1 the projected w is 1, so the NDC of these points
+    // give the scale and offset of the projection.
+    const vrb::Matrix& perspective = cameras[index]->GetPerspective();
+    const vrb::Vector center = perspective.MultiplyPosition(vrb::Vector(0.0f, 0.0f, -1.0f));
+    const vrb::Vector corner = perspective.MultiplyPosition(vrb::Vector(1.0f, 1.0f, -1.0f));
+    eye.scaleX = corner.x() - center.x();
+    eye.offsetX = center.x();
+    eye.scaleY = corner.y() - center.y();
+    eye.offsetY = center.y();
+  }
+  mEntries.clear();
+}
+
+void
+WidgetVisibility::Add(const int32_t aHandle, const vrb::Matrix& aTransform, const vrb::Vector& aMin,
+                      const vrb::Vector& aMax, const bool aFlat, const bool aOpaque) {
+  Entry entry = {};
+  entry.handle = aHandle;
+  entry.flat = aFlat;
+  entry.opaque = aFlat && aOpaque;
+
+  // The first four corners go around the rectangle. A curve never bulges more
+  // than half its width out of the plane.
+  vrb::Vector corners[8];
+  int count = 0;
+  const float depth = aFlat ? 0.0f : (aMax.x() - aMin.x()) * 0.5f;
+  for (const float z: {-depth, depth}) {
+    corners[count++] = vrb::Vector(aMin.x(), aMin.y(), z);
+    corners[count++] = vrb::Vector(aMax.x(), aMin.y(), z);
+    corners[count++] = vrb::Vector(aMax.x(), aMax.y(), z);
+    corners[count++] = vrb::Vector(aMin.x(), aMax.y(), z);
+    if (aFlat) {
+      break;
+    }
+  }
+
+  const float limit = 1.0f + kFrustumMargin;
+  for (int index = 0; index < 2; ++index) {
+    const Eye& eye = mEyes[index];
+    EyeBounds& bounds = entry.eyes[index];
+    const vrb::Matrix modelView = eye.view.PostMultiply(aTransform);
+    // Left, right, bottom, top and near planes, scaled by the distance so that
+    // they hold for corners behind the eye too. The widget is outside when
+    // every corner is on the negative side of one of them.
+    float planes[5];
+    std::fill(std::begin(planes), std::end(planes), -std::numeric_limits<float>::max());
+    bounds.inFront = true;
+    bounds.nearest = std::numeric_limits<float>::max();
+    bounds.farthest = -std::numeric_limits<float>::max();
+    for (int corner = 0; corner < count; ++corner) {
+      const vrb::Vector point = modelView.MultiplyPosition(corners[corner]);
+      const float distance = -point.z();
+      planes[0] = std::max(planes[0], eye.scaleX * point.x() + (eye.offsetX + limit) * distance);
+      planes[1] = std::max(planes[1], (limit - eye.offsetX) * distance - eye.scaleX * point.x());
+      planes[2] = std::max(planes[2], eye.scaleY * point.y() + (eye.offsetY + limit) * distance);
+      planes[3] = std::max(planes[3], (limit - eye.offsetY) * distance - eye.scaleY * point.y());
+      planes[4] = std::max(planes[4], distance - kNearDistance);
+      bounds.nearest = std::min(bounds.nearest, distance);
+      bounds.farthest = std::max(bounds.farthest, distance);
+      if (distance <= kNearDistance) {
+        bounds.inFront = false;
+      } else if (corner < 4) {
+        bounds.ndcX[corner] = eye.scaleX * point.x() / distance + eye.offsetX;
+        bounds.ndcY[corner] = eye.scaleY * point.y() / distance + eye.offsetY;
+      }
+    }
+    bounds.outside = std::any_of(std::begin(planes), std::end(planes), [](const float aValue) {
+      return aValue < 0.0f;
+    });
+  }
+  mEntries.push_back(entry);
+}
+
+void
+WidgetVisibility::End(const double aTime) {
+  mTime = aTime;
+  for (auto& item: mTracked) {
+    item.second.added = false;
+  }
+  for (const Entry& entry: mEntries) {
+    Result result = Result::Visible;
+    if (entry.eyes[0].outside && entry.eyes[1].outside) {
+      result = Result::OutsideFrustum;
+    } else if (entry.flat) {
+      bool hidden = true;
+      for (int index = 0; index < 2 && hidden; ++index) {
+        hidden = entry.eyes[index].outside ||
+            std::any_of(mEntries.begin(), mEntries.end(), [&](const Entry& aOccluder) {
+              return aOccluder.opaque && aOccluder.handle != entry.handle &&
+                  Occludes(aOccluder.eyes[index], entry.eyes[index]);
+            });
+      }
+      if (hidden) {
+        result = Result::Occluded;
+      }
+    }
+
+    auto iter = mTracked.find(entry.handle);
+    if (iter == mTracked.end()) {
+      iter = mTracked.emplace(entry.handle, Tracked{Result::Visible, false, 0.0, false}).first;
+    }
+    Tracked& tracked = iter->second;
+    if (result != Result::Visible && tracked.result == Result::Visible) {
+      tracked.culledSince = aTime;
+    }
+    tracked.result = result;
+    tracked.added = true;
+  }
+}
+
+WidgetVisibility::Result
+WidgetVisibility::GetResult(const int32_t aHandle) const {
+  auto iter = mTracked.find(aHandle);
+  return iter != mTracked.end() && iter->second.added ? iter->second.result : Result::Visible;
+}
+
+void
+WidgetVisibility::ReportChanges(const std::function<bool(const int32_t aHandle, const bool aOnScreen)>& aCallback) {
+  for (auto iter = mTracked.begin(); iter != mTracked.end();) {
+    Tracked& tracked = iter->second;
+    const bool offScreen = tracked.added && tracked.result != Result::Visible &&
+        mTime - tracked.culledSince >= kOffScreenDelay;
+    if (offScreen != tracked.offScreen && aCallback(iter->first, !offScreen)) {
+      tracked.offScreen = offScreen;
+    }
+    if (!tracked.added && !tracked.offScreen) {
+      iter = mTracked.erase(iter);
+    } else {
+      ++iter;
+    }
+  }
+}
+
+void
+WidgetVisibility::Remove(const int32_t aHandle) {
+  mTracked.erase(aHandle);
+}
+
+// Whether aOccluder is entirely nearer than aOccludee and its projection
+// contains the projection of aOccludee, seen from the same eye.
+bool
+WidgetVisibility::Occludes(const EyeBounds& aOccluder, const EyeBounds& aOccludee) {
+  if (!aOccluder.inFront || !aOccludee.inFront || aOccluder.farthest >= aOccludee.nearest) {
+    return false;
+  }
+  float area = 0.0f;
+  for (int index = 0; index < 4; ++index) {
+    const int next = (index + 1) % 4;
+    area += aOccluder.ndcX[index] * aOccluder.ndcY[next] - aOccluder.ndcX[next] * aOccluder.ndcY[index];
+  }
+  if (std::fabs(area) < kMinOccluderArea) {
+    return false;
+  }
+  // The projection of a rectangle is convex, so the occludee is inside when
+  // all of its corners are on the inner side of every occluder edge.
+  const float winding = area > 0.0f ? 1.0f : -1.0f;
+  for (int index = 0; index < 4; ++index) {
+    const int next = (index + 1) % 4;
+    const float edgeX = aOccluder.ndcX[next] - aOccluder.ndcX[index];
+    const float edgeY = aOccluder.ndcY[next] - aOccluder.ndcY[index];
+    const float margin = kOcclusionMargin * std::sqrt(edgeX * edgeX + edgeY * edgeY);
+    for (int corner = 0; corner < 4; ++corner) {
+      const float cross = edgeX * (aOccludee.ndcY[corner] - aOccluder.ndcY[index]) -
+          edgeY * (aOccludee.ndcX[corner] - aOccluder.ndcX[index]);
+      if (cross * winding < margin) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+} // namespace crow
@@ -0,0 +1,92 @@
+/* -*- Mode: C++; tab-width: 20; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#ifndef VRBROWSER_WIDGET_VISIBILITY_H
+#define VRBROWSER_WIDGET_VISIBILITY_H
+
+#include "vrb/Forward.h"
+#include "vrb/Matrix.h"
+#include "vrb/Vector.h"
+
+#include <functional>
+#include <stdint.h>
+#include <unordered_map>
+#include <vector>
+
+namespace crow {
+
+// Finds the shown widgets that neither eye sees in a frame: those outside both
+// eye frusta and those entirely behind an opaque flat widget. The tests are
+// conservative, a widget is only culled when it is certainly not seen.
+//
+// A widget is reported off screen once it has been culled for a while, and
+// back on screen as soon as it is not, so that looking around does not keep
+// throttling and waking up the windows.
+class WidgetVisibility {
+public:
+  enum class Result {
+    Visible,
+    OutsideFrustum,
+    Occluded
+  };
+  WidgetVisibility();
+  // Starts the pass of a frame drawn with the cameras of both eyes.
+  void Begin(const vrb::Camera& aLeft, const vrb::Camera& aRight);
+  // Adds a shown widget, the rectangle between aMin and aMax in the XY plane of
+  // aTransform. Curved widgets are bounded by a box around that rectangle.
+  // Flat opaque widgets hide the flat widgets entirely behind them.
+  void Add(const int32_t aHandle, const vrb::Matrix& aTransform, const vrb::Vector& aMin, const vrb::Vector& aMax,
+           const bool aFlat, const bool aOpaque);
+  // Classifies the widgets added since Begin(), at aTime in seconds.
+  void End(const double aTime);
+  Result GetResult(const int32_t aHandle) const;
+  // Calls aCallback for every widget whose on screen state changed. Widgets that
+  // were not added in the last pass are reported back on screen and forgotten.
+  // aCallback returns false if the change could not be sent, it is retried on
+  // the next call.
+  void ReportChanges(const std::function<bool(const int32_t aHandle, const bool aOnScreen)>& aCallback);
+  void Remove(const int32_t aHandle);
+private:
+  // The NDC x of a view space point is scaleX * x / -z + offsetX, and so on for y.
+  struct Eye {
+    vrb::Matrix view;
+    float scaleX;
+    float offsetX;
+    float scaleY;
+    float offsetY;
+  };
+  struct EyeBounds {
+    bool outside;
+    // Every corner is in front of the near plane, so ndc is valid.
+    bool inFront;
+    float nearest;
+    float farthest;
+    float ndcX[4];
+    float ndcY[4];
+  };
+  struct Entry {
+    int32_t handle;
+    bool flat;
+    bool opaque;
+    EyeBounds eyes[2];
+  };
+  struct Tracked {
+    Result result;
+    bool added;
+    double culledSince;
+    bool offScreen;
+  };
+
+  static bool Occludes(const EyeBounds& aOccluder, const EyeBounds& aOccludee);
+
+  Eye mEyes[2];
+  std::vector<Entry> mEntries;
+  std::unordered_map<int32_t, Tracked> mTracked;
+  double mTime;
+};
+
+} // namespace crow
+
+#endif // VRBROWSER_WIDGET_VISIBILITY_H
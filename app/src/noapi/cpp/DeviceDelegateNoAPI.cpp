@@ -51,6 +51,7 @@ struct DeviceDelegateNoAPI::State {
   vrb::Matrix pitchMatrix;
   vrb::Vector position;
   bool clicked;
+  bool singlePassStereo;
   GLsizei glWidth, glHeight;
   float near, far;
   State()
@@ -61,6 +62,7 @@ struct DeviceDelegateNoAPI::State {
       , pitchMatrix(vrb::Matrix::Identity())
       , position(GetHomePosition())
       , clicked(false)
+      , singlePassStereo(false)
       , glWidth(0)
       , glHeight(0)
       , near(0.1f)
@@ -247,6 +249,24 @@ DeviceDelegateNoAPI::BindEye(const device::Eye aEye) {
   }
 }
 
+bool
+DeviceDelegateNoAPI::SupportsSinglePassStereo() const {
+  return m.singlePassStereo;
+}
+
+void
+DeviceDelegateNoAPI::BindStereoTarget() {
+  // Both eyes share the camera, each one gets half of the viewport.
+  m.camera->SetViewport(m.glWidth / 2, m.glHeight);
+  VRB_GL_CHECK(glViewport(0, 0, m.glWidth, m.glHeight));
+}
+
+void
+DeviceDelegateNoAPI::SetEyeViewport(const device::Eye aEye) {
+  const GLsizei width = m.glWidth / 2;
+  VRB_GL_CHECK(glViewport(aEye == device::Eye::Left ? 0 : width, 0, width, m.glHeight));
+}
+
 void
 DeviceDelegateNoAPI::EndFrame(const FrameEndMode aMode) {
   // noop
@@ -292,6 +312,10 @@ DeviceDelegateNoAPI::SetViewport(const int aWidth, const int aHeight) {
   m.UpdateDisplay();
 }
 
+void
+DeviceDelegateNoAPI::SetSinglePassStereo(const bool aEnabled) {
+  m.singlePassStereo = aEnabled;
+}
 
 void
 DeviceDelegateNoAPI::Pause() {
@@ -39,11 +39,16 @@ public:
   void ProcessEvents() override;
   void StartFrame(const FramePrediction aPrediction) override;
   void BindEye(const device::Eye) override;
+  bool SupportsSinglePassStereo() const override;
+  void BindStereoTarget() override;
+  void SetEyeViewport(const device::Eye aEye) override;
   void EndFrame(const FrameEndMode aMode) override;
   // DeviceDelegateNoAPI interface
   void InitializeJava(JNIEnv* aEnv, jobject aActivity);
   void ShutdownJava();
   void SetViewport(const int aWidth, const int aHeight);
+  // Draws both eyes side by side in a single pass, used to profile the single pass stereo path.
+  void SetSinglePassStereo(const bool aEnabled);
   void Pause();
   void Resume();
   void MoveAxis(const float aX, const float aY, const float aZ);
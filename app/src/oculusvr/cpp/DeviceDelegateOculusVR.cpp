@@ -1032,8 +1032,8 @@ DeviceDelegateOculusVR::EndFrame(const FrameEndMode aEndMode) {
   const ovrTracking2& tracking = frameAhead ? m.prevPredictedTracking : m.predictedTracking;
   const double displayTime = frameAhead ? m.prevPredictedDisplayTime : m.predictedDisplayTime;
 
-  if (aEndMode == FrameEndMode::DISCARD) {
-    // Reuse the last frame when a frame is discarded.
+  if (aEndMode == FrameEndMode::DISCARD || aEndMode == FrameEndMode::REPEAT) {
+    // Reuse the last frame when a frame is discarded or repeated.
     // The last frame is timewarped by the VR compositor.
     if (m.discardCount == 0) {
       m.discardPredictedTracking = tracking;
@@ -27,6 +27,7 @@
 #include <cstdlib>
 #include <unistd.h>
 #include <string.h>
+#include <time.h>
 
 #include "VRBrowser.h"
 
@@ -37,12 +38,25 @@
 #endif
 #include "OpenXRHelpers.h"
 #include "OpenXRSwapChain.h"
+#include "OpenXRFramePacer.h"
 #include "OpenXRInput.h"
 #include "OpenXRExtensions.h"
 #include "OpenXRLayers.h"
 
 namespace crow {
 
+// Wait for the frames on a dedicated thread, see OpenXRFramePacer.
+#if defined(FRAME_PACING_THREAD)
+const bool kUseFramePacingThread = true;
+#else
+const bool kUseFramePacingThread = false;
+#endif
+
+// Resolution of the eye buffers, per axis, in frames where they only hold the
+// controller beams and pointers. Those are thin, antialiased and move with the
+// hand, so the compositor upscale is not noticeable.
+const float kControllersOnlyScale = 0.5f;
+
 struct DeviceDelegateOpenXR::State {
   vrb::RenderContextWeak context;
   JavaContext* javaContext = nullptr;
@@ -61,6 +75,10 @@ struct DeviceDelegateOpenXR::State {
   std::vector<XrView> views;
   std::vector<XrView> prevViews;
   std::vector<OpenXRSwapChainPtr> eyeSwapChains;
+  // Both views are rendered side by side into eyeSwapChains[0].
+  bool singlePassStereo = false;
+  // Set by BrowserWorld for the current frame, see DeviceDelegate::SetEyeContent().
+  EyeContent eyeContent = EyeContent::Full;
   OpenXRSwapChainPtr boundSwapChain;
   OpenXRSwapChainPtr previousBoundSwapchain;
   XrSpace viewSpace = XR_NULL_HANDLE;
@@ -70,6 +88,8 @@ struct DeviceDelegateOpenXR::State {
   std::vector<int64_t> swapchainFormats;
   OpenXRInputPtr input;
   OpenXRLayerCubePtr cubeLayer;
+  // Loads while cubeLayer is drawn, and replaces it when cubeLayer is deleted.
+  OpenXRLayerCubePtr pendingCubeLayer;
   OpenXRLayerEquirectPtr equirectLayer;
   std::vector<OpenXRLayerPtr> uiLayers;
   OpenXRSwapChainPtr crearColorSwapChain;
@@ -80,6 +100,12 @@ struct DeviceDelegateOpenXR::State {
   XrTime predictedDisplayTime = 0;
   XrPosef predictedPose = {};
   XrPosef prevPredictedPose = {};
+  OpenXRFramePacerPtr framePacer;
+  // CLOCK_MONOTONIC seconds, see GetFrameTiming().
+  double submitDeadline = 0.0;
+  double displayPeriod = 0.0;
+  // Views of the last applied frame, used again to submit repeated frames.
+  std::vector<XrView> appliedViews;
   uint32_t discardedFrameIndex = 0;
   int discardCount = 0;
   vrb::Color clearColor;
@@ -93,11 +119,26 @@ struct DeviceDelegateOpenXR::State {
   vrb::Matrix reorientMatrix = vrb::Matrix::Identity();
   device::CPULevel minCPULevel = device::CPULevel::Normal;
   device::DeviceType deviceType = device::UnknownType;
+  // Per frame storage, sized during the first frames and reused afterwards.
   std::vector<const XrCompositionLayerBaseHeader*> frameEndLayers;
+  std::vector<XrCompositionLayerProjectionView> projectionLayerViews;
   std::function<void()> controllersReadyCallback;
   std::optional<XrPosef> firstPose;
   bool mHandTrackingSupported = false;
 
+  // The compositor latches a frame about one refresh period before its predicted display time.
+  // Without XR_KHR_convert_timespec_time fall back to the next xrWaitFrame wake up.
+  void UpdateFrameTiming(const XrFrameState& aFrameState, const double aWakeTime) {
+    displayPeriod = (double)aFrameState.predictedDisplayPeriod * 1e-9;
+    submitDeadline = aWakeTime + displayPeriod;
+    timespec displayTime = {};
+    if (OpenXRExtensions::sXrConvertTimeToTimespecTimeKHR &&
+        XR_SUCCEEDED(OpenXRExtensions::sXrConvertTimeToTimespecTimeKHR(instance, aFrameState.predictedDisplayTime, &displayTime))) {
+      const double latchTime = (double)displayTime.tv_sec + (double)displayTime.tv_nsec * 1e-9 - displayPeriod;
+      submitDeadline = std::max(aWakeTime + displayPeriod * 0.5, std::min(latchTime, submitDeadline));
+    }
+  }
+
   bool IsPositionTrackingSupported() {
       CHECK(system != XR_NULL_SYSTEM_ID);
       CHECK(instance != XR_NULL_HANDLE);
@@ -153,6 +194,9 @@ struct DeviceDelegateOpenXR::State {
     if (OpenXRExtensions::IsExtensionSupported(XR_KHR_ANDROID_SURFACE_SWAPCHAIN_EXTENSION_NAME)) {
       extensions.push_back(XR_KHR_ANDROID_SURFACE_SWAPCHAIN_EXTENSION_NAME);
     }
+    if (OpenXRExtensions::IsExtensionSupported(XR_KHR_CONVERT_TIMESPEC_TIME_EXTENSION_NAME)) {
+      extensions.push_back(XR_KHR_CONVERT_TIMESPEC_TIME_EXTENSION_NAME);
+    }
     if (OpenXRExtensions::IsExtensionSupported(XR_KHR_COMPOSITION_LAYER_CUBE_EXTENSION_NAME)) {
       extensions.push_back(XR_KHR_COMPOSITION_LAYER_CUBE_EXTENSION_NAME);
     }
@@ -268,19 +312,81 @@ struct DeviceDelegateOpenXR::State {
     viewConfig.resize(viewCount, {XR_TYPE_VIEW_CONFIGURATION_VIEW});
     CHECK_XRCMD(xrEnumerateViewConfigurationViews(instance, system, viewConfigType, viewCount, &viewCount, viewConfig.data()));
 
-    // Cache view buffer (used in xrLocateViews)
+    // Cache view buffers (used in xrLocateViews), views and prevViews are swapped on frame ahead prediction.
     views.resize(viewCount, {XR_TYPE_VIEW});
+    prevViews.resize(viewCount, {XR_TYPE_VIEW});
 
     vrb::RenderContextPtr render = context.lock();
 
-    // Create the main swapChain for each eye view
-    for (uint32_t i = 0; i < viewCount; i++) {
+    // Use a single double wide swapChain for both eyes when the runtime can
+    // create it, otherwise create the main swapChain for each eye view.
+    const XrViewConfigurationView& left = viewConfig.front();
+    singlePassStereo = viewCount == 2 &&
+                       left.recommendedImageRectWidth == viewConfig[1].recommendedImageRectWidth &&
+                       left.recommendedImageRectHeight == viewConfig[1].recommendedImageRectHeight &&
+                       left.recommendedImageRectWidth * 2 <= systemProperties.graphicsProperties.maxSwapchainImageWidth;
+    const uint32_t swapChainCount = singlePassStereo ? 1 : viewCount;
+    for (uint32_t i = 0; i < swapChainCount; i++) {
       auto swapChain = OpenXRSwapChain::create();
-      XrSwapchainCreateInfo info = GetSwapChainCreateInfo();
+      XrSwapchainCreateInfo info = GetEyeSwapChainCreateInfo();
       swapChain->InitFBO(render, session, info, GetFBOAttributes());
       eyeSwapChains.push_back(swapChain);
     }
-    VRB_DEBUG("OpenXR available views: %d", (int)eyeSwapChains.size());
+    VRB_DEBUG("OpenXR available views: %d single pass stereo: %s", (int)viewCount, singlePassStereo ? "yes" : "no");
+  }
+
+  XrSwapchainCreateInfo GetEyeSwapChainCreateInfo() {
+    if (!singlePassStereo) {
+      return GetSwapChainCreateInfo();
+    }
+    return GetSwapChainCreateInfo(viewConfig.front().recommendedImageRectWidth * 2,
+                                  viewConfig.front().recommendedImageRectHeight);
+  }
+
+  // Returns the swapChain holding the view aIndex and the rect of the view in it. Frames with
+  // only the controllers in the eye buffers use the top left part of the rect.
+  const OpenXRSwapChainPtr& GetViewSwapChain(const uint32_t aIndex, XrRect2Di& aRect) const {
+    const OpenXRSwapChainPtr& swapChain = eyeSwapChains[singlePassStereo ? 0 : aIndex];
+    const int32_t width = singlePassStereo ? swapChain->Width() / 2 : swapChain->Width();
+    aRect.offset = {singlePassStereo ? (int32_t)aIndex * width : 0, 0};
+    aRect.extent = {width, swapChain->Height()};
+    if (eyeContent == EyeContent::ControllersOnly) {
+      aRect.extent.width = std::max(1, (int32_t)(width * kControllersOnlyScale));
+      aRect.extent.height = std::max(1, (int32_t)(swapChain->Height() * kControllersOnlyScale));
+    }
+    return swapChain;
+  }
+
+  // Acquires and clears aSwapChain unless it is already bound for this frame,
+  // which happens when both eyes share it.
+  void BindEyeSwapChain(const OpenXRSwapChainPtr& aSwapChain) {
+    if (boundSwapChain == aSwapChain) {
+      boundSwapChain->BindFBO();
+      return;
+    }
+    if (boundSwapChain) {
+      boundSwapChain->ReleaseImage();
+    }
+    boundSwapChain = aSwapChain;
+    boundSwapChain->AcquireImage();
+    boundSwapChain->BindFBO();
+    VRB_GL_CHECK(glViewport(0, 0, boundSwapChain->Width(), boundSwapChain->Height()));
+    VRB_GL_CHECK(glClearColor(clearColor.Red(), clearColor.Green(), clearColor.Blue(), clearColor.Alpha()));
+    if (eyeContent != EyeContent::ControllersOnly) {
+      VRB_GL_CHECK(glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT));
+      return;
+    }
+    // Only the reduced view rects are drawn and submitted, clear just them.
+    VRB_GL_CHECK(glEnable(GL_SCISSOR_TEST));
+    for (uint32_t i = 0; i < views.size(); ++i) {
+      XrRect2Di rect;
+      if (GetViewSwapChain(i, rect) != boundSwapChain) {
+        continue;
+      }
+      VRB_GL_CHECK(glScissor(rect.offset.x, rect.offset.y, rect.extent.width, rect.extent.height));
+      VRB_GL_CHECK(glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT));
+    }
+    VRB_GL_CHECK(glDisable(GL_SCISSOR_TEST));
   }
 
   void InitializeImmersiveDisplay() {
@@ -450,8 +556,38 @@ struct DeviceDelegateOpenXR::State {
       sessionBeginInfo.primaryViewConfigurationType = viewConfigType;
       CHECK_XRCMD(xrBeginSession(session, &sessionBeginInfo));
       vrReady = true;
+      if (kUseFramePacingThread) {
+        framePacer = OpenXRFramePacer::Create(session);
+        framePacer->Start();
+      }
     }
 
+  void StopFramePacer() {
+    if (framePacer) {
+      framePacer->Stop();
+      framePacer = nullptr;
+    }
+  }
+
+  // Waits for the next frame, or takes the one already waited for by the pacing thread.
+  void WaitFrame(XrFrameState& aFrameState) {
+    if (framePacer) {
+      OpenXRFramePacer::Frame frame;
+      if (framePacer->NextFrame(frame)) {
+        aFrameState = frame.state;
+        UpdateFrameTiming(aFrameState, (double)frame.waitEnd * 1e-9);
+        return;
+      }
+      VRB_ERROR("OpenXR frame pacer stopped, waiting for frames on the render thread");
+      StopFramePacer();
+    }
+    XrFrameWaitInfo frameWaitInfo{XR_TYPE_FRAME_WAIT_INFO};
+    CHECK_XRCMD(xrWaitFrame(session, &frameWaitInfo, &aFrameState));
+    timespec now = {};
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    UpdateFrameTiming(aFrameState, (double)now.tv_sec + (double)now.tv_nsec * 1e-9);
+  }
+
   void HandleSessionEvent(const XrEventDataSessionStateChanged& event) {
     VRB_LOG("OpenXR XrEventDataSessionStateChanged: state %s->%s session=%p time=%ld",
         to_string(sessionState), to_string(event.state), event.session, event.time);
@@ -482,17 +618,25 @@ struct DeviceDelegateOpenXR::State {
       case XR_SESSION_STATE_STOPPING: {
         VRB_LOG("XR_SESSION_STATE_STOPPING");
         vrReady = false;
+        // The runtime may hold a pending xrWaitFrame until the session ends,
+        // so the pacing thread is only joined after xrEndSession.
+        if (framePacer) {
+          framePacer->RequestStop();
+        }
         CHECK_XRCMD(xrEndSession(session))
+        StopFramePacer();
         break;
       }
       case XR_SESSION_STATE_EXITING: {
         VRB_LOG("XR_SESSION_STATE_EXITING");
         vrReady = false;
+        StopFramePacer();
         break;
       }
       case XR_SESSION_STATE_LOSS_PENDING: {
         VRB_LOG("XR_SESSION_STATE_LOSS_PENDING");
         vrReady = false;
+        StopFramePacer();
         break;
       }
       default:
@@ -506,6 +650,8 @@ struct DeviceDelegateOpenXR::State {
 
 
   void Shutdown() {
+    StopFramePacer();
+
     // Release swapChains
     for (OpenXRSwapChainPtr swapChain: eyeSwapChains) {
       swapChain->Destroy();
@@ -572,7 +718,7 @@ DeviceDelegateOpenXR::SetRenderMode(const device::RenderMode aMode) {
   m.renderMode = aMode;
   vrb::RenderContextPtr render = m.context.lock();
   for (OpenXRSwapChainPtr& eyeSwapchain: m.eyeSwapChains) {
-    XrSwapchainCreateInfo info = m.GetSwapChainCreateInfo();
+    XrSwapchainCreateInfo info = m.GetEyeSwapChainCreateInfo();
     eyeSwapchain->InitFBO(render, m.session, info, m.GetFBOAttributes());
   }
 
@@ -689,6 +835,7 @@ DeviceDelegateOpenXR::ProcessEvents() {
         const auto& event = *reinterpret_cast<const XrEventDataInstanceLossPending*>(ev);
         VRB_WARN("OpenXR XR_TYPE_EVENT_DATA_INSTANCE_LOSS_PENDING by %ld", event.lossTime);
         m.vrReady = false;
+        m.StopFramePacer();
         return;
       }
       case XR_TYPE_EVENT_DATA_INTERACTION_PROFILE_CHANGED: {
@@ -717,6 +864,30 @@ DeviceDelegateOpenXR::SupportsFramePrediction(FramePrediction aPrediction) const
   return true;
 }
 
+bool
+DeviceDelegateOpenXR::GetFrameTiming(double& aSubmitDeadline, double& aDisplayPeriod) const {
+  if (m.displayPeriod <= 0.0) {
+    return false;
+  }
+  aSubmitDeadline = m.submitDeadline;
+  aDisplayPeriod = m.displayPeriod;
+  return true;
+}
+
+float
+DeviceDelegateOpenXR::GetPixelsPerDegree() const {
+  if (m.viewConfig.empty() || m.views.empty()) {
+    return 0.0f;
+  }
+  const XrFovf& fov = m.views.front().fov;
+  const float tangentWidth = tanf(fov.angleRight) - tanf(fov.angleLeft);
+  if (tangentWidth <= 0.0f) {
+    return 0.0f;
+  }
+  // Pixels per unit of tangent are pixels per radian at the center of the view.
+  return (float)m.viewConfig.front().recommendedImageRectWidth / tangentWidth * (float)M_PI / 180.0f;
+}
+
 void
 DeviceDelegateOpenXR::StartFrame(const FramePrediction aPrediction) {
   if (!m.vrReady) {
@@ -734,13 +905,16 @@ DeviceDelegateOpenXR::StartFrame(const FramePrediction aPrediction) {
 
   // Throttle the application frame loop in order to synchronize
   // application frame submissions with the display.
-  XrFrameWaitInfo frameWaitInfo{XR_TYPE_FRAME_WAIT_INFO};
   XrFrameState frameState{XR_TYPE_FRAME_STATE};
-  CHECK_XRCMD(xrWaitFrame(m.session, &frameWaitInfo, &frameState));
+  m.WaitFrame(frameState);
 
   // Begin frame and select the predicted display time
   XrFrameBeginInfo frameBeginInfo{XR_TYPE_FRAME_BEGIN_INFO};
   CHECK_XRCMD(xrBeginFrame(m.session, &frameBeginInfo));
+  if (m.framePacer) {
+    // The next frame can be waited for while this one is rendered.
+    m.framePacer->FrameBegun();
+  }
 
   CHECK_MSG(frameState.shouldRender, "shouldRender==false bailout not implemented yet");
 
@@ -748,7 +922,8 @@ DeviceDelegateOpenXR::StartFrame(const FramePrediction aPrediction) {
   if (aPrediction == FramePrediction::ONE_FRAME_AHEAD) {
     m.prevPredictedDisplayTime = m.predictedDisplayTime;
     m.prevPredictedPose = m.predictedPose;
-    m.prevViews = m.views;
+    // The views are located again below, no need to copy them.
+    std::swap(m.prevViews, m.views);
     m.predictedDisplayTime = frameState.predictedDisplayTime + frameState.predictedDisplayPeriod;
   } else {
     m.predictedDisplayTime = frameState.predictedDisplayTime;
@@ -762,7 +937,8 @@ DeviceDelegateOpenXR::StartFrame(const FramePrediction aPrediction) {
     m.firstPose = location.pose;
   }
 
-  vrb::Matrix head = XrPoseToMatrix(location.pose);
+  const vrb::Matrix headPose = XrPoseToMatrix(location.pose);
+  vrb::Matrix head = headPose;
 #if HVR
   if (IsPositionTrackingSupported()) {
     // Convert from floor to local (HVR doesn't support stageSpace yet)
@@ -809,47 +985,32 @@ DeviceDelegateOpenXR::StartFrame(const FramePrediction aPrediction) {
     m.immersiveDisplay->SetCapabilityFlags(caps);
   }
 
-  // Query eyeTransform and perspective for each view
+  // Query eyeTransform and perspective for each view. The views are located once, in local
+  // space for the projection layer, and the eye transforms are derived from the head pose
+  // located above for the same display time.
   XrViewState viewState{XR_TYPE_VIEW_STATE};
-  uint32_t viewCapacityInput = (uint32_t) m.views.size();
   uint32_t viewCountOutput = 0;
-
-  // Eye transform
-  {
-    XrViewLocateInfo viewLocateInfo{XR_TYPE_VIEW_LOCATE_INFO};
-    viewLocateInfo.viewConfigurationType = m.viewConfigType;
-    viewLocateInfo.displayTime = m.predictedDisplayTime;
-    viewLocateInfo.space = m.viewSpace;
-    CHECK_XRCMD(xrLocateViews(m.session, &viewLocateInfo, &viewState, viewCapacityInput, &viewCountOutput, m.views.data()));
-    for (int i = 0; i < m.views.size(); ++i) {
-      const XrView &view = m.views[i];
-      const device::Eye eye = i == 0 ? device::Eye::Left : device::Eye::Right;
-      vrb::Matrix eyeTransform = XrPoseToMatrix(view.pose);
-      m.cameras[i]->SetEyeTransform(eyeTransform);
-      if (m.immersiveDisplay) {
-        m.immersiveDisplay->SetEyeTransform(eye, eyeTransform);
-      }
-    }
-  }
-
-  // Perspective
   XrViewLocateInfo viewLocateInfo{XR_TYPE_VIEW_LOCATE_INFO};
   viewLocateInfo.viewConfigurationType = m.viewConfigType;
   viewLocateInfo.displayTime = m.predictedDisplayTime;
   viewLocateInfo.space = m.localSpace;
-  CHECK_XRCMD(xrLocateViews(m.session, &viewLocateInfo, &viewState, viewCapacityInput, &viewCountOutput, m.views.data()));
+  CHECK_XRCMD(xrLocateViews(m.session, &viewLocateInfo, &viewState, (uint32_t) m.views.size(), &viewCountOutput, m.views.data()));
 
+  const vrb::Matrix headInverse = headPose.AfineInverse();
   for (int i = 0; i < m.views.size(); ++i) {
     const XrView& view = m.views[i];
+    const device::Eye eye = i == 0 ? device::Eye::Left : device::Eye::Right;
+    const vrb::Matrix eyeTransform = headInverse.PostMultiply(XrPoseToMatrix(view.pose));
+    m.cameras[i]->SetEyeTransform(eyeTransform);
 
     vrb::Matrix perspective = vrb::Matrix::PerspectiveMatrix(fabsf(view.fov.angleLeft), view.fov.angleRight,
                                                              view.fov.angleUp, fabsf(view.fov.angleDown), m.near, m.far);
     m.cameras[i]->SetPerspective(perspective);
     if (m.immersiveDisplay) {
-      const device::Eye eye = i == 0 ? device::Eye::Left : device::Eye::Right;
       auto toDegrees = [](float angle) -> float {
         return angle * 180.0f / (float)M_PI;
       };
+      m.immersiveDisplay->SetEyeTransform(eye, eyeTransform);
       m.immersiveDisplay->SetFieldOfView(eye, toDegrees(fabsf(view.fov.angleLeft)), toDegrees(view.fov.angleRight),
                                          toDegrees(view.fov.angleUp), toDegrees(fabsf(view.fov.angleDown)));
     }
@@ -874,21 +1035,57 @@ DeviceDelegateOpenXR::BindEye(const device::Eye aWhich) {
   }
 
   int32_t index = device::EyeIndex(aWhich);
-  if (index < 0 || index >= m.eyeSwapChains.size()) {
+  if (index < 0 || index >= m.views.size()) {
     VRB_ERROR("No eye found");
     return;
   }
 
-  if (m.boundSwapChain) {
-    m.boundSwapChain->ReleaseImage();
+  if (m.eyeContent == EyeContent::None) {
+    return;
   }
 
-  m.boundSwapChain = m.eyeSwapChains[index];
-  m.boundSwapChain->AcquireImage();
-  m.boundSwapChain->BindFBO();
-  VRB_GL_CHECK(glViewport(0, 0, m.boundSwapChain->Width(), m.boundSwapChain->Height()));
-  VRB_GL_CHECK(glClearColor(m.clearColor.Red(), m.clearColor.Green(), m.clearColor.Blue(), m.clearColor.Alpha()));
-  VRB_GL_CHECK(glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT));
+  XrRect2Di rect;
+  m.BindEyeSwapChain(m.GetViewSwapChain((uint32_t)index, rect));
+  VRB_GL_CHECK(glViewport(rect.offset.x, rect.offset.y, rect.extent.width, rect.extent.height));
+}
+
+bool
+DeviceDelegateOpenXR::SupportsEyeContent() const {
+  // Without layers every window is drawn in the eye buffers.
+  return m.layersEnabled;
+}
+
+void
+DeviceDelegateOpenXR::SetEyeContent(const EyeContent aContent) {
+  m.eyeContent = aContent;
+}
+
+bool
+DeviceDelegateOpenXR::SupportsSinglePassStereo() const {
+  return m.singlePassStereo;
+}
+
+void
+DeviceDelegateOpenXR::BindStereoTarget() {
+  if (!m.vrReady || !m.singlePassStereo) {
+    VRB_ERROR("OpenXR BindStereoTarget called without a stereo swapChain");
+    return;
+  }
+  if (m.eyeContent == EyeContent::None) {
+    return;
+  }
+  m.BindEyeSwapChain(m.eyeSwapChains.front());
+}
+
+void
+DeviceDelegateOpenXR::SetEyeViewport(const device::Eye aWhich) {
+  const int32_t index = device::EyeIndex(aWhich);
+  if (!m.singlePassStereo || index < 0 || index >= m.views.size() || m.eyeContent == EyeContent::None) {
+    return;
+  }
+  XrRect2Di rect;
+  m.GetViewSwapChain((uint32_t)index, rect);
+  VRB_GL_CHECK(glViewport(rect.offset.x, rect.offset.y, rect.extent.width, rect.extent.height));
 }
 
 void
@@ -906,6 +1103,13 @@ DeviceDelegateOpenXR::EndFrame(const FrameEndMode aEndMode) {
   const XrPosef& predictedPose = frameAhead ? m.prevPredictedPose : m.predictedPose;
   const XrTime displayTime = frameAhead ? m.prevPredictedDisplayTime : m.predictedDisplayTime;
   auto& targetViews = frameAhead ? m.prevViews : m.views;
+  // A repeated frame was rendered for the views of the last applied frame, the
+  // compositor reprojects it to the current head pose.
+  const bool repeat = aEndMode == FrameEndMode::REPEAT && m.appliedViews.size() == targetViews.size();
+  const std::vector<XrView>& projectionViews = repeat ? m.appliedViews : targetViews;
+  if (aEndMode == FrameEndMode::APPLY) {
+    m.appliedViews = targetViews;
+  }
 
   std::vector<const XrCompositionLayerBaseHeader*>& layers = m.frameEndLayers;
   layers.clear();
@@ -928,10 +1132,14 @@ DeviceDelegateOpenXR::EndFrame(const FrameEndMode aEndMode) {
     m.equirectLayer->ClearRequestDraw();
   }
 
-  // Sort quad layers by draw priority
-  std::sort(m.uiLayers.begin(), m.uiLayers.end(), [](const OpenXRLayerPtr & a, OpenXRLayerPtr & b) -> bool {
+  // Sort quad layers by draw priority. The order only changes with a priority or
+  // when the widgets are drawn in a different order, so it is usually still valid.
+  auto drawsBefore = [](const OpenXRLayerPtr& a, const OpenXRLayerPtr& b) -> bool {
     return a->GetLayer()->ShouldDrawBefore(*b->GetLayer());
-  });
+  };
+  if (!std::is_sorted(m.uiLayers.begin(), m.uiLayers.end(), drawsBefore)) {
+    std::sort(m.uiLayers.begin(), m.uiLayers.end(), drawsBefore);
+  }
 
   // Add back UI layers
   for (const OpenXRLayerPtr& layer: m.uiLayers) {
@@ -944,24 +1152,28 @@ DeviceDelegateOpenXR::EndFrame(const FrameEndMode aEndMode) {
     }
   }
 
-  // Add main eye buffer layer
+  // Add main eye buffer layer. Nothing was rendered into it when the frame only has compositor
+  // layers, and the eye buffers are cleared to transparent, so it is left out.
   XrCompositionLayerProjection projectionLayer{XR_TYPE_COMPOSITION_LAYER_PROJECTION};
-  std::vector<XrCompositionLayerProjectionView> projectionLayerViews;
-  projectionLayerViews.resize(targetViews.size());
-  projectionLayer.layerFlags = XR_COMPOSITION_LAYER_BLEND_TEXTURE_SOURCE_ALPHA_BIT;
-  for (int i = 0; i < targetViews.size(); ++i) {
-    const OpenXRSwapChainPtr& viewSwapChain =  m.eyeSwapChains[i];
-    projectionLayerViews[i] = {XR_TYPE_COMPOSITION_LAYER_PROJECTION_VIEW};
-    projectionLayerViews[i].pose = targetViews[i].pose;
-    projectionLayerViews[i].fov = targetViews[i].fov;
-    projectionLayerViews[i].subImage.swapchain = viewSwapChain->SwapChain();
-    projectionLayerViews[i].subImage.imageRect.offset = {0, 0};
-    projectionLayerViews[i].subImage.imageRect.extent = {viewSwapChain->Width(), viewSwapChain->Height()};
-  }
-  projectionLayer.space = m.localSpace;
-  projectionLayer.viewCount = (uint32_t)projectionLayerViews.size();
-  projectionLayer.views = projectionLayerViews.data();
-  layers.push_back(reinterpret_cast<XrCompositionLayerBaseHeader*>(&projectionLayer));
+  if (m.eyeContent != EyeContent::None) {
+    std::vector<XrCompositionLayerProjectionView>& projectionLayerViews = m.projectionLayerViews;
+    projectionLayerViews.resize(targetViews.size());
+    projectionLayer.layerFlags = XR_COMPOSITION_LAYER_BLEND_TEXTURE_SOURCE_ALPHA_BIT;
+    for (int i = 0; i < targetViews.size(); ++i) {
+      XrRect2Di rect;
+      const OpenXRSwapChainPtr& viewSwapChain = m.GetViewSwapChain((uint32_t)i, rect);
+      projectionLayerViews[i] = {XR_TYPE_COMPOSITION_LAYER_PROJECTION_VIEW};
+      projectionLayerViews[i].pose = projectionViews[i].pose;
+      projectionLayerViews[i].fov = projectionViews[i].fov;
+      projectionLayerViews[i].subImage.swapchain = viewSwapChain->SwapChain();
+      projectionLayerViews[i].subImage.imageRect = rect;
+    }
+    projectionLayer.space = m.localSpace;
+    projectionLayer.viewCount = (uint32_t)projectionLayerViews.size();
+    projectionLayer.views = projectionLayerViews.data();
+    layers.push_back(reinterpret_cast<XrCompositionLayerBaseHeader*>(&projectionLayer));
+  }
+  m.eyeContent = EyeContent::Full;
 
   // Add front UI layers
   for (const OpenXRLayerPtr& layer: m.uiLayers) {
@@ -1058,14 +1270,19 @@ DeviceDelegateOpenXR::CreateLayerCube(int32_t aWidth, int32_t aHeight, GLint aIn
   if (!m.layersEnabled) {
     return nullptr;
   }
-  if (m.cubeLayer) {
-    m.cubeLayer->Destroy();
+  if (m.pendingCubeLayer) {
+    m.pendingCubeLayer->Destroy();
   }
   VRLayerCubePtr layer = VRLayerCube::Create(aWidth, aHeight, aInternalFormat);
-  m.cubeLayer = OpenXRLayerCube::Create(layer, aInternalFormat);
+  OpenXRLayerCubePtr cubeLayer = OpenXRLayerCube::Create(layer, aInternalFormat);
   if (m.session != XR_NULL_HANDLE) {
     vrb::RenderContextPtr context = m.context.lock();
-    m.cubeLayer->Init(m.javaContext->env, m.session, context);
+    cubeLayer->Init(m.javaContext->env, m.session, context);
+  }
+  if (m.cubeLayer) {
+    m.pendingCubeLayer = cubeLayer;
+  } else {
+    m.cubeLayer = cubeLayer;
   }
   return layer;
 }
@@ -1099,7 +1316,13 @@ void
 DeviceDelegateOpenXR::DeleteLayer(const VRLayerPtr& aLayer) {
   if (m.cubeLayer && m.cubeLayer->layer == aLayer) {
     m.cubeLayer->Destroy();
-    m.cubeLayer = nullptr;
+    m.cubeLayer = m.pendingCubeLayer;
+    m.pendingCubeLayer = nullptr;
+    return;
+  }
+  if (m.pendingCubeLayer && m.pendingCubeLayer->layer == aLayer) {
+    m.pendingCubeLayer->Destroy();
+    m.pendingCubeLayer = nullptr;
     return;
   }
   if (m.equirectLayer && m.equirectLayer->layer == aLayer) {
@@ -1116,6 +1339,16 @@ DeviceDelegateOpenXR::DeleteLayer(const VRLayerPtr& aLayer) {
   }
 }
 
+bool
+DeviceDelegateOpenXR::ReleaseLayerSurface(const VRLayerSurfacePtr& aLayer) {
+  for (const OpenXRLayerPtr& layer: m.uiLayers) {
+    if (layer->GetLayer() == aLayer) {
+      return layer->ReleaseSurface();
+    }
+  }
+  return false;
+}
+
 void
 DeviceDelegateOpenXR::EnterVR(const crow::BrowserEGLContext& aEGLContext) {
   // Reset reorientation after Enter VR
@@ -1164,6 +1397,9 @@ DeviceDelegateOpenXR::EnterVR(const crow::BrowserEGLContext& aEGLContext) {
   if (m.cubeLayer) {
     m.cubeLayer->Init(m.javaContext->env, m.session, context);
   }
+  if (m.pendingCubeLayer) {
+    m.pendingCubeLayer->Init(m.javaContext->env, m.session, context);
+  }
   if (m.equirectLayer) {
     m.equirectLayer->Init(m.javaContext->env, m.session, context);
   }
@@ -46,7 +46,14 @@ public:
   void ProcessEvents() override;
   bool SupportsFramePrediction(FramePrediction aPrediction) const override;
   void StartFrame(const FramePrediction aPrediction) override;
+  bool GetFrameTiming(double& aSubmitDeadline, double& aDisplayPeriod) const override;
+  float GetPixelsPerDegree() const override;
   void BindEye(const device::Eye aWhich) override;
+  bool SupportsEyeContent() const override;
+  void SetEyeContent(const EyeContent aContent) override;
+  bool SupportsSinglePassStereo() const override;
+  void BindStereoTarget() override;
+  void SetEyeViewport(const device::Eye aWhich) override;
   void EndFrame(const FrameEndMode aMode) override;
   VRLayerQuadPtr CreateLayerQuad(int32_t aWidth, int32_t aHeight,
                                  VRLayerSurface::SurfaceType aSurfaceType) override;
@@ -57,6 +64,7 @@ public:
   VRLayerCubePtr CreateLayerCube(int32_t aWidth, int32_t aHeight, GLint aInternalFormat) override;
   VRLayerEquirectPtr CreateLayerEquirect(const VRLayerPtr &aSource) override;
   void DeleteLayer(const VRLayerPtr& aLayer) override;
+  bool ReleaseLayerSurface(const VRLayerSurfacePtr& aLayer) override;
   // Custom methods for NativeActivity render loop based devices.
   void BeginXRSession();
   void EnterVR(const crow::BrowserEGLContext& aEGLContext);
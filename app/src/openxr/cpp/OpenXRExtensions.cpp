@@ -6,6 +6,7 @@ namespace crow {
 std::unordered_set<std::string> OpenXRExtensions::sSupportedExtensions { };
 PFN_xrGetOpenGLESGraphicsRequirementsKHR OpenXRExtensions::sXrGetOpenGLESGraphicsRequirementsKHR = nullptr;
 PFN_xrCreateSwapchainAndroidSurfaceKHR OpenXRExtensions::sXrCreateSwapchainAndroidSurfaceKHR = nullptr;
+PFN_xrConvertTimeToTimespecTimeKHR OpenXRExtensions::sXrConvertTimeToTimespecTimeKHR = nullptr;
 PFN_xrCreateHandTrackerEXT OpenXRExtensions::sXrCreateHandTrackerEXT = nullptr;
 PFN_xrDestroyHandTrackerEXT OpenXRExtensions::sXrDestroyHandTrackerEXT = nullptr;
 PFN_xrLocateHandJointsEXT OpenXRExtensions::sXrLocateHandJointsEXT = nullptr;
@@ -33,6 +34,10 @@ void OpenXRExtensions::LoadExtensions(XrInstance instance) {
   if (IsExtensionSupported(XR_KHR_ANDROID_SURFACE_SWAPCHAIN_EXTENSION_NAME)) {
       CHECK_XRCMD(xrGetInstanceProcAddr(instance, "xrCreateSwapchainAndroidSurfaceKHR",
                                         reinterpret_cast<PFN_xrVoidFunction *>(&sXrCreateSwapchainAndroidSurfaceKHR)));
+  }
+  if (IsExtensionSupported(XR_KHR_CONVERT_TIMESPEC_TIME_EXTENSION_NAME)) {
+      CHECK_XRCMD(xrGetInstanceProcAddr(instance, "xrConvertTimeToTimespecTimeKHR",
+                                        reinterpret_cast<PFN_xrVoidFunction *>(&sXrConvertTimeToTimespecTimeKHR)));
   }
     if (IsExtensionSupported(XR_EXT_HAND_TRACKING_EXTENSION_NAME)) {
         CHECK_XRCMD(xrGetInstanceProcAddr(instance, "xrCreateHandTrackerEXT",
@@ -17,6 +17,7 @@ namespace crow {
 
     static PFN_xrGetOpenGLESGraphicsRequirementsKHR sXrGetOpenGLESGraphicsRequirementsKHR;
     static PFN_xrCreateSwapchainAndroidSurfaceKHR sXrCreateSwapchainAndroidSurfaceKHR;
+    static PFN_xrConvertTimeToTimespecTimeKHR sXrConvertTimeToTimespecTimeKHR;
 
     // hand tracking extension prototypes
     static PFN_xrCreateHandTrackerEXT sXrCreateHandTrackerEXT;
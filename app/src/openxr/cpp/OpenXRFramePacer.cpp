@@ -0,0 +1,149 @@
+/* -*- Mode: C++; tab-width: 20; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include "OpenXRFramePacer.h"
+#include "vrb/Logger.h"
+
+#include <algorithm>
+#include <chrono>
+
+namespace crow {
+
+namespace {
+// Frames between telemetry reports.
+const int32_t kTelemetryFrames = 600;
+
+// steady_clock is CLOCK_MONOTONIC, the clock of the frame timing code.
+int64_t
+NowNanoseconds() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+}
+
+OpenXRFramePacerPtr
+OpenXRFramePacer::Create(XrSession aSession) {
+  return OpenXRFramePacerPtr(new OpenXRFramePacer(aSession));
+}
+
+OpenXRFramePacer::OpenXRFramePacer(XrSession aSession)
+    : mSession(aSession)
+{}
+
+OpenXRFramePacer::~OpenXRFramePacer() {
+  Stop();
+}
+
+void
+OpenXRFramePacer::Start() {
+  std::lock_guard<std::mutex> lock(mMutex);
+  if (mRunning) {
+    return;
+  }
+  mRunning = true;
+  mCanWait = true;
+  mHasFrame = false;
+  mFailed = false;
+  mThread = std::thread([this] { Run(); });
+}
+
+void
+OpenXRFramePacer::RequestStop() {
+  {
+    std::lock_guard<std::mutex> lock(mMutex);
+    mRunning = false;
+  }
+  mCondition.notify_all();
+}
+
+void
+OpenXRFramePacer::Stop() {
+  RequestStop();
+  if (mThread.joinable()) {
+    mThread.join();
+  }
+}
+
+bool
+OpenXRFramePacer::NextFrame(Frame& aFrame) {
+  const int64_t start = NowNanoseconds();
+  std::unique_lock<std::mutex> lock(mMutex);
+  mCondition.wait(lock, [this] { return mHasFrame || mFailed || !mRunning; });
+  if (!mHasFrame) {
+    return false;
+  }
+  aFrame = mFrame;
+  mHasFrame = false;
+  lock.unlock();
+  AddTelemetry(aFrame, NowNanoseconds() - start);
+  return true;
+}
+
+void
+OpenXRFramePacer::FrameBegun() {
+  {
+    std::lock_guard<std::mutex> lock(mMutex);
+    mCanWait = true;
+  }
+  mCondition.notify_all();
+}
+
+void
+OpenXRFramePacer::Run() {
+  while (true) {
+    {
+      std::unique_lock<std::mutex> lock(mMutex);
+      mCondition.wait(lock, [this] { return !mRunning || (mCanWait && !mHasFrame); });
+      if (!mRunning) {
+        return;
+      }
+      mCanWait = false;
+    }
+
+    Frame frame;
+    XrFrameWaitInfo frameWaitInfo{XR_TYPE_FRAME_WAIT_INFO};
+    frame.waitStart = NowNanoseconds();
+    const XrResult result = xrWaitFrame(mSession, &frameWaitInfo, &frame.state);
+    frame.waitEnd = NowNanoseconds();
+
+    {
+      std::lock_guard<std::mutex> lock(mMutex);
+      if (XR_FAILED(result)) {
+        // Expected when the session ended under a pending wait.
+        if (mRunning) {
+          VRB_ERROR("OpenXR frame pacer: xrWaitFrame failed: %d", (int)result);
+        }
+        mFailed = true;
+      } else {
+        mFrame = frame;
+        mHasFrame = true;
+      }
+    }
+    mCondition.notify_all();
+    if (XR_FAILED(result)) {
+      return;
+    }
+  }
+}
+
+// The part of xrWaitFrame during which the render thread was not blocked in
+// NextFrame() is the headroom gained over calling it from the render thread.
+void
+OpenXRFramePacer::AddTelemetry(const Frame& aFrame, const int64_t aBlocked) {
+  mWaitTime += aFrame.waitEnd - aFrame.waitStart;
+  mBlockedTime += aBlocked;
+  if (++mTelemetryFrames < kTelemetryFrames) {
+    return;
+  }
+  const double waitMs = (double)mWaitTime / mTelemetryFrames * 1e-6;
+  const double blockedMs = (double)mBlockedTime / mTelemetryFrames * 1e-6;
+  VRB_LOG("OpenXR frame pacer: xrWaitFrame %.2fms render thread blocked %.2fms headroom %.2fms (avg of %d frames)",
+          waitMs, blockedMs, std::max(0.0, waitMs - blockedMs), mTelemetryFrames);
+  mTelemetryFrames = 0;
+  mWaitTime = 0;
+  mBlockedTime = 0;
+}
+
+} // namespace crow
@@ -0,0 +1,71 @@
+/* -*- Mode: C++; tab-width: 20; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#pragma once
+
+#include "OpenXRHelpers.h"
+
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+namespace crow {
+
+class OpenXRFramePacer;
+typedef std::shared_ptr<OpenXRFramePacer> OpenXRFramePacerPtr;
+
+// Calls xrWaitFrame on its own thread so that the render thread can finish the
+// current frame and process its runnables while the runtime throttles the next
+// one. Frames are handed over through a single slot: the pacing thread waits
+// for frame N+1 once the render thread has begun frame N, as the runtime
+// requires, so it is never more than one frame ahead.
+class OpenXRFramePacer {
+public:
+  struct Frame {
+    XrFrameState state{XR_TYPE_FRAME_STATE};
+    // steady_clock (CLOCK_MONOTONIC) nanoseconds when xrWaitFrame was called
+    // and returned.
+    int64_t waitStart = 0;
+    int64_t waitEnd = 0;
+  };
+
+  static OpenXRFramePacerPtr Create(XrSession aSession);
+  void Start();
+  // Tells the pacing thread to stop without waiting for it. An xrWaitFrame
+  // call already in flight only returns once the session ends.
+  void RequestStop();
+  // Requests the stop and joins the pacing thread. Unless the session is
+  // running, the session must have been ended or be lost first.
+  void Stop();
+  // Blocks until the next frame has been waited for. Returns false when the
+  // pacer is stopped or xrWaitFrame failed.
+  bool NextFrame(Frame& aFrame);
+  // Must be called after xrBeginFrame for the frame returned by NextFrame().
+  void FrameBegun();
+
+  ~OpenXRFramePacer();
+private:
+  OpenXRFramePacer(XrSession aSession);
+  void Run();
+  void AddTelemetry(const Frame& aFrame, const int64_t aBlocked);
+
+  XrSession mSession { XR_NULL_HANDLE };
+  std::thread mThread;
+  std::mutex mMutex;
+  std::condition_variable mCondition;
+  bool mRunning { false };
+  bool mCanWait { true };
+  bool mHasFrame { false };
+  bool mFailed { false };
+  Frame mFrame;
+
+  // Render thread only.
+  int32_t mTelemetryFrames { 0 };
+  int64_t mWaitTime { 0 };
+  int64_t mBlockedTime { 0 };
+};
+
+} // namespace crow
@@ -48,6 +48,8 @@ public:
   virtual void SetComposited(bool aValue) = 0;
   virtual VRLayerPtr GetLayer() const = 0;
   virtual void Destroy() = 0;
+  // Frees the swapchain until the layer is resized. False if the layer keeps it.
+  virtual bool ReleaseSurface() = 0;
   typedef std::function<void(const OpenXRSwapChainPtr &, GLenum aTarget, bool aBound)> BindDelegate;
   virtual void SetBindDelegate(const BindDelegate &aDelegate) = 0;
   virtual jobject GetSurface() const = 0;
@@ -152,6 +154,10 @@ public:
     layer->NotifySurfaceChanged(VRLayer::SurfaceChange::Destroy, nullptr);
   }
 
+  bool ReleaseSurface() override {
+    return false;
+  }
+
   void SetBindDelegate(const BindDelegate &aDelegate) override {}
 
   jobject GetSurface() const override {
@@ -213,6 +219,9 @@ class OpenXRLayerSurface : public OpenXRLayerBase<T, U> {
 public:
   vrb::RenderContextWeak contextWeak;
   OpenXRLayer::BindDelegate bindDelegate;
+  // Set by ReleaseSurface() for Resize() to create the next swapchain.
+  JNIEnv* releasedEnv = nullptr;
+  XrSession releasedSession = XR_NULL_HANDLE;
 
   void Init(JNIEnv *aEnv, XrSession session, vrb::RenderContextPtr &aContext) override {
     this->contextWeak = aContext;
@@ -220,6 +229,8 @@ public:
       return;
     }
 
+    releasedEnv = nullptr;
+    releasedSession = XR_NULL_HANDLE;
     InitSwapChain(aEnv, session, this->swapchain);
     this->layer->SetResizeDelegate([=] {
       Resize();
@@ -234,13 +245,18 @@ public:
 #endif
 
   void Resize() {
-    if (!this->IsSwapChainReady()) {
+    const bool released = releasedSession != XR_NULL_HANDLE;
+    if (!this->IsSwapChainReady() && !released) {
       return;
     }
     // Delay the destruction of the current swapChain until the new one is composited.
     // This is required to prevent a black flicker when resizing.
     OpenXRSwapChainPtr newSwapChain;
-    InitSwapChain(this->swapchain->Env(), this->swapchain->Session(), newSwapChain);
+    if (released) {
+      InitSwapChain(releasedEnv, releasedSession, newSwapChain);
+    } else {
+      InitSwapChain(this->swapchain->Env(), this->swapchain->Session(), newSwapChain);
+    }
     this->layer->SetSurface(newSwapChain->AndroidSurface());
 
     SurfaceChangedTargetWeakPtr weakTarget = this->surfaceChangedTarget;
@@ -256,6 +272,22 @@ public:
   HandleResize(const OpenXRSwapChainPtr& newSwapChain) override {
     this->swapchain = newSwapChain;
     this->SetComposited(true);
+    releasedEnv = nullptr;
+    releasedSession = XR_NULL_HANDLE;
+  }
+
+  bool ReleaseSurface() override {
+    if (!this->IsSwapChainReady() || this->layer->GetSurfaceType() != VRLayerSurface::SurfaceType::AndroidSurface) {
+      return false;
+    }
+    OpenXRSwapChainPtr oldSwapChain = this->swapchain;
+    releasedEnv = oldSwapChain->Env();
+    releasedSession = oldSwapChain->Session();
+    this->swapchain = nullptr;
+    this->layer->SetSurface(nullptr);
+    // The callback holds the swapChain until Java no longer draws into its surface.
+    this->layer->NotifySurfaceChanged(VRLayer::SurfaceChange::Destroy, [oldSwapChain]() {});
+    return true;
   }
 
   void SetBindDelegate(const OpenXRLayer::BindDelegate &aDelegate) override {
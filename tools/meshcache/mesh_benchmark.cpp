@@ -0,0 +1,96 @@
+/* -*- Mode: C++; tab-width: 20; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+// Cold and warm load time of OBJ models through MeshFile. Cold is the first
+// launch: the OBJ text is parsed and the cache file written. Warm is a later
+// launch: the source is hashed and the cache file memory mapped.
+
+#include "MeshFile.h"
+
+#include <chrono>
+#include <fstream>
+#include <sstream>
+#include <stdio.h>
+#include <unistd.h>
+
+namespace {
+
+const int kRuns = 10;
+
+bool
+ReadFile(const std::string& aPath, std::string& aContent) {
+  std::ifstream input(aPath, std::ios::binary);
+  if (!input) {
+    return false;
+  }
+  std::stringstream buffer;
+  buffer << input.rdbuf();
+  aContent = buffer.str();
+  return true;
+}
+
+double
+Milliseconds(const std::chrono::steady_clock::time_point& aStart) {
+  return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - aStart).count();
+}
+
+} // namespace
+
+int
+main(int argc, char* argv[]) {
+  if (argc < 2) {
+    fprintf(stderr, "Usage: %s model.obj...\n", argv[0]);
+    return 1;
+  }
+  printf("%-48s %9s %9s %9s %9s %9s\n", "model", "vertices", "triangles", "cold ms", "warm ms", "speedup");
+  int result = 0;
+  for (int arg = 1; arg < argc; ++arg) {
+    const std::string path = argv[arg];
+    const size_t slash = path.find_last_of('/');
+    const std::string directory = slash == std::string::npos ? "." : path.substr(0, slash);
+    const std::string name = slash == std::string::npos ? path : path.substr(slash + 1);
+    const std::string cachePath = "/tmp/" + name + ".mesh";
+    crow::MeshFile::ReadFileFunction readFile = [&](const std::string& aName, std::string& aContent) {
+      return ReadFile(directory + "/" + aName, aContent);
+    };
+
+    double cold = 0.0;
+    double warm = 0.0;
+    size_t vertexCount = 0;
+    size_t indexCount = 0;
+    bool failed = false;
+    for (int run = 0; run < kRuns && !failed; ++run) {
+      unlink(cachePath.c_str());
+      auto start = std::chrono::steady_clock::now();
+      std::string text;
+      crow::MeshFile parsed;
+      failed = !ReadFile(path, text);
+      const uint64_t hash = crow::MeshFile::HashSource(text.data(), text.size(), readFile);
+      failed = failed || !parsed.ParseObj(text, readFile) || !parsed.Write(cachePath, hash);
+      cold += Milliseconds(start);
+
+      start = std::chrono::steady_clock::now();
+      crow::MeshFile cached;
+      failed = failed || !ReadFile(path, text) ||
+               !cached.Read(cachePath, crow::MeshFile::HashSource(text.data(), text.size(), readFile));
+      warm += Milliseconds(start);
+      failed = failed || cached.GetVertexCount() != parsed.GetVertexCount() ||
+               cached.GetIndexCount() != parsed.GetIndexCount();
+      vertexCount = parsed.GetVertexCount();
+      indexCount = parsed.GetIndexCount();
+    }
+    unlink(cachePath.c_str());
+    if (failed) {
+      fprintf(stderr, "Failed to load %s\n", path.c_str());
+      result = 1;
+      continue;
+    }
+    cold /= kRuns;
+    warm /= kRuns;
+    printf("%-48s %9zu %9zu %9.2f %9.2f %8.1fx\n", name.c_str(), vertexCount, indexCount / 3, cold, warm,
+           warm > 0.0 ? cold / warm : 0.0);
+  }
+  return result;
+}